@@ -0,0 +1,193 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "audit-input.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "error.h"
+#include "logger.h"
+
+const size_t AuditInput::DEFAULT_CHUNK_SIZE;
+
+/*------------------------------
+ * AuditInput
+ *------------------------------*/
+
+void AuditInput::split_at_nul(const char *data, size_t len,
+    const std::function<void(const char*, size_t)> &feed) {
+  const char *end = data + len;
+  while (data < end) {
+    const char *nul = (const char*) memchr(data, '\0', end - data);
+    const char *part_end = nul ? nul : end;
+    if (part_end > data) {
+      feed(data, part_end - data);
+    }
+    data = nul ? nul + 1 : end;
+  }
+}
+
+/*------------------------------
+ * FdAuditInput
+ *------------------------------*/
+
+FdAuditInput::FdAuditInput(int fd, size_t chunk_size) :
+    fd { fd },
+    buffer(chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE) {}
+
+int FdAuditInput::open() {
+  return fd >= 0 ? NO_ERROR : ERROR_NO_RETRY;
+}
+
+ssize_t FdAuditInput::read_chunk(const char **data) {
+  ssize_t rc;
+  do {
+    rc = read(fd, buffer.data(), buffer.size());
+  } while (rc < 0 && errno == EINTR);
+  *data = buffer.data();
+  return rc;
+}
+
+std::string FdAuditInput::str() const {
+  return "FdAuditInput(" + std::to_string(fd) + ")";
+}
+
+/*------------------------------
+ * UnixSocketAuditInput
+ *------------------------------*/
+
+UnixSocketAuditInput::UnixSocketAuditInput(const std::string &path, size_t chunk_size) :
+    FdAuditInput(-1, chunk_size),
+    path { path } {}
+
+UnixSocketAuditInput::~UnixSocketAuditInput() {
+  close();
+}
+
+int UnixSocketAuditInput::open() {
+  sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    LOGGER_LOG_ERROR("Audit socket path " << path << " is too long");
+    return ERROR_NO_RETRY;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    LOGGER_LOG_ERROR("Can't create audit socket: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  if (connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+    LOGGER_LOG_ERROR("Can't connect to audit socket " << path << ": " << strerror(errno));
+    ::close(fd);
+    fd = -1;
+    return ERROR_RETRY;
+  }
+
+  // the socket buffer is the only thing between us and dropped records
+  int rcvbuf = buffer.size();
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  return NO_ERROR;
+}
+
+void UnixSocketAuditInput::close() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+std::string UnixSocketAuditInput::str() const {
+  return "UnixSocketAuditInput(" + path + ")";
+}
+
+/*------------------------------
+ * FileAuditInput
+ *------------------------------*/
+
+FileAuditInput::FileAuditInput(const std::string &path, size_t chunk_size) :
+    path { path },
+    chunk_size { chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE },
+    mapped { nullptr },
+    size { 0 },
+    offset { 0 } {}
+
+FileAuditInput::~FileAuditInput() {
+  close();
+}
+
+int FileAuditInput::open() {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOGGER_LOG_ERROR("Can't open audit file " << path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    LOGGER_LOG_ERROR("Can't stat audit file " << path << ": " << strerror(errno));
+    ::close(fd);
+    return ERROR_NO_RETRY;
+  }
+
+  size = st.st_size;
+  offset = 0;
+  if (size > 0) {
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      LOGGER_LOG_ERROR("Can't map audit file " << path << ": " << strerror(errno));
+      ::close(fd);
+      size = 0;
+      return ERROR_NO_RETRY;
+    }
+    madvise(addr, size, MADV_SEQUENTIAL);
+    mapped = (const char*) addr;
+  }
+  // the mapping stays valid after closing the descriptor
+  ::close(fd);
+  return NO_ERROR;
+}
+
+void FileAuditInput::close() {
+  if (mapped) {
+    munmap((void*) mapped, size);
+    mapped = nullptr;
+  }
+  size = 0;
+  offset = 0;
+}
+
+ssize_t FileAuditInput::read_chunk(const char **data) {
+  size_t len = std::min(chunk_size, size - offset);
+  *data = mapped + offset;
+  offset += len;
+  return len;
+}
+
+std::string FileAuditInput::str() const {
+  return "FileAuditInput(" + path + ")";
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDITD_PLUGIN_AUDIT_INPUT_H_
+#define AUDITD_PLUGIN_AUDIT_INPUT_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * An audit input provides the raw, text-formatted audit records that the
+ * extractor feeds to auparse. By default, the plugin runs under audispd and
+ * reads from stdin, but it can also read directly from a file of recorded
+ * audit records or from a Unix socket (e.g. audispd's af_unix plugin), which
+ * allows running the plugin standalone.
+ *
+ * Inputs hand out data in large chunks. Chunk boundaries don't need to line
+ * up with records as auparse buffers partial records.
+ */
+class AuditInput {
+public:
+  static const size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+  virtual ~AuditInput() {}
+  virtual int open() = 0;
+  virtual void close() = 0;
+  /*
+   * Returns the file descriptor that can be polled for new data or -1 if
+   * data can always be read without blocking (e.g. from a mapped file).
+   */
+  virtual int get_fd() const = 0;
+  /*
+   * Points data to the next chunk of records and returns its length. Returns
+   * 0 on EOF and -1 on error (errno is set). The chunk remains valid until the
+   * next call.
+   */
+  virtual ssize_t read_chunk(const char **data) = 0;
+  virtual std::string str() const = 0;
+
+  /*
+   * Calls feed for each part of the chunk between NUL bytes. auparse treats
+   * its input as a string, so a stray NUL (e.g. from a writer that pads its
+   * output) would otherwise cut off the rest of the chunk.
+   */
+  static void split_at_nul(const char *data, size_t len,
+      const std::function<void(const char*, size_t)> &feed);
+};
+
+/**
+ * Reads audit records from an already open file descriptor, by default
+ * stdin as set up by audispd.
+ */
+class FdAuditInput: public AuditInput {
+protected:
+  int fd;
+  std::vector<char> buffer;
+
+public:
+  FdAuditInput(int fd = 0, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  virtual ~FdAuditInput() {}
+
+  virtual int open() override;
+  virtual void close() override {}
+  virtual int get_fd() const override { return fd; }
+  virtual ssize_t read_chunk(const char **data) override;
+  virtual std::string str() const override;
+};
+
+/**
+ * Reads audit records from a stream Unix socket, e.g. the one created by
+ * audispd's af_unix plugin in string format. Opening the input returns
+ * ERROR_RETRY if the socket isn't up yet.
+ */
+class UnixSocketAuditInput: public FdAuditInput {
+private:
+  std::string path;
+
+public:
+  UnixSocketAuditInput(const std::string &path, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  virtual ~UnixSocketAuditInput();
+
+  virtual int open() override;
+  virtual void close() override;
+  virtual std::string str() const override;
+};
+
+/**
+ * Reads recorded audit records from a file (e.g. /var/log/audit/audit.log).
+ * The file is mapped into memory and handed to auparse without copying. The
+ * input ends when the end of the file has been reached.
+ */
+class FileAuditInput: public AuditInput {
+private:
+  std::string path;
+  size_t chunk_size;
+  const char *mapped;
+  size_t size;
+  size_t offset;
+
+public:
+  FileAuditInput(const std::string &path, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+  virtual ~FileAuditInput();
+
+  virtual int open() override;
+  virtual void close() override;
+  virtual int get_fd() const override { return -1; }
+  virtual ssize_t read_chunk(const char **data) override;
+  virtual std::string str() const override;
+};
+
+#endif /* AUDITD_PLUGIN_AUDIT_INPUT_H_ */
@@ -28,6 +28,8 @@
 #include "constants.h"
 #include "error.h"
 #include "kafka-output-stream.h"
+#include "proc-scanner.h"
+#include "audit-input.h"
 
 std::unique_ptr<MsgOutputStream> create_configured_output_stream() {
   // create the output stream for the plugin
@@ -62,6 +64,37 @@ std::unique_ptr<MsgOutputStream> create_configured_output_stream() {
   return out;
 }
 
+std::unique_ptr<AuditInput> create_configured_audit_input() {
+  // by default, we're running under audispd and read from stdin
+  std::unique_ptr<AuditInput> input;
+  std::string input_src = constants::AUDIT_INPUT_STDIN;
+  if (Config::has_conf_key(Config::CKEY_AUDIT_INPUT)) {
+    input_src = Config::config[Config::CKEY_AUDIT_INPUT];
+  }
+
+  if (input_src == constants::AUDIT_INPUT_STDIN) {
+    input = std::make_unique<FdAuditInput>(0);
+  } else if (input_src == constants::AUDIT_INPUT_FILE
+      || input_src == constants::AUDIT_INPUT_UNIX) {
+    if (!Config::has_conf_key(Config::CKEY_AUDIT_INPUT_PATH)) {
+      LOGGER_LOG_ERROR("Audit input " << input_src << " needs to specify "
+          << Config::CKEY_AUDIT_INPUT_PATH << ".");
+      return nullptr;
+    }
+    std::string path = Config::config[Config::CKEY_AUDIT_INPUT_PATH];
+    if (input_src == constants::AUDIT_INPUT_FILE) {
+      input = std::make_unique<FileAuditInput>(path);
+    } else {
+      input = std::make_unique<UnixSocketAuditInput>(path);
+    }
+  } else {
+    LOGGER_LOG_ERROR("Unknown audit input " << input_src);
+    return nullptr;
+  }
+
+  return input;
+}
+
 int main(int argc, char *argv[]) {
   std::cout << "-----------------------------------------------------------" << std::endl <<
                "                    Ursprung auditd plugin                 " << std::endl <<
@@ -87,6 +120,15 @@ int main(int argc, char *argv[]) {
   Config::print_config();
 
   Logger::set_log_file_name(Config::config[Config::CKEY_LOG_FILE]);
+  if (Config::has_conf_key(Config::CKEY_LOG_RATE_LIMIT)) {
+    Logger::set_rate_limit(Config::get_long(Config::CKEY_LOG_RATE_LIMIT));
+  }
+  if (Config::get_bool(Config::config[Config::CKEY_LOG_ASYNC])) {
+    Logger::enable_async();
+  }
+  if (Config::has_conf_key(Config::CKEY_LOG_BINARY_FILE)) {
+    Logger::enable_binary(Config::config[Config::CKEY_LOG_BINARY_FILE]);
+  }
 
   // create output stream
   std::unique_ptr<MsgOutputStream>  out = create_configured_output_stream();
@@ -100,16 +142,77 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  // create the source of audit records, opened by the extractor
+  std::unique_ptr<AuditInput> input = create_configured_audit_input();
+  if (!input) {
+    LOGGER_LOG_ERROR("Error, could not create configured audit input.");
+    return -1;
+  }
+
+  // size the reverse DNS cache used for socket connects (TTL in seconds)
+  if (Config::has_conf_key(Config::CKEY_DNS_CACHE_SIZE)
+      || Config::has_conf_key(Config::CKEY_DNS_CACHE_TTL)) {
+    size_t dns_cache_size = ReverseDnsCache::DEFAULT_CAPACITY;
+    long dns_cache_ttl_ms = ReverseDnsCache::DEFAULT_TTL_MS;
+    if (Config::has_conf_key(Config::CKEY_DNS_CACHE_SIZE)) {
+      dns_cache_size = Config::get_long(Config::CKEY_DNS_CACHE_SIZE);
+    }
+    if (Config::has_conf_key(Config::CKEY_DNS_CACHE_TTL)) {
+      dns_cache_ttl_ms = Config::get_long(Config::CKEY_DNS_CACHE_TTL) * 1000;
+    }
+    Socket::reverse_dns_cache.configure(dns_cache_size, dns_cache_ttl_ms,
+        ReverseDnsCache::DEFAULT_NEGATIVE_TTL_MS);
+  }
+
   SynchronizedQueue<void*> extractor_to_transformer;
   SynchronizedQueue<void*> transformer_to_loader;
-  std::shared_ptr<Statistics> stats = std::make_shared<Statistics>();
+  // pipeline statistics are reported periodically and optionally written to a file
+  int stats_interval = Statistics::DEFAULT_REPORT_FREQ_IN_SECONDS;
+  if (Config::has_conf_key(Config::CKEY_STATS_INTERVAL)) {
+    stats_interval = Config::get_long(Config::CKEY_STATS_INTERVAL);
+  }
+  std::shared_ptr<Statistics> stats = std::make_shared<Statistics>(stats_interval,
+      Config::config[Config::CKEY_STATS_FILE]);
+  stats->add_gauge("queue_depth_extractor_to_transformer",
+      [&extractor_to_transformer]() { return extractor_to_transformer.size(); });
+  stats->add_gauge("queue_depth_transformer_to_loader",
+      [&transformer_to_loader]() { return transformer_to_loader.size(); });
+
+  // recycle syscall events once they've left the pipeline
+  size_t event_pool_size = SyscallEventPool::DEFAULT_MAX_FREE;
+  if (Config::has_conf_key(Config::CKEY_EVENT_POOL_SIZE)) {
+    event_pool_size = Config::get_long(Config::CKEY_EVENT_POOL_SIZE);
+  }
+  std::shared_ptr<SyscallEventPool> event_pool;
+  if (event_pool_size > 0) {
+    event_pool = std::make_shared<SyscallEventPool>(event_pool_size);
+    stats->add_gauge("event_pool_free", [event_pool]() { return event_pool->get_num_free(); });
+  }
 
-  ExtractorStep extractor(nullptr, &extractor_to_transformer, stats);
+  ExtractorStep extractor(nullptr, &extractor_to_transformer, stats, event_pool);
   TransformerStep transformer(&extractor_to_transformer,
-      &transformer_to_loader, stats);
-  LoaderStep loader(&transformer_to_loader, nullptr, stats, std::move(out));
+      &transformer_to_loader, stats, event_pool);
+  LoaderStep loader(&transformer_to_loader, nullptr, stats, std::move(out), event_pool);
+
+  // Seed the process table before we start consuming audit records so that
+  // processes that predate the plugin show up with their full state.
+  if (Config::get_bool(Config::config[Config::CKEY_PROC_BOOTSTRAP])) {
+    long timeout_ms = ProcScanner::DEFAULT_TIMEOUT_MS;
+    if (Config::has_conf_key(Config::CKEY_PROC_BOOTSTRAP_TIMEOUT)) {
+      timeout_ms = Config::get_long(Config::CKEY_PROC_BOOTSTRAP_TIMEOUT);
+    }
+    ProcScanner scanner("/proc", ProcScanner::DEFAULT_NUM_THREADS, timeout_ms);
+    transformer.bootstrap_process_table(scanner.scan());
+  }
+
+  // sample events to trace their latency all the way to the database
+  if (Config::has_conf_key(Config::CKEY_TRACE_SAMPLE_RATE)) {
+    PipelineStep::trace_sampler.set_rate(Config::get_long(Config::CKEY_TRACE_SAMPLE_RATE));
+  }
 
   extractor.set_config_path(configPath);
+  extractor.set_input(std::move(input));
+  stats->start();
   extractor.start();
   transformer.start();
   loader.start();
@@ -118,6 +221,7 @@ int main(int argc, char *argv[]) {
   extractor.join();
   transformer.join();
   loader.join();
+  stats->stop();
 
   if (!signal_handling::running) {
     LOGGER_LOG_INFO("Exiting on stop request\n");
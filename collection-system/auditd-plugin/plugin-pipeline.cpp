@@ -15,11 +15,14 @@
  */
 
 #include <signal.h>
+#include <errno.h>
 #include <libaudit.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <librdkafka/rdkafkacpp.h>
 #include <string.h>
+#include <algorithm>
+#include <chrono>
 
 #include "plugin-pipeline.h"
 #include "plugin-util.h"
@@ -35,10 +38,31 @@
 // pointer to indicate that no more events are coming
 void *DONE_PTR = (void*) 0xdeadbeef;
 
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/**
+ * Returns the time that has passed since the audit record of the event was
+ * created in microseconds, or -1 if the event doesn't carry an audit timestamp.
+ */
+static int64_t get_audit_latency_us(const SyscallEvent *se) {
+  if (!se->get_audit_time_ms()) {
+    return -1;
+  }
+  int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  int64_t latency_us = now_us - (int64_t) se->get_audit_time_ms() * 1000;
+  // the audit timestamp only has ms resolution
+  return latency_us > 0 ? latency_us : 0;
+}
+
 /*------------------------------
  * Stage
  *------------------------------*/
 
+TraceSampler PipelineStep::trace_sampler;
+
 void PipelineStep::mask_signals() {
   sigset_t signal_mask;
   sigemptyset(&signal_mask);
@@ -51,10 +75,28 @@ void PipelineStep::mask_signals() {
   }
 }
 
+SyscallEvent* PipelineStep::new_syscall_event(auparse_state_t *au) {
+  SyscallEvent *se = nullptr;
+#ifdef __linux__
+  se = event_pool ? event_pool->acquire(au) : new SyscallEvent(au);
+#endif
+  return se;
+}
+
+void PipelineStep::free_event(Event *e) {
+  if (event_pool) {
+    event_pool->release(e);
+  } else {
+    delete e;
+  }
+}
+
 /*------------------------------
  * Extractor
  *------------------------------*/
 
+const int ExtractorStep::OPEN_RETRY_MAX_SECONDS;
+
 void ExtractorStep::handle_audisp_event(auparse_state_t *au,
     auparse_cb_event_t cb_event_type, void *user_data) {
   ExtractorStep *that = (ExtractorStep*) user_data;
@@ -102,14 +144,25 @@ void ExtractorStep::handle_audisp_event(auparse_state_t *au,
       continue;
     }
 
+    // drop unwanted syscalls before we spend any time on parsing them
+    int syscall_number = -1;
+    unsigned int arch = 0;
+    if (AuparseInterface::get_raw_syscall(au, syscall_record_number, &syscall_number, &arch)
+        && !that->syscall_filter.is_allowed(syscall_number, arch)) {
+      LOGGER_LOG_DEBUG("Skipping filtered syscall " << syscall_number);
+      that->stats->skipped_auditd_event();
+      num++;
+      continue;
+    }
+
     // update statistics
     that->stats->received_auditd_event();
 
     // send to next stage of pipeline
-    SyscallEvent *se = nullptr;
-#ifdef __linux__
-    se = new SyscallEvent(au);
-#endif
+    SyscallEvent *se = that->new_syscall_event(au);
+    if (trace_sampler.sample()) {
+      EventTrace::start(se, trace_extractor, se->get_audit_time_ms() * 1000);
+    }
     that->out->push(se);
     num++;
   }
@@ -117,7 +170,6 @@ void ExtractorStep::handle_audisp_event(auparse_state_t *au,
 
 int ExtractorStep::run() {
   mask_signals();
-  char tmp[MAX_AUDIT_MESSAGE_LENGTH];
   pid_t tid = syscall(GETTID);
   LOGGER_LOG_DEBUG("Extractor running with pid " << tid);
 
@@ -132,14 +184,36 @@ int ExtractorStep::run() {
     return -1;
   }
 
+  // open the audit record source, a socket may not be up yet
+  int rc = input->open();
+  for (int backoff = 1; rc == ERROR_RETRY && signal_handling::running;
+      backoff = std::min(2 * backoff, OPEN_RETRY_MAX_SECONDS)) {
+    LOGGER_LOG_WARN("Couldn't open " << input->str() << ", retrying in " << backoff << "s");
+    for (int i = 0; i < backoff && signal_handling::running; i++) {
+      sleep(1);
+    }
+    rc = input->open();
+  }
+  if (rc != NO_ERROR) {
+    LOGGER_LOG_ERROR("Extractor exiting, could not open " << input->str());
+    auparse_destroy(au);
+    if (out) {
+      out->push(DONE_PTR);
+    }
+    return -1;
+  }
+  LOGGER_LOG_INFO("Extractor reading audit records from " << input->str());
+
   // there may be some mumbo jumbo so that 'this' is set using std::bind, but this approach works OK
   auparse_add_callback(au, &ExtractorStep::handle_audisp_event, this, NULL);
+  syscall_filter.load_config();
 
   do {
     fd_set read_mask;
     struct timeval tv;
     int retval = -1;
-    int read_size = 0;
+    ssize_t read_size = -1;
+    int fd = input->get_fd();
 
     // load configuration
     if (signal_handling::hup) {
@@ -147,27 +221,39 @@ int ExtractorStep::run() {
       signal_handling::hup = 0;
       Config::parse_config(config_path);
       Config::print_config();
+      syscall_filter.load_config();
+    }
+    if (fd < 0) {
+      // the input never blocks
+      retval = 1;
+    } else {
+      do {
+        // if we timed out & have events, shake them loose
+        if (retval == 0 && auparse_feed_has_data(au)) {
+          auparse_feed_age_events(au);
+        }
+
+        tv.tv_sec = 3;
+        tv.tv_usec = 0;
+        FD_ZERO(&read_mask);
+        FD_SET(fd, &read_mask);
+        if (auparse_feed_has_data(au))
+          retval = select(fd + 1, &read_mask, NULL, NULL, &tv);
+        else
+          retval = select(fd + 1, &read_mask, NULL, NULL, NULL);
+      } while (retval <= 0 && signal_handling::running);
     }
-    do {
-      // if we timed out & have events, shake them loose
-      if (retval == 0 && auparse_feed_has_data(au)) {
-        auparse_feed_age_events(au);
-      }
-
-      tv.tv_sec = 3;
-      tv.tv_usec = 0;
-      FD_ZERO(&read_mask);
-      FD_SET(0, &read_mask);
-      if (auparse_feed_has_data(au))
-        retval = select(1, &read_mask, NULL, NULL, &tv);
-      else
-        retval = select(1, &read_mask, NULL, NULL, NULL);
-    } while (retval <= 0 && signal_handling::running);
 
     // main event loop
     if (retval > 0) {
-      if ((read_size = read(0, tmp, MAX_AUDIT_MESSAGE_LENGTH)) > 0) {
-        auparse_feed(au, tmp, strnlen(tmp, read_size));
+      const char *chunk = nullptr;
+      if ((read_size = input->read_chunk(&chunk)) > 0) {
+        AuditInput::split_at_nul(chunk, read_size, [this](const char *data, size_t len) {
+          auparse_feed(au, data, len);
+        });
+      } else if (read_size < 0 && errno != EAGAIN) {
+        LOGGER_LOG_ERROR("Error reading from " << input->str() << ": " << strerror(errno));
+        break;
       }
     }
     // check EOF
@@ -182,6 +268,7 @@ int ExtractorStep::run() {
   // flush any accumulated events from queue
   auparse_flush_feed(au);
   auparse_destroy(au);
+  input->close();
 
   // tell downstream no more is coming
   if (out) {
@@ -195,6 +282,8 @@ int ExtractorStep::run() {
  * Transformer
  *------------------------------*/
 
+const long TransformerStep::IDLE_REAP_INTERVAL_MS;
+
 int TransformerStep::run() {
   mask_signals();
   pid_t tid = syscall(GETTID);
@@ -211,8 +300,14 @@ int TransformerStep::run() {
 
   // loop until we see DONE_PTR
   while (1) {
-    // blocking
-    void *elt = in->pop();
+    // wake up regularly even if no events arrive, so that events that are held
+    // back (e.g. connects waiting for their hostname) are released on a quiet host
+    void *elt = NULL;
+    if (!in->pop(&elt, std::chrono::milliseconds(IDLE_REAP_INTERVAL_MS))) {
+      send_ready_events();
+      start_readtime = time(NULL);
+      continue;
+    }
 
     if (elt == DONE_PTR) {
       break;
@@ -222,6 +317,11 @@ int TransformerStep::run() {
       // normal event, apply to our model
       SyscallEvent *se = (SyscallEvent*) elt;
       num_events_processed++;
+      int64_t latency_us = get_audit_latency_us(se);
+      if (latency_us >= 0) {
+        stats->record_latency(Statistics::latency_audit_to_transformer, latency_us);
+      }
+      EventTrace::stamp(se, trace_transformer);
       // passes ownership of se to osModel
       osModel.apply_syscall(se);
     }
@@ -237,7 +337,7 @@ int TransformerStep::run() {
 
   // cleanup
   LOGGER_LOG_INFO("Transformer::stopping");
-  send_ready_events();
+  send_ready_events(true);
   if (out) {
     out->push(DONE_PTR);
   }
@@ -245,8 +345,8 @@ int TransformerStep::run() {
   return 0;
 }
 
-void TransformerStep::send_ready_events() {
-  std::vector<Event*> reaped_events = osModel.reap_os_events();
+void TransformerStep::send_ready_events(bool drain) {
+  std::vector<Event*> reaped_events = osModel.reap_os_events(drain);
   LOGGER_LOG_DEBUG("Transformer: Reaped " << std::to_string(reaped_events.size()) << " os events");
 
   for (Event *e : reaped_events) {
@@ -265,6 +365,7 @@ void TransformerStep::send_ready_events() {
       out->push(e);
     } else {
       LOGGER_LOG_DEBUG("Transformer: Filtering out event " << e->serialize());
+      free_event(e);
     }
   }
 }
@@ -274,8 +375,9 @@ void TransformerStep::send_ready_events() {
  *------------------------------*/
 
 LoaderStep::LoaderStep(SynchronizedQueue<void*> *in, SynchronizedQueue<void*> *out,
-    std::shared_ptr<Statistics> stats, std::unique_ptr<MsgOutputStream> out_stream) :
-    PipelineStep(in, out, stats),
+    std::shared_ptr<Statistics> stats, std::unique_ptr<MsgOutputStream> out_stream,
+    std::shared_ptr<SyscallEventPool> event_pool) :
+    PipelineStep(in, out, stats, event_pool),
     out_stream { std::move(out_stream) } {
   assert(in);
   assert(!out);
@@ -311,6 +413,13 @@ int LoaderStep::run() {
     // set the node name
     evt->set_node_name(hostname);
 
+    // syscall events are sampled by the extractor, events derived from them here
+    if (EventTrace::is_traced(evt)) {
+      EventTrace::stamp(evt, trace_loader);
+    } else if (evt->get_type() != EventType::SYSCALL_EVENT && trace_sampler.sample()) {
+      EventTrace::start(evt, trace_loader);
+    }
+
     // extract the partition key component (pid or pgid)
     std::string key;
     switch (evt->get_type()) {
@@ -338,13 +447,23 @@ int LoaderStep::run() {
     std::string combined_key = key + hostname;
 
     int rc = 0;
+    auto send_start = std::chrono::steady_clock::now();
     if ((rc = out_stream->send(evt->serialize(), RdKafka::Topic::PARTITION_UA, &combined_key)) == NO_ERROR) {
       stats->sent_event();
+      stats->record_latency(Statistics::latency_send,
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - send_start).count());
+      if (evt->get_type() == EventType::SYSCALL_EVENT) {
+        int64_t latency_us = get_audit_latency_us((SyscallEvent*) evt);
+        if (latency_us >= 0) {
+          stats->record_latency(Statistics::latency_audit_to_send, latency_us);
+        }
+      }
     } else {
       LOGGER_LOG_DEBUG("send returned  " << rc);
     }
 
-    delete evt;
+    free_event(evt);
   }
 
   // cleanup
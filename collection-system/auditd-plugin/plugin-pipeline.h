@@ -25,8 +25,12 @@
 #include "event.h"
 #include "logger.h"
 #include "plugin-util.h"
+#include "audit-input.h"
 #include "os-model.h"
+#include "event-pool.h"
+#include "trace.h"
 #include "msg-output-stream.h"
+#include "config.h"
 
 /**
  * A stage represents a step in the event processing pipeline
@@ -54,14 +58,29 @@ protected:
    */
   void mask_signals();
 
+  /*
+   * Creates the event for the current auditd record and cleans up events
+   * that leave the pipeline. If an event pool is set, events are recycled
+   * through the pool, otherwise they are allocated and deleted.
+   */
+  SyscallEvent* new_syscall_event(auparse_state_t *au);
+  void free_event(Event *e);
+
 public:
+  /* Picks the events whose way through the pipeline is traced (see EventTrace). */
+  static TraceSampler trace_sampler;
+
   std::shared_ptr<Statistics> stats;
+  /* Pool of SyscallEvents shared by all steps of the pipeline, may be null. */
+  std::shared_ptr<SyscallEventPool> event_pool;
 
   PipelineStep(SynchronizedQueue<void*> *in, SynchronizedQueue<void*> *out,
-      std::shared_ptr<Statistics> stats) :
+      std::shared_ptr<Statistics> stats,
+      std::shared_ptr<SyscallEventPool> event_pool = nullptr) :
       in { in },
       out { out },
-      stats { stats } {}
+      stats { stats },
+      event_pool { event_pool } {}
   virtual ~PipelineStep() {};
 
   virtual int run() = 0;
@@ -77,13 +96,17 @@ public:
 /**
  * This is the first pipeline step, which:
  *
- *  1. Polls audisp
+ *  1. Reads raw audit records (from audisp by default, see AuditInput)
  *  2. Converts audisp events to SyscallEvents
  *  3. Sends those to the next stage
  *
  *  This step does not have an input queue.
  */
 class ExtractorStep: public PipelineStep {
+public:
+  /* Upper bound for the backoff while the audit input can't be opened yet. */
+  static const int OPEN_RETRY_MAX_SECONDS = 30;
+
 private:
   /*
    * The extractor is responsible for reloading the plugin
@@ -93,12 +116,18 @@ private:
    */
   std::string config_path;
   auparse_state_t *au;
+  /* Source of the raw audit records, stdin (as set up by audispd) by default. */
+  std::unique_ptr<AuditInput> input;
+  /* Drops syscalls we're not interested in before turning them into events. */
+  SyscallFilter syscall_filter;
 
 public:
   ExtractorStep(SynchronizedQueue<void*> *in, SynchronizedQueue<void*> *out,
-      std::shared_ptr<Statistics> stats) :
-      PipelineStep(in, out, stats),
-      au { nullptr } {
+      std::shared_ptr<Statistics> stats,
+      std::shared_ptr<SyscallEventPool> event_pool = nullptr) :
+      PipelineStep(in, out, stats, event_pool),
+      au { nullptr },
+      input { new FdAuditInput(0) } {
     assert(!in);
     assert(out);
   }
@@ -109,6 +138,8 @@ public:
       void *user_data);
   virtual int run() override;
   void set_config_path(std::string path) { config_path = path; }
+  /* Replaces the audit record source. Must be called before the step is started. */
+  void set_input(std::unique_ptr<AuditInput> input) { this->input = std::move(input); }
 };
 
 /**
@@ -123,17 +154,36 @@ private:
   OSModel osModel;
 
 public:
+  /* How often ready events are sent downstream while no syscall events arrive. */
+  static const long IDLE_REAP_INTERVAL_MS = 100;
+
   TransformerStep(SynchronizedQueue<void*> *in, SynchronizedQueue<void*> *out,
-      std::shared_ptr<Statistics> stats) :
-      PipelineStep(in, out, stats),
+      std::shared_ptr<Statistics> stats,
+      std::shared_ptr<SyscallEventPool> event_pool = nullptr) :
+      PipelineStep(in, out, stats, event_pool),
       osModel { } {
     assert(in);
     assert(out);
+    osModel.set_event_pool(event_pool);
+    if (Config::has_conf_key(Config::CKEY_DNS_RESOLVE_WAIT)) {
+      osModel.set_dns_resolve_wait(Config::get_long(Config::CKEY_DNS_RESOLVE_WAIT));
+    }
   }
   virtual ~TransformerStep() {}
 
   virtual int run() override;
-  void send_ready_events();
+  /*
+   * Sends all reaped events to the next stage. If drain is set, events that are
+   * still waiting to be enriched (e.g. with a hostname) are sent as well.
+   */
+  void send_ready_events(bool drain = false);
+  /*
+   * Seeds the OSModel with the processes that are alive before the plugin
+   * starts. This must be called before the step is started.
+   */
+  void bootstrap_process_table(const std::vector<ProcSnapshot> &snapshots) {
+    osModel.bootstrap(snapshots);
+  }
 };
 
 /*
@@ -149,7 +199,8 @@ private:
 
 public:
   LoaderStep(SynchronizedQueue<void*> *in, SynchronizedQueue<void*> *out,
-      std::shared_ptr<Statistics> stats, std::unique_ptr<MsgOutputStream> out_stream);
+      std::shared_ptr<Statistics> stats, std::unique_ptr<MsgOutputStream> out_stream,
+      std::shared_ptr<SyscallEventPool> event_pool = nullptr);
   virtual ~LoaderStep() {
     out_stream->close();
   }
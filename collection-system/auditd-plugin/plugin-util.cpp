@@ -15,9 +15,17 @@
  */
 
 #include <string.h>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <errno.h>
+#include <stdio.h>
+#include <libaudit.h>
 
 #include "plugin-util.h"
 #include "logger.h"
+#include "config.h"
+#include "os-common.h"
 
 /*------------------------------
  * AuparseInterface
@@ -41,37 +49,259 @@ int AuparseInterface::get_syscall_record_number(auparse_state_t *au) {
   return found ? record_number : -1;
 }
 
+bool AuparseInterface::get_raw_syscall(auparse_state_t *au, int record_number,
+    int *syscall_number, unsigned int *arch) {
+  int pos = auparse_get_record_num(au);
+  auparse_goto_record_num(au, record_number);
+
+  // auparse_find_field returns the raw value, e.g. 'c000003e' for arch
+  const char *arch_str = nullptr;
+  const char *syscall_str = nullptr;
+  auparse_first_field(au);
+  if ((arch_str = auparse_find_field(au, "arch")) != nullptr) {
+    *arch = strtoul(arch_str, NULL, 16);
+  }
+  auparse_first_field(au);
+  if ((syscall_str = auparse_find_field(au, "syscall")) != nullptr) {
+    *syscall_number = atoi(syscall_str);
+  }
+
+  auparse_goto_record_num(au, pos);
+  return arch_str && syscall_str;
+}
+
+/*------------------------------
+ * SyscallFilter
+ *------------------------------*/
+
+SyscallFilter::SyscallFilter() :
+    allow_all { true },
+    machine { audit_detect_machine() } {}
+
+void SyscallFilter::set_allowed_syscalls(const std::vector<std::string> &names) {
+  allow_all = false;
+  allowed.clear();
+  for (const std::string &name : names) {
+    int syscall_number = audit_name_to_syscall(name.c_str(), machine);
+    if (syscall_number < 0) {
+      LOGGER_LOG_WARN("Unknown syscall " << name << " in syscall filter, ignoring it.");
+      continue;
+    }
+    if ((size_t) syscall_number >= allowed.size()) {
+      allowed.resize(syscall_number + 1, false);
+    }
+    allowed[syscall_number] = true;
+  }
+}
+
+void SyscallFilter::allow_all_syscalls() {
+  allow_all = true;
+  allowed.clear();
+}
+
+void SyscallFilter::load_config() {
+  std::vector<std::string> names;
+  if (Config::has_conf_key(Config::CKEY_SYSCALL_FILTER)) {
+    std::string filter = Config::config[Config::CKEY_SYSCALL_FILTER];
+    if (filter == "all") {
+      allow_all_syscalls();
+      return;
+    }
+    std::stringstream ss(filter);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+      name.erase(0, name.find_first_not_of(" \t"));
+      name.erase(name.find_last_not_of(" \t") + 1);
+      if (!name.empty()) {
+        names.push_back(name);
+      }
+    }
+  } else if (Config::get_bool(Config::config[Config::CKEY_EMIT_SYSCALL_EVENTS])) {
+    // raw syscall events are forwarded, so we can't drop anything
+    allow_all_syscalls();
+    return;
+  } else {
+    // only keep what the OSModel can make use of
+    for (auto &s : string_to_syscall) {
+      names.push_back(s.first);
+    }
+  }
+  set_allowed_syscalls(names);
+}
+
+bool SyscallFilter::is_allowed(int syscall_number, unsigned int arch) const {
+  if (allow_all || machine < 0 || audit_elf_to_machine(arch) != machine) {
+    return true;
+  }
+  return syscall_number >= 0 && (size_t) syscall_number < allowed.size()
+      && allowed[syscall_number];
+}
+
 /*------------------------------
  * Statistics
  *------------------------------*/
 
-Statistics::Statistics() :
-    num_received_events { 0 },
-    num_skipped_events { 0 },
-    num_sent_events { 0 },
-    report_freq_in_seconds { 1 } {
-  last_report = time(NULL);
-  report_prefix = "Report (interval " + std::to_string(report_freq_in_seconds) + " seconds)";
+static const char *counter_names[Statistics::num_counters] = {
+  "auditd_events_received",
+  "auditd_events_skipped",
+  "os_events_sent"
+};
+
+static const char *latency_names[Statistics::num_latencies] = {
+  "latency_audit_to_transformer_us",
+  "latency_audit_to_send_us",
+  "latency_send_us"
+};
+
+const int Statistics::MAX_THREAD_SLOTS;
+const int Statistics::DEFAULT_REPORT_FREQ_IN_SECONDS;
+
+Statistics::Statistics(int report_freq_in_seconds, const std::string &stats_file) :
+    report_freq_in_seconds { report_freq_in_seconds > 0 ? report_freq_in_seconds : 1 },
+    stats_file { stats_file },
+    running { false } {
+  for (int i = 0; i < MAX_THREAD_SLOTS; i++) {
+    for (int c = 0; c < num_counters; c++) {
+      slots[i].counters[c].store(0, std::memory_order_relaxed);
+    }
+  }
+  for (int c = 0; c < num_counters; c++) {
+    last_totals[c] = 0;
+  }
+  report_prefix = "Report (interval " + std::to_string(this->report_freq_in_seconds) + " seconds)";
+}
+
+Statistics::~Statistics() {
+  stop();
 }
 
-void Statistics::try_report() {
-  time_t now = time(NULL);
-  if (report_freq_in_seconds < difftime(now, last_report)) {
+Statistics::ThreadSlot& Statistics::get_thread_slot() {
+  // threads are assigned slots round robin, the pipeline only has a handful
+  static std::atomic<int> next_slot { 0 };
+  static thread_local int slot = next_slot.fetch_add(1) % MAX_THREAD_SLOTS;
+  return slots[slot];
+}
+
+void Statistics::add_gauge(const std::string &name, gauge_t gauge) {
+  std::unique_lock<std::mutex> lock(mtx);
+  gauges.push_back(std::make_pair(name, gauge));
+}
+
+uint64_t Statistics::get_total(counter_t c) {
+  uint64_t total = 0;
+  for (int i = 0; i < MAX_THREAD_SLOTS; i++) {
+    total += slots[i].counters[c].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void Statistics::start() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (running) {
+    return;
+  }
+  running = true;
+  reporter = std::thread(&Statistics::run_reporter, this);
+}
+
+void Statistics::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!running) {
+      return;
+    }
+    running = false;
+  }
+  stop_cv.notify_all();
+  reporter.join();
+  report();
+}
+
+void Statistics::run_reporter() {
+  std::unique_lock<std::mutex> lock(mtx);
+  while (running) {
+    stop_cv.wait_for(lock, std::chrono::seconds(report_freq_in_seconds));
+    if (!running) {
+      break;
+    }
+    lock.unlock();
     report();
-    last_report = now;
-    // FIXME possible race condition if both Extractor and Loader are calling tryReport
-    num_received_events = 0;
-    num_skipped_events = 0;
-    num_sent_events = 0;
+    lock.lock();
   }
 }
 
 void Statistics::report() {
-  double compression_factor = (1.0 * num_received_events) / num_sent_events;
-  char report[256];
-  snprintf(report, sizeof(report), "%s:\n  %ld auditd events received\n  "
-      "%ld auditd events skipped\n %ld OS events sent\n  %.1f event compression "
-      "factor", report_prefix.c_str(), num_received_events, num_skipped_events,
-      num_sent_events, compression_factor);
-  LOGGER_LOG_INFO(report);
+  uint64_t totals[num_counters];
+  uint64_t deltas[num_counters];
+  for (int c = 0; c < num_counters; c++) {
+    totals[c] = get_total((counter_t) c);
+    deltas[c] = totals[c] - last_totals[c];
+    last_totals[c] = totals[c];
+  }
+
+  HistogramSnapshot snapshots[num_latencies];
+  for (int l = 0; l < num_latencies; l++) {
+    snapshots[l] = latencies[l].snapshot(true);
+  }
+
+  std::vector<std::pair<std::string, long>> gauge_values;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    for (auto &gauge : gauges) {
+      gauge_values.push_back(std::make_pair(gauge.first, gauge.second()));
+    }
+  }
+
+  double compression_factor = (1.0 * deltas[counter_received]) / deltas[counter_sent];
+  std::stringstream report;
+  report << report_prefix << ":\n  " << deltas[counter_received] << " auditd events received\n  "
+      << deltas[counter_skipped] << " auditd events skipped\n  " << deltas[counter_sent]
+      << " OS events sent\n  " << compression_factor << " event compression factor";
+  for (auto &gauge : gauge_values) {
+    report << "\n  " << gauge.first << " " << gauge.second;
+  }
+  for (int l = 0; l < num_latencies; l++) {
+    report << "\n  " << latency_names[l] << " p50 " << snapshots[l].get_percentile(50)
+        << " p99 " << snapshots[l].get_percentile(99) << " max " << snapshots[l].get_max();
+  }
+  LOGGER_LOG_INFO(report.str());
+
+  if (!stats_file.empty()) {
+    write_stats_file(totals, snapshots, gauge_values);
+  }
+}
+
+void Statistics::write_stats_file(const uint64_t totals[], const HistogramSnapshot snapshots[],
+    const std::vector<std::pair<std::string, long>> &gauge_values) {
+  // write to a temporary file first so that readers never see a partial file
+  std::string tmp_file = stats_file + ".tmp";
+  std::ofstream out(tmp_file, std::ios::trunc);
+  if (!out) {
+    LOGGER_LOG_ERROR("Can't write statistics to " << tmp_file);
+    return;
+  }
+
+  out << "report_interval_seconds " << report_freq_in_seconds << "\n";
+  for (int c = 0; c < num_counters; c++) {
+    out << counter_names[c] << "_total " << totals[c] << "\n";
+  }
+  for (auto &gauge : gauge_values) {
+    out << gauge.first << " " << gauge.second << "\n";
+  }
+  // latencies are reported for the last interval
+  for (int l = 0; l < num_latencies; l++) {
+    const HistogramSnapshot &s = snapshots[l];
+    out << latency_names[l] << "_count " << s.get_count() << "\n"
+        << latency_names[l] << "_mean " << s.get_mean() << "\n"
+        << latency_names[l] << "_p50 " << s.get_percentile(50) << "\n"
+        << latency_names[l] << "_p90 " << s.get_percentile(90) << "\n"
+        << latency_names[l] << "_p99 " << s.get_percentile(99) << "\n"
+        << latency_names[l] << "_p999 " << s.get_percentile(99.9) << "\n"
+        << latency_names[l] << "_max " << s.get_max() << "\n";
+  }
+  out.close();
+
+  if (rename(tmp_file.c_str(), stats_file.c_str()) < 0) {
+    LOGGER_LOG_ERROR("Can't move statistics to " << stats_file << ": " << strerror(errno));
+  }
 }
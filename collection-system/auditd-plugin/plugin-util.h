@@ -17,9 +17,17 @@
 #ifndef AUDITD_PLUGIN_PLUGIN_UTIL_H_
 #define AUDITD_PLUGIN_PLUGIN_UTIL_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include <auparse.h>
 
+#include "histogram.h"
+
 class AuparseInterface {
 public:
   /*
@@ -27,35 +35,132 @@ public:
    * not found. At return, au state is unchanged.
    */
   static int get_syscall_record_number(auparse_state_t *au);
+  /*
+   * Reads the raw (uninterpreted) syscall number and architecture from the
+   * SYSCALL record at the specified position. Returns false if the fields
+   * are missing. At return, au state is unchanged.
+   */
+  static bool get_raw_syscall(auparse_state_t *au, int record_number, int *syscall_number,
+      unsigned int *arch);
 };
 
+/**
+ * Decides, based on the raw syscall number of a SYSCALL record, whether the
+ * record should be turned into a SyscallEvent. Evaluating this before the
+ * event is constructed means that we don't parse execve arguments or socket
+ * addresses, allocate an event, or push to the transformer for syscalls that
+ * the rest of the pipeline would drop anyway.
+ *
+ * Syscall numbers are architecture specific. We resolve the allowed names
+ * for the architecture we're running on and let records from any other
+ * architecture (e.g. 32-bit processes on a 64-bit machine) pass.
+ */
+class SyscallFilter {
+private:
+  bool allow_all;
+  int machine;
+  /* Indexed by syscall number. */
+  std::vector<bool> allowed;
+
+public:
+  SyscallFilter();
+
+  /* Allow only the named syscalls. Unknown names are logged and ignored. */
+  void set_allowed_syscalls(const std::vector<std::string> &names);
+  void allow_all_syscalls();
+  /*
+   * Configures the filter from the syscall-filter config value (a comma-separated
+   * list of syscall names or 'all'). If not set, only the syscalls modeled by the
+   * OSModel are allowed unless raw syscall events are emitted.
+   */
+  void load_config();
+  bool is_allowed(int syscall_number, unsigned int arch) const;
+};
+
+/**
+ * Statistics about the plugin pipeline. Counters are updated from all pipeline
+ * threads on every event so they are kept per thread, each in its own cache
+ * line, and only summed up by a reporter thread. Updating a counter is a
+ * relaxed atomic increment on a line no other thread writes to.
+ *
+ * In addition, the statistics track latency histograms for the different
+ * stages and gauges (e.g. the depth of the queues between the stages), which
+ * together show where the pipeline is backing up. The reporter logs a summary
+ * every interval and, if configured, writes the current values to a stats
+ * file in a simple "name value" text format.
+ */
 class Statistics {
+public:
+  typedef enum counter {
+    counter_received,
+    counter_skipped,
+    counter_sent,
+    num_counters
+  } counter_t;
+
+  typedef enum latency {
+    /* From the audit record timestamp until the transformer picks up the event. */
+    latency_audit_to_transformer,
+    /* From the audit record timestamp until the event has been sent. */
+    latency_audit_to_send,
+    /* Time spent handing a single event to the output stream. */
+    latency_send,
+    num_latencies
+  } latency_t;
+
+  /* Gauges are sampled by the reporter thread. */
+  typedef std::function<long()> gauge_t;
+
+  static const int MAX_THREAD_SLOTS = 16;
+  static const int DEFAULT_REPORT_FREQ_IN_SECONDS = 1;
+
 private:
+  struct alignas(64) ThreadSlot {
+    std::atomic<uint64_t> counters[num_counters];
+  };
+
+  ThreadSlot slots[MAX_THREAD_SLOTS];
+  Histogram latencies[num_latencies];
+  std::vector<std::pair<std::string, gauge_t>> gauges;
+  /* Counter totals at the time of the last report. */
+  uint64_t last_totals[num_counters];
+
   int report_freq_in_seconds;
   std::string report_prefix;
-  ssize_t num_received_events;
-  ssize_t num_skipped_events;
-  ssize_t num_sent_events;
-  time_t last_report;
+  std::string stats_file;
+  std::thread reporter;
+  std::mutex mtx;
+  std::condition_variable stop_cv;
+  bool running;
 
-  void try_report();
+  ThreadSlot& get_thread_slot();
+  void increment(counter_t c) {
+    get_thread_slot().counters[c].fetch_add(1, std::memory_order_relaxed);
+  }
+  void run_reporter();
   void report();
+  void write_stats_file(const uint64_t totals[], const HistogramSnapshot snapshots[],
+      const std::vector<std::pair<std::string, long>> &gauge_values);
 
 public:
-  Statistics();
+  Statistics(int report_freq_in_seconds = DEFAULT_REPORT_FREQ_IN_SECONDS,
+      const std::string &stats_file = "");
+  ~Statistics();
 
-  void received_auditd_event() {
-    num_received_events++;
-    try_report();
-  }
-  void skipped_auditd_event() {
-    num_skipped_events++;
-    try_report();
-  }
-  void sent_event() {
-    num_sent_events++;
-    try_report();
-  }
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  void received_auditd_event() { increment(counter_received); }
+  void skipped_auditd_event() { increment(counter_skipped); }
+  void sent_event() { increment(counter_sent); }
+  void record_latency(latency_t l, uint64_t latency_us) { latencies[l].record(latency_us); }
+  /* Registers a gauge, must be called before the reporter is started. */
+  void add_gauge(const std::string &name, gauge_t gauge);
+  uint64_t get_total(counter_t c);
+
+  /* Starts/stops the reporter thread. Stopping triggers a final report. */
+  void start();
+  void stop();
 };
 
 #endif /* AUDITD_PLUGIN_PLUGIN_UTIL_H_ */
@@ -0,0 +1,144 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmark for matching the output of traced processes in provd. It
+ * generates a synthetic stdout file of a chatty job (log lines with terminal
+ * control sequences, every n-th line a provenance record), reads it back in
+ * the same chunks provd uses, and scans it with an OutputScanner for each
+ * matcher engine. As a baseline, the lines are also matched with
+ * std::regex_match directly, which is what provd did before LineMatcher.
+ *
+ * Usage: matcher-benchmark [num-lines] [regex] [match-every-n]
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <regex>
+#include <string>
+
+#include "line-matcher.h"
+#include "output-scanner.h"
+
+static std::string generate_output(unsigned long num_lines, unsigned long match_every_n) {
+  std::string out;
+  for (unsigned long i = 0; i < num_lines; i++) {
+    if (match_every_n > 0 && i % match_every_n == 0) {
+      out += "prov: step=" + std::to_string(i) + ",input=/data/in-" + std::to_string(i % 97)
+          + ".csv,output=/data/out-" + std::to_string(i) + ".csv\n";
+    } else {
+      out += "\x1b[32mINFO\x1b[0m 2020-06-01 12:00:00," + std::to_string(i % 1000)
+          + " worker-" + std::to_string(i % 16) + " processed batch " + std::to_string(i)
+          + " of the current epoch, loss=0." + std::to_string(i % 9973) + "\n";
+    }
+  }
+  return out;
+}
+
+/* Reads the file in chunks as provd does and returns the number of matches and the time. */
+static double scan(const char *path, std::function<void(const char*, size_t)> feed) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Error, can't open " << path << ": " << strerror(errno) << std::endl;
+    return 0;
+  }
+  char buffer[8192];
+  ssize_t n;
+  auto start = std::chrono::steady_clock::now();
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    feed(buffer, n);
+  }
+  auto end = std::chrono::steady_clock::now();
+  close(fd);
+  return std::chrono::duration<double>(end - start).count();
+}
+
+static void report(const std::string &name, unsigned long num_lines, size_t num_bytes,
+    unsigned long num_matches, double secs) {
+  std::cout << name << ": " << num_matches << " matches in " << secs << " s, "
+      << (unsigned long) (num_lines / secs) << " lines/s, "
+      << (num_bytes / secs / 1024 / 1024) << " MB/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 4) {
+    fprintf(stderr, "Error, usage: %s [num-lines] [regex] [match-every-n]\n", argv[0]);
+    return -1;
+  }
+  unsigned long num_lines = argc > 1 ? std::stoul(argv[1]) : 1000000;
+  std::string regex = argc > 2 ? argv[2] : "prov: step=([0-9]+),input=(.*),output=(.*)";
+  unsigned long match_every_n = argc > 3 ? std::stoul(argv[3]) : 100;
+
+  // write the output to a file first, as provd reads it back from the traced process
+  char path[] = "/tmp/matcher-benchmark-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    fprintf(stderr, "Error, can't create output file: %s\n", strerror(errno));
+    return -1;
+  }
+  std::string out = generate_output(num_lines, match_every_n);
+  if (write(fd, out.data(), out.size()) != (ssize_t) out.size()) {
+    fprintf(stderr, "Error, can't write output file: %s\n", strerror(errno));
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+  close(fd);
+
+  bool prefix;
+  std::cout << "lines:           " << num_lines << std::endl
+            << "bytes:           " << out.size() << std::endl
+            << "regex:           " << regex << std::endl
+            << "literal:         \"" << LineMatcher::required_literal(regex, &prefix) << "\""
+            << (prefix ? " (prefix)" : "") << std::endl;
+
+  // baseline: every line is copied and matched with std::regex
+  std::regex re(regex);
+  unsigned long num_matches = 0;
+  std::string line;
+  double secs = scan(path, [&](const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      if (data[i] == '\n') {
+        if (std::regex_match(line, re)) {
+          num_matches++;
+        }
+        line.clear();
+      } else if (!iscntrl(data[i])) {
+        line += data[i];
+      }
+    }
+  });
+  report("std::regex      ", num_lines, out.size(), num_matches, secs);
+
+  for (matcher_engine_t engine : { matcher_std, matcher_re2 }) {
+    std::shared_ptr<LineMatcher> matcher = LineMatcher::create(regex, engine);
+    if (matcher->get_engine() != engine) {
+      continue;
+    }
+    num_matches = 0;
+    OutputScanner scanner(matcher, [&](const std::string &line) { num_matches++; });
+    secs = scan(path, [&](const char *data, size_t len) { scanner.feed(data, len); });
+    report(engine == matcher_std ? "LineMatcher std " : "LineMatcher re2 ", num_lines,
+        out.size(), num_matches, secs);
+  }
+
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,246 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark for the auditd plugin pipeline. It replays a captured
+ * audit log through the real extractor, transformer, and loader steps and
+ * reports how many records and events per second the pipeline sustained.
+ *
+ * By default, the log is fed through stdin, exactly as audisp would. With the
+ * file input, the replayed log is written to a temporary file first, which
+ * the extractor then reads through a FileAuditInput. In both cases, the
+ * extractor's auparse AUSOURCE_FEED path is exercised end to end. The log is replayed
+ * the requested number of times with the event serial numbers shifted on
+ * each pass so that auparse sees distinct events. Loaded events are counted
+ * and discarded.
+ *
+ * Usage: plugin-benchmark <audit-log> [passes] [event-pool-size] [emit-syscall-events]
+ *     [stdin|file]
+ */
+
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audit-input.h"
+#include "auditd-event.h"
+#include "config.h"
+#include "constants.h"
+#include "error.h"
+#include "event-pool.h"
+#include "msg-output-stream.h"
+#include "plugin-pipeline.h"
+
+/**
+ * Output stream that only counts what it is sent.
+ */
+class CountingOutputStream: public MsgOutputStream {
+private:
+  unsigned long num_msgs;
+  unsigned long num_bytes;
+
+public:
+  CountingOutputStream() : num_msgs { 0 }, num_bytes { 0 } {}
+
+  virtual int open() override { return NO_ERROR; }
+  virtual void close() override {}
+  virtual int send(const std::string &msg_str, int partition,
+      const std::string *key = nullptr) override {
+    num_msgs++;
+    num_bytes += msg_str.size();
+    return NO_ERROR;
+  }
+  virtual int send_batch(const std::vector<std::string> &msg_batch) override {
+    for (const std::string &msg : msg_batch) {
+      send(msg, 0);
+    }
+    return NO_ERROR;
+  }
+  virtual void flush() const override {}
+  virtual std::string str() const override { return "CountingOutputStream"; }
+
+  unsigned long get_num_msgs() const { return num_msgs; }
+  unsigned long get_num_bytes() const { return num_bytes; }
+};
+
+/**
+ * Shifts the serial number in "msg=audit(<sec>.<ms>:<serial>)" by offset.
+ */
+static std::string shift_serial(const std::string &line, unsigned long offset) {
+  size_t start = line.find("audit(");
+  if (start == std::string::npos) {
+    return line;
+  }
+  size_t colon = line.find(':', start);
+  size_t end = line.find(')', start);
+  if (colon == std::string::npos || end == std::string::npos || colon > end) {
+    return line;
+  }
+  unsigned long serial = std::stoul(line.substr(colon + 1, end - colon - 1));
+  return line.substr(0, colon + 1) + std::to_string(serial + offset) + line.substr(end);
+}
+
+/**
+ * Prepares all passes up front so that generating the input doesn't
+ * compete with the pipeline for CPU while we measure.
+ */
+static std::string build_input(const std::vector<std::string> &lines, int passes,
+    unsigned long *num_records) {
+  std::string input;
+  *num_records = 0;
+  for (int pass = 0; pass < passes; pass++) {
+    for (const std::string &line : lines) {
+      input += shift_serial(line, (unsigned long) pass * lines.size());
+      input += '\n';
+      (*num_records)++;
+    }
+  }
+  return input;
+}
+
+static void feed(int fd, const std::string &input) {
+  size_t written = 0;
+  while (written < input.size()) {
+    ssize_t rc = write(fd, input.data() + written, input.size() - written);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error, couldn't write to pipeline: " << strerror(errno) << std::endl;
+      break;
+    }
+    written += rc;
+  }
+  close(fd);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 6) {
+    fprintf(stderr, "Error, usage: %s audit-log [passes] [event-pool-size] "
+        "[emit-syscall-events] [stdin|file]\n", argv[0]);
+    return -1;
+  }
+
+  int passes = argc > 2 ? std::stoi(argv[2]) : 1000;
+  size_t event_pool_size = argc > 3 ? std::stoul(argv[3]) : SyscallEventPool::DEFAULT_MAX_FREE;
+  std::string emit_syscall_events = argc > 4 ? argv[4] : "false";
+  std::string input_src = argc > 5 ? argv[5] : constants::AUDIT_INPUT_STDIN;
+  if (input_src != constants::AUDIT_INPUT_STDIN && input_src != constants::AUDIT_INPUT_FILE) {
+    fprintf(stderr, "Error, unsupported input %s\n", input_src.c_str());
+    return -1;
+  }
+
+  std::ifstream log_file(argv[1]);
+  if (!log_file) {
+    fprintf(stderr, "Error, can't open %s\n", argv[1]);
+    return -1;
+  }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(log_file, line)) {
+    if (!line.empty()) {
+      lines.push_back(line);
+    }
+  }
+
+  Config::config[Config::CKEY_AUDITD_KEY] = "ursprung";
+  Config::config[Config::CKEY_EMIT_SYSCALL_EVENTS] = emit_syscall_events;
+
+  unsigned long num_records = 0;
+  std::string input = build_input(lines, passes, &num_records);
+
+  int pipe_fds[2] = { -1, -1 };
+  char input_file[] = "/tmp/plugin-benchmark-XXXXXX";
+  if (input_src == constants::AUDIT_INPUT_STDIN) {
+    // the extractor reads from stdin
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe(pipe_fds) < 0 || dup2(pipe_fds[0], 0) < 0) {
+      fprintf(stderr, "Error, can't set up input pipe: %s\n", strerror(errno));
+      return -1;
+    }
+    close(pipe_fds[0]);
+  } else {
+    int fd = mkstemp(input_file);
+    if (fd < 0) {
+      fprintf(stderr, "Error, can't create input file: %s\n", strerror(errno));
+      return -1;
+    }
+    feed(fd, input);
+  }
+
+  SynchronizedQueue<void*> extractor_to_transformer;
+  SynchronizedQueue<void*> transformer_to_loader;
+  std::shared_ptr<Statistics> stats = std::make_shared<Statistics>();
+  std::shared_ptr<SyscallEventPool> event_pool;
+  if (event_pool_size > 0) {
+    event_pool = std::make_shared<SyscallEventPool>(event_pool_size);
+  }
+  std::unique_ptr<CountingOutputStream> out = std::make_unique<CountingOutputStream>();
+  CountingOutputStream *counter = out.get();
+
+  ExtractorStep extractor(nullptr, &extractor_to_transformer, stats, event_pool);
+  TransformerStep transformer(&extractor_to_transformer,
+      &transformer_to_loader, stats, event_pool);
+  LoaderStep loader(&transformer_to_loader, nullptr, stats, std::move(out), event_pool);
+  if (input_src == constants::AUDIT_INPUT_FILE) {
+    extractor.set_input(std::make_unique<FileAuditInput>(input_file));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  extractor.start();
+  transformer.start();
+  loader.start();
+  std::thread feeder;
+  if (input_src == constants::AUDIT_INPUT_STDIN) {
+    feeder = std::thread(feed, pipe_fds[1], std::cref(input));
+  }
+
+  extractor.join();
+  if (feeder.joinable()) {
+    // unblock the feeder in case the extractor stopped early
+    close(0);
+    feeder.join();
+  }
+  transformer.join();
+  loader.join();
+  auto end = std::chrono::steady_clock::now();
+  if (input_src == constants::AUDIT_INPUT_FILE) {
+    unlink(input_file);
+  }
+
+  double secs = std::chrono::duration<double>(end - start).count();
+  std::cout << "input:           " << input_src << std::endl
+            << "passes:          " << passes << std::endl
+            << "records:         " << num_records << std::endl
+            << "events loaded:   " << counter->get_num_msgs() << std::endl
+            << "bytes loaded:    " << counter->get_num_bytes() << std::endl
+            << "time (s):        " << secs << std::endl
+            << "records/s:       " << (unsigned long) (num_records / secs) << std::endl
+            << "events/s:        " << (unsigned long) (counter->get_num_msgs() / secs) << std::endl;
+  if (event_pool) {
+    std::cout << "events alloc'd:  " << event_pool->get_num_allocated() << std::endl
+              << "events reused:   " << event_pool->get_num_reused() << std::endl;
+  }
+
+  return 0;
+}
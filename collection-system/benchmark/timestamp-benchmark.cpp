@@ -0,0 +1,116 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmark for parsing and formatting timestamps. It compares the
+ * Timestamp functions with the C/C++ time APIs that were used before for
+ * the same conversions: converting LOGLOAD date fields (strptime/strftime),
+ * formatting event times (gmtime_r/strftime/sprintf), and getting the
+ * current UTC time for the database (std::put_time).
+ *
+ * Usage: timestamp-benchmark [iterations]
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "timestamp.h"
+
+/* Runs fn for all iterations and reports the time per call. */
+static void run(const std::string &name, unsigned long iterations,
+    std::function<size_t(unsigned long)> fn) {
+  size_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++) {
+    checksum += fn(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double secs = std::chrono::duration<double>(end - start).count();
+  std::cout << name << ": " << (secs * 1e9 / iterations) << " ns/op, "
+      << (unsigned long) (iterations / secs) << " ops/s (checksum " << checksum << ")"
+      << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2) {
+    fprintf(stderr, "Error, usage: %s [iterations]\n", argv[0]);
+    return -1;
+  }
+  unsigned long iterations = argc > 1 ? std::stoul(argv[1]) : 1000000;
+
+  // log dates as they appear in a log, one per second starting at noon
+  std::vector<std::string> dates;
+  for (unsigned long i = 0; i < 86400; i++) {
+    char buf[Timestamp::DATETIME_LENGTH];
+    dates.push_back(std::string(buf, Timestamp::format_datetime(1596456000 + i, buf)));
+  }
+
+  std::cout << "iterations: " << iterations << std::endl;
+  run("date field, strptime/strftime ", iterations, [&](unsigned long i) {
+    const std::string &date = dates[i % dates.size()];
+    struct tm tm;
+    strptime(date.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    tm.tm_hour = (tm.tm_hour + 8) % 24;
+    char new_date[32];
+    return strftime(new_date, sizeof(new_date), "%Y-%m-%d %H:%M:%S", &tm);
+  });
+  run("date field, Timestamp         ", iterations, [&](unsigned long i) {
+    const std::string &date = dates[i % dates.size()];
+    int64_t secs;
+    Timestamp::parse_datetime(date.data(), date.size(), &secs);
+    char new_date[Timestamp::DATETIME_LENGTH];
+    return Timestamp::format_datetime(secs + 8 * 3600, new_date);
+  });
+
+  run("event time, gmtime_r/strftime ", iterations, [&](unsigned long i) {
+    time_t sec = 1596456000 + i / 10;
+    struct tm tm_;
+    gmtime_r(&sec, &tm_);
+    char string_representation[32];
+    size_t len = strftime(string_representation, sizeof(string_representation),
+        "%Y-%m-%d %H:%M:%S", &tm_);
+    sprintf(string_representation + len, ".%03d", (int) (i % 1000));
+    return std::string(string_representation).size();
+  });
+  run("event time, Timestamp         ", iterations, [&](unsigned long i) {
+    return Timestamp::to_utc(1596456000 + i / 10, i % 1000).size();
+  });
+
+  run("now, put_time                 ", iterations, [&](unsigned long i) {
+    auto now = std::chrono::system_clock::now();
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()) % 1000;
+    auto timer = std::chrono::system_clock::to_time_t(now);
+    std::tm utc_bt = *std::gmtime(&timer);
+    std::ostringstream utc;
+    utc << std::put_time(&utc_bt, "%Y-%m-%d %H:%M:%S");
+    utc << '.' << std::setfill('0') << std::setw(3) << ms.count();
+    return utc.str().size();
+  });
+  run("now, Timestamp                ", iterations, [&](unsigned long i) {
+    return Timestamp::now_utc().size();
+  });
+
+  return 0;
+}
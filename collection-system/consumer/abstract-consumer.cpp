@@ -19,6 +19,7 @@
 
 #include "abstract-consumer.h"
 #include "config.h"
+#include "constants.h"
 #include "signal-handling.h"
 
 AbstractConsumer::AbstractConsumer(ConsumerSource csrc,
@@ -26,14 +27,59 @@ AbstractConsumer::AbstractConsumer(ConsumerSource csrc,
     std::unique_ptr<MsgOutputStream> out, uint32_t batchsize) :
     c_src(csrc), in_stream(std::move(in)),
     c_dst(cdst), out_stream(std::move(out)),
-    batch_size(batchsize) {
+    batch_size(batchsize),
+    events_received(metrics().counter("consumer_events_received_total",
+        "Events received from the input stream.")),
+    events_malformed(metrics().counter("consumer_events_dropped_total",
+        "Events that were dropped by the consumer.", { { "reason", "malformed" } })),
+    events_rejected(metrics().counter("consumer_events_dropped_total",
+        "Events that were dropped by the consumer.", { { "reason", "rejected" } })),
+    rule_errors(metrics().counter("consumer_rule_errors_total",
+        "Events for which the rules couldn't be executed.")),
+    batches_sent(metrics().counter("consumer_batches_sent_total",
+        "Batches sent to the output stream.")),
+    batch_errors(metrics().counter("consumer_batch_errors_total",
+        "Batches that couldn't be sent to the output stream.")),
+    batch_sizes(metrics().histogram("consumer_batch_size",
+        "Number of events per batch.")),
+    batch_send_latency(metrics().histogram("consumer_batch_send_latency_us",
+        "Time to send a batch to the output stream.")),
+    last_batch_time(metrics().gauge("consumer_last_batch_timestamp_seconds",
+        "Time at which the last batch was sent.")) {
   if (!Config::config[Config::CKEY_RULES_FILE].empty()) {
     rule_engine = std::make_unique<RuleEngine>(Config::config[Config::CKEY_RULES_FILE]);
+    configure_rule_costs();
+  }
+  if (!Config::config[Config::CKEY_TRACE_FILE].empty()) {
+    trace_collector = std::make_unique<TraceCollector>(Config::config[Config::CKEY_TRACE_FILE]);
   }
   in_stream->open();
   out_stream->open();
 }
 
+void AbstractConsumer::configure_rule_costs() {
+  if (Config::has_conf_key(Config::CKEY_RULE_COST_REPORT_INTERVAL)) {
+    rule_engine->set_cost_report_interval(
+        Config::get_long(Config::CKEY_RULE_COST_REPORT_INTERVAL));
+  }
+  if (!Config::has_conf_key(Config::CKEY_RULE_COST_BUDGET)) {
+    return;
+  }
+
+  rule_mode_t mode = rule_sampled;
+  std::string action = Config::config[Config::CKEY_RULE_COST_ACTION];
+  if (action == constants::RULE_COST_DISABLE) {
+    mode = rule_disabled;
+  } else if (!action.empty() && action != constants::RULE_COST_SAMPLE) {
+    LOGGER_LOG_WARN("Unknown " << Config::CKEY_RULE_COST_ACTION << " " << action
+        << ", sampling rules that exceed their budget.");
+  }
+  uint32_t sample_rate = Config::has_conf_key(Config::CKEY_RULE_SAMPLE_RATE) ?
+      Config::get_long(Config::CKEY_RULE_SAMPLE_RATE) : RuleEngine::DEFAULT_SAMPLE_RATE;
+  rule_engine->set_cost_budget(Config::get_long(Config::CKEY_RULE_COST_BUDGET), mode,
+      sample_rate);
+}
+
 AbstractConsumer::~AbstractConsumer() {
   if (rule_engine) {
     rule_engine->shutdown();
@@ -57,27 +103,32 @@ int AbstractConsumer::run() {
     while (!batch_done && signal_handling::running) {
       rc = in_stream->recv(next_msg);
       if (rc == NO_ERROR) {
+        events_received.inc();
         evt_t evt = Event::deserialize_event(next_msg);
         if (!evt) {
-          LOGGER_LOG_ERROR("Problems while receiving event " << next_msg << " Skipping event.");
+          events_malformed.inc();
+          LOGGER_LOGF_ERROR("Problems while receiving event {} Skipping event.", next_msg);
           continue;
         }
         if (receive_event(c_src, evt)) {
-          LOGGER_LOG_ERROR("Problems while processing event " << next_msg << " Skipping event.");
+          events_rejected.inc();
+          LOGGER_LOGF_ERROR("Problems while processing event {} Skipping event.", next_msg);
           continue;
         }
+        EventTrace::stamp(evt.get(), trace_consumer);
         msg_buffer.push_back(evt);
 
         // find and execute any matching rules
         if (evaluate_rules(evt) != NO_ERROR) {
-          LOGGER_LOG_ERROR("Problems while executing rules, some provenance " <<
-              "might be lost");
+          rule_errors.inc();
+          LOGGER_LOGF_ERROR("Problems while executing rules, some provenance might be lost");
         }
+        EventTrace::stamp(evt.get(), trace_rules);
       } else if (rc == ERROR_NO_RETRY || rc == ERROR_EOF) {
         signal_handling::running = false;
       } else {
         // log and ignore error
-        LOGGER_LOG_DEBUG("Got error " << rc << " during receive. Continuing.");
+        LOGGER_LOGF_DEBUG("Got error {} during receive. Continuing.", rc);
       }
 
       if (msg_buffer.size() > batch_size) {
@@ -88,26 +139,45 @@ int AbstractConsumer::run() {
         long elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(
                 curr_time - batch_start).count();
         if (elapsed_time >= BATCH_TIMEOUT && msg_buffer.size() > 0) {
-          LOGGER_LOG_DEBUG("Batch timed out and will be sent with size " << msg_buffer.size());
+          LOGGER_LOGF_DEBUG("Batch timed out and will be sent with size {}", msg_buffer.size());
           batch_done = true;
         }
       }
     }
 
     // normalize messages for destination
-    LOGGER_LOG_INFO("Submitting batch of size " << msg_buffer.size());
+    LOGGER_LOGF_INFO("Submitting batch of size {}", msg_buffer.size());
     std::vector<std::string> normalized_msgs;
     for (evt_t evt : msg_buffer) {
       normalized_msgs.push_back(evt->format_for_dst(c_dst));
     }
 
     // send messages
+    auto send_start = std::chrono::steady_clock::now();
     rc = out_stream->send_batch(normalized_msgs);
+    batch_send_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - send_start).count());
+    batch_sizes.record(normalized_msgs.size());
+    batches_sent.inc();
+    last_batch_time.set(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
     if (rc != NO_ERROR) {
+      batch_errors.inc();
       LOGGER_LOG_ERROR("Problems while sending batch. Messages might have been lost.");
       // TODO better error handling
     }
 
+    // complete the traces of any sampled events
+    if (trace_collector) {
+      for (evt_t evt : msg_buffer) {
+        if (EventTrace::is_traced(evt.get())) {
+          EventTrace::stamp(evt.get(), trace_db_insert);
+          trace_collector->collect(evt.get());
+        }
+      }
+      trace_collector->report();
+    }
+
     // clear buffer
     msg_buffer.clear();
   }
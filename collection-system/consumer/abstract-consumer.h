@@ -20,9 +20,11 @@
 #include <vector>
 
 #include "event.h"
+#include "metrics.h"
 #include "msg-input-stream.h"
 #include "msg-output-stream.h"
 #include "rule-engine.h"
+#include "trace.h"
 
 typedef std::vector<evt_t> msgs_t;
 
@@ -50,6 +52,8 @@ private:
    * matching ones) but inheriting classes can override it to add custom processing.
    */
   virtual int evaluate_rules(evt_t msg);
+  /* Applies the rule cost settings from the config to the rule engine. */
+  void configure_rule_costs();
 
 protected:
   uint32_t batch_size;
@@ -59,8 +63,21 @@ protected:
   std::unique_ptr<MsgInputStream> in_stream;
   std::unique_ptr<MsgOutputStream> out_stream;
   std::unique_ptr<RuleEngine> rule_engine;
+  /* Collects the traces of sampled events, only set if a trace file is configured. */
+  std::unique_ptr<TraceCollector> trace_collector;
   msgs_t msg_buffer;
 
+  /* Consumer metrics (see MetricsRegistry). */
+  Counter &events_received;
+  Counter &events_malformed;
+  Counter &events_rejected;
+  Counter &rule_errors;
+  Counter &batches_sent;
+  Counter &batch_errors;
+  Histogram &batch_sizes;
+  Histogram &batch_send_latency;
+  Gauge &last_batch_time;
+
 public:
   AbstractConsumer(ConsumerSource csrc, std::unique_ptr<MsgInputStream> in,
       ConsumerDestination cdest, std::unique_ptr<MsgOutputStream> out,
@@ -20,6 +20,7 @@
 #include "error.h"
 #include "config.h"
 #include "logger.h"
+#include "metrics.h"
 #include "constants.h"
 #include "msg-input-stream.h"
 #include "msg-output-stream.h"
@@ -209,6 +210,27 @@ int main(int argc, char **argv) {
   }
   // configure Logger
   Logger::set_log_file_name(Config::config[Config::CKEY_LOG_FILE]);
+  if (Config::has_conf_key(Config::CKEY_LOG_RATE_LIMIT)) {
+    Logger::set_rate_limit(Config::get_long(Config::CKEY_LOG_RATE_LIMIT));
+  }
+  if (Config::get_bool(Config::config[Config::CKEY_LOG_ASYNC])) {
+    Logger::enable_async();
+  }
+  if (Config::has_conf_key(Config::CKEY_LOG_BINARY_FILE)) {
+    Logger::enable_binary(Config::config[Config::CKEY_LOG_BINARY_FILE]);
+  }
+
+  // serve the consumer's metrics if requested
+  std::unique_ptr<MetricsServer> metrics_server;
+  if (Config::has_conf_key(Config::CKEY_METRICS_PORT)) {
+    std::string address = Config::has_conf_key(Config::CKEY_METRICS_ADDRESS) ?
+        Config::config[Config::CKEY_METRICS_ADDRESS] : "127.0.0.1";
+    metrics_server = std::make_unique<MetricsServer>(metrics(),
+        Config::get_long(Config::CKEY_METRICS_PORT), address);
+    if (metrics_server->start() != NO_ERROR) {
+      exit(-1);
+    }
+  }
 
   // create the consumer
   std::unique_ptr<AbstractConsumer> consumer = create_configured_consumer();
@@ -21,23 +21,53 @@
 
 #include "auditd-event.h"
 #include "logger.h"
+#include "timestamp.h"
 
 /*------------------------------
  * SyscallEvent
  *------------------------------*/
 
-#ifdef __linux__
-SyscallEvent::SyscallEvent(auparse_state_t *au) :
-    pid {-1 },
+SyscallEvent::SyscallEvent() :
+    auditd_event_id { 0 },
+    audit_time_ms { 0 },
+    pid { -1 },
     ppid { -1 },
     uid { -1 },
     gid { -1 },
     euid { -1 },
     egid { -1 },
+    rc { RETURNS_VOID },
     syscall_name { "unknown" },
     event_time { "" },
-    rc { RETURNS_VOID },
-    data { } {
+    data { } {}
+
+#ifdef __linux__
+SyscallEvent::SyscallEvent(auparse_state_t *au) : SyscallEvent() {
+  load(au);
+}
+
+void SyscallEvent::load(auparse_state_t *au) {
+  // reset all fields but keep the memory that has been allocated for them
+  node_name.clear();
+  send_time.clear();
+  auditd_event_id = 0;
+  audit_time_ms = 0;
+  pid = -1;
+  ppid = -1;
+  uid = -1;
+  gid = -1;
+  euid = -1;
+  egid = -1;
+  rc = RETURNS_VOID;
+  syscall_name = "unknown";
+  event_time.clear();
+  arg0.clear();
+  arg1.clear();
+  arg2.clear();
+  arg3.clear();
+  arg4.clear();
+  data.clear();
+
   // ensure we are parsing an auditd syscall event
   assert(strcmp(auparse_get_type_name(au), "SYSCALL") == 0);
   int pos = auparse_get_record_num(au);
@@ -83,27 +113,21 @@ SyscallEvent::SyscallEvent(auparse_state_t *au) :
 
   // get event ID and timestamp
   const au_event_t *au_event = auparse_get_timestamp(au);
-  struct tm tm_;
-  gmtime_r(&au_event->sec, &tm_); // Use GMT/UTC because that's what GPFS LWE (policy engine) does.
-  char string_representation[32]; // ~20 + ~4 plus some buffer
-  size_t len = strftime(string_representation, sizeof(string_representation),
-      "%Y-%m-%d %H:%M:%S", &tm_);
-  sprintf(string_representation + len, ".%03d", au_event->milli);
-
   auditd_event_id = au_event->serial;
-  event_time = string_representation;
+  audit_time_ms = (uint64_t) au_event->sec * 1000 + au_event->milli;
+  // Use GMT/UTC because that's what GPFS LWE (policy engine) does.
+  char string_representation[Timestamp::UTC_LENGTH];
+  event_time.assign(string_representation,
+      Timestamp::format_utc(au_event->sec, au_event->milli, string_representation));
 
   // set any additional data fields for exec, pipe, and socket-related calls
   if (syscall_name == "execve") {
-    data.clear();
     data.push_back(get_cwd(au));
     std::vector<std::string> execve_args = get_execve_args(au);
     data.insert(data.end(), execve_args.begin(), execve_args.end());
   } else if (syscall_name == "pipe") {
-    data.clear();
     data = get_pipe_fds(au);
   } else if (syscall_name == "accept" || syscall_name == "connect" || syscall_name == "bind") {
-    data.clear();
     data = get_sockaddr(au);
   }
 
@@ -112,7 +136,8 @@ SyscallEvent::SyscallEvent(auparse_state_t *au) :
 }
 #endif
 
-SyscallEvent::SyscallEvent(const std::string &serialized_event) {
+SyscallEvent::SyscallEvent(const std::string &serialized_event) :
+    audit_time_ms { 0 } {
   std::stringstream evt_ss(serialized_event);
   // event type
   std::string evt_type;
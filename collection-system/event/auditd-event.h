@@ -18,6 +18,7 @@
 #define EVENT_AUDITD_EVENT_H_
 
 #include <vector>
+#include <cstdint>
 #ifdef __linux__
 #include <libaudit.h>
 #include <auparse.h>
@@ -28,16 +29,20 @@
 class OSModel;
 class ProcessTable;
 class LiveProcess;
+class SyscallEventPool;
 
 class SyscallEvent: public Event {
 friend class OSModel;
 friend class ProcessTable;
 friend class LiveProcess;
+friend class SyscallEventPool;
 
 private:
   static const int RETURNS_VOID = -2;
 
   unsigned long auditd_event_id;
+  /* Timestamp of the audit record in ms since the epoch, 0 if unknown (not serialized). */
+  uint64_t audit_time_ms;
   int pid;
   int ppid;
   int uid;
@@ -77,6 +82,9 @@ private:
   std::string get_cwd(auparse_state_t *au);
 #endif
 
+  /* Creates an empty event, which is filled later through load() (see SyscallEventPool). */
+  SyscallEvent();
+
 public:
   /*
    * Creates a Syscall event from a raw auditd event using libauparse.
@@ -85,6 +93,13 @@ public:
    */
 #ifdef __linux__
   SyscallEvent(auparse_state_t *au);
+  /*
+   * (Re-)initializes the event from a raw auditd event. All previous
+   * contents are discarded but the memory allocated for them is kept,
+   * which allows recycling events instead of allocating new ones. The
+   * same requirements as for the constructor apply to au.
+   */
+  void load(auparse_state_t *au);
 #endif
   SyscallEvent(const std::string &serialized_event);
   ~SyscallEvent() {};
@@ -95,6 +110,7 @@ public:
   virtual EventType get_type() const override {
     return SYSCALL_EVENT;
   }
+  uint64_t get_audit_time_ms() const { return audit_time_ms; }
 };
 
 class ProcessEvent: public Event {
@@ -203,6 +219,9 @@ public:
       std::string dst_node, uint16_t dst_port);
   ~SocketConnectEvent() {}
 
+  /* Used to replace the remote IP address with its hostname once it has been resolved. */
+  void set_dst_node(const std::string &node) { dst_node = node; }
+
   virtual std::string serialize() const override;
   virtual std::string format_for_dst(ConsumerDestination c_dst) const override;
   virtual std::string get_value(std::string field) const override;
@@ -0,0 +1,85 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "event-pool.h"
+
+const size_t SyscallEventPool::DEFAULT_MAX_FREE;
+
+SyscallEventPool::SyscallEventPool(size_t max_free) :
+    max_free { max_free },
+    num_allocated { 0 },
+    num_reused { 0 } {
+  free_events.reserve(max_free);
+}
+
+SyscallEventPool::~SyscallEventPool() {
+  for (SyscallEvent *se : free_events) {
+    delete se;
+  }
+}
+
+#ifdef __linux__
+SyscallEvent* SyscallEventPool::acquire(auparse_state_t *au) {
+  SyscallEvent *se = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!free_events.empty()) {
+      se = free_events.back();
+      free_events.pop_back();
+      num_reused++;
+    } else {
+      num_allocated++;
+    }
+  }
+
+  // parse outside of the lock, the other stages may be releasing events
+  if (se) {
+    se->load(au);
+  } else {
+    se = new SyscallEvent(au);
+  }
+  return se;
+}
+#endif
+
+void SyscallEventPool::release(Event *e) {
+  if (!e) {
+    return;
+  }
+  if (e->get_type() == EventType::SYSCALL_EVENT) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (free_events.size() < max_free) {
+      free_events.push_back((SyscallEvent*) e);
+      return;
+    }
+  }
+  delete e;
+}
+
+size_t SyscallEventPool::get_num_free() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return free_events.size();
+}
+
+unsigned long SyscallEventPool::get_num_allocated() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return num_allocated;
+}
+
+unsigned long SyscallEventPool::get_num_reused() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return num_reused;
+}
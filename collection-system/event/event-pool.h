@@ -0,0 +1,74 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVENT_EVENT_POOL_H_
+#define EVENT_EVENT_POOL_H_
+
+#include <mutex>
+#include <vector>
+
+#include "auditd-event.h"
+
+/**
+ * Pool of SyscallEvents that allows recycling events once they have left
+ * the auditd plugin pipeline. The extractor acquires events from the pool
+ * and whichever stage is done with an event (the loader after sending it,
+ * the transformer/OSModel when dropping it) hands it back. Recycled events
+ * keep the memory of their strings and vectors so that, in steady state,
+ * turning an auditd record into an event doesn't allocate.
+ *
+ * The pool is shared between the pipeline threads and is thread-safe. It
+ * only keeps up to max_free idle events around, any surplus is deleted.
+ */
+class SyscallEventPool {
+public:
+  static const size_t DEFAULT_MAX_FREE = 4096;
+
+private:
+  std::mutex mtx;
+  std::vector<SyscallEvent*> free_events;
+  size_t max_free;
+  /* Number of events that had to be allocated/could be reused. */
+  unsigned long num_allocated;
+  unsigned long num_reused;
+
+public:
+  SyscallEventPool(size_t max_free = DEFAULT_MAX_FREE);
+  ~SyscallEventPool();
+
+  SyscallEventPool(const SyscallEventPool&) = delete;
+  SyscallEventPool& operator=(const SyscallEventPool&) = delete;
+
+#ifdef __linux__
+  /*
+   * Returns an event for the SYSCALL record au is at, either by recycling
+   * an idle event or by allocating a new one (see SyscallEvent::load).
+   */
+  SyscallEvent* acquire(auparse_state_t *au);
+#endif
+  /*
+   * Hands an event back to the pool. The caller must not use the event
+   * afterwards. Events that are not SyscallEvents are deleted, which makes
+   * it possible to release whatever comes out of the pipeline.
+   */
+  void release(Event *e);
+
+  size_t get_num_free();
+  unsigned long get_num_allocated();
+  unsigned long get_num_reused();
+};
+
+#endif /* EVENT_EVENT_POOL_H_ */
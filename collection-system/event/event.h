@@ -100,9 +100,9 @@ public:
   virtual EventType get_type() const =0;
 
   void set_node_name(std::string name) { node_name = name; }
-  std::string get_node_name() { return node_name; }
+  std::string get_node_name() const { return node_name; }
   void set_send_time(std::string time) { send_time = time; }
-  std::string get_send_time() { return send_time; }
+  const std::string& get_send_time() const { return send_time; }
 };
 
 /**
@@ -20,6 +20,7 @@
 
 #include "scale-event.h"
 #include "logger.h"
+#include "timestamp.h"
 
 /*------------------------------
  * FSEvent
@@ -307,21 +308,16 @@ FSEventJson::FSEventJson(const std::string &serialized_event) {
     throw std::invalid_argument(serialized_event + " is not a FSEventJson.");
   }
   // convert to UTC time (scale event times are %YYYY-%mm-%dd_%HH-%MM-%SS%z)
-  std::string time_str = doc["eventTime"].GetString();
-  struct tm tm1{};
-  strptime(time_str.c_str(), "%Y-%m-%d_%H:%M:%S%z", &tm1);
-  tm1.tm_isdst = -1;
-  time_t t = mktime(&tm1);
-
-  struct tm tm2{};
-  gmtime_r(&t, &tm2);
-  char string_representation[32];
-  size_t len = strftime(string_representation, sizeof(string_representation),
-      "%Y-%m-%d %H:%M:%S", &tm2);
+  const rapidjson::Value &time_val = doc["eventTime"];
+  int64_t t;
+  if (!Timestamp::parse_scale_time(time_val.GetString(), time_val.GetStringLength(), &t)) {
+    LOGGER_LOG_ERROR("Can't deserialize event " << serialized_event << " as"
+        " FSEventJson. Wrong eventTime format!");
+    throw std::invalid_argument(serialized_event + " is not a FSEventJson.");
+  }
   // add '000' as milliseconds as we need it for the database but don't get
   // milliseconds from watch folders
-  sprintf(string_representation + len, ".%03d", 0);
-  event_time = std::string(string_representation);
+  event_time = Timestamp::to_utc(t, 0);
 
   // dst_path
   dst_path = "_NULL_";
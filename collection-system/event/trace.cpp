@@ -0,0 +1,194 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#include <chrono>
+#include <sstream>
+#include <stdio.h>
+
+#include "logger.h"
+
+const std::string EventTrace::PREFIX = "trace";
+
+static const char *stage_names[num_trace_stages] = {
+  "audit",
+  "extractor",
+  "transformer",
+  "loader",
+  "consumer",
+  "rules",
+  "db_insert"
+};
+
+/*------------------------------
+ * EventTrace
+ *------------------------------*/
+
+EventTrace::EventTrace() {
+  for (int s = 0; s < num_trace_stages; s++) {
+    stamps[s] = 0;
+  }
+}
+
+uint64_t EventTrace::now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool EventTrace::is_traced(const Event *e) {
+  return e->get_send_time().compare(0, PREFIX.size(), PREFIX) == 0;
+}
+
+void EventTrace::start(Event *e, trace_stage_t stage, uint64_t audit_time_us) {
+  EventTrace trace;
+  trace.set_stamp(trace_audit, audit_time_us);
+  trace.set_stamp(stage, now_us());
+  e->set_send_time(trace.str());
+}
+
+void EventTrace::stamp(Event *e, trace_stage_t stage) {
+  EventTrace trace;
+  if (trace.parse(e->get_send_time())) {
+    trace.set_stamp(stage, now_us());
+    e->set_send_time(trace.str());
+  }
+}
+
+bool EventTrace::parse(const std::string &send_time) {
+  if (send_time.compare(0, PREFIX.size(), PREFIX) != 0) {
+    return false;
+  }
+  // trace:<stamp>:<stamp>:...
+  std::stringstream ss(send_time.substr(PREFIX.size()));
+  std::string stamp;
+  int s = 0;
+  while (s < num_trace_stages && getline(ss, stamp, ':')) {
+    if (stamp.empty()) {
+      continue;
+    }
+    try {
+      stamps[s++] = std::stoull(stamp);
+    } catch (const std::exception &e) {
+      LOGGER_LOG_DEBUG("Invalid trace " << send_time);
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string EventTrace::str() const {
+  std::string s = PREFIX;
+  for (int i = 0; i < num_trace_stages; i++) {
+    s += ":" + std::to_string(stamps[i]);
+  }
+  return s;
+}
+
+const char* EventTrace::get_stage_name(trace_stage_t stage) {
+  return stage_names[stage];
+}
+
+/*------------------------------
+ * TraceCollector
+ *------------------------------*/
+
+TraceCollector::TraceCollector(const std::string &trace_file) :
+    trace_file { trace_file },
+    out { trace_file, std::ios::app },
+    num_traces { 0 } {
+  if (!out) {
+    LOGGER_LOG_ERROR("Can't open trace file " << trace_file);
+  }
+}
+
+TraceCollector::~TraceCollector() {
+  report();
+}
+
+void TraceCollector::collect(const Event *e) {
+  EventTrace trace;
+  if (!trace.parse(e->get_send_time())) {
+    return;
+  }
+
+  // attribute the time since the previous stamp to each stage
+  uint64_t first = 0;
+  uint64_t prev = 0;
+  for (int s = 0; s < num_trace_stages; s++) {
+    uint64_t stamp = trace.get_stamp((trace_stage_t) s);
+    if (!stamp) {
+      continue;
+    }
+    if (prev) {
+      stage_latencies[s].record(stamp > prev ? stamp - prev : 0);
+    } else {
+      first = stamp;
+    }
+    prev = stamp;
+  }
+  if (first && prev > first) {
+    end_to_end_latency.record(prev - first);
+  }
+
+  std::unique_lock<std::mutex> lock(mtx);
+  num_traces++;
+  if (out) {
+    out << e->get_type() << "," << e->get_node_name();
+    for (int s = 0; s < num_trace_stages; s++) {
+      out << "," << trace.get_stamp((trace_stage_t) s);
+    }
+    out << "\n";
+  }
+}
+
+void TraceCollector::report() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (out) {
+    out.flush();
+  }
+  if (!num_traces) {
+    return;
+  }
+
+  std::stringstream summary;
+  summary << "traces " << num_traces << "\n";
+  for (int s = 0; s <= num_trace_stages; s++) {
+    // the last row is the end-to-end latency
+    Histogram &h = s < num_trace_stages ? stage_latencies[s] : end_to_end_latency;
+    HistogramSnapshot snapshot = h.snapshot();
+    if (!snapshot.get_count()) {
+      continue;
+    }
+    const char *name = s < num_trace_stages ? stage_names[s] : "end_to_end";
+    summary << name << "_us count " << snapshot.get_count()
+        << " p50 " << snapshot.get_percentile(50)
+        << " p90 " << snapshot.get_percentile(90)
+        << " p99 " << snapshot.get_percentile(99)
+        << " max " << snapshot.get_max() << "\n";
+  }
+  LOGGER_LOG_INFO("Trace summary:\n" << summary.str());
+
+  // replace the summary atomically
+  std::string summary_file = trace_file + ".summary";
+  std::string tmp_file = summary_file + ".tmp";
+  std::ofstream summary_out(tmp_file, std::ios::trunc);
+  summary_out << summary.str();
+  summary_out.close();
+  if (!summary_out || rename(tmp_file.c_str(), summary_file.c_str()) < 0) {
+    LOGGER_LOG_ERROR("Can't write trace summary to " << summary_file);
+  }
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVENT_TRACE_H_
+#define EVENT_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "event.h"
+#include "histogram.h"
+
+typedef enum trace_stage {
+  /* When the audit record was created (only known for syscall events). */
+  trace_audit,
+  trace_extractor,
+  trace_transformer,
+  trace_loader,
+  trace_consumer,
+  trace_rules,
+  trace_db_insert,
+  num_trace_stages
+} trace_stage_t;
+
+/**
+ * Trace stamps record when a sampled event passed each stage on its way from
+ * the audit record to the database row. The stamps travel with the event in
+ * its send_time field, which is serialized by all events but not stored in
+ * the database, so tracing doesn't change the event or table formats. Events
+ * that aren't sampled carry an empty send_time and pay nothing but a check.
+ *
+ * Stamps are in microseconds since the epoch. As they are taken on different
+ * nodes, latencies between the plugin and the consumer include clock skew.
+ */
+class EventTrace {
+private:
+  uint64_t stamps[num_trace_stages];
+
+public:
+  static const std::string PREFIX;
+
+  EventTrace();
+
+  static uint64_t now_us();
+  static bool is_traced(const Event *e);
+  /* Starts tracing the event. audit_time_us is the audit record time if known, 0 otherwise. */
+  static void start(Event *e, trace_stage_t stage, uint64_t audit_time_us = 0);
+  /* Stamps the stage with the current time. Does nothing if the event isn't traced. */
+  static void stamp(Event *e, trace_stage_t stage);
+
+  /* Parses the trace in the event's send_time. Returns false if the event isn't traced. */
+  bool parse(const std::string &send_time);
+  std::string str() const;
+  uint64_t get_stamp(trace_stage_t stage) const { return stamps[stage]; }
+  void set_stamp(trace_stage_t stage, uint64_t time_us) { stamps[stage] = time_us; }
+  static const char* get_stage_name(trace_stage_t stage);
+};
+
+/**
+ * Decides which events are traced by picking every n-th event. A rate of 0
+ * disables tracing. Can be called from several threads concurrently.
+ */
+class TraceSampler {
+private:
+  std::atomic<uint64_t> rate;
+  std::atomic<uint64_t> num_seen;
+
+public:
+  TraceSampler(uint64_t rate = 0) : rate { rate }, num_seen { 0 } {}
+
+  void set_rate(uint64_t rate) { this->rate = rate; }
+  bool sample() {
+    uint64_t r = rate.load(std::memory_order_relaxed);
+    return r && num_seen.fetch_add(1, std::memory_order_relaxed) % r == 0;
+  }
+};
+
+/**
+ * Collects completed traces at the end of the pipeline (the consumer). Every
+ * trace is appended to the trace file, one line per event, and the latency of
+ * each stage (from the previous stamped stage) is added to a histogram. The
+ * percentiles of the histograms are periodically written to a summary file
+ * next to the trace file, which shows the stage responsible for any lag.
+ */
+class TraceCollector {
+private:
+  std::string trace_file;
+  std::ofstream out;
+  std::mutex mtx;
+  Histogram stage_latencies[num_trace_stages];
+  Histogram end_to_end_latency;
+  uint64_t num_traces;
+
+public:
+  TraceCollector(const std::string &trace_file);
+  ~TraceCollector();
+
+  /* Records the trace of the event if it is traced. */
+  void collect(const Event *e);
+  /* Logs the percentile summary and writes it to <trace_file>.summary. */
+  void report();
+};
+
+#endif /* EVENT_TRACE_H_ */
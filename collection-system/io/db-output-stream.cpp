@@ -16,12 +16,13 @@
 
 #include <sstream>
 #include <unordered_map>
-#include <iomanip>
 #include <assert.h>
 
 #include "db-output-stream.h"
 #include "error.h"
 #include "logger.h"
+#include "metrics.h"
+#include "timestamp.h"
 
 DBOutputStream::DBOutputStream(const std::string &conn, const std::string &db_schema,
     const std::string &tablename, bool async_val, bool multiplex_val, int pos) :
@@ -38,11 +39,26 @@ DBOutputStream::DBOutputStream(const std::string &conn, const std::string &db_sc
     attr_position = pos;
   } else {
     tablenames.push_back(tablename);
+    table_metrics.push_back(register_table_metrics(tablename));
     db_schemas.push_back(db_schema);
     attr_keys.push_back("NA");
   }
 }
 
+DBOutputStream::TableMetrics DBOutputStream::register_table_metrics(const std::string &table) {
+  metric_labels_t labels = { { "table", table } };
+  TableMetrics insert_metrics;
+  insert_metrics.connection_errors = &metrics().counter("db_connection_errors_total",
+      "Failed connection attempts to the target database.", labels);
+  insert_metrics.insert_errors = &metrics().counter("db_insert_errors_total",
+      "Failed inserts into the target database.", labels);
+  insert_metrics.rows_inserted = &metrics().counter("db_rows_inserted_total",
+      "Rows inserted into the target database.", labels);
+  insert_metrics.insert_latency = &metrics().histogram("db_insert_latency_us",
+      "Time to connect to the target database and insert a batch.", labels);
+  return insert_metrics;
+}
+
 DBOutputStream::~DBOutputStream() {
   if (async) {
     running = false;
@@ -102,6 +118,7 @@ void DBOutputStream::set_multiplex_group(std::string target_table, std::string t
     return;
   }
   tablenames.push_back(target_table);
+  table_metrics.push_back(register_table_metrics(target_table));
   db_schemas.push_back(target_schema);
   attr_keys.push_back(key);
 }
@@ -171,7 +188,8 @@ int DBOutputStream::send_sync(const std::vector<std::string> &records) {
   // send batches for each table to DB
   int rc = NO_ERROR;
   for (unsigned int k = 0; k < attr_keys.size(); k++) {
-    rc = parallel_send_to_db(payload_contents[attr_keys[k]], tablenames[k], db_schemas[k]);
+    rc = parallel_send_to_db(payload_contents[attr_keys[k]], tablenames[k], db_schemas[k],
+        table_metrics[k]);
     if (rc != NO_ERROR) {
       LOGGER_LOG_ERROR("Problems when sending auditd events for " << attr_keys[k]);
     }
@@ -180,12 +198,12 @@ int DBOutputStream::send_sync(const std::vector<std::string> &records) {
 }
 
 int DBOutputStream::parallel_send_to_db(const std::vector<std::vector<std::string>> &batches,
-    std::string table, std::string schema) {
+    std::string table, std::string schema, TableMetrics insert_metrics) {
   std::vector<std::thread> insert_threads;
   for (unsigned int i = 0; i < batches.size(); i++) {
     LOGGER_LOG_DEBUG("Sending stream of size " << batches[i].size() << " to DB for " << table);
     insert_threads.push_back(std::thread(&DBOutputStream::send_to_db,
-        this, std::ref(batches[i]), table, schema));
+        this, std::ref(batches[i]), table, schema, insert_metrics));
     // TODO correct error handling using promises and futures
   }
 
@@ -204,9 +222,10 @@ int DBOutputStream::parallel_send_to_db(const std::vector<std::vector<std::strin
  * connections.
  */
 int DBOutputStream::send_to_db(const std::vector<std::string> &batch,
-    std::string table, std::string schema) {
+    std::string table, std::string schema, TableMetrics insert_metrics) {
   int rc = NO_ERROR;
   db_rc err;
+  auto start = std::chrono::steady_clock::now();
 
   // prepare the query
   std::string query;
@@ -222,15 +241,21 @@ int DBOutputStream::send_to_db(const std::vector<std::string> &batch,
   std::unique_ptr<DBConnector> db_conn = ConnectorFactory::create_connector(connection_string);
   err = db_conn->connect();
   if (err != DB_SUCCESS) {
+    insert_metrics.connection_errors->inc();
     LOGGER_LOG_ERROR("Error while connecting to target DB " << connection_string);
     throw DBConnectionException();
   }
   err = db_conn->submit_query(query);
   if (err != DB_SUCCESS) {
+    insert_metrics.insert_errors->inc();
     LOGGER_LOG_ERROR("Problems when submitting query " << query << " to database: " << err);
     rc = ERROR_NO_RETRY;
+  } else {
+    insert_metrics.rows_inserted->inc(batch.size());
   }
   db_conn->disconnect();
+  insert_metrics.insert_latency->record(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count());
 
   return rc;
 }
@@ -287,15 +312,5 @@ std::string DBOutputStream::format_csv_line(const std::string &line) {
 }
 
 std::string DBOutputStream::get_utc_time() {
-  // get current UTC time
-  auto now = std::chrono::system_clock::now();
-  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-      now.time_since_epoch()) % 1000;
-  auto timer = std::chrono::system_clock::to_time_t(now);
-  std::tm utc_bt = *std::gmtime(&timer);
-  std::ostringstream utc;
-  utc << std::put_time(&utc_bt, "%Y-%m-%d %H:%M:%S");
-  utc << '.' << std::setfill('0') << std::setw(3) << ms.count();
-
-  return utc.str();
+  return Timestamp::now_utc();
 }
@@ -25,6 +25,9 @@
 
 typedef std::unique_ptr<SynchronizedQueue<std::vector<std::string>>> b_queue_t;
 
+class Counter;
+class Histogram;
+
 /**
  * Output stream to send (insert) messages to a database via ODBC.
  * Inserts are batched.
@@ -39,8 +42,17 @@ typedef std::unique_ptr<SynchronizedQueue<std::vector<std::string>>> b_queue_t;
  */
 class DBOutputStream: public MsgOutputStream {
 private:
+  /* Insert metrics of a target table, looked up once when the table is added. */
+  struct TableMetrics {
+    Counter *connection_errors;
+    Counter *insert_errors;
+    Counter *rows_inserted;
+    Histogram *insert_latency;
+  };
+
   /* Multiplexing properties. */
   std::vector<std::string> tablenames;
+  std::vector<TableMetrics> table_metrics;
   std::vector<std::string> db_schemas;
   std::vector<std::string> attr_keys;
   int attr_position = -1;
@@ -79,10 +91,11 @@ private:
    * Takes a list of batches as input and inserts each batch in
    * a separate thread into the DB using the specified table and schema.
    */
+  static TableMetrics register_table_metrics(const std::string &table);
   int parallel_send_to_db(const std::vector<std::vector<std::string>> &batches,
-      std::string table, std::string schema);
+      std::string table, std::string schema, TableMetrics insert_metrics);
   int send_to_db(const std::vector<std::string> &batch, std::string table,
-      std::string schema);
+      std::string schema, TableMetrics insert_metrics);
   int send_sync(const std::vector<std::string> &records);
   void send_async(std::vector<std::string> records);
 
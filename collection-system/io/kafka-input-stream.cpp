@@ -14,13 +14,23 @@
  * limitations under the License.
  */
 
+#include <chrono>
+
 #include "kafka-input-stream.h"
 #include "logger.h"
 #include "error.h"
 #include "config.h"
 
 KafkaInputStream::KafkaInputStream(std::string t, std::string b, std::string g) :
-    topic(t), brokers(b), group_id(g) {
+    topic(t), brokers(b), group_id(g),
+    messages_received(metrics().counter("kafka_messages_received_total",
+        "Messages consumed from Kafka.", { { "topic", t } })),
+    bytes_received(metrics().counter("kafka_bytes_received_total",
+        "Payload bytes consumed from Kafka.", { { "topic", t } })),
+    consume_errors(metrics().counter("kafka_consume_errors_total",
+        "Failed consume calls, excluding timeouts.", { { "topic", t } })),
+    consume_lag(metrics().gauge("kafka_consume_lag_ms",
+        "Time between producing and consuming the last message.", { { "topic", t } })) {
   conf = RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL);
   consumer = nullptr;
 }
@@ -117,6 +127,13 @@ int KafkaInputStream::recv(std::string &next_msg) {
         rc = ERROR_RETRY;
       } else {
         rc = NO_ERROR;
+        messages_received.inc();
+        bytes_received.inc(msg->len());
+        RdKafka::MessageTimestamp ts = msg->timestamp();
+        if (ts.type != RdKafka::MessageTimestamp::MSG_TIMESTAMP_NOT_AVAILABLE) {
+          consume_lag.set(std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count() - ts.timestamp);
+        }
       }
     } else {
       rc = ERROR_RETRY;
@@ -125,11 +142,13 @@ int KafkaInputStream::recv(std::string &next_msg) {
     break;
   case RdKafka::ERR__UNKNOWN_TOPIC:
   case RdKafka::ERR__UNKNOWN_PARTITION:
+    consume_errors.inc();
     LOGGER_LOG_ERROR("Consume failed with: " << msg->errstr());
     rc = ERROR_NO_RETRY;
     break;
   default:
     // TODO Check whether ERROR_RETRY is ok for all other error codes (see rdkafkacpp.h).
+    consume_errors.inc();
     LOGGER_LOG_DEBUG("Consume returned error: " << msg->errstr());
     rc = ERROR_RETRY;
     break;
@@ -18,6 +18,7 @@
 #define IO_KAFKA_INPUT_STREAM_H_
 
 #include "msg-input-stream.h"
+#include "metrics.h"
 #include <librdkafka/rdkafkacpp.h>
 
 const int TIMEOUT_MS = 500;
@@ -30,6 +31,13 @@ private:
 
   RdKafka::Conf *conf;
   RdKafka::KafkaConsumer *consumer;
+
+  Counter &messages_received;
+  Counter &bytes_received;
+  Counter &consume_errors;
+  /* Time between producing and consuming the last message, a measure of the consumer's lag. */
+  Gauge &consume_lag;
+
 public:
   KafkaInputStream(std::string topic, std::string brokers, std::string group_id);
   virtual ~KafkaInputStream();
@@ -0,0 +1,233 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../os-model/dns-cache.h"
+
+#include <cstring>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "logger.h"
+
+const size_t ReverseDnsCache::DEFAULT_CAPACITY;
+const long ReverseDnsCache::DEFAULT_TTL_MS;
+const long ReverseDnsCache::DEFAULT_NEGATIVE_TTL_MS;
+const int ReverseDnsCache::DEFAULT_NUM_RESOLVERS;
+const long ReverseDnsCache::STOP_TIMEOUT_MS;
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/**
+ * Resolves an IPv4 address to its hostname (without the domain).
+ */
+static bool resolve_with_getnameinfo(const std::string &addr, std::string *hostname) {
+  char host[NI_MAXHOST];
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = inet_addr(addr.c_str());
+
+  int rc = getnameinfo((sockaddr*) &address, sizeof(address), host, sizeof(host),
+      NULL, 0, NI_NAMEREQD);
+  if (rc != 0) {
+    LOGGER_LOG_DEBUG("Couldn't resolve " << addr << " due to " << gai_strerror(rc));
+    return false;
+  }
+
+  // use only name portion not FQDN
+  char *first_dot = strchr(host, '.');
+  if (first_dot) {
+    *first_dot = '\0';
+  }
+  *hostname = host;
+  return true;
+}
+
+/*------------------------------
+ * ReverseDnsCache
+ *------------------------------*/
+
+ReverseDnsCache::ReverseDnsCache(size_t capacity, long ttl_ms, long negative_ttl_ms,
+    int num_resolvers) :
+    state { std::make_shared<State>() },
+    num_resolvers { num_resolvers > 0 ? num_resolvers : 1 } {
+  state->running = false;
+  state->generation = 0;
+  state->num_running_resolvers = 0;
+  state->capacity = capacity > 0 ? capacity : 1;
+  state->ttl = std::chrono::milliseconds(ttl_ms);
+  state->negative_ttl = std::chrono::milliseconds(negative_ttl_ms);
+  state->resolve = resolve_with_getnameinfo;
+}
+
+ReverseDnsCache::~ReverseDnsCache() {
+  stop_resolvers();
+}
+
+dns_lookup_rc_t ReverseDnsCache::lookup(const std::string &addr, std::string *hostname) {
+  std::unique_lock<std::mutex> lock(state->mtx);
+
+  auto entry = state->entries.find(addr);
+  if (entry != state->entries.end()) {
+    if (clock_t::now() < entry->second.expiry) {
+      // move to the front of the LRU list
+      state->lru.splice(state->lru.begin(), state->lru, entry->second.lru_pos);
+      if (entry->second.resolved) {
+        *hostname = entry->second.hostname;
+        return dns_resolved;
+      }
+      return dns_unresolvable;
+    }
+    // expired, resolve again
+    state->lru.erase(entry->second.lru_pos);
+    state->entries.erase(entry);
+  }
+
+  if (state->in_flight.find(addr) == state->in_flight.end()) {
+    // bound the backlog, the address will be queued again on the next lookup
+    if (state->pending.size() >= state->capacity) {
+      LOGGER_LOG_DEBUG("Resolver backlog full, not queueing " << addr);
+      return dns_pending;
+    }
+    state->in_flight.insert(addr);
+    state->pending.push_back(addr);
+    if (!state->running) {
+      start_resolvers();
+    }
+    state->pending_cv.notify_one();
+  }
+  return dns_pending;
+}
+
+void ReverseDnsCache::put(const std::string &addr, const std::string &hostname) {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->insert(addr, hostname, true);
+}
+
+void ReverseDnsCache::configure(size_t capacity, long ttl_ms, long negative_ttl_ms) {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->capacity = capacity > 0 ? capacity : 1;
+  state->ttl = std::chrono::milliseconds(ttl_ms);
+  state->negative_ttl = std::chrono::milliseconds(negative_ttl_ms);
+  while (state->entries.size() > state->capacity) {
+    state->entries.erase(state->lru.back());
+    state->lru.pop_back();
+  }
+}
+
+void ReverseDnsCache::set_resolver(resolver_t resolver) {
+  stop_resolvers();
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->resolve = resolver;
+}
+
+void ReverseDnsCache::clear() {
+  stop_resolvers();
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->entries.clear();
+  state->lru.clear();
+}
+
+size_t ReverseDnsCache::size() {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  return state->entries.size();
+}
+
+void ReverseDnsCache::State::insert(const std::string &addr, const std::string &hostname,
+    bool resolved) {
+  auto entry = entries.find(addr);
+  if (entry != entries.end()) {
+    lru.erase(entry->second.lru_pos);
+    entries.erase(entry);
+  } else if (entries.size() >= capacity) {
+    // evict the least recently used address
+    entries.erase(lru.back());
+    lru.pop_back();
+  }
+
+  lru.push_front(addr);
+  Entry &e = entries[addr];
+  e.hostname = hostname;
+  e.resolved = resolved;
+  e.expiry = clock_t::now() + (resolved ? ttl : negative_ttl);
+  e.lru_pos = lru.begin();
+}
+
+void ReverseDnsCache::start_resolvers() {
+  state->running = true;
+  for (int i = 0; i < num_resolvers; i++) {
+    state->num_running_resolvers++;
+    std::thread(&ReverseDnsCache::run_resolver, state, state->generation).detach();
+  }
+}
+
+void ReverseDnsCache::stop_resolvers() {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  if (!state->running) {
+    return;
+  }
+  state->running = false;
+  state->generation++;
+  state->pending_cv.notify_all();
+
+  // don't wait for resolvers that are stuck in a slow resolver, e.g. on exit
+  if (!state->stopped_cv.wait_for(lock, std::chrono::milliseconds(STOP_TIMEOUT_MS),
+      [this] { return state->num_running_resolvers == 0; })) {
+    LOGGER_LOG_WARN("Not waiting for " << state->num_running_resolvers
+        << " reverse DNS lookups that are still in progress");
+  }
+
+  // anything that is still queued will be queued again on the next lookup
+  state->pending.clear();
+  state->in_flight.clear();
+}
+
+void ReverseDnsCache::run_resolver(std::shared_ptr<State> state, uint64_t generation) {
+  std::unique_lock<std::mutex> lock(state->mtx);
+  while (true) {
+    state->pending_cv.wait(lock, [&state, generation] {
+      return !state->pending.empty() || state->generation != generation;
+    });
+    if (state->generation != generation) {
+      break;
+    }
+    std::string addr = state->pending.front();
+    state->pending.pop_front();
+    resolver_t resolver = state->resolve;
+
+    // don't hold the lock while we're waiting for the resolver
+    lock.unlock();
+    std::string hostname;
+    bool resolved = resolver(addr, &hostname);
+    lock.lock();
+
+    // the cache has been cleared or destroyed in the meantime
+    if (state->generation != generation) {
+      break;
+    }
+    if (!resolved) {
+      LOGGER_LOG_DEBUG("Caching " << addr << " as unresolvable");
+    }
+    state->insert(addr, hostname, resolved);
+    state->in_flight.erase(addr);
+  }
+  state->num_running_resolvers--;
+  state->stopped_cv.notify_all();
+}
@@ -0,0 +1,140 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROV_AUDITD_DNS_CACHE_H_
+#define PROV_AUDITD_DNS_CACHE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef enum dns_lookup_rc {
+  /* The address is cached and has been resolved to a hostname. */
+  dns_resolved,
+  /* The address is cached but couldn't be resolved (negative entry). */
+  dns_unresolvable,
+  /* The address is not cached yet, resolution happens in the background. */
+  dns_pending
+} dns_lookup_rc_t;
+
+/**
+ * Thread-safe cache mapping IP addresses to hostnames. Lookups never block
+ * on the resolver. If an address is not in the cache, it is handed to a
+ * small pool of resolver threads and the caller is told to come back later.
+ *
+ * The cache is bounded and evicts the least recently used entries. Entries
+ * expire after a TTL so that changes in DNS are eventually picked up and
+ * addresses that failed to resolve are cached as well (with their own,
+ * usually shorter, TTL) so that we don't keep hammering the resolver with
+ * addresses that don't have a PTR record.
+ */
+class ReverseDnsCache {
+public:
+  /*
+   * Resolves the address to a hostname. Returns false if the address
+   * couldn't be resolved. Called from the resolver threads.
+   */
+  typedef std::function<bool(const std::string &addr, std::string *hostname)> resolver_t;
+
+  static const size_t DEFAULT_CAPACITY = 4096;
+  static const long DEFAULT_TTL_MS = 3600 * 1000;
+  static const long DEFAULT_NEGATIVE_TTL_MS = 60 * 1000;
+  static const int DEFAULT_NUM_RESOLVERS = 2;
+  /* How long stopping the resolvers waits for resolutions in progress. */
+  static const long STOP_TIMEOUT_MS = 1000;
+
+private:
+  typedef std::chrono::steady_clock clock_t;
+
+  struct Entry {
+    std::string hostname;
+    bool resolved;
+    clock_t::time_point expiry;
+    std::list<std::string>::iterator lru_pos;
+  };
+
+  /*
+   * The state is shared with the resolver threads. A resolver can be stuck in
+   * getnameinfo for a long time, so the threads are detached and the state
+   * outlives the cache if a resolver is still running when it's destroyed.
+   */
+  struct State {
+    std::mutex mtx;
+    std::condition_variable pending_cv;
+    std::condition_variable stopped_cv;
+    std::unordered_map<std::string, Entry> entries;
+    /* Addresses ordered by last use, most recently used first. */
+    std::list<std::string> lru;
+    std::deque<std::string> pending;
+    /* Addresses that are either pending or currently being resolved. */
+    std::set<std::string> in_flight;
+    bool running;
+    /* Incremented whenever the resolvers are stopped, stale resolvers just exit. */
+    uint64_t generation;
+    int num_running_resolvers;
+
+    size_t capacity;
+    std::chrono::milliseconds ttl;
+    std::chrono::milliseconds negative_ttl;
+    resolver_t resolve;
+
+    /* Adds or updates an entry and evicts the LRU entry if needed. Requires mtx. */
+    void insert(const std::string &addr, const std::string &hostname, bool resolved);
+  };
+
+  std::shared_ptr<State> state;
+  int num_resolvers;
+
+  static void run_resolver(std::shared_ptr<State> state, uint64_t generation);
+  /* Requires state->mtx. */
+  void start_resolvers();
+  void stop_resolvers();
+
+public:
+  ReverseDnsCache(size_t capacity = DEFAULT_CAPACITY, long ttl_ms = DEFAULT_TTL_MS,
+      long negative_ttl_ms = DEFAULT_NEGATIVE_TTL_MS, int num_resolvers = DEFAULT_NUM_RESOLVERS);
+  ~ReverseDnsCache();
+
+  ReverseDnsCache(const ReverseDnsCache&) = delete;
+  ReverseDnsCache& operator=(const ReverseDnsCache&) = delete;
+
+  /*
+   * Looks up the address. If the address has been resolved, hostname is
+   * set. If the address isn't cached yet (or has expired), it is queued
+   * for resolution and dns_pending is returned.
+   */
+  dns_lookup_rc_t lookup(const std::string &addr, std::string *hostname);
+  /* Adds a resolved entry to the cache, e.g. for static mappings. */
+  void put(const std::string &addr, const std::string &hostname);
+  void configure(size_t capacity, long ttl_ms, long negative_ttl_ms);
+  /* Replaces the resolver. The default resolver uses getnameinfo. */
+  void set_resolver(resolver_t resolver);
+  /* Removes all entries and abandons in-flight resolutions. */
+  void clear();
+  size_t size();
+};
+
+#endif /* PROV_AUDITD_DNS_CACHE_H_ */
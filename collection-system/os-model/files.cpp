@@ -17,10 +17,6 @@
 #include "../os-model/files.h"
 
 #include <cstring>
-#include <sys/socket.h>
-#include <netdb.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 
 #include "logger.h"
 
@@ -44,43 +40,22 @@ IPCEvent* Pipe::to_ipc_event() {
  * Socket
  *------------------------------*/
 
-std::map<std::string, std::string> Socket::reverse_dns_cache;
+ReverseDnsCache Socket::reverse_dns_cache;
 
-void Socket::connect(std::string addressStr, uint16_t port, std::string time) {
+dns_lookup_rc_t Socket::connect(std::string addressStr, uint16_t port, std::string time) {
   remote_port = port;
   connect_time = time;
   connected = true;
 
-  // check if we have resolved this address before
-  if (Socket::reverse_dns_cache.find(addressStr) != Socket::reverse_dns_cache.end()) {
-    remote_addr = Socket::reverse_dns_cache[addressStr];
-    return;
-  }
-  remote_addr = addressStr;
-
-  // resolve IP address to hostname
-  int bufferLen = 256;
-  char hostname[bufferLen];
-  char service[bufferLen];
-  sockaddr_in address;
-  memset(&address, 0, sizeof(address));
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = inet_addr(remote_addr.c_str());
-  int rc = getnameinfo((sockaddr*) &address, sizeof(address), hostname, 260,
-      service, 260, 0);
-  // only set hostname if we successfully resolve IP address
-  if (rc != 0) {
-    LOGGER_LOG_ERROR("Couldn't resolve " << remote_addr << " due to " << gai_strerror(rc));
+  // only use the hostname if we have resolved this address before
+  std::string hostname;
+  dns_lookup_rc_t rc = Socket::reverse_dns_cache.lookup(addressStr, &hostname);
+  if (rc == dns_resolved) {
+    remote_addr = hostname;
   } else {
-    // use only name portion not FQDN
-    char *firstDot = strchr(hostname, '.');
-    if (firstDot) {
-        *firstDot = '\0';
-    }
-    remote_addr = std::string(hostname);
-    // cache entry
-    Socket::reverse_dns_cache[addressStr] = remote_addr;
+    remote_addr = addressStr;
   }
+  return rc;
 }
 
 std::string Socket::str() const {
@@ -22,6 +22,7 @@
 #include <memory>
 
 #include "auditd-event.h"
+#include "dns-cache.h"
 
 class OpenFile;
 
@@ -99,8 +100,11 @@ private:
   bool bound;
 
 public:
-  /* Store mapping between IP Addresses and hostnames to speed up socket connects. */
-  static std::map<std::string, std::string> reverse_dns_cache;
+  /*
+   * Store mapping between IP Addresses and hostnames to speed up socket connects.
+   * Addresses are resolved in the background so connect never blocks on DNS.
+   */
+  static ReverseDnsCache reverse_dns_cache;
 
   Socket() :
       local_pid { -1 },
@@ -123,7 +127,13 @@ public:
     local_port = port;
     bound = true;
   }
-  void connect(std::string addr, uint16_t port, std::string time);
+  /*
+   * Connects the socket. If the remote address has been resolved before, it is
+   * replaced by the hostname. Otherwise, the IP address is kept and resolution
+   * is kicked off in the background (see ProcessTable::connect). Returns the
+   * result of the hostname lookup.
+   */
+  dns_lookup_rc_t connect(std::string addr, uint16_t port, std::string time);
   void close(std::string time) { close_time = time; }
   osm_pid_t get_local_pid() const { return local_pid; }
   uint16_t get_local_port() const { return local_port; }
@@ -45,7 +45,11 @@ osm_rc_t OSModel::apply_syscall(SyscallEvent *se) {
   if (se->rc != SyscallEvent::RETURNS_VOID && se->rc < 0 && se->rc != -115) {
     LOGGER_LOG_ERROR("OSModel::applySyscall: Ignoring failed syscall for pid "
         << se->pid << ": " << se->syscall_name << " rc " << se->rc);
-    delete se;
+    if (event_pool) {
+      event_pool->release(se);
+    } else {
+      delete se;
+    }
     return osm_rc_ok;
   }
 
@@ -79,7 +83,11 @@ osm_rc_t OSModel::apply_syscall(SyscallEvent *se) {
   return osm_rc_ok;
 }
 
-std::vector<Event*> OSModel::reap_os_events() {
+void OSModel::bootstrap(const std::vector<ProcSnapshot> &snapshots) {
+  pt.bootstrap(snapshots);
+}
+
+std::vector<Event*> OSModel::reap_os_events(bool drain) {
   std::vector<Event*> ret;
 
   // get all raw syscalls first
@@ -88,7 +96,7 @@ std::vector<Event*> OSModel::reap_os_events() {
   applied_syscalls.clear();
 
   // then get all aggregated events (process, process group, etc.)
-  std::vector<Event*> processEvents = pt.reap_os_events();
+  std::vector<Event*> processEvents = pt.reap_os_events(drain);
   ret.reserve(ret.size() + processEvents.size());
   ret.insert(ret.end(), processEvents.begin(), processEvents.end());
 
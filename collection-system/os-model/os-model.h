@@ -22,10 +22,12 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <memory>
 
 #include "os-common.h"
 #include "processes.h"
 #include "auditd-event.h"
+#include "event-pool.h"
 
 /**
  * OSModel models an OS. It replays a syscall trace to track higher-level objects
@@ -36,14 +38,23 @@ class OSModel {
 private:
   ProcessTable pt;
   std::vector<SyscallEvent*> applied_syscalls;
+  /* If set, dropped syscalls are handed back to this pool instead of being deleted. */
+  std::shared_ptr<SyscallEventPool> event_pool;
 
 public:
   OSModel();
 
   /* Apply this syscall to the existing model. This OSModel is now the owner of se. */
   osm_rc_t apply_syscall(SyscallEvent *se);
-  /* Return completed OS events. Caller is responsible for cleaning them up. */
-  std::vector<Event*> reap_os_events();
+  /* Seed the model with processes that predate the event stream (see ProcScanner). */
+  void bootstrap(const std::vector<ProcSnapshot> &snapshots);
+  /*
+   * Return completed OS events. Caller is responsible for cleaning them up. If drain
+   * is set, events that are held back waiting for enrichment are returned as well.
+   */
+  std::vector<Event*> reap_os_events(bool drain = false);
+  void set_dns_resolve_wait(long wait_ms) { pt.set_dns_resolve_wait(wait_ms); }
+  void set_event_pool(std::shared_ptr<SyscallEventPool> pool) { event_pool = pool; }
 };
 
 #endif // OS_MODEL_H
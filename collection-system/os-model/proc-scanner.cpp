@@ -0,0 +1,326 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../os-model/proc-scanner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+#include "timestamp.h"
+
+const int ProcScanner::DEFAULT_NUM_THREADS;
+const long ProcScanner::DEFAULT_TIMEOUT_MS;
+const size_t ProcScanner::DEFAULT_MAX_PROCESSES;
+const size_t ProcScanner::DEFAULT_MAX_FDS_PER_PROCESS;
+const size_t ProcScanner::DEFAULT_MAX_CMD_LINE_LENGTH;
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/**
+ * Returns true if the specified directory entry name
+ * consists of digits only (i.e. is a pid or fd).
+ */
+static bool is_numeric(const char *name) {
+  if (*name == '\0') {
+    return false;
+  }
+  for (const char *c = name; *c; c++) {
+    if (*c < '0' || *c > '9') {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Parses the inode from a procfs fd link of the form 'type:[inode]'.
+ * Returns 0 if the link target doesn't start with the specified prefix.
+ */
+static unsigned long parse_link_inode(const std::string &target, const std::string &prefix) {
+  if (target.compare(0, prefix.length(), prefix) != 0) {
+    return 0;
+  }
+  return strtoul(target.c_str() + prefix.length(), NULL, 10);
+}
+
+/*------------------------------
+ * ProcScanner
+ *------------------------------*/
+
+ProcScanner::ProcScanner(std::string proc_root, int num_threads, long timeout_ms,
+    size_t max_processes) :
+    proc_root { proc_root },
+    num_threads { num_threads > 0 ? num_threads : 1 },
+    timeout_ms { timeout_ms },
+    max_processes { max_processes },
+    max_fds_per_process { DEFAULT_MAX_FDS_PER_PROCESS },
+    max_cmd_line_length { DEFAULT_MAX_CMD_LINE_LENGTH },
+    boot_time { 0 },
+    clock_ticks { sysconf(_SC_CLK_TCK) },
+    truncated { false } {}
+
+std::vector<ProcSnapshot> ProcScanner::scan() {
+  auto scan_start = std::chrono::steady_clock::now();
+  auto deadline = scan_start + std::chrono::milliseconds(timeout_ms);
+  truncated = false;
+  boot_time = read_boot_time();
+
+  std::vector<osm_pid_t> pids = list_pids();
+  if (pids.size() > max_processes) {
+    LOGGER_LOG_WARN("Found " << pids.size() << " processes in " << proc_root
+        << ", only scanning the first " << max_processes);
+    pids.resize(max_processes);
+    truncated = true;
+  }
+
+  // Each worker scans a strided partition of the pid list into its own result
+  // vector so that the workers don't have to synchronize on a shared container.
+  std::vector<std::vector<ProcSnapshot>> results(num_threads);
+  std::vector<std::thread> workers;
+  std::atomic<bool> timed_out(false);
+  for (int t = 0; t < num_threads; t++) {
+    workers.push_back(std::thread([this, t, &pids, &results, &timed_out, deadline]() {
+      for (size_t i = t; i < pids.size(); i += num_threads) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+          timed_out = true;
+          return;
+        }
+        ProcSnapshot snapshot;
+        if (scan_process(pids[i], &snapshot)) {
+          results[t].push_back(std::move(snapshot));
+        }
+      }
+    }));
+  }
+  for (std::thread &w : workers) {
+    w.join();
+  }
+
+  std::vector<ProcSnapshot> snapshots;
+  for (std::vector<ProcSnapshot> &r : results) {
+    snapshots.insert(snapshots.end(), std::make_move_iterator(r.begin()),
+        std::make_move_iterator(r.end()));
+  }
+  std::sort(snapshots.begin(), snapshots.end(),
+      [](const ProcSnapshot &lhs, const ProcSnapshot &rhs) {
+        return lhs.pid < rhs.pid;
+      });
+
+  if (timed_out) {
+    LOGGER_LOG_WARN("Scan of " << proc_root << " exceeded its time budget of " << timeout_ms
+        << "ms, the process table will only be partially seeded.");
+    truncated = true;
+  }
+  LOGGER_LOG_INFO("Scanned " << snapshots.size() << " processes from " << proc_root << " in "
+      << std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - scan_start).count() << "ms");
+
+  return snapshots;
+}
+
+std::vector<osm_pid_t> ProcScanner::list_pids() const {
+  std::vector<osm_pid_t> pids;
+  DIR *dir = opendir(proc_root.c_str());
+  if (!dir) {
+    LOGGER_LOG_ERROR("Can't open " << proc_root << ": " << strerror(errno));
+    return pids;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (is_numeric(entry->d_name)) {
+      pids.push_back(atoi(entry->d_name));
+    }
+  }
+  closedir(dir);
+
+  std::sort(pids.begin(), pids.end());
+  return pids;
+}
+
+bool ProcScanner::scan_process(osm_pid_t pid, ProcSnapshot *snapshot) const {
+  std::string dir = proc_root + "/" + std::to_string(pid);
+  snapshot->pid = pid;
+
+  // the process may have exited since we listed it, in which case we skip it
+  if (!read_stat(dir, snapshot)) {
+    LOGGER_LOG_DEBUG("Couldn't read stat for " << dir << ", skipping process");
+    return false;
+  }
+  read_cmd_line(dir, snapshot);
+  read_cwd(dir, snapshot);
+  read_fds(dir, snapshot);
+
+  return true;
+}
+
+bool ProcScanner::read_stat(const std::string &dir, ProcSnapshot *snapshot) const {
+  std::ifstream stat_file(dir + "/stat");
+  std::string stat;
+  if (!std::getline(stat_file, stat)) {
+    return false;
+  }
+
+  // The command name (second field) is in parentheses and may contain spaces
+  // and parentheses itself so we start parsing after the last ')'.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == std::string::npos) {
+    return false;
+  }
+  std::istringstream ss(stat.substr(comm_end + 1));
+
+  // fields 3 (state) to 22 (starttime), see proc(5)
+  std::string state;
+  osm_pid_t ppid;
+  osm_pgid_t pgid;
+  std::string skip;
+  unsigned long long start_ticks;
+  if (!(ss >> state >> ppid >> pgid)) {
+    return false;
+  }
+  for (int field = 6; field < 22; field++) {
+    if (!(ss >> skip)) {
+      return false;
+    }
+  }
+  if (!(ss >> start_ticks)) {
+    return false;
+  }
+
+  snapshot->ppid = ppid;
+  snapshot->pgid = pgid;
+  snapshot->start_time_utc = ticks_to_utc(start_ticks);
+  return true;
+}
+
+void ProcScanner::read_cmd_line(const std::string &dir, ProcSnapshot *snapshot) const {
+  std::ifstream cmd_line_file(dir + "/cmdline", std::ios::binary);
+  std::string arg;
+  size_t length = 0;
+
+  // arguments are separated (and terminated) by '\0'
+  while (length < max_cmd_line_length && std::getline(cmd_line_file, arg, '\0')) {
+    length += arg.length() + 1;
+    snapshot->cmd_line.push_back(arg);
+  }
+
+  // kernel threads don't have a command line
+  if (snapshot->cmd_line.empty()) {
+    snapshot->cmd_line.push_back("UNKNOWN");
+  }
+}
+
+void ProcScanner::read_cwd(const std::string &dir, ProcSnapshot *snapshot) const {
+  char cwd[PATH_MAX];
+  ssize_t len = readlink((dir + "/cwd").c_str(), cwd, sizeof(cwd) - 1);
+  if (len < 0) {
+    snapshot->cwd = "UNKNOWN";
+  } else {
+    cwd[len] = '\0';
+    snapshot->cwd = cwd;
+  }
+}
+
+void ProcScanner::read_fds(const std::string &dir, ProcSnapshot *snapshot) const {
+  std::string fd_dir_path = dir + "/fd";
+  DIR *fd_dir = opendir(fd_dir_path.c_str());
+  if (!fd_dir) {
+    // permission denied or process exited
+    return;
+  }
+
+  struct dirent *entry;
+  char target[PATH_MAX];
+  while ((entry = readdir(fd_dir)) != NULL && snapshot->fds.size() < max_fds_per_process) {
+    if (!is_numeric(entry->d_name)) {
+      continue;
+    }
+    ssize_t len = readlink((fd_dir_path + "/" + entry->d_name).c_str(), target,
+        sizeof(target) - 1);
+    if (len < 0) {
+      continue;
+    }
+    target[len] = '\0';
+    std::string target_str(target);
+    int fd = atoi(entry->d_name);
+
+    unsigned long inode;
+    if ((inode = parse_link_inode(target_str, "socket:[")) != 0) {
+      snapshot->fds.push_back({ fd, osm_fd_socket, inode });
+    } else if ((inode = parse_link_inode(target_str, "pipe:[")) != 0) {
+      // we need to know which end of the pipe this fd refers to
+      int access_mode = read_fd_access_mode(dir, fd);
+      if (access_mode == O_RDONLY) {
+        snapshot->fds.push_back({ fd, osm_fd_pipe_read, inode });
+      } else if (access_mode == O_WRONLY) {
+        snapshot->fds.push_back({ fd, osm_fd_pipe_write, inode });
+      }
+    }
+  }
+  closedir(fd_dir);
+
+  std::sort(snapshot->fds.begin(), snapshot->fds.end(),
+      [](const ProcFdSnapshot &lhs, const ProcFdSnapshot &rhs) {
+        return lhs.fd < rhs.fd;
+      });
+}
+
+int ProcScanner::read_fd_access_mode(const std::string &dir, int fd) const {
+  std::ifstream fdinfo_file(dir + "/fdinfo/" + std::to_string(fd));
+  std::string line;
+  while (std::getline(fdinfo_file, line)) {
+    // flags are printed in octal, e.g. 'flags:	0100001'
+    if (line.compare(0, 6, "flags:") == 0) {
+      return strtol(line.c_str() + 6, NULL, 8) & O_ACCMODE;
+    }
+  }
+  return -1;
+}
+
+long ProcScanner::read_boot_time() const {
+  std::ifstream stat_file(proc_root + "/stat");
+  std::string line;
+  while (std::getline(stat_file, line)) {
+    if (line.compare(0, 6, "btime ") == 0) {
+      return atol(line.c_str() + 6);
+    }
+  }
+  LOGGER_LOG_WARN("Couldn't find boot time in " << proc_root << "/stat");
+  return 0;
+}
+
+std::string ProcScanner::ticks_to_utc(unsigned long long start_ticks) const {
+  long long millis_since_boot = (start_ticks * 1000) / clock_ticks;
+  time_t start_sec = boot_time + millis_since_boot / 1000;
+  int start_millis = millis_since_boot % 1000;
+
+  // use the same format as SyscallEvent::event_time
+  return Timestamp::to_utc(start_sec, start_millis);
+}
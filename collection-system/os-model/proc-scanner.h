@@ -0,0 +1,114 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROV_AUDITD_PROC_SCANNER_H_
+#define PROV_AUDITD_PROC_SCANNER_H_
+
+#include <string>
+#include <vector>
+
+#include "files.h"
+
+/**
+ * Describes an open file descriptor of a process as found under
+ * /proc/<pid>/fd. We only keep file descriptors that point to
+ * pipes or sockets as these are the only ones the OS model tracks.
+ * Pipes and sockets are identified through their inode so that
+ * descriptors shared between processes can be mapped to the same
+ * OpenFile.
+ */
+struct ProcFdSnapshot {
+  int fd;
+  osm_fd_t type;
+  unsigned long inode;
+};
+
+/**
+ * Snapshot of a single process as found under /proc/<pid>.
+ */
+struct ProcSnapshot {
+  osm_pid_t pid;
+  osm_pid_t ppid;
+  osm_pgid_t pgid;
+  std::string cwd;
+  std::vector<std::string> cmd_line;
+  std::string start_time_utc;
+  std::vector<ProcFdSnapshot> fds;
+};
+
+/**
+ * The ProcScanner walks a procfs tree and creates a snapshot of all
+ * processes that are alive at the time of the scan. It is used to seed
+ * the ProcessTable on plugin startup so that processes that predate
+ * the plugin don't have to be represented as stubs until they make a
+ * syscall.
+ *
+ * The scan is parallelized across a configurable number of threads and
+ * is bounded in time and memory. Once the time budget is exhausted,
+ * workers stop picking up new processes and the scan returns whatever
+ * has been collected so far. Memory is bounded by capping the number of
+ * processes, the number of file descriptors per process, and the length
+ * of the command line that is read per process.
+ */
+class ProcScanner {
+private:
+  std::string proc_root;
+  int num_threads;
+  long timeout_ms;
+  size_t max_processes;
+  size_t max_fds_per_process;
+  size_t max_cmd_line_length;
+  /* Boot time in seconds since the epoch (btime in /proc/stat). */
+  long boot_time;
+  long clock_ticks;
+  bool truncated;
+
+  std::vector<osm_pid_t> list_pids() const;
+  /*
+   * Reads the snapshot for the specified pid. Returns false if the
+   * process disappeared during the scan or its stat file couldn't
+   * be parsed.
+   */
+  bool scan_process(osm_pid_t pid, ProcSnapshot *snapshot) const;
+  bool read_stat(const std::string &dir, ProcSnapshot *snapshot) const;
+  void read_cmd_line(const std::string &dir, ProcSnapshot *snapshot) const;
+  void read_cwd(const std::string &dir, ProcSnapshot *snapshot) const;
+  void read_fds(const std::string &dir, ProcSnapshot *snapshot) const;
+  /* Returns the access mode flags (O_RDONLY, O_WRONLY, O_RDWR) of the fd or -1. */
+  int read_fd_access_mode(const std::string &dir, int fd) const;
+  long read_boot_time() const;
+  std::string ticks_to_utc(unsigned long long start_ticks) const;
+
+public:
+  static const int DEFAULT_NUM_THREADS = 4;
+  static const long DEFAULT_TIMEOUT_MS = 5000;
+  static const size_t DEFAULT_MAX_PROCESSES = 65536;
+  static const size_t DEFAULT_MAX_FDS_PER_PROCESS = 1024;
+  static const size_t DEFAULT_MAX_CMD_LINE_LENGTH = 4096;
+
+  ProcScanner(std::string proc_root = "/proc", int num_threads = DEFAULT_NUM_THREADS,
+      long timeout_ms = DEFAULT_TIMEOUT_MS, size_t max_processes = DEFAULT_MAX_PROCESSES);
+
+  /*
+   * Scans the procfs tree and returns a snapshot of all live processes,
+   * sorted by pid.
+   */
+  std::vector<ProcSnapshot> scan();
+  /* Returns true if the last scan hit the time or process limit. */
+  bool was_truncated() const { return truncated; }
+};
+
+#endif /* PROV_AUDITD_PROC_SCANNER_H_ */
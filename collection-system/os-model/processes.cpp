@@ -25,6 +25,8 @@
 static const std::string EPOCH_TIME_UTC = "1970-01-01 00:00:00.000";
 static const std::string FUTURE_TIME_UTC = "9999-01-01 00:00:00.000";
 
+const long ProcessTable::DEFAULT_DNS_RESOLVE_WAIT_MS;
+
 /*------------------------------
  * Helpers
  *------------------------------*/
@@ -74,6 +76,9 @@ ProcessTable::~ProcessTable() {
   for (SocketConnectEvent *e: finished_socket_connects) {
     delete e;
   }
+  for (PendingSocketConnect &p : pending_socket_connects) {
+    delete p.event;
+  }
 }
 
 osm_rc_t ProcessTable::apply_syscall(SyscallEvent *se) {
@@ -131,7 +136,54 @@ osm_rc_t ProcessTable::apply_syscall(SyscallEvent *se) {
   return osm_rc_ok;
 }
 
-std::vector<Event*> ProcessTable::reap_os_events() {
+void ProcessTable::bootstrap(const std::vector<ProcSnapshot> &snapshots) {
+  // pipes and sockets can be shared between processes, so we keep track
+  // of the ones we created by inode to get the reference counting right
+  std::map<unsigned long, std::shared_ptr<OpenFile>> open_files;
+  size_t num_added = 0;
+
+  for (const ProcSnapshot &snapshot : snapshots) {
+    if (get_live_process(snapshot.pid)) {
+      // we already saw a syscall from this process
+      continue;
+    }
+    LiveProcess *lp = new LiveProcess(snapshot);
+    register_live_process(lp);
+    num_added++;
+
+    for (const ProcFdSnapshot &fd_snapshot : snapshot.fds) {
+      std::shared_ptr<OpenFile> target_file;
+      if (open_files.find(fd_snapshot.inode) != open_files.end()) {
+        target_file = open_files[fd_snapshot.inode];
+      } else if (fd_snapshot.type == osm_fd_socket) {
+        // we don't know when the socket was opened, the process' start
+        // time is the best lower bound we have
+        std::shared_ptr<Socket> sock = std::make_shared<Socket>();
+        sock->open(lp->pid, lp->start_time_utc);
+        target_file = sock;
+        open_files[fd_snapshot.inode] = target_file;
+      } else {
+        target_file = std::make_shared<Pipe>();
+        open_files[fd_snapshot.inode] = target_file;
+      }
+      lp->fds[fd_snapshot.fd] = FileDescriptor(fd_snapshot.type, fd_snapshot.fd, target_file);
+
+      // same as in dup2, a pipe is only considered set up if its ends
+      // are connected to stdin and stdout
+      if (fd_snapshot.type == osm_fd_pipe_read && fd_snapshot.fd == 0) {
+        ((Pipe*) target_file.get())->set_reader_process(lp->pid, lp->start_time_utc);
+      } else if (fd_snapshot.type == osm_fd_pipe_write && fd_snapshot.fd == 1) {
+        ((Pipe*) target_file.get())->set_writer_process(lp->pid, lp->start_time_utc);
+      }
+    }
+  }
+  LOGGER_LOG_INFO("Bootstrapped process table with " << num_added << " processes and "
+      << open_files.size() << " pipes/sockets.");
+}
+
+std::vector<Event*> ProcessTable::reap_os_events(bool drain) {
+  release_pending_socket_connects(drain);
+
   std::vector<Event*> ret;
   size_t size = dead_processes.size() + dead_process_groups.size() + finished_ipcs.size()
       + finished_sockets.size() + finished_socket_connects.size();
@@ -160,6 +212,24 @@ std::vector<Event*> ProcessTable::reap_os_events() {
   return ret;
 }
 
+void ProcessTable::release_pending_socket_connects(bool drain) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  auto itr = pending_socket_connects.begin();
+  while (itr != pending_socket_connects.end()) {
+    std::string hostname;
+    dns_lookup_rc_t rc = Socket::reverse_dns_cache.lookup(itr->remote_addr, &hostname);
+    if (rc == dns_resolved) {
+      itr->event->set_dst_node(hostname);
+    } else if (rc == dns_pending && !drain && now < itr->deadline) {
+      itr++;
+      continue;
+    }
+    // resolved, unresolvable, or we've waited long enough
+    finished_socket_connects.push_back(itr->event);
+    itr = pending_socket_connects.erase(itr);
+  }
+}
+
 LiveProcess* ProcessTable::get_live_process(osm_pid_t pid) {
   LiveProcess *lp = nullptr;
   if (live_processes.find(pid) != live_processes.end()) {
@@ -434,11 +504,15 @@ void ProcessTable::connect(SyscallEvent *se) {
   // connect the socket
   FileDescriptor fd = lp->fds[sockfd];
   Socket *sock = (Socket*) fd.get_target_file();
-  sock->connect(remote_addr, remote_port, se->event_time);
+  dns_lookup_rc_t rc = sock->connect(remote_addr, remote_port, se->event_time);
 
-  // record the connection event
+  // Record the connection event. If the remote address is still being
+  // resolved, hold on to the event for a bit so we can enrich it later.
   SocketConnectEvent *ev = sock->to_socket_connect_event();
-  if (ev) {
+  if (ev && rc == dns_pending && dns_resolve_wait.count() > 0) {
+    pending_socket_connects.push_back({ ev, remote_addr,
+      std::chrono::steady_clock::now() + dns_resolve_wait });
+  } else if (ev) {
     finished_socket_connects.push_back(ev);
   }
   LOGGER_LOG_DEBUG("[" << lp->pid << "] connected to " << remote_addr << ":" << remote_port);
@@ -740,6 +814,17 @@ LiveProcess::LiveProcess(osm_pid_t pid) :
     is_thread { false } {
 }
 
+LiveProcess::LiveProcess(const ProcSnapshot &snapshot) :
+    pid { snapshot.pid },
+    ppid { snapshot.ppid },
+    pgid { snapshot.pgid },
+    exec_cwd { snapshot.cwd },
+    exec_cmd_line { snapshot.cmd_line },
+    start_time_utc { snapshot.start_time_utc },
+    finish_time_utc { FUTURE_TIME_UTC },
+    is_thread { false } {
+}
+
 void LiveProcess::setpgid(osm_pgid_t pgid) {
   if (pgid == 0) {
     this->pgid = this->pid;
@@ -17,6 +17,7 @@
 #ifndef PROV_AUDITD_PROCESSES_H_
 #define PROV_AUDITD_PROCESSES_H_
 
+#include <chrono>
 #include <map>
 #include <list>
 #include <vector>
@@ -25,6 +26,7 @@
 
 #include "files.h"
 #include "os-common.h"
+#include "proc-scanner.h"
 #include "auditd-event.h"
 
 class LiveThread;
@@ -62,6 +64,12 @@ public:
    */
   LiveProcess(const SyscallEvent *se);
   LiveProcess(osm_pid_t pid);
+  /*
+   * This is for prehistoric processes that we learned about from a procfs
+   * scan on startup. File descriptors are added separately by the
+   * ProcessTable as they may be shared with other processes.
+   */
+  LiveProcess(const ProcSnapshot &snapshot);
   ~LiveProcess() {};
 
   void setpgid(osm_pgid_t pgid);
@@ -145,8 +153,9 @@ private:
    * prehistoric pgroups are not interesting.
    *
    * As a result, we don't attempt to deal with prehistoric process groups.
-   * If we need them, we have to take `ps` snapshot(s) when we start
-   * to get the initial set of memberships.
+   * Even when the table is seeded from a procfs scan on startup (see
+   * bootstrap()), we only use the scan to fill in the processes themselves
+   * and not their memberships as the scan is bounded and may be incomplete.
    *
    * Zombie process groups are possible if zombie processes are possible.
    * We identify a zpg if we try to add a process to a process group
@@ -158,6 +167,18 @@ private:
   std::vector<IPCEvent*> finished_ipcs;
   std::vector<SocketEvent*> finished_sockets;
   std::vector<SocketConnectEvent*> finished_socket_connects;
+  /*
+   * Socket connects whose remote address is still being resolved. We hold
+   * on to them for up to dns_resolve_wait to give the resolver a chance to
+   * replace the IP address with the hostname before they are reaped.
+   */
+  struct PendingSocketConnect {
+    SocketConnectEvent *event;
+    std::string remote_addr;
+    std::chrono::steady_clock::time_point deadline;
+  };
+  std::list<PendingSocketConnect> pending_socket_connects;
+  std::chrono::milliseconds dns_resolve_wait;
   std::string hostname;
 
   /*
@@ -211,17 +232,37 @@ private:
   void remove_thread_from_state(LiveThread *lt, bool deleteFromParent);
   /* Deletes the process group from live group and add it to list of dead process groups. */
   void remove_process_group_from_state(LiveProcessGroup *lpg, const std::string &time);
+  /*
+   * Moves pending socket connects whose address has been resolved (or whose
+   * deadline has passed) to the finished socket connects. If drain is set,
+   * all pending socket connects are moved.
+   */
+  void release_pending_socket_connects(bool drain);
 
 public:
-  ProcessTable() {};
+  static const long DEFAULT_DNS_RESOLVE_WAIT_MS = 1000;
+
+  ProcessTable() : dns_resolve_wait { DEFAULT_DNS_RESOLVE_WAIT_MS } {};
   ~ProcessTable();
 
   ProcessTable(const ProcessTable&) = delete;
   ProcessTable& operator=(const ProcessTable &x) = delete;
 
   osm_rc_t apply_syscall(SyscallEvent *se);
-  /* Return all finished events (caller is responsible to free these events). */
-  std::vector<Event*> reap_os_events();
+  /*
+   * Seed the table with processes that predate the event stream. Processes
+   * that are already live are skipped. Pipes and sockets that are shared
+   * between processes (identified by their inode) map to the same OpenFile.
+   */
+  void bootstrap(const std::vector<ProcSnapshot> &snapshots);
+  /*
+   * Return all finished events (caller is responsible to free these events).
+   * If drain is set, socket connects that are waiting for their remote address
+   * to be resolved are returned as well.
+   */
+  std::vector<Event*> reap_os_events(bool drain = false);
+  /* Set how long socket connects are held back waiting for DNS resolution. */
+  void set_dns_resolve_wait(long wait_ms) { dns_resolve_wait = std::chrono::milliseconds(wait_ms); }
 };
 
 #endif /* PROV_AUDITD_PROCESSES_H_ */
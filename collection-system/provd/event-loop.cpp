@@ -0,0 +1,300 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "event-loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <set>
+#include <tuple>
+#include <vector>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#else
+#include <poll.h>
+#endif
+
+#include "error.h"
+#include "logger.h"
+
+const long EventLoop::SLOW_CALLBACK_MS;
+
+EventLoop::EventLoop() :
+    running { false },
+    wakeup_fds { -1, -1 },
+    poll_fd { -1 },
+    inotify_fd { -1 } {}
+
+EventLoop::~EventLoop() {
+  stop();
+}
+
+int EventLoop::start() {
+  if (pipe(wakeup_fds) < 0) {
+    LOGGER_LOG_ERROR("Couldn't create wake-up pipe: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  fcntl(wakeup_fds[0], F_SETFL, fcntl(wakeup_fds[0], F_GETFL, 0) | O_NONBLOCK);
+#ifdef __linux__
+  if ((poll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    LOGGER_LOG_ERROR("Couldn't create epoll instance: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  epoll_event ev = { };
+  ev.events = EPOLLIN;
+  ev.data.fd = wakeup_fds[0];
+  epoll_ctl(poll_fd, EPOLL_CTL_ADD, wakeup_fds[0], &ev);
+
+  if ((inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+    LOGGER_LOG_ERROR("Couldn't create inotify instance: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  ev.data.fd = inotify_fd;
+  epoll_ctl(poll_fd, EPOLL_CTL_ADD, inotify_fd, &ev);
+#endif
+  running = true;
+  thr = std::thread(&EventLoop::run, this);
+  return NO_ERROR;
+}
+
+void EventLoop::stop() {
+  if (!running) {
+    return;
+  }
+  running = false;
+  wakeup();
+  thr.join();
+  // release the state of posted callbacks that haven't run
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  posted.clear();
+  close(wakeup_fds[0]);
+  close(wakeup_fds[1]);
+#ifdef __linux__
+  close(inotify_fd);
+  close(poll_fd);
+#endif
+}
+
+void EventLoop::wakeup() {
+  char c = 0;
+  if (write(wakeup_fds[1], &c, 1) < 0) {
+    LOGGER_LOG_WARN("Couldn't wake up event loop: " << strerror(errno));
+  }
+}
+
+int EventLoop::add_fd(int fd, callback_t cb) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  fd_callbacks[fd] = cb;
+  if (update_fd(fd) != NO_ERROR) {
+    fd_callbacks.erase(fd);
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+void EventLoop::remove_fd(int fd) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  if (fd_callbacks.erase(fd)) {
+    update_fd(fd);
+  }
+}
+
+int EventLoop::add_write_fd(int fd, callback_t cb) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  write_callbacks[fd] = cb;
+  if (update_fd(fd) != NO_ERROR) {
+    write_callbacks.erase(fd);
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+void EventLoop::remove_write_fd(int fd) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  if (write_callbacks.erase(fd)) {
+    update_fd(fd);
+  }
+}
+
+int EventLoop::update_fd(int fd) {
+#ifdef __linux__
+  epoll_event ev = { };
+  ev.events = (fd_callbacks.count(fd) ? EPOLLIN : 0) | (write_callbacks.count(fd) ? EPOLLOUT : 0);
+  ev.data.fd = fd;
+  if (!ev.events) {
+    epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    return NO_ERROR;
+  }
+  if (epoll_ctl(poll_fd, EPOLL_CTL_MOD, fd, &ev) < 0
+      && (errno != ENOENT || epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+    LOGGER_LOG_ERROR("Couldn't watch fd " << fd << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+#else
+  // the poll set is rebuilt on every iteration
+  wakeup();
+#endif
+  return NO_ERROR;
+}
+
+int EventLoop::add_file_watch(const std::string &path, callback_t cb) {
+#ifdef __linux__
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  int wd = inotify_add_watch(inotify_fd, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE);
+  if (wd < 0) {
+    LOGGER_LOG_ERROR("Couldn't watch " << path << ": " << strerror(errno));
+    return -1;
+  }
+  file_callbacks[wd] = cb;
+  return wd;
+#else
+  LOGGER_LOG_ERROR("File watches are only supported on Linux, can't watch " << path);
+  return -1;
+#endif
+}
+
+void EventLoop::remove_file_watch(int wd) {
+#ifdef __linux__
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  inotify_rm_watch(inotify_fd, wd);
+  file_callbacks.erase(wd);
+#endif
+}
+
+void EventLoop::dispatch_file_events() {
+#ifdef __linux__
+  // several events for the same file (e.g. a burst of writes) result in one callback
+  alignas(inotify_event) char buf[4096];
+  std::set<int> modified;
+  ssize_t len;
+  while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len; p += sizeof(inotify_event) + ((inotify_event*) p)->len) {
+      modified.insert(((inotify_event*) p)->wd);
+    }
+  }
+  for (int wd : modified) {
+    dispatch(file_callbacks, wd);
+  }
+#endif
+}
+
+void EventLoop::post(callback_t cb) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  if (!running) {
+    return;
+  }
+  posted.push_back(cb);
+  wakeup();
+}
+
+void EventLoop::run_posted() {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  std::vector<callback_t> callbacks;
+  callbacks.swap(posted);
+  for (const callback_t &cb : callbacks) {
+    run_callback(cb);
+  }
+}
+
+void EventLoop::dispatch(std::map<int, callback_t> &callbacks, int fd) {
+  std::unique_lock<std::recursive_mutex> lock(mtx);
+  auto cb = callbacks.find(fd);
+  if (cb != callbacks.end()) {
+    // copy, the callback might remove itself
+    callback_t f = cb->second;
+    run_callback(f);
+  }
+}
+
+void EventLoop::run_callback(const callback_t &cb) {
+  auto start = std::chrono::steady_clock::now();
+  cb();
+  long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  if (elapsed >= SLOW_CALLBACK_MS) {
+    LOGGER_LOG_WARN("Event loop callback ran for " << elapsed << " ms, other connections"
+        << " have been stalled in the meantime.");
+  }
+}
+
+void EventLoop::run() {
+  // fds with their readiness for reading and writing
+  std::vector<std::tuple<int, bool, bool>> ready;
+  while (running) {
+    ready.clear();
+#ifdef __linux__
+    epoll_event events[64];
+    int n = epoll_wait(poll_fd, events, 64, -1);
+    for (int i = 0; i < n; i++) {
+      // errors and hang-ups are reported to both callbacks so that they notice
+      int fd = events[i].data.fd;
+      uint32_t e = events[i].events;
+      ready.emplace_back(fd, e & (EPOLLIN | EPOLLERR | EPOLLHUP),
+          e & (EPOLLOUT | EPOLLERR | EPOLLHUP));
+    }
+#else
+    std::vector<pollfd> fds;
+    fds.push_back(pollfd { wakeup_fds[0], POLLIN, 0 });
+    {
+      std::unique_lock<std::recursive_mutex> lock(mtx);
+      std::map<int, short> interest;
+      for (auto &cb : fd_callbacks) {
+        interest[cb.first] |= POLLIN;
+      }
+      for (auto &cb : write_callbacks) {
+        interest[cb.first] |= POLLOUT;
+      }
+      for (auto &fd : interest) {
+        fds.push_back(pollfd { fd.first, fd.second, 0 });
+      }
+    }
+    int n = poll(fds.data(), fds.size(), -1);
+    for (size_t i = 0; n > 0 && i < fds.size(); i++) {
+      short e = fds[i].revents;
+      if (e) {
+        ready.emplace_back(fds[i].fd, e & (POLLIN | POLLERR | POLLHUP),
+            e & (POLLOUT | POLLERR | POLLHUP));
+      }
+    }
+#endif
+    if (n < 0 && errno != EINTR) {
+      LOGGER_LOG_ERROR("Problems while waiting for events: " << strerror(errno));
+    }
+
+    for (auto &r : ready) {
+      int fd = std::get<0>(r);
+      if (fd == wakeup_fds[0]) {
+        char buf[64];
+        while (read(fd, buf, sizeof(buf)) > 0) {}
+        run_posted();
+      } else if (fd == inotify_fd) {
+        dispatch_file_events();
+      } else {
+        if (std::get<1>(r)) {
+          dispatch(fd_callbacks, fd);
+        }
+        if (std::get<2>(r)) {
+          dispatch(write_callbacks, fd);
+        }
+      }
+    }
+  }
+}
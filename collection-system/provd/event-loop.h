@@ -0,0 +1,107 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef PROVD_EVENT_LOOP_H_
+#define PROVD_EVENT_LOOP_H_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * A single-threaded event loop that calls back when file descriptors become
+ * readable or writable (epoll on Linux, poll elsewhere) or when watched files
+ * have been written to (inotify, Linux only).
+ *
+ * Callbacks run on the loop thread and must not block: they hold the loop's
+ * mutex, so a blocking callback stalls all other connections as well as
+ * every thread that adds or removes a callback. Callbacks that have to wait
+ * for a peer should buffer their data and register a write callback instead.
+ * Callbacks that run longer than SLOW_CALLBACK_MS are logged.
+ *
+ * Callbacks can be removed from any thread. Removal waits for a running
+ * callback of the same loop to finish, so the state a callback refers to
+ * can be freed right afterwards.
+ */
+class EventLoop {
+public:
+  typedef std::function<void()> callback_t;
+
+  static const long SLOW_CALLBACK_MS = 100;
+
+private:
+  std::thread thr;
+  std::atomic<bool> running;
+  /* Used to wake up the loop thread when it is stopped or fds are added or removed. */
+  int wakeup_fds[2];
+  int poll_fd;
+  int inotify_fd;
+  /* Held while callbacks run, recursive so that callbacks can add and remove callbacks. */
+  std::recursive_mutex mtx;
+  std::map<int, callback_t> fd_callbacks;
+  std::map<int, callback_t> write_callbacks;
+  std::map<int, callback_t> file_callbacks;
+  std::vector<callback_t> posted;
+
+  void run();
+  /* Updates the events we wait for on fd after its callbacks changed. Requires mtx. */
+  int update_fd(int fd);
+  /* Runs the callback for fd in callbacks if there (still) is one. */
+  void dispatch(std::map<int, callback_t> &callbacks, int fd);
+  void dispatch_file_events();
+  void run_posted();
+  void run_callback(const callback_t &cb);
+  void wakeup();
+
+public:
+  EventLoop();
+  ~EventLoop();
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  int start();
+  void stop();
+
+  /* Calls cb whenever fd is readable (level-triggered). */
+  int add_fd(int fd, callback_t cb);
+  void remove_fd(int fd);
+  /*
+   * Calls cb whenever fd is writable (level-triggered), independently of a
+   * callback added with add_fd(). Remove the callback once there's nothing
+   * left to write.
+   */
+  int add_write_fd(int fd, callback_t cb);
+  void remove_write_fd(int fd);
+  /*
+   * Calls cb whenever the file has been modified or closed after writing.
+   * Returns a watch descriptor for remove_file_watch() or -1 on error.
+   */
+  int add_file_watch(const std::string &path, callback_t cb);
+  void remove_file_watch(int wd);
+  /*
+   * Runs cb once on the loop thread, e.g. to touch state that is otherwise
+   * only used by callbacks. Callbacks that haven't run when the loop is
+   * stopped are discarded.
+   */
+  void post(callback_t cb);
+};
+
+#endif /* PROVD_EVENT_LOOP_H_ */
@@ -0,0 +1,344 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "line-matcher.h"
+#include "logger.h"
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/* Returns the position after the character class starting at pos, npos if unterminated. */
+static size_t skip_class(const std::string &regex, size_t pos) {
+  size_t i = pos + 1;
+  if (i < regex.size() && regex[i] == '^') {
+    i++;
+  }
+  // a leading ']' is part of the class
+  if (i < regex.size() && regex[i] == ']') {
+    i++;
+  }
+  while (i < regex.size()) {
+    char c = regex[i];
+    if (c == '\\') {
+      i += 2;
+    } else if (c == ']') {
+      return i + 1;
+    } else if (c == '[' && i + 1 < regex.size()
+        && (regex[i + 1] == ':' || regex[i + 1] == '.' || regex[i + 1] == '=')) {
+      // e.g. [:alpha:]
+      size_t end = regex.find(std::string(1, regex[i + 1]) + "]", i + 2);
+      if (end == std::string::npos) {
+        return end;
+      }
+      i = end + 2;
+    } else {
+      i++;
+    }
+  }
+  return std::string::npos;
+}
+
+/* Returns the position after the group starting at pos, npos if unterminated. */
+static size_t skip_group(const std::string &regex, size_t pos) {
+  int depth = 0;
+  size_t i = pos;
+  while (i < regex.size()) {
+    char c = regex[i];
+    if (c == '\\') {
+      i += 2;
+      continue;
+    }
+    if (c == '[') {
+      i = skip_class(regex, i);
+      if (i == std::string::npos) {
+        return i;
+      }
+      continue;
+    }
+    if (c == '(') {
+      depth++;
+    } else if (c == ')' && --depth == 0) {
+      return i + 1;
+    }
+    i++;
+  }
+  return std::string::npos;
+}
+
+/* Returns whether count hex digits follow pos. */
+static bool has_hex_digits(const std::string &regex, size_t pos, size_t count) {
+  if (pos + count > regex.size()) {
+    return false;
+  }
+  for (size_t i = pos; i < pos + count; i++) {
+    if (!isxdigit(regex[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Returns the length of the escape sequence starting at pos, 0 if it's not
+ * one whose extent is known (ECMAScript and RE2 syntax).
+ */
+static size_t escape_length(const std::string &regex, size_t pos) {
+  if (pos + 1 >= regex.size()) {
+    return 0;
+  }
+  char e = regex[pos + 1];
+  if (!isalnum(e) || strchr("dDwWsSbBAzfnrtv", e) != nullptr) {
+    return 2;
+  }
+  if (isdigit(e)) {
+    // backreference or octal escape, both may have several digits
+    size_t i = pos + 1;
+    while (i < regex.size() && isdigit(regex[i])) {
+      i++;
+    }
+    return i - pos;
+  }
+  size_t end;
+  switch (e) {
+  case 'x':
+    if (pos + 2 < regex.size() && regex[pos + 2] == '{') {
+      end = regex.find('}', pos + 2);
+      return end == std::string::npos ? 0 : end + 1 - pos;
+    }
+    return has_hex_digits(regex, pos + 2, 2) ? 4 : 0;
+  case 'u':
+    return has_hex_digits(regex, pos + 2, 4) ? 6 : 0;
+  case 'c':
+    return pos + 2 < regex.size() && isalpha(regex[pos + 2]) ? 3 : 0;
+  case 'p':
+  case 'P':
+    if (pos + 2 >= regex.size()) {
+      return 0;
+    }
+    if (regex[pos + 2] == '{') {
+      end = regex.find('}', pos + 2);
+      return end == std::string::npos ? 0 : end + 1 - pos;
+    }
+    return 3;
+  default:
+    return 0;
+  }
+}
+
+/*------------------------------
+ * LineMatcher
+ *------------------------------*/
+
+LineMatcher::LineMatcher(const std::string &regex) {
+  literal = required_literal(regex, &literal_is_prefix);
+}
+
+std::unique_ptr<LineMatcher> LineMatcher::create(const std::string &regex,
+    matcher_engine_t engine) {
+#ifdef WITH_RE2
+  if (engine == matcher_re2) {
+    std::unique_ptr<Re2Matcher> matcher(new Re2Matcher(regex));
+    if (matcher->ok()) {
+      return std::move(matcher);
+    }
+    LOGGER_LOG_INFO("RE2 doesn't support " << regex << ", falling back to std::regex.");
+  }
+#else
+  if (engine == matcher_re2) {
+    LOGGER_LOG_WARN("Built without RE2, matching " << regex << " with std::regex.");
+  }
+#endif
+  return std::unique_ptr<LineMatcher>(new StdRegexMatcher(regex));
+}
+
+matcher_engine_t LineMatcher::default_engine() {
+#ifdef WITH_RE2
+  return matcher_re2;
+#else
+  return matcher_std;
+#endif
+}
+
+std::string LineMatcher::required_literal(const std::string &regex, bool *is_prefix) {
+  std::string best;
+  bool best_is_prefix = false;
+  std::string run;
+  bool run_is_prefix = true;
+  size_t i = regex.size() > 0 && regex[0] == '^' ? 1 : 0;
+
+  auto end_run = [&]() {
+    if (run.size() > best.size()) {
+      best = run;
+      best_is_prefix = run_is_prefix;
+    }
+    run.clear();
+    run_is_prefix = false;
+  };
+
+  while (i < regex.size()) {
+    // determine the next atom and whether it's a literal character
+    char c = regex[i];
+    bool is_literal = false;
+    char value = 0;
+    switch (c) {
+    case '|':
+      // any of the alternatives may match, nothing is required
+      *is_prefix = false;
+      return "";
+    case '(':
+    case '[':
+      // flag groups like (?i) may make the rest of the regex case-insensitive
+      if (c == '(' && i + 2 < regex.size() && regex[i + 1] == '?'
+          && strchr("imsU-", regex[i + 2]) != nullptr) {
+        *is_prefix = false;
+        return "";
+      }
+      i = c == '(' ? skip_group(regex, i) : skip_class(regex, i);
+      if (i == std::string::npos) {
+        *is_prefix = false;
+        return "";
+      }
+      break;
+    case '\\': {
+      size_t len = escape_length(regex, i);
+      if (len == 0) {
+        *is_prefix = false;
+        return "";
+      }
+      // escaped letters and digits are classes, anchors, backreferences, or
+      // character codes, only escaped punctuation is taken literally
+      is_literal = !isalnum(regex[i + 1]);
+      value = regex[i + 1];
+      i += len;
+      break;
+    }
+    case ')':
+    case ']':
+    case '{':
+    case '}':
+    case '*':
+    case '+':
+    case '?':
+      // unexpected here, don't guess
+      *is_prefix = false;
+      return "";
+    case '.':
+    case '^':
+    case '$':
+      i++;
+      break;
+    default:
+      is_literal = true;
+      value = c;
+      i++;
+    }
+
+    // a quantifier decides whether the atom is required
+    bool optional = false;
+    bool repeated = false;
+    if (i < regex.size()) {
+      char q = regex[i];
+      if (q == '*' || q == '?' || q == '{') {
+        optional = true;
+      } else if (q == '+') {
+        repeated = true;
+      }
+      if (optional || repeated) {
+        if (q == '{') {
+          size_t end = regex.find('}', i);
+          if (end == std::string::npos) {
+            *is_prefix = false;
+            return "";
+          }
+          i = end + 1;
+        } else {
+          i++;
+        }
+        // lazy quantifier
+        if (i < regex.size() && regex[i] == '?') {
+          i++;
+        }
+      }
+    }
+
+    if (is_literal && !optional) {
+      run += value;
+      if (repeated) {
+        end_run();
+      }
+    } else {
+      end_run();
+    }
+  }
+  end_run();
+  *is_prefix = best_is_prefix;
+  return best;
+}
+
+bool LineMatcher::matches(const char *line, size_t len) const {
+  if (!literal.empty()) {
+    if (len < literal.size()) {
+      return false;
+    }
+    if (literal_is_prefix) {
+      if (memcmp(line, literal.data(), literal.size()) != 0) {
+        return false;
+      }
+    } else if (!memmem(line, len, literal.data(), literal.size())) {
+      return false;
+    }
+  }
+  return full_match(line, len);
+}
+
+/*------------------------------
+ * StdRegexMatcher
+ *------------------------------*/
+
+StdRegexMatcher::StdRegexMatcher(const std::string &regex) :
+    LineMatcher(regex),
+    re { regex } {}
+
+bool StdRegexMatcher::full_match(const char *line, size_t len) const {
+  return std::regex_match(line, line + len, re);
+}
+
+/*------------------------------
+ * Re2Matcher
+ *------------------------------*/
+
+#ifdef WITH_RE2
+static RE2::Options re2_options() {
+  RE2::Options options;
+  // we fall back to std::regex for regexes RE2 can't handle
+  options.set_log_errors(false);
+  // match bytes like std::regex does, output doesn't have to be valid UTF-8
+  options.set_encoding(RE2::Options::EncodingLatin1);
+  return options;
+}
+
+Re2Matcher::Re2Matcher(const std::string &regex) :
+    LineMatcher(regex),
+    re { regex, re2_options() } {}
+
+bool Re2Matcher::full_match(const char *line, size_t len) const {
+  return RE2::FullMatch(re2::StringPiece(line, len), re);
+}
+#endif
@@ -0,0 +1,111 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROVD_LINE_MATCHER_H_
+#define PROVD_LINE_MATCHER_H_
+
+#include <memory>
+#include <regex>
+#include <string>
+
+#ifdef WITH_RE2
+#include <re2/re2.h>
+#endif
+
+typedef enum matcher_engine {
+  /* std::regex, supports the full ECMAScript syntax but may backtrack. */
+  matcher_std,
+  /* RE2, runs in linear time (only available if built WITH_RE2). */
+  matcher_re2
+} matcher_engine_t;
+
+/**
+ * Decides whether a line of a traced process' output matches the regex of
+ * a trace request (the whole line has to match, as with std::regex_match).
+ *
+ * Most regexes contain a literal that every matching line has to contain,
+ * e.g. "prov: " in "prov: (.*)". Before the regex engine is run, lines are
+ * checked for that literal (at the start of the line if the regex starts
+ * with it, with memmem otherwise), which rejects the vast majority of lines
+ * without running the engine at all.
+ */
+class LineMatcher {
+private:
+  /* Literal every matching line contains, empty if unknown. */
+  std::string literal;
+  /* Whether matching lines start with the literal. */
+  bool literal_is_prefix;
+
+protected:
+  LineMatcher(const std::string &regex);
+
+  /* Runs the regex engine on the line. */
+  virtual bool full_match(const char *line, size_t len) const =0;
+
+public:
+  virtual ~LineMatcher() {}
+
+  /*
+   * Creates a matcher for the regex using the requested engine. If the
+   * engine doesn't support the regex (e.g. RE2 and backreferences), the
+   * matcher falls back to std::regex. Throws std::regex_error if the regex
+   * is invalid.
+   */
+  static std::unique_ptr<LineMatcher> create(const std::string &regex,
+      matcher_engine_t engine = default_engine());
+  static matcher_engine_t default_engine();
+  /*
+   * Extracts the longest literal that every string fully matching the regex
+   * contains. Returns an empty string if there is no such literal (e.g. due
+   * to top-level alternations) or if it can't be determined safely.
+   */
+  static std::string required_literal(const std::string &regex, bool *is_prefix);
+
+  bool matches(const char *line, size_t len) const;
+  bool matches(const std::string &line) const { return matches(line.data(), line.size()); }
+  virtual matcher_engine_t get_engine() const =0;
+};
+
+class StdRegexMatcher: public LineMatcher {
+private:
+  std::regex re;
+
+protected:
+  virtual bool full_match(const char *line, size_t len) const override;
+
+public:
+  StdRegexMatcher(const std::string &regex);
+
+  virtual matcher_engine_t get_engine() const override { return matcher_std; }
+};
+
+#ifdef WITH_RE2
+class Re2Matcher: public LineMatcher {
+private:
+  RE2 re;
+
+protected:
+  virtual bool full_match(const char *line, size_t len) const override;
+
+public:
+  Re2Matcher(const std::string &regex);
+
+  bool ok() const { return re.ok(); }
+  virtual matcher_engine_t get_engine() const override { return matcher_re2; }
+};
+#endif
+
+#endif /* PROVD_LINE_MATCHER_H_ */
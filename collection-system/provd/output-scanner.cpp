@@ -0,0 +1,88 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+
+#include "output-scanner.h"
+#include "logger.h"
+
+#define ESC 27
+
+const size_t OutputScanner::LINE_BUFFER_SIZE;
+
+OutputScanner::OutputScanner(std::shared_ptr<const LineMatcher> matcher, match_cb_t on_match) :
+    matcher { matcher },
+    on_match { on_match },
+    line_buffer(LINE_BUFFER_SIZE),
+    offset { 0 },
+    control_seq { false },
+    in_control_seq { false } {}
+
+void OutputScanner::feed(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    // bounds check
+    if (offset >= LINE_BUFFER_SIZE) {
+      LOGGER_LOG_ERROR("Found line longer than " << LINE_BUFFER_SIZE << ", resetting buffer. "
+          << "Some provenance may be lost.");
+      offset = 0;
+    }
+
+    // We're in a control sequence, fast forward to the end of it. A control
+    // sequence ends with a character between @ and ~ (e.g. A - H for cursor
+    // movements or m for colors). It may span several chunks of output.
+    if (in_control_seq) {
+      if (data[i] >= '@' && data[i] <= '~') {
+        in_control_seq = false;
+        continue;
+      }
+      if (data[i] != '\n') {
+        continue;
+      }
+      // malformed sequence, don't swallow the line break
+      in_control_seq = false;
+    }
+
+    // deal with control characters
+    if (iscntrl(data[i]) && data[i] != '\n') {
+      if (data[i] == ESC) {
+        // set state to check, whether we have a control sequence
+        control_seq = true;
+      }
+      continue;
+    }
+    if (control_seq) {
+      control_seq = false;
+      if (data[i] == '[') {
+        in_control_seq = true;
+        continue;
+      }
+    }
+
+    // copy current line content to the line buffer
+    line_buffer[offset] = data[i];
+    offset++;
+    // once we find line feed, finish the current line
+    if (data[i] == '\n') {
+      // check if the line matches, most lines don't and are never copied
+      if (matcher->matches(line_buffer.data(), offset - 1)) {
+        std::string line(line_buffer.data(), offset - 1);
+        LOGGER_LOG_DEBUG("Found match in " << line);
+        on_match(line);
+      }
+      offset = 0;
+    }
+  }
+}
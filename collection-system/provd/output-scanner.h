@@ -0,0 +1,57 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROVD_OUTPUT_SCANNER_H_
+#define PROVD_OUTPUT_SCANNER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "line-matcher.h"
+
+/**
+ * Splits the output of a traced process into lines and reports the lines
+ * that match a regex (see LineMatcher). Control characters and terminal control sequences
+ * (e.g. colors) are stripped before matching. Output can be fed in chunks
+ * of any size, incomplete lines are kept until the rest arrives.
+ */
+class OutputScanner {
+public:
+  typedef std::function<void(const std::string &line)> match_cb_t;
+
+  /* We assume a line does not contain more than 4K characters. */
+  static const size_t LINE_BUFFER_SIZE = 4096;
+
+private:
+  std::shared_ptr<const LineMatcher> matcher;
+  match_cb_t on_match;
+  /* State of the line that is currently being assembled. */
+  std::vector<char> line_buffer;
+  size_t offset;
+  /* Set after an ESC character. */
+  bool control_seq;
+  /* Set while skipping the rest of a control sequence (ESC [ ...). */
+  bool in_control_seq;
+
+public:
+  OutputScanner(std::shared_ptr<const LineMatcher> matcher, match_cb_t on_match);
+
+  void feed(const char *data, size_t len);
+};
+
+#endif /* PROVD_OUTPUT_SCANNER_H_ */
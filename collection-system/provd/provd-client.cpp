@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 #include <stdio.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <unistd.h>
@@ -26,12 +27,48 @@
 #include "provd.h"
 #include "logger.h"
 
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+
 /*------------------------------
  * ProvdClient
  *------------------------------*/
 
+const int ProvdClient::DEFAULT_NEGOTIATION_TIMEOUT_MS;
+
+/*
+ * Reads len bytes unless the peer closes the connection or doesn't send
+ * anything for timeout_ms. Returns the number of bytes read.
+ */
+static int read_with_timeout(int fd, char *buffer, int len, int timeout_ms) {
+  int bytes_read = 0;
+  while (bytes_read < len) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int rc = poll(&pfd, 1, timeout_ms);
+    if (rc < 0 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      return bytes_read;
+    }
+    if ((rc = read(fd, buffer + bytes_read, len - bytes_read)) <= 0) {
+      return bytes_read;
+    }
+    bytes_read += rc;
+  }
+  return bytes_read;
+}
+
 int ProvdClient::connect_to_server(std::string node) {
+  // TODO support custom provd port by adding a provd-consumer config
+  return connect_to_server(node, DEFAULT_PORT);
+}
+
+int ProvdClient::connect_to_server(std::string node, int port) {
   int rc;
+  this->node = node;
+  this->port = port;
   struct sockaddr_in serv_addr;
 
   if ((socket_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
@@ -40,8 +77,7 @@ int ProvdClient::connect_to_server(std::string node) {
   }
 
   serv_addr.sin_family = AF_INET;
-  // TODO support custom provd port by adding a provd-consumer config
-  serv_addr.sin_port = htons(DEFAULT_PORT);
+  serv_addr.sin_port = htons(port);
 
   // convert hostname to IP address
   char ip[100];
@@ -49,7 +85,7 @@ int ProvdClient::connect_to_server(std::string node) {
   struct in_addr **addr_list;
   if ((he = gethostbyname(node.c_str())) == NULL) {
     // get the host info
-    LOGGER_LOG_ERROR("Couldn't lookup " << node)
+    LOGGER_LOG_ERROR("Couldn't lookup " << node);
     return -1;
   }
   addr_list = (struct in_addr**) he->h_addr_list;
@@ -72,37 +108,60 @@ int ProvdClient::disconnect_from_server() {
   return close(socket_fd);
 }
 
-int ProvdClient::submit_trace_proc_request(int32_t pid, std::string regex_str) {
-  int rc = 0;
-  int16_t opcode = REQ_TRACE_PROCESS;
-
-  // send opcode
+int ProvdClient::send_trace_request(int16_t opcode, int32_t pid, int32_t flags,
+    const std::string &regex_str) {
+  // assemble the request so that it is sent with a single write
+  std::string req;
   int16_t opcode_to_send = htons(opcode);
-  char *bytes = (char*) &opcode_to_send;
-  if ((rc = NetworkHelper::write_to_socket(socket_fd, bytes, sizeof(opcode_to_send))) < 0) {
-    return rc;
-  }
+  req.append((char*) &opcode_to_send, sizeof(opcode_to_send));
 
-  // send first operand - pid
+  // first operand - pid
   int32_t operand_to_send = htonl(pid);
-  bytes = (char*) &operand_to_send;
-  if ((rc = NetworkHelper::write_to_socket(socket_fd, bytes, sizeof(operand_to_send))) < 0) {
-    return rc;
+  req.append((char*) &operand_to_send, sizeof(operand_to_send));
+
+  // requested protocol flags, only for batched requests
+  if (opcode == REQ_TRACE_PROCESS_BATCHED) {
+    int32_t flags_to_send = htonl(flags);
+    req.append((char*) &flags_to_send, sizeof(flags_to_send));
   }
 
-  // send second operand - regex
-  char *regex = (char*) regex_str.c_str();
-  // add 1 for the '\0' character
+  // second operand - regex, add 1 for the '\0' character
   int32_t len = regex_str.size() + 1;
   int32_t len_to_send = htonl(len);
-  bytes = (char*) &len_to_send;
-  if ((rc = NetworkHelper::write_to_socket(socket_fd, bytes, sizeof(len_to_send))) < 0) {
-    return rc;
-  }
-  if ((rc = NetworkHelper::write_to_socket(socket_fd, regex, len)) < 0) {
+  req.append((char*) &len_to_send, sizeof(len_to_send));
+  req.append(regex_str.c_str(), len);
+
+  int rc = NetworkHelper::write_to_socket(socket_fd, (char*) req.data(), req.size());
+  return rc < (int) req.size() ? -1 : rc;
+}
+
+int ProvdClient::submit_trace_proc_request(int32_t pid, std::string regex_str) {
+  batched = false;
+  flags = 0;
+  return send_trace_request(REQ_TRACE_PROCESS, pid, 0, regex_str);
+}
+
+int ProvdClient::submit_batched_trace_proc_request(int32_t pid, std::string regex_str,
+    int32_t flags) {
+  int rc;
+  if ((rc = send_trace_request(REQ_TRACE_PROCESS_BATCHED, pid, flags, regex_str)) < 0) {
     return rc;
   }
 
+  // the server replies with the flags it accepted, older servers close the
+  // connection or never reply
+  int32_t accepted;
+  if (read_with_timeout(socket_fd, (char*) &accepted, sizeof(accepted), negotiation_timeout_ms)
+      < (int) sizeof(accepted)) {
+    LOGGER_LOG_INFO("Server on " << node << " doesn't support batching, falling back.");
+    disconnect_from_server();
+    if ((rc = connect_to_server(node, port)) < 0) {
+      return rc;
+    }
+    return submit_trace_proc_request(pid, regex_str);
+  }
+  batched = true;
+  this->flags = ntohl(accepted) & flags;
   return rc;
 }
 
@@ -128,6 +187,19 @@ int ProvdClient::submit_stop_trace_proc_request(int32_t pid) {
 }
 
 int ProvdClient::receive_line(std::string *line) {
+  if (batched) {
+    if (received.empty()) {
+      std::vector<std::string> lines;
+      if (receive_batch(&lines) <= 0) {
+        return 0;
+      }
+      received.insert(received.end(), lines.begin(), lines.end());
+    }
+    *line = received.front();
+    received.pop_front();
+    return line->size();
+  }
+
   int32_t line_len;
   int bytes_read = NetworkHelper::read_from_socket(socket_fd, (char*) &line_len, sizeof(line_len));
   if (bytes_read == 0) {
@@ -144,6 +216,282 @@ int ProvdClient::receive_line(std::string *line) {
   return bytes_read;
 }
 
+int ProvdClient::receive_batch(std::vector<std::string> *lines) {
+  lines->clear();
+  if (!batched) {
+    std::string line;
+    if (receive_line(&line) <= 0) {
+      return 0;
+    }
+    lines->push_back(line);
+    return 1;
+  }
+
+  int32_t frame_len;
+  if (NetworkHelper::read_from_socket(socket_fd, (char*) &frame_len, sizeof(frame_len))
+      < (int) sizeof(frame_len)) {
+    return 0;
+  }
+  size_t len = ntohl(frame_len);
+  if (len < ProvdFrame::HEADER_SIZE - sizeof(frame_len)
+      || len > ProvdFrame::MAX_PAYLOAD_SIZE + ProvdFrame::HEADER_SIZE) {
+    LOGGER_LOG_ERROR("Received frame with invalid length " << len);
+    return -1;
+  }
+  std::vector<char> frame(len);
+  if (NetworkHelper::read_from_socket(socket_fd, frame.data(), len) < (int) len) {
+    return 0;
+  }
+  if (!ProvdFrame::decode(frame.data(), len, lines)) {
+    return -1;
+  }
+  return lines->size();
+}
+
+/*------------------------------
+ * ProvdFrame
+ *------------------------------*/
+
+const int32_t ProvdFrame::FLAG_LZ4;
+const size_t ProvdFrame::HEADER_SIZE;
+const size_t ProvdFrame::MAX_PAYLOAD_SIZE;
+
+/* Appends a 4-byte integer in network byte order. */
+static void append_int32(int32_t val, std::string *buffer) {
+  val = htonl(val);
+  buffer->append((char*) &val, sizeof(val));
+}
+
+/* Reads a 4-byte integer in network byte order from data. */
+static int32_t read_int32(const char *data) {
+  int32_t val;
+  memcpy(&val, data, sizeof(val));
+  return ntohl(val);
+}
+
+int32_t ProvdFrame::supported_flags() {
+#ifdef WITH_LZ4
+  return FLAG_LZ4;
+#else
+  return 0;
+#endif
+}
+
+void ProvdFrame::append_line(const std::string &line, std::string *payload) {
+  append_int32(line.size(), payload);
+  payload->append(line);
+}
+
+void ProvdFrame::encode(const std::string &payload, int32_t num_lines, int32_t flags,
+    std::string *frame) {
+  frame->clear();
+  frame->reserve(HEADER_SIZE + payload.size());
+  // the frame length is filled in once we know whether compression paid off
+  append_int32(0, frame);
+  append_int32(0, frame);
+  append_int32(num_lines, frame);
+  append_int32(payload.size(), frame);
+
+  int32_t frame_flags = 0;
+#ifdef WITH_LZ4
+  if (flags & FLAG_LZ4) {
+    int bound = LZ4_compressBound(payload.size());
+    frame->resize(HEADER_SIZE + bound);
+    int compressed = LZ4_compress_default(payload.data(), &(*frame)[HEADER_SIZE],
+        payload.size(), bound);
+    if (compressed > 0 && (size_t) compressed < payload.size()) {
+      frame->resize(HEADER_SIZE + compressed);
+      frame_flags = FLAG_LZ4;
+    } else {
+      frame->resize(HEADER_SIZE);
+    }
+  }
+#endif
+  if (!(frame_flags & FLAG_LZ4)) {
+    frame->append(payload);
+  }
+
+  int32_t len = htonl(frame->size() - sizeof(int32_t));
+  int32_t flags_to_send = htonl(frame_flags);
+  memcpy(&(*frame)[0], &len, sizeof(len));
+  memcpy(&(*frame)[sizeof(int32_t)], &flags_to_send, sizeof(flags_to_send));
+}
+
+bool ProvdFrame::decode(const char *data, size_t len, std::vector<std::string> *lines) {
+  const size_t header_size = HEADER_SIZE - sizeof(int32_t);
+  if (len < header_size) {
+    LOGGER_LOG_ERROR("Received truncated frame.");
+    return false;
+  }
+  int32_t frame_flags = read_int32(data);
+  int32_t num_lines = read_int32(data + sizeof(int32_t));
+  size_t raw_len = (uint32_t) read_int32(data + 2 * sizeof(int32_t));
+  if (num_lines < 0 || raw_len > MAX_PAYLOAD_SIZE) {
+    LOGGER_LOG_ERROR("Received frame with invalid header.");
+    return false;
+  }
+  const char *payload = data + header_size;
+  size_t payload_len = len - header_size;
+
+  std::vector<char> decompressed;
+  if (frame_flags & FLAG_LZ4) {
+#ifdef WITH_LZ4
+    decompressed.resize(raw_len);
+    int rc = LZ4_decompress_safe(payload, decompressed.data(), payload_len, raw_len);
+    if (rc < 0 || (size_t) rc != raw_len) {
+      LOGGER_LOG_ERROR("Couldn't decompress frame.");
+      return false;
+    }
+    payload = decompressed.data();
+    payload_len = raw_len;
+#else
+    LOGGER_LOG_ERROR("Received compressed frame but LZ4 is not supported.");
+    return false;
+#endif
+  } else if (payload_len != raw_len) {
+    LOGGER_LOG_ERROR("Received frame with inconsistent length.");
+    return false;
+  }
+
+  size_t pos = 0;
+  for (int32_t i = 0; i < num_lines; i++) {
+    if (payload_len - pos < sizeof(int32_t)) {
+      LOGGER_LOG_ERROR("Received frame with truncated line.");
+      return false;
+    }
+    size_t line_len = (uint32_t) read_int32(payload + pos);
+    pos += sizeof(int32_t);
+    if (payload_len - pos < line_len) {
+      LOGGER_LOG_ERROR("Received frame with truncated line.");
+      return false;
+    }
+    lines->emplace_back(payload + pos, line_len);
+    pos += line_len;
+  }
+  return true;
+}
+
+/*------------------------------
+ * ProvdLineDecoder
+ *------------------------------*/
+
+void ProvdLineDecoder::feed(const char *data, size_t len) {
+  if (pos > 0 && pos >= buffer.size() / 2) {
+    // drop the lines that have already been returned
+    buffer.erase(0, pos);
+    pos = 0;
+  }
+  buffer.append(data, len);
+}
+
+bool ProvdLineDecoder::next(std::string *line) {
+  int32_t line_len;
+  if (framed) {
+    // decode frames until we have a line or need more data
+    while (lines.empty() && !corrupt && pending() >= sizeof(line_len)) {
+      memcpy(&line_len, buffer.data() + pos, sizeof(line_len));
+      size_t len = ntohl(line_len);
+      if (len > ProvdFrame::MAX_PAYLOAD_SIZE + ProvdFrame::HEADER_SIZE) {
+        LOGGER_LOG_ERROR("Received frame with invalid length " << len);
+        corrupt = true;
+        break;
+      }
+      if (pending() < sizeof(line_len) + len) {
+        break;
+      }
+      std::vector<std::string> decoded;
+      if (!ProvdFrame::decode(buffer.data() + pos + sizeof(line_len), len, &decoded)) {
+        corrupt = true;
+        break;
+      }
+      lines.insert(lines.end(), decoded.begin(), decoded.end());
+      pos += sizeof(line_len) + len;
+    }
+    if (lines.empty()) {
+      return false;
+    }
+    *line = lines.front();
+    lines.pop_front();
+    return true;
+  }
+
+  if (corrupt || pending() < sizeof(line_len)) {
+    return false;
+  }
+  memcpy(&line_len, buffer.data() + pos, sizeof(line_len));
+  size_t len = ntohl(line_len);
+  if (len > ProvdFrame::MAX_PAYLOAD_SIZE) {
+    LOGGER_LOG_ERROR("Received line with invalid length " << len);
+    corrupt = true;
+    return false;
+  }
+  if (pending() < sizeof(line_len) + len) {
+    return false;
+  }
+  line->assign(buffer, pos + sizeof(line_len), len);
+  pos += sizeof(line_len) + len;
+  return true;
+}
+
+/*------------------------------
+ * ProvdRequestParser
+ *------------------------------*/
+
+const int32_t ProvdRequestParser::MAX_REGEX_LENGTH;
+
+/* Reads a 4-byte integer in network byte order from buffer at pos. */
+static int32_t read_int32(const std::string &buffer, size_t pos) {
+  return read_int32(buffer.data() + pos);
+}
+
+parse_rc_t ProvdRequestParser::feed(const char *data, size_t len) {
+  buffer.append(data, len);
+  if (buffer.size() < sizeof(opcode)) {
+    return parse_incomplete;
+  }
+  int16_t op;
+  memcpy(&op, buffer.data(), sizeof(op));
+  opcode = ntohs(op);
+  size_t pos = sizeof(opcode);
+
+  switch (opcode) {
+  case REQ_TRACE_PROCESS:
+  case REQ_TRACE_PROCESS_BATCHED: {
+    // pid, flags (batched only), regex length (including the terminating '\0'), regex
+    size_t num_operands = opcode == REQ_TRACE_PROCESS_BATCHED ? 3 : 2;
+    if (buffer.size() < pos + num_operands * sizeof(int32_t)) {
+      return parse_incomplete;
+    }
+    pid = read_int32(buffer, pos);
+    pos += sizeof(int32_t);
+    if (opcode == REQ_TRACE_PROCESS_BATCHED) {
+      flags = read_int32(buffer, pos);
+      pos += sizeof(int32_t);
+    }
+    int32_t regex_len = read_int32(buffer, pos);
+    if (regex_len < 0 || regex_len > MAX_REGEX_LENGTH) {
+      LOGGER_LOG_ERROR("Invalid regex length " << regex_len << " in trace request.");
+      return parse_error;
+    }
+    pos += sizeof(int32_t);
+    if (buffer.size() < pos + regex_len) {
+      return parse_incomplete;
+    }
+    regex = std::string(buffer.c_str() + pos, strnlen(buffer.c_str() + pos, regex_len));
+    return parse_complete;
+  }
+  case REQ_TRACE_PROCESS_STOP:
+    if (buffer.size() < pos + sizeof(int32_t)) {
+      return parse_incomplete;
+    }
+    pid = read_int32(buffer, pos);
+    return parse_complete;
+  default:
+    LOGGER_LOG_ERROR("Received unknown request " << opcode << ".");
+    return parse_error;
+  }
+}
+
 /*------------------------------
  * NetworkHelper
  *------------------------------*/
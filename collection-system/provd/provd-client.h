@@ -17,18 +17,146 @@
 #ifndef PROVD_PROVD_CLIENT_H_
 #define PROVD_PROVD_CLIENT_H_
 
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <vector>
 
+/**
+ * Encodes and decodes the frames of the batched protocol. After accepting a
+ * REQ_TRACE_PROCESS_BATCHED request, provd sends the matching lines in
+ * frames of many lines each. All integers are in network byte order:
+ *
+ * 4 bytes containing the length of the rest of the frame
+ * 4 bytes containing the frame flags (FLAG_LZ4 if the payload is compressed)
+ * 4 bytes containing the number of lines
+ * 4 bytes containing the uncompressed length of the payload
+ * the payload, i.e., each line as a 4-byte length followed by the line
+ *
+ * LZ4 compression is only available if built WITH_LZ4.
+ */
+class ProvdFrame {
+public:
+  static const int32_t FLAG_LZ4 = 0x1;
+  static const size_t HEADER_SIZE = 4 * sizeof(int32_t);
+  /* Upper bound for the (uncompressed) payload of a frame. */
+  static const size_t MAX_PAYLOAD_SIZE = 16 * 1024 * 1024;
+
+  /* Flags this build can handle. */
+  static int32_t supported_flags();
+  /* Appends a line to the payload of a frame. */
+  static void append_line(const std::string &line, std::string *payload);
+  /* Builds a frame, the payload is compressed if requested and it gets smaller. */
+  static void encode(const std::string &payload, int32_t num_lines, int32_t flags,
+      std::string *frame);
+  /* Decodes the rest of a frame after its length, returns false if it's malformed. */
+  static bool decode(const char *data, size_t len, std::vector<std::string> *lines);
+};
+
+/*
+ * ProvdClient is used by the consumer to submit requests to a provd server.
+ * With a plain trace request, matching lines are sent back as a 4-byte
+ * length (in network byte order) followed by the line. With a batched trace
+ * request, they are sent in frames of many lines (see ProvdFrame).
+ */
 class ProvdClient {
+public:
+  /* How long to wait for the server to accept a batched trace request. */
+  static const int DEFAULT_NEGOTIATION_TIMEOUT_MS = 5000;
+
 private:
   int socket_fd;
+  std::string node;
+  int port;
+  int negotiation_timeout_ms = DEFAULT_NEGOTIATION_TIMEOUT_MS;
+  bool batched = false;
+  int32_t flags = 0;
+  /* Lines of the last frame that haven't been returned by receive_line() yet. */
+  std::deque<std::string> received;
+
+  int send_trace_request(int16_t opcode, int32_t pid, int32_t flags, const std::string &regex_str);
 
 public:
   int connect_to_server(std::string node);
+  int connect_to_server(std::string node, int port);
   int disconnect_from_server();
   int submit_trace_proc_request(int32_t pid, std::string regex_str);
+  /*
+   * Requests the batched protocol with the given flags (e.g. ProvdFrame::FLAG_LZ4).
+   * The server replies with the flags it accepted. Servers that don't know the
+   * batched protocol close the connection or don't reply at all, in which case
+   * the client reconnects and falls back to a plain trace request.
+   */
+  int submit_batched_trace_proc_request(int32_t pid, std::string regex_str, int32_t flags);
   int submit_stop_trace_proc_request(int32_t pid);
   int receive_line(std::string *line);
+  /*
+   * Receives the next batch of lines (a single line with the plain protocol).
+   * Returns the number of lines or 0 once the server has closed the connection.
+   */
+  int receive_batch(std::vector<std::string> *lines);
+  void set_negotiation_timeout(int timeout_ms) { negotiation_timeout_ms = timeout_ms; }
+  int get_socket() const { return socket_fd; }
+  bool is_batched() const { return batched; }
+  int32_t get_flags() const { return flags; }
+};
+
+/**
+ * Assembles the length-prefixed lines or the frames sent by provd from data
+ * that arrives in arbitrary chunks, e.g. when reading from a non-blocking
+ * socket.
+ */
+class ProvdLineDecoder {
+private:
+  bool framed;
+  bool corrupt = false;
+  std::string buffer;
+  /* Start of the first line or frame in buffer that hasn't been returned yet. */
+  size_t pos = 0;
+  /* Decoded lines of the frames that haven't been returned yet. */
+  std::deque<std::string> lines;
+
+public:
+  ProvdLineDecoder(bool framed = false) : framed { framed } {}
+
+  void feed(const char *data, size_t len);
+  /* Returns false if no complete line has been received yet. */
+  bool next(std::string *line);
+  /* Number of buffered bytes that don't form a complete line yet. */
+  size_t pending() const { return buffer.size() - pos; }
+  /* Whether a malformed frame has been received, the connection should be closed. */
+  bool is_corrupt() const { return corrupt; }
+};
+
+typedef enum parse_rc {
+  parse_incomplete,
+  parse_complete,
+  /* The request is malformed, the connection should be closed. */
+  parse_error
+} parse_rc_t;
+
+/**
+ * Parses a request sent by ProvdClient from data that arrives in arbitrary
+ * chunks, so that the server can read requests from non-blocking sockets.
+ * See ProvdServer for the protocol of the individual requests.
+ */
+class ProvdRequestParser {
+public:
+  /* Upper bound for the regex of a trace request. */
+  static const int32_t MAX_REGEX_LENGTH = 64 * 1024;
+
+private:
+  std::string buffer;
+
+public:
+  int16_t opcode = 0;
+  int32_t pid = 0;
+  /* Requested protocol flags of a batched trace request. */
+  int32_t flags = 0;
+  std::string regex;
+
+  /* Appends the data and checks whether the request is complete. */
+  parse_rc_t feed(const char *data, size_t len);
 };
 
 class NetworkHelper {
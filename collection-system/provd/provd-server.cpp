@@ -0,0 +1,1022 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "provd.h"
+#include "error.h"
+#include "provd-client.h"
+#include "logger.h"
+#include "config.h"
+#include "signal-handling.h"
+
+#ifdef __linux__
+extern "C" {
+#include <libptrace_do.h>
+}
+#endif
+
+// not available on MacOS, where SIGPIPE is ignored through SO_NOSIGPIPE instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/*------------------------------
+ * ProvdServer
+ *------------------------------*/
+
+ProvdServer::ProvdServer() {
+  int enable = 1;
+
+  if ((socketfd = socket(AF_INET, SOCK_STREAM, 0)) <= 0) {
+    LOGGER_LOG_ERROR("Can't create server socket: " << strerror(errno));
+  }
+  if (setsockopt(socketfd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &enable, sizeof(enable))) {
+    LOGGER_LOG_ERROR("Can't set SO_REUSEADDR on server socket: " << strerror(errno));
+  }
+  if (fcntl(socketfd, F_SETFL, fcntl(socketfd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+    LOGGER_LOG_ERROR("Can't make server socket non-blocking: " << strerror(errno));
+  }
+
+  address.sin_family = AF_INET;
+  address.sin_port = htons((uint16_t ) std::stoi(Config::config[Config::CKEY_PROVD_PORT]));
+  address.sin_addr.s_addr = INADDR_ANY;
+
+  if (bind(socketfd, (const sockaddr*) &address, sizeof(address)) < 0) {
+    LOGGER_LOG_ERROR("Can't bind server socket: " << strerror(errno));
+  }
+
+  int num_workers = DEFAULT_WORKERS;
+  if (Config::has_conf_key(Config::CKEY_PROVD_WORKERS)) {
+    num_workers = Config::get_long(Config::CKEY_PROVD_WORKERS);
+  }
+  pool = std::unique_ptr<WorkStealingExecutor>(new WorkStealingExecutor(num_workers));
+
+  mode = capture_file;
+  if (Config::has_conf_key(Config::CKEY_PROVD_CAPTURE_MODE)) {
+    std::string m = Config::config[Config::CKEY_PROVD_CAPTURE_MODE];
+    if (m == "pipe") {
+      mode = capture_pipe;
+    } else if (m != "file") {
+      LOGGER_LOG_WARN("Unknown capture mode " << m << ", capturing output to files.");
+    }
+  }
+
+  engine = LineMatcher::default_engine();
+  if (Config::has_conf_key(Config::CKEY_PROVD_MATCHER)) {
+    std::string m = Config::config[Config::CKEY_PROVD_MATCHER];
+    if (m == "std") {
+      engine = matcher_std;
+    } else if (m == "re2") {
+      engine = matcher_re2;
+    } else {
+      LOGGER_LOG_WARN("Unknown matcher " << m << ", using the default.");
+    }
+  }
+}
+
+ProvdServer::~ProvdServer() {
+  std::map<int32_t, std::shared_ptr<TraceProcessReqHandler>> handlers;
+  {
+    std::unique_lock<std::mutex> lock(workers_mtx);
+    handlers.swap(workers);
+  }
+  LOGGER_LOG_INFO("Stopping " << handlers.size() << " handlers...");
+  for (auto &handler : handlers) {
+    handler.second->stop();
+  }
+  // handlers that are still being set up finish on their own
+  pool->stop();
+  loop.stop();
+  for (auto &conn : pending) {
+    close(conn.first);
+  }
+  close(socketfd);
+  LOGGER_LOG_INFO("All handlers finished. provd shutting down.");
+}
+
+void ProvdServer::start() {
+  if (loop.start() != NO_ERROR) {
+    LOGGER_LOG_ERROR("Couldn't start event loop, not serving any requests.");
+    return;
+  }
+  listen(socketfd, BACKLOG);
+  if (loop.add_fd(socketfd, [this]() { accept_connections(); }) != NO_ERROR) {
+    LOGGER_LOG_ERROR("Couldn't watch server socket, not serving any requests.");
+    return;
+  }
+  LOGGER_LOG_INFO("Server Listening on " << ntohs(address.sin_port));
+
+  // Server can be stopped from the outside by receiving a SIGINT/SIGTERM
+  // or by the owner of the ProvdServer object by calling stop() and setting
+  // running to false. All the work happens on the loop and the workers.
+  while (running && signal_handling::running) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  loop.remove_fd(socketfd);
+  LOGGER_LOG_INFO("Server finished, shutting down.");
+}
+
+void ProvdServer::accept_connections() {
+  int clientfd;
+  while ((clientfd = accept(socketfd, NULL, NULL)) >= 0) {
+    if (fcntl(clientfd, F_SETFL, fcntl(clientfd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+      LOGGER_LOG_ERROR("Can't make client socket non-blocking: " << strerror(errno));
+      close(clientfd);
+      continue;
+    }
+#ifdef SO_NOSIGPIPE
+    int no_sigpipe = 1;
+    setsockopt(clientfd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+    pending[clientfd] = ProvdRequestParser();
+    if (loop.add_fd(clientfd, [this, clientfd]() { read_request(clientfd); }) != NO_ERROR) {
+      close_connection(clientfd);
+    }
+  }
+  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    LOGGER_LOG_ERROR("Problems while accepting new incoming connection: " << strerror(errno));
+  }
+}
+
+void ProvdServer::close_connection(int sock) {
+  loop.remove_fd(sock);
+  pending.erase(sock);
+  close(sock);
+}
+
+void ProvdServer::read_request(int sock) {
+  auto conn = pending.find(sock);
+  if (conn == pending.end()) {
+    return;
+  }
+
+  char buffer[4096];
+  ssize_t bytes_read = read(sock, buffer, sizeof(buffer));
+  if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return;
+  }
+  if (bytes_read <= 0) {
+    LOGGER_LOG_ERROR("Connection closed before the request has been received.");
+    close_connection(sock);
+    return;
+  }
+
+  ProvdRequestParser &parser = conn->second;
+  switch (parser.feed(buffer, bytes_read)) {
+  case parse_incomplete:
+    return;
+  case parse_error:
+    close_connection(sock);
+    return;
+  case parse_complete:
+    break;
+  }
+
+  int16_t opcode = parser.opcode;
+  int32_t pid = parser.pid;
+  int32_t flags = parser.flags;
+  std::string regex_str = parser.regex;
+  loop.remove_fd(sock);
+  pending.erase(conn);
+
+  if (opcode == REQ_TRACE_PROCESS) {
+    LOGGER_LOG_INFO("Received trace process request.");
+    dispatch_trace_process_req(sock, pid, regex_str);
+  } else if (opcode == REQ_TRACE_PROCESS_BATCHED) {
+    LOGGER_LOG_INFO("Received batched trace process request.");
+    dispatch_batched_trace_process_req(sock, pid, flags, regex_str);
+  } else {
+    LOGGER_LOG_INFO("Received trace process STOP request.");
+    dispatch_trace_process_stop_req(sock, pid);
+  }
+}
+
+void ProvdServer::dispatch_batched_trace_process_req(int sock, int32_t pid, int32_t flags,
+    const std::string &regex_str) {
+  // the handler replies with the accepted flags
+  dispatch_trace_process_req(sock, pid, regex_str, true, flags & ProvdFrame::supported_flags());
+}
+
+void ProvdServer::dispatch_trace_process_req(int sock, int32_t pid,
+    const std::string &regex_str, bool batched, int32_t flags) {
+  std::shared_ptr<TraceProcessReqHandler> handler;
+  try {
+    handler = std::make_shared<TraceProcessReqHandler>(sock, pid, regex_str, &loop, pool.get(),
+        mode, batched, flags, engine);
+  } catch (const std::regex_error &e) {
+    LOGGER_LOG_ERROR("Invalid regex " << regex_str << ": " << e.what());
+    close(sock);
+    return;
+  }
+  if (batched) {
+    // the client waits for the reply before anything else
+    handler->send_accepted_flags();
+  }
+  // remove the handler once it's done unless it has been replaced in the meantime
+  std::weak_ptr<TraceProcessReqHandler> weak_handler = handler;
+  handler->set_on_finished([this, pid, weak_handler]() {
+    pool->submit([this, pid, weak_handler]() {
+      std::unique_lock<std::mutex> lock(workers_mtx);
+      auto worker = workers.find(pid);
+      if (worker != workers.end() && worker->second == weak_handler.lock()) {
+        workers.erase(worker);
+      }
+    });
+  });
+
+  std::shared_ptr<TraceProcessReqHandler> previous;
+  {
+    std::unique_lock<std::mutex> lock(workers_mtx);
+    auto worker = workers.find(pid);
+    if (worker != workers.end()) {
+      previous = worker->second;
+    }
+    workers[pid] = handler;
+  }
+  if (previous) {
+    // clean up the previous handler, restoring its output doesn't belong on the loop
+    pool->submit([previous]() { previous->stop(); });
+  }
+  pool->submit([handler]() { handler->handle(); });
+}
+
+void ProvdServer::dispatch_trace_process_stop_req(int sock, int32_t pid) {
+  std::shared_ptr<TraceProcessReqHandler> handler;
+  {
+    std::unique_lock<std::mutex> lock(workers_mtx);
+    auto worker = workers.find(pid);
+    if (worker != workers.end()) {
+      handler = worker->second;
+      workers.erase(worker);
+    }
+  }
+  if (handler) {
+    pool->submit([handler]() { handler->stop(); });
+  }
+  close(sock);
+}
+
+/*------------------------------
+ * TraceProcessReqHandler
+ *------------------------------*/
+
+const size_t TraceProcessReqHandler::MAX_BATCH_SIZE;
+const size_t TraceProcessReqHandler::MAX_PENDING_OUTPUT;
+const size_t TraceProcessReqHandler::MAX_PENDING_FORWARD;
+
+/**
+ * This method is only available on Linux and will just return
+ * on any other platform.
+ */
+void TraceProcessReqHandler::handle() {
+  LOGGER_LOG_INFO("Read pid " << tracee_pid << " and regex " << regex_str);
+  if (!running) {
+    // stopped before a worker got to it
+    finish();
+    return;
+  }
+
+#ifdef __linux__
+  if (redirect_output() != NO_ERROR) {
+    finish();
+    return;
+  }
+
+  // Now we have to read the output and look for provenance records
+  std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+  bool watching = false;
+  bool stopped;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    stopped = !running;
+    if (!stopped) {
+      if (mode == capture_pipe) {
+        watching = true;
+        for (size_t i = 0; i < streams.size(); i++) {
+          if (watch_stream(i) != NO_ERROR) {
+            watching = false;
+          }
+        }
+      } else {
+        wd = loop->add_file_watch(out_path, [self]() { self->process_new_data(); });
+        watching = wd >= 0;
+      }
+      if (watching && loop->add_fd(sock, [self]() { self->check_client(); }) != NO_ERROR) {
+        LOGGER_LOG_WARN("Can't watch client connection for pid " << tracee_pid);
+      }
+      attached = true;
+    }
+  }
+  if (stopped) {
+    // we've been stopped in the meantime
+    if (mode == capture_pipe) {
+      restore_output();
+    }
+    finish();
+    return;
+  }
+  if (!watching) {
+    stop();
+    return;
+  }
+  if (mode == capture_file) {
+    // pick up the output that has been written before the watch was added,
+    // on the loop like all other output
+    loop->post([self]() { self->process_new_data(); });
+  }
+#endif
+}
+
+#ifdef __linux__
+int TraceProcessReqHandler::redirect_output() {
+  size_t buffer_size = 1024;
+  char *buffer;
+
+  /*
+   * Here, we attach to the tracee and then allocate some memory in
+   * the tracee's address space. We copy the name of the file or pipe
+   * to which the tracee's output should be redirected to that allocated
+   * memory and then open it, dup stdout and stderr to it, and then close
+   * it again.
+   */
+  // check if the process still exists
+  if (kill(tracee_pid, 0) < 0) {
+    LOGGER_LOG_WARN("Process " << tracee_pid << " doesn't exist anymore. Not tracing.");
+    return ERROR_NO_RETRY;
+  }
+
+  struct ptrace_do *target = ptrace_do_init(tracee_pid);
+  if (!target) {
+    LOGGER_LOG_ERROR("Can't attach to process " << tracee_pid << ". Not tracing.");
+    return ERROR_NO_RETRY;
+  }
+  buffer = (char*) ptrace_do_malloc(target, buffer_size);
+  if (!buffer) {
+    LOGGER_LOG_ERROR("Can't allocate memory in process " << tracee_pid << ". Not tracing.");
+    ptrace_do_cleanup(target);
+    return ERROR_NO_RETRY;
+  }
+  int rc = mode == capture_pipe ? capture_to_pipes(target, buffer, buffer_size)
+      : capture_to_file(target, buffer, buffer_size);
+  ptrace_do_cleanup(target);
+  return rc;
+}
+
+int TraceProcessReqHandler::capture_to_file(struct ptrace_do *target, char *buffer,
+    size_t buffer_size) {
+  memset(buffer, 0, buffer_size);
+  snprintf(buffer, buffer_size, "%s-%d", tracee_out_base_path.c_str(), tracee_pid);
+  out_path = buffer;
+  void *remote_addr = ptrace_do_push_mem(target, buffer);
+  if (!remote_addr) {
+    LOGGER_LOG_ERROR("Can't pass " << out_path << " to process " << tracee_pid);
+    return ERROR_NO_RETRY;
+  }
+
+  long remote_fd = ptrace_do_syscall(target, __NR_open, (unsigned long) remote_addr,
+      O_CREAT | O_WRONLY | O_TRUNC, 0644, 0, 0, 0);
+  if (remote_fd < 0) {
+    LOGGER_LOG_ERROR("Process " << tracee_pid << " can't open " << out_path << ": "
+        << strerror(-remote_fd));
+    return ERROR_NO_RETRY;
+  }
+  long rc = ptrace_do_syscall(target, __NR_dup2, remote_fd, 1, 0, 0, 0, 0);
+  if (rc >= 0) {
+    // stdout is already redirected, so capture it even if stderr can't be
+    if ((long) ptrace_do_syscall(target, __NR_dup2, remote_fd, 2, 0, 0, 0, 0) < 0) {
+      LOGGER_LOG_WARN("Can't redirect stderr of process " << tracee_pid);
+    }
+  }
+  ptrace_do_syscall(target, __NR_close, remote_fd, 0, 0, 0, 0, 0);
+  if (rc < 0) {
+    LOGGER_LOG_ERROR("Can't redirect stdout of process " << tracee_pid << ": " << strerror(-rc));
+    unlink(out_path.c_str());
+    return ERROR_NO_RETRY;
+  }
+  return open_output_file(out_path);
+}
+
+int TraceProcessReqHandler::capture_to_pipes(struct ptrace_do *target, char *buffer,
+    size_t buffer_size) {
+  for (int target_fd : { STDOUT_FILENO, STDERR_FILENO }) {
+    // Only redirect output that can still reach its original destination,
+    // otherwise the process' output would be lost.
+    int tee_fd = open_tracee_fd(target_fd);
+    if (tee_fd < 0) {
+      LOGGER_LOG_WARN("Can't forward fd " << target_fd << " of process " << tracee_pid
+          << " to its original destination, not capturing it.");
+      continue;
+    }
+
+    // The pipe is passed to the tracee as a named pipe, which is removed as
+    // soon as the tracee has opened it. As we open it for reading first, the
+    // tracee won't block when opening it.
+    memset(buffer, 0, buffer_size);
+    snprintf(buffer, buffer_size, "%s-%d-%d", tracee_out_base_path.c_str(), tracee_pid,
+        target_fd);
+    std::string path = buffer;
+    unlink(path.c_str());
+    if (mkfifo(path.c_str(), 0600) < 0) {
+      LOGGER_LOG_ERROR("Can't create pipe " << path << ": " << strerror(errno));
+      close(tee_fd);
+      continue;
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+      LOGGER_LOG_ERROR("Can't open pipe " << path << ": " << strerror(errno));
+      unlink(path.c_str());
+      close(tee_fd);
+      continue;
+    }
+
+    void *remote_addr = ptrace_do_push_mem(target, buffer);
+    long saved_fd = -1;
+    long remote_fd = -1;
+    long rc = -1;
+    if (remote_addr) {
+      saved_fd = ptrace_do_syscall(target, __NR_dup, target_fd, 0, 0, 0, 0, 0);
+      remote_fd = ptrace_do_syscall(target, __NR_open, (unsigned long) remote_addr,
+          O_WRONLY, 0, 0, 0, 0);
+    }
+    unlink(path.c_str());
+    if (saved_fd >= 0 && remote_fd >= 0) {
+      rc = ptrace_do_syscall(target, __NR_dup2, remote_fd, target_fd, 0, 0, 0, 0);
+    }
+    if (remote_fd >= 0) {
+      ptrace_do_syscall(target, __NR_close, remote_fd, 0, 0, 0, 0, 0);
+    }
+    if (rc < 0) {
+      // the fd still points to its original destination
+      LOGGER_LOG_ERROR("Can't redirect fd " << target_fd << " of process " << tracee_pid
+          << " to pipe " << path);
+      if (saved_fd >= 0) {
+        ptrace_do_syscall(target, __NR_close, saved_fd, 0, 0, 0, 0, 0);
+      }
+      close(fd);
+      close(tee_fd);
+      continue;
+    }
+    add_pipe_stream(target_fd, fd, tee_fd, saved_fd);
+  }
+  if (streams.empty()) {
+    return ERROR_NO_RETRY;
+  }
+  LOGGER_LOG_INFO("Start reading output of " << tracee_pid << " from pipes");
+  return NO_ERROR;
+}
+
+void TraceProcessReqHandler::restore_output() {
+  bool redirected = false;
+  for (Stream &stream : streams) {
+    redirected = redirected || stream.saved_fd >= 0;
+  }
+  if (!redirected) {
+    return;
+  }
+  struct ptrace_do *target = ptrace_do_init(tracee_pid);
+  if (!target) {
+    LOGGER_LOG_ERROR("Can't restore the output of process " << tracee_pid);
+    return;
+  }
+  for (Stream &stream : streams) {
+    if (stream.saved_fd >= 0) {
+      ptrace_do_syscall(target, __NR_dup2, stream.saved_fd, stream.target_fd, 0, 0, 0, 0);
+      ptrace_do_syscall(target, __NR_close, stream.saved_fd, 0, 0, 0, 0, 0);
+      stream.saved_fd = -1;
+    }
+  }
+  ptrace_do_cleanup(target);
+}
+#endif
+
+int TraceProcessReqHandler::open_output_file(const std::string &path) {
+  out_path = path;
+  streams.emplace_back(STDOUT_FILENO, OutputScanner(matcher,
+      [this](const std::string &line) { send_line(line); }));
+  streams[0].fd = open(out_path.c_str(), O_RDONLY | O_CREAT, 0644);
+  if (streams[0].fd < 0) {
+    LOGGER_LOG_ERROR("Problems while opening file: " << out_path << " " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  LOGGER_LOG_INFO("Start reading file " << out_path);
+  return NO_ERROR;
+}
+
+void TraceProcessReqHandler::add_pipe_stream(int target_fd, int fd, int tee_fd, int saved_fd) {
+  streams.emplace_back(target_fd, OutputScanner(matcher,
+      [this](const std::string &line) { send_line(line); }));
+  Stream &stream = streams.back();
+  stream.fd = fd;
+  stream.tee_fd = tee_fd;
+  stream.saved_fd = saved_fd;
+  struct stat sb;
+  stream.tee_socket = tee_fd >= 0 && fstat(tee_fd, &sb) == 0 && S_ISSOCK(sb.st_mode);
+}
+
+int TraceProcessReqHandler::open_tracee_fd(int fd) {
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_getfd)
+  // duplicate the fd itself, which also works for sockets and shares the file offset
+  int pidfd = syscall(SYS_pidfd_open, tracee_pid, 0);
+  if (pidfd >= 0) {
+    int local = syscall(SYS_pidfd_getfd, pidfd, fd, 0);
+    close(pidfd);
+    if (local >= 0) {
+      return local;
+    }
+  }
+#endif
+  // Opening the fd through /proc creates a new file description, which only
+  // behaves the same for pipes and devices. It fails for sockets and would
+  // have its own offset for regular files.
+  std::string path = "/proc/" + std::to_string(tracee_pid) + "/fd/" + std::to_string(fd);
+  struct stat sb;
+  if (stat(path.c_str(), &sb) < 0 || !(S_ISFIFO(sb.st_mode) || S_ISCHR(sb.st_mode))) {
+    return -1;
+  }
+  return open(path.c_str(), O_WRONLY | O_APPEND);
+}
+
+void TraceProcessReqHandler::stop() {
+  bool was_attached;
+  int watch;
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!running) {
+      return;
+    }
+    running = false;
+    was_attached = attached;
+    attached = false;
+    watch = wd;
+    wd = -1;
+  }
+  if (!was_attached) {
+    // handle() is still setting up and finishes on its own
+    return;
+  }
+
+  // waits for running callbacks, no new output is read afterwards
+  loop->remove_fd(sock);
+  if (watch >= 0) {
+    loop->remove_file_watch(watch);
+  }
+  if (mode == capture_pipe) {
+    for (Stream &stream : streams) {
+      if (stream.fd >= 0) {
+        loop->remove_fd(stream.fd);
+      }
+    }
+#ifdef __linux__
+    if (!tracee_gone) {
+      restore_output();
+    }
+#endif
+  }
+  // the output is only ever sent from the loop
+  std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+  loop->post([self]() { self->drain(); });
+}
+
+void TraceProcessReqHandler::drain() {
+  bool done;
+  {
+    std::unique_lock<std::mutex> lock(read_mtx);
+    if (finished) {
+      return;
+    }
+    draining = true;
+    if (mode == capture_pipe) {
+      // forward what the tracee has written before its output was restored
+      for (size_t i = 0; i < streams.size(); i++) {
+        if (!streams[i].eof) {
+          read_stream(i);
+        }
+      }
+    }
+    // otherwise we finish once the rest has been sent
+    send_output();
+    done = all_sent();
+  }
+  if (done) {
+    finish();
+  }
+}
+
+void TraceProcessReqHandler::check_client() {
+  // the client never sends anything after its request, so the connection
+  // only becomes readable once it has been closed
+  char buffer[256];
+  ssize_t bytes_read = recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (bytes_read == 0 || (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+      && errno != EINTR)) {
+    LOGGER_LOG_INFO("Client of pid " << tracee_pid << " disconnected.");
+    // restoring the output attaches to the tracee, which doesn't belong on the loop
+    loop->remove_fd(sock);
+    std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+    pool->submit([self]() { self->stop(); });
+  }
+}
+
+void TraceProcessReqHandler::process_new_data() {
+  std::unique_lock<std::mutex> lock(read_mtx);
+  if (finished || paused) {
+    return;
+  }
+  read_stream(0);
+}
+
+void TraceProcessReqHandler::process_stream(size_t idx) {
+  bool all_closed = true;
+  {
+    std::unique_lock<std::mutex> lock(read_mtx);
+    if (finished || paused || streams[idx].eof) {
+      return;
+    }
+    if (!read_stream(idx)) {
+      streams[idx].eof = true;
+      loop->remove_fd(streams[idx].fd);
+    }
+    for (Stream &stream : streams) {
+      all_closed = all_closed && stream.eof;
+    }
+  }
+  if (all_closed) {
+    LOGGER_LOG_INFO("Process " << tracee_pid << " closed its output, stop tracing.");
+    tracee_gone = true;
+    std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+    pool->submit([self]() { self->stop(); });
+  }
+}
+
+/*
+ * Writes as much of the data as the fd takes without blocking and returns
+ * the number of bytes written or -1 on error. The fd can share its flags with
+ * the tracee, so it can't be made non-blocking. Sockets are written with
+ * MSG_DONTWAIT, other fds in chunks that fit once poll() reports them as
+ * writable.
+ */
+static ssize_t write_available(int fd, bool socket, const char *data, size_t len) {
+  size_t written = 0;
+  while (written < len) {
+    ssize_t rc;
+    if (socket) {
+      rc = send(fd, data + written, len - written, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } else {
+      pollfd pfd = { fd, POLLOUT, 0 };
+      if (poll(&pfd, 1, 0) < 0 && errno != EINTR) {
+        return -1;
+      }
+      if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+        // e.g. a pipe without readers, writing would raise SIGPIPE
+        errno = EPIPE;
+        return -1;
+      }
+      if (!(pfd.revents & POLLOUT)) {
+        break;
+      }
+      rc = write(fd, data + written, std::min<size_t>(len - written, PIPE_BUF));
+    }
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return -1;
+    }
+    written += rc;
+  }
+  return written;
+}
+
+bool TraceProcessReqHandler::read_stream(size_t idx) {
+  Stream &stream = streams[idx];
+  ssize_t bytes_read;
+  const size_t file_buffer_size = 8192;
+  char file_buffer[file_buffer_size];
+
+  while ((bytes_read = read(stream.fd, file_buffer, file_buffer_size)) > 0) {
+    forward(idx, file_buffer, bytes_read);
+    stream.scanner.feed(file_buffer, bytes_read);
+    if (!draining && is_behind()) {
+      pause_reading();
+      break;
+    }
+  }
+  if (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    LOGGER_LOG_ERROR("Problems while reading output: " << strerror(errno));
+  }
+  // everything that is available has been scanned, send the matches in one frame
+  flush_batch();
+  // a pipe without writers signals EOF, a file is just at its current end
+  return !(bytes_read == 0 && mode == capture_pipe);
+}
+
+int TraceProcessReqHandler::watch_stream(size_t idx) {
+  std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+  return loop->add_fd(streams[idx].fd, [self, idx]() { self->process_stream(idx); });
+}
+
+void TraceProcessReqHandler::pause_reading() {
+  LOGGER_LOG_DEBUG("Output of pid " << tracee_pid << " isn't taken fast enough, pausing reading it.");
+  paused = true;
+  if (mode == capture_pipe) {
+    for (Stream &stream : streams) {
+      if (!stream.eof) {
+        loop->remove_fd(stream.fd);
+      }
+    }
+  }
+}
+
+void TraceProcessReqHandler::resume_reading() {
+  paused = false;
+  if (!running) {
+    // stop() reads the rest
+    return;
+  }
+  if (mode == capture_pipe) {
+    for (size_t i = 0; i < streams.size(); i++) {
+      if (!streams[i].eof && watch_stream(i) != NO_ERROR) {
+        LOGGER_LOG_ERROR("Can't watch output of " << tracee_pid << " anymore.");
+      }
+    }
+  } else {
+    read_stream(0);
+  }
+}
+
+void TraceProcessReqHandler::send_line(const std::string &line) {
+  if (batched) {
+    ProvdFrame::append_line(line, &batch);
+    batch_lines++;
+    if (batch.size() >= MAX_BATCH_SIZE) {
+      flush_batch();
+    }
+    return;
+  }
+
+  // send matching line to client
+  int32_t len_to_send = htonl(line.size());
+  queue_output((char*) &len_to_send, sizeof(len_to_send));
+  queue_output(line.data(), line.size());
+}
+
+void TraceProcessReqHandler::flush_batch() {
+  if (batch_lines == 0) {
+    return;
+  }
+  std::string frame;
+  ProvdFrame::encode(batch, batch_lines, frame_flags, &frame);
+  queue_output(frame.data(), frame.size());
+  batch.clear();
+  batch_lines = 0;
+}
+
+void TraceProcessReqHandler::send_accepted_flags() {
+  std::unique_lock<std::mutex> lock(read_mtx);
+  int32_t accepted_to_send = htonl(frame_flags);
+  queue_output((char*) &accepted_to_send, sizeof(accepted_to_send));
+}
+
+void TraceProcessReqHandler::queue_output(const char *data, size_t len) {
+  if (client_failed) {
+    return;
+  }
+  out.append(data, len);
+  send_output();
+}
+
+bool TraceProcessReqHandler::send_output() {
+  if (client_failed) {
+    return false;
+  }
+  while (pending_output() > 0) {
+    ssize_t sent = send(sock, out.data() + out_pos, pending_output(),
+        MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      LOGGER_LOG_ERROR("Problems while sending output of " << tracee_pid << ": "
+          << strerror(errno) << ", dropping " << pending_output() << " bytes.");
+      client_failed = true;
+      out.clear();
+      out_pos = 0;
+      break;
+    }
+    out_pos += sent;
+  }
+  if (out_pos == out.size()) {
+    out.clear();
+    out_pos = 0;
+  } else if (out_pos > out.size() / 2) {
+    out.erase(0, out_pos);
+    out_pos = 0;
+  }
+
+  bool wait = pending_output() > 0;
+  if (wait != waiting_for_client) {
+    if (wait) {
+      std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+      loop->add_write_fd(sock, [self]() { self->on_client_writable(); });
+    } else {
+      loop->remove_write_fd(sock);
+    }
+    waiting_for_client = wait;
+  }
+  return !client_failed;
+}
+
+void TraceProcessReqHandler::on_client_writable() {
+  bool done;
+  {
+    std::unique_lock<std::mutex> lock(read_mtx);
+    if (finished) {
+      return;
+    }
+    send_output();
+    if (paused && all_sent()) {
+      resume_reading();
+    }
+    done = draining && all_sent();
+  }
+  if (done) {
+    finish();
+  }
+}
+
+void TraceProcessReqHandler::forward(size_t idx, const char *data, size_t len) {
+  Stream &stream = streams[idx];
+  if (stream.tee_fd < 0) {
+    return;
+  }
+  if (stream.tee_pending.empty()) {
+    // common case, the destination takes everything right away
+    ssize_t written = write_available(stream.tee_fd, stream.tee_socket, data, len);
+    if (written < 0) {
+      LOGGER_LOG_ERROR("Problems while forwarding output of " << tracee_pid << ": "
+          << strerror(errno) << ", not forwarding anymore.");
+      stop_forwarding(stream);
+      return;
+    }
+    data += written;
+    len -= written;
+  }
+  stream.tee_pending.append(data, len);
+  send_forwarded(idx);
+}
+
+void TraceProcessReqHandler::send_forwarded(size_t idx) {
+  Stream &stream = streams[idx];
+  if (stream.tee_fd < 0) {
+    return;
+  }
+  if (!stream.tee_pending.empty()) {
+    ssize_t written = write_available(stream.tee_fd, stream.tee_socket,
+        stream.tee_pending.data(), stream.tee_pending.size());
+    if (written < 0) {
+      LOGGER_LOG_ERROR("Problems while forwarding output of " << tracee_pid << ": "
+          << strerror(errno) << ", not forwarding anymore.");
+      stop_forwarding(stream);
+      return;
+    }
+    stream.tee_pending.erase(0, written);
+  }
+
+  bool wait = !stream.tee_pending.empty();
+  if (wait != stream.tee_waiting) {
+    if (!wait) {
+      loop->remove_write_fd(stream.tee_fd);
+    } else {
+      std::shared_ptr<TraceProcessReqHandler> self = shared_from_this();
+      if (loop->add_write_fd(stream.tee_fd, [self, idx]() { self->on_tee_writable(idx); })
+          != NO_ERROR) {
+        LOGGER_LOG_ERROR("Can't wait for the destination of fd " << stream.target_fd
+            << " of process " << tracee_pid << ", not forwarding anymore.");
+        stop_forwarding(stream);
+        return;
+      }
+    }
+    stream.tee_waiting = wait;
+  }
+}
+
+void TraceProcessReqHandler::stop_forwarding(Stream &stream) {
+  if (stream.tee_waiting) {
+    loop->remove_write_fd(stream.tee_fd);
+    stream.tee_waiting = false;
+  }
+  close(stream.tee_fd);
+  stream.tee_fd = -1;
+  stream.tee_pending.clear();
+}
+
+void TraceProcessReqHandler::on_tee_writable(size_t idx) {
+  bool done;
+  {
+    std::unique_lock<std::mutex> lock(read_mtx);
+    if (finished) {
+      return;
+    }
+    send_forwarded(idx);
+    if (paused && all_sent()) {
+      resume_reading();
+    }
+    done = draining && all_sent();
+  }
+  if (done) {
+    finish();
+  }
+}
+
+bool TraceProcessReqHandler::is_behind() const {
+  if (pending_output() >= MAX_PENDING_OUTPUT) {
+    return true;
+  }
+  for (const Stream &stream : streams) {
+    if (stream.tee_pending.size() >= MAX_PENDING_FORWARD) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool TraceProcessReqHandler::all_sent() const {
+  if (pending_output() > 0) {
+    return false;
+  }
+  for (const Stream &stream : streams) {
+    if (!stream.tee_pending.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TraceProcessReqHandler::finish() {
+  // the callbacks of the connection take read_mtx, so don't wait for them while holding it
+  loop->remove_fd(sock);
+  loop->remove_write_fd(sock);
+  {
+    std::unique_lock<std::mutex> lock(read_mtx);
+    if (finished) {
+      return;
+    }
+    finished = true;
+    cleanup();
+  }
+  if (on_finished) {
+    on_finished();
+  }
+}
+
+void TraceProcessReqHandler::cleanup() {
+  for (Stream &stream : streams) {
+    if (stream.fd >= 0) {
+      close(stream.fd);
+    }
+    if (stream.tee_fd >= 0) {
+      stop_forwarding(stream);
+    }
+  }
+  if (mode == capture_file && !streams.empty() && streams[0].fd >= 0) {
+    LOGGER_LOG_INFO("Stop reading file " << out_path);
+    if (remove(out_path.c_str()) != 0) {
+      LOGGER_LOG_ERROR("Problems while deleting file " << out_path << ": " << strerror(errno));
+    }
+  }
+  close(sock);
+}
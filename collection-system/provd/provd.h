@@ -19,48 +19,99 @@
 
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <thread>
+#include <atomic>
+#include <functional>
 #include <map>
-#include <regex>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <sstream>
+#include <vector>
+
+#include "event-loop.h"
+#include "executor.h"
+#include "line-matcher.h"
+#include "output-scanner.h"
+#include "provd-client.h"
 
 #define DEFAULT_PORT 7531
 #define BACKLOG 1000
+#define DEFAULT_WORKERS 4
 
 // request Types the provd server can process
 #define REQ_TRACE_PROCESS       0x0001
 #define REQ_TRACE_PROCESS_STOP  0x0002
+#define REQ_TRACE_PROCESS_BATCHED 0x0003
+
+class TraceProcessReqHandler;
+struct ptrace_do;
 
-class ReqHandler;
+typedef enum capture_mode {
+  /* Redirect the output of traced processes to a file and read it back. */
+  capture_file,
+  /* Redirect the output into pipes and forward it to its original destination. */
+  capture_pipe
+} capture_mode_t;
 
+/**
+ * The provd server. All sockets are non-blocking and served by a single
+ * event loop thread, which accepts connections, parses requests as their
+ * bytes arrive (see ProvdRequestParser), and delivers the output of the
+ * traced processes. The potentially slow parts of a request (attaching
+ * to the tracee) run on a small, bounded pool of workers so that a burst
+ * of requests can't create an unbounded number of threads.
+ */
 class ProvdServer {
 private:
-  bool running = true;
+  std::atomic<bool> running { true };
   int socketfd;
   struct sockaddr_in address;
-  std::map<int32_t, ReqHandler*> workers;
+  /* Delivers new connections, requests, and process output. */
+  EventLoop loop;
+  std::unique_ptr<WorkStealingExecutor> pool;
+  capture_mode_t mode;
+  matcher_engine_t engine;
+  /* Connections whose request hasn't been fully received yet (loop thread only). */
+  std::map<int, ProvdRequestParser> pending;
+  std::mutex workers_mtx;
+  std::map<int32_t, std::shared_ptr<TraceProcessReqHandler>> workers;
 
+  /* Accepts all pending connections and waits for their requests. */
+  void accept_connections();
+  /* Reads the available request bytes from the connection and dispatches complete requests. */
+  void read_request(int sock);
+  void close_connection(int sock);
   /*
-   * Receives and dispatches a REQ_TRACE_PROCESS request according to
-   * its protocol. The protocol is:
+   * Dispatches a REQ_TRACE_PROCESS request, whose protocol is:
    *
    * 4 bytes containing pid
    * 4 bytes containing msg length (N)
    *   (we assume that the length includes the \0 character at the end of the regex)
    * N bytes containing the regex to search for in the process' stdout
    */
-  void dispatch_trace_process_req(int sock);
+  void dispatch_trace_process_req(int sock, int32_t pid, const std::string &regex_str,
+      bool batched = false, int32_t flags = 0);
+  /*
+   * Dispatches a REQ_TRACE_PROCESS_BATCHED request, whose protocol is:
+   *
+   * 4 bytes containing pid
+   * 4 bytes containing the requested protocol flags (see ProvdFrame)
+   * 4 bytes containing msg length (N), including the \0 character
+   * N bytes containing the regex to search for in the process' stdout
+   *
+   * The server replies with 4 bytes containing the flags it accepted and
+   * afterwards sends the matching lines in frames (see ProvdFrame).
+   */
+  void dispatch_batched_trace_process_req(int sock, int32_t pid, int32_t flags,
+      const std::string &regex_str);
   /*
-   * Receives and handles a REQ_TRACE_PROCESS_STOP request according
-   * to its protocol. The protocol is:
+   * Handles a REQ_TRACE_PROCESS_STOP request, whose protocol is:
    *
    * 4 bytes containing pid
    *
-   * This function does not dispatch a thread itself but rather just send a
-   * signal to the corresponding worker thread to signal it to stop.
+   * This function doesn't dispatch any work itself but rather just signals
+   * the corresponding handler to stop.
    */
-  void dispatch_trace_process_stop_req(int sock);
+  void dispatch_trace_process_stop_req(int sock, int32_t pid);
 
 public:
   ProvdServer();
@@ -69,20 +120,16 @@ public:
   ProvdServer& operator=(const ProvdServer &x) = delete;
 
   /*
-   * Main request server loop which waits for incoming client connections,
-   * reads the request and its corresponding arguments, and dispatches a thread
-   * to handle the request.
+   * Starts serving requests on the event loop and returns once the server
+   * has been stopped through stop() or a SIGINT/SIGTERM.
    */
   void start();
   void stop() { running = false; }
 };
 
 class ReqHandler {
-private:
-  std::thread thr;
-
 protected:
-  bool running = true;
+  std::atomic<bool> running { true };
   int sock;
 
 public:
@@ -95,35 +142,193 @@ public:
   ReqHandler(int sock) : sock { sock } {}
   virtual ~ReqHandler() {}
 
+  /* Called on one of the server's workers. */
   virtual void handle() =0;
 
-  void run() { thr = std::thread(&ReqHandler::handle, this); }
-  void stop() { running = false; }
+  virtual void stop() { running = false; }
   bool is_running() { return running; }
-  std::string get_thread_id() const {
-    auto id = thr.get_id();
-    std::stringstream ss;
-    ss << id;
-    return ss.str();
-  }
-  void join() { thr.join(); }
 };
 
-class TraceProcessReqHandler: public ReqHandler {
+/**
+ * Redirects the stdout and stderr of a process and sends the lines matching
+ * the regex back to the client. The handler only sets up the redirection on
+ * a worker. Afterwards, the output is read on the server's event loop as
+ * soon as it has been written, so a traced process that doesn't write
+ * anything doesn't cost anything. The client's connection is watched as
+ * well so that the handler stops once the client disconnects.
+ *
+ * Lines for the client are queued and sent whenever the non-blocking
+ * connection is writable, so a slow client doesn't block the loop. While
+ * more than MAX_PENDING_OUTPUT bytes are queued, the output of the process
+ * isn't read, which eventually blocks the process like a full pipe would.
+ * A stopped handler finishes once the client has received everything.
+ *
+ * In capture_file mode, the output is redirected to a file, which is
+ * watched with inotify and read back. In capture_pipe mode, each stream is
+ * redirected into a pipe owned by provd. The output is scanned in memory
+ * and forwarded to the stream's original destination, so nothing is
+ * written to disk and the handler notices when the process exits. The
+ * original destinations are restored in the process when tracing stops.
+ * Forwarded output is queued the same way, reading pauses as well while
+ * more than MAX_PENDING_FORWARD bytes wait for a destination.
+ */
+class TraceProcessReqHandler: public ReqHandler,
+    public std::enable_shared_from_this<TraceProcessReqHandler> {
+public:
+  typedef std::function<void()> finished_cb_t;
+
 private:
+  /* A redirected output stream of the tracee. */
+  struct Stream {
+    /* The fd in the tracee (stdout or stderr). */
+    int target_fd;
+    /* Our end of the pipe or the output file. */
+    int fd;
+    /* Original destination of the output (capture_pipe only). */
+    int tee_fd;
+    /* Copy of the original fd in the tracee to restore it (capture_pipe only). */
+    int saved_fd;
+    /* Whether tee_fd is a socket, which can be written without blocking. */
+    bool tee_socket;
+    /* Output the original destination hasn't taken yet. */
+    std::string tee_pending;
+    /* Whether we're waiting for tee_fd to become writable. */
+    bool tee_waiting;
+    bool eof;
+    OutputScanner scanner;
+
+    Stream(int target_fd, OutputScanner scanner) : target_fd { target_fd }, fd { -1 },
+        tee_fd { -1 }, saved_fd { -1 }, tee_socket { false }, tee_waiting { false },
+        eof { false }, scanner { scanner } {}
+  };
+
   const std::string tracee_out_base_path = "/tmp/stdout";
+  /* Frames are sent once their payload reaches this size or all available output has been read. */
+  static const size_t MAX_BATCH_SIZE = 64 * 1024;
+  /* Reading the output pauses while more than this is waiting to be sent to the client. */
+  static const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+  /* Reading also pauses while more than this is waiting for a stream's original destination. */
+  static const size_t MAX_PENDING_FORWARD = 1024 * 1024;
+
   int32_t tracee_pid;
   std::string regex_str;
-  std::regex matching_str;
+  std::shared_ptr<const LineMatcher> matcher;
+  EventLoop *loop;
+  /* Runs the work that must not block the loop, e.g. restoring the tracee's output. */
+  WorkStealingExecutor *pool;
+  capture_mode_t mode;
+  std::string out_path;
+  /* Protects the fields below against concurrent stop() calls. */
+  std::mutex mtx;
+  /* Whether the output is being delivered by the loop. */
+  bool attached = false;
+  int wd = -1;
+  /* Serializes reading the output and cleaning up. */
+  std::mutex read_mtx;
+  bool finished = false;
+  /* Set once all pipes have been closed by the tracee, i.e. it has exited. */
+  std::atomic<bool> tracee_gone { false };
+  std::vector<Stream> streams;
+  finished_cb_t on_finished;
+  /* Matching lines are sent in frames (REQ_TRACE_PROCESS_BATCHED). */
+  bool batched;
+  int32_t frame_flags;
+  /* Payload of the next frame and its number of lines. */
+  std::string batch;
+  int32_t batch_lines = 0;
+  /* Output that hasn't been sent to the client yet, starting at out_pos. */
+  std::string out;
+  size_t out_pos = 0;
+  /* Whether we're waiting for the client's connection to become writable. */
+  bool waiting_for_client = false;
+  /* Set once sending to the client has failed, output is dropped afterwards. */
+  bool client_failed = false;
+  /* Whether reading the output is paused until the client has caught up. */
+  bool paused = false;
+  /* Set after stop(), the handler finishes once all output has been sent and forwarded. */
+  bool draining = false;
+
+#ifdef __linux__
+  int capture_to_file(struct ptrace_do *target, char *buffer, size_t buffer_size);
+  int capture_to_pipes(struct ptrace_do *target, char *buffer, size_t buffer_size);
+  /* Points the tracee's fds back to their original destinations. */
+  void restore_output();
+#endif
+  /*
+   * Opens the fd of the tracee for writing so that it shares the tracee's file
+   * description (and thus file offset), -1 if that isn't possible.
+   */
+  int open_tracee_fd(int fd);
+  /* Reads the new output of the process and sends matching lines to the client. */
+  void process_new_data();
+  /* Reads the pipe of the stream in capture_pipe mode. */
+  void process_stream(size_t idx);
+  /* Reads and scans all available data, returns false once the writers are gone. Requires read_mtx. */
+  bool read_stream(size_t idx);
+  /* Calls process_stream() whenever the pipe of the stream is readable. */
+  int watch_stream(size_t idx);
+  void pause_reading();
+  void resume_reading();
+  void send_line(const std::string &line);
+  /* Sends the pending lines as one frame. Requires read_mtx. */
+  void flush_batch();
+  /* Queues data for the client and sends as much as possible. Requires read_mtx. */
+  void queue_output(const char *data, size_t len);
+  /*
+   * Sends queued output without blocking and waits for the connection to
+   * become writable if some is left. Returns false if the client is gone.
+   * Requires read_mtx.
+   */
+  bool send_output();
+  size_t pending_output() const { return out.size() - out_pos; }
+  void on_client_writable();
+  /* Forwards data to the original destination of the stream. Requires read_mtx. */
+  void forward(size_t idx, const char *data, size_t len);
+  /* Forwards pending output without blocking, same as send_output(). Requires read_mtx. */
+  void send_forwarded(size_t idx);
+  void stop_forwarding(Stream &stream);
+  void on_tee_writable(size_t idx);
+  /* Whether the client or an original destination is too far behind to read more output. */
+  bool is_behind() const;
+  /* Whether all output has been sent or dropped. */
+  bool all_sent() const;
+  /* Sends the rest of the output after stop() and finishes, runs on the loop. */
+  void drain();
+  /* Stops the handler if the client has closed the connection. */
+  void check_client();
+  /* Closes the output and the client connection and notifies on_finished. */
+  void finish();
+  void cleanup();
+
+protected:
+#ifdef __linux__
+  /* Attaches to the tracee and redirects its output (see capture_mode_t). */
+  virtual int redirect_output();
+#endif
+  /* Reads the output from the file at path (capture_file mode). */
+  int open_output_file(const std::string &path);
+  /*
+   * Reads the output for target_fd from the non-blocking pipe fd and
+   * forwards it to tee_fd, if any (capture_pipe mode).
+   */
+  void add_pipe_stream(int target_fd, int fd, int tee_fd, int saved_fd = -1);
 
 public:
-  TraceProcessReqHandler(int sock, int32_t pid, std::string regexStr) :
-      ReqHandler(sock), tracee_pid { pid }, regex_str { regexStr } {
-    matching_str = std::regex(regexStr);
-  }
+  TraceProcessReqHandler(int sock, int32_t pid, std::string regexStr, EventLoop *loop,
+      WorkStealingExecutor *pool, capture_mode_t mode = capture_file, bool batched = false,
+      int32_t frame_flags = 0, matcher_engine_t engine = LineMatcher::default_engine()) :
+      ReqHandler(sock), tracee_pid { pid }, regex_str { regexStr },
+      matcher { LineMatcher::create(regexStr, engine) }, loop { loop }, pool { pool },
+      mode { mode }, batched { batched }, frame_flags { frame_flags } {}
   virtual ~TraceProcessReqHandler() {}
 
+  /* Called once the handler has finished, from whichever thread finished it. */
+  void set_on_finished(finished_cb_t cb) { on_finished = cb; }
+  /* Replies to a REQ_TRACE_PROCESS_BATCHED request with the accepted flags. */
+  void send_accepted_flags();
+
   virtual void handle() override;
+  virtual void stop() override;
 };
 
 #endif /* PROVD_PROVD_H_ */
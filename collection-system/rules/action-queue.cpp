@@ -0,0 +1,367 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "action-queue.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "error.h"
+#include "logger.h"
+
+ActionQueue::ActionQueue(size_t capacity, overflow_policy_t policy) :
+    num_wakeups { 0 },
+    coalesce_all { false },
+    debounce { 0 },
+    capacity { capacity },
+    policy { policy },
+    num_spilled { 0 },
+    num_spilling { 0 },
+    spill_fd { -1 },
+    spill_read_offset { 0 },
+    spill_write_offset { 0 },
+    dropped { nullptr },
+    coalesced { nullptr },
+    spilled { nullptr },
+    blocked_us { nullptr } {}
+
+ActionQueue::~ActionQueue() {
+  reset_spill_file();
+}
+
+void ActionQueue::configure(size_t capacity, overflow_policy_t policy) {
+  std::unique_lock<std::mutex> lock(mtx);
+  this->capacity = capacity;
+  this->policy = policy;
+}
+
+void ActionQueue::set_coalescing(bool enabled, long debounce_ms) {
+  std::unique_lock<std::mutex> lock(mtx);
+  coalesce_all = enabled;
+  debounce = std::chrono::milliseconds(debounce_ms > 0 ? debounce_ms : 0);
+}
+
+void ActionQueue::set_counters(Counter *dropped, Counter *coalesced, Counter *spilled,
+    Counter *blocked_us) {
+  this->dropped = dropped;
+  this->coalesced = coalesced;
+  this->spilled = spilled;
+  this->blocked_us = blocked_us;
+}
+
+bool ActionQueue::push(evt_t evt) {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::string key;
+  if ((coalesce_all || policy == overflow_coalesce) && coalesce_key) {
+    key = coalesce_key(*evt);
+  }
+  if (coalesce_all && !key.empty() && queued_keys.count(key)) {
+    // the queued event will catch up with this one as well
+    if (coalesced) coalesced->inc();
+    return false;
+  }
+
+  if (policy == overflow_spill && !spill_path.empty()
+      && (num_spilled || num_spilling || is_full())) {
+    // don't block the consumers while we're writing
+    num_spilling++;
+    lock.unlock();
+    int rc = spill(evt);
+    lock.lock();
+    num_spilling--;
+    if (rc == NO_ERROR) {
+      num_spilled++;
+      if (spilled) spilled->inc();
+      lock.unlock();
+      not_empty.notify_one();
+      if (listener) listener();
+      return true;
+    }
+    // fall back to blocking if we can't spill
+  }
+
+  if (is_full()) {
+    if (policy == overflow_drop) {
+      if (dropped) dropped->inc();
+      return false;
+    }
+    if (policy == overflow_coalesce && !key.empty()) {
+      auto queued = queued_keys.find(key);
+      if (queued != queued_keys.end() && queued->second > 0) {
+        if (coalesced) coalesced->inc();
+        return false;
+      }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    not_full.wait(lock, [this]() { return !is_full(); });
+    if (blocked_us) {
+      blocked_us->inc(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count());
+    }
+  }
+
+  enqueue(evt, key);
+  lock.unlock();
+  not_empty.notify_one();
+  if (listener) listener();
+  return true;
+}
+
+void ActionQueue::enqueue(const evt_t &evt, const std::string &key) {
+  if (!key.empty()) {
+    queued_keys[key]++;
+  }
+  clock_t::time_point ready = clock_t::now();
+  if (coalesce_all && !key.empty()) {
+    ready += debounce;
+  }
+  queue.push_back(Entry { evt, key, affinity_key ? affinity_key(*evt) : "", ready });
+}
+
+void ActionQueue::push_wakeup() {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    num_wakeups++;
+  }
+  not_empty.notify_one();
+}
+
+bool ActionQueue::take_ready(clock_t::time_point now, bool affinity, Entry *entry,
+    clock_t::time_point *next_ready) {
+  for (auto it = queue.begin(); it != queue.end(); ++it) {
+    if (it->ready > now) {
+      // still in its debounce window
+      *next_ready = std::min(*next_ready, it->ready);
+      continue;
+    }
+    if (affinity && !it->affinity.empty() && in_flight.count(it->affinity)) {
+      // an earlier event with the same key is still being processed
+      continue;
+    }
+    *entry = *it;
+    if (!it->key.empty()) {
+      auto queued = queued_keys.find(it->key);
+      if (--queued->second == 0) {
+        queued_keys.erase(queued);
+      }
+    }
+    queue.erase(it);
+    return true;
+  }
+  return false;
+}
+
+evt_t ActionQueue::pop() {
+  std::unique_lock<std::mutex> lock(mtx);
+  while (true) {
+    not_empty.wait(lock, [this]() {
+      return !queue.empty() || num_spilled || num_wakeups;
+    });
+
+    if (!queue.empty()) {
+      Entry entry;
+      clock_t::time_point next_ready = clock_t::time_point::max();
+      // when stopping, drain the queue without waiting for debounced entries
+      clock_t::time_point now = num_wakeups ? clock_t::time_point::max() : clock_t::now();
+      if (take_ready(now, false, &entry, &next_ready)) {
+        lock.unlock();
+        not_full.notify_one();
+        return entry.evt;
+      }
+      // everything is being debounced, wait for the first entry to become ready
+      not_empty.wait_until(lock, next_ready);
+      continue;
+    }
+    if (num_spilled) {
+      num_spilled--;
+      lock.unlock();
+      evt_t evt = read_spilled();
+      if (evt) {
+        return evt;
+      }
+      // the event couldn't be read back, try the next one
+      lock.lock();
+      continue;
+    }
+    num_wakeups--;
+    return nullptr;
+  }
+}
+
+evt_t ActionQueue::try_pop(std::string *affinity, clock_t::time_point *next_ready) {
+  std::unique_lock<std::mutex> lock(mtx);
+  *next_ready = clock_t::time_point::max();
+  while (true) {
+    Entry entry;
+    if (take_ready(clock_t::now(), true, &entry, next_ready)) {
+      if (!entry.affinity.empty()) {
+        in_flight[entry.affinity]++;
+      }
+      *affinity = entry.affinity;
+      lock.unlock();
+      not_full.notify_one();
+      return entry.evt;
+    }
+    if (!num_spilled) {
+      return nullptr;
+    }
+    // move the next spilled event to the queue so that it is subject to the affinity rules
+    num_spilled--;
+    lock.unlock();
+    evt_t evt = read_spilled();
+    lock.lock();
+    if (evt) {
+      enqueue(evt, (coalesce_all || policy == overflow_coalesce) && coalesce_key ?
+          coalesce_key(*evt) : "");
+    }
+  }
+}
+
+void ActionQueue::release(const std::string &affinity) {
+  if (affinity.empty()) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mtx);
+  auto it = in_flight.find(affinity);
+  if (it != in_flight.end() && --it->second == 0) {
+    in_flight.erase(it);
+  }
+}
+
+bool ActionQueue::has_ready() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (num_spilled) {
+    return true;
+  }
+  clock_t::time_point now = clock_t::now();
+  for (const Entry &entry : queue) {
+    if (entry.ready <= now && (entry.affinity.empty() || !in_flight.count(entry.affinity))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t ActionQueue::size() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return queue.size() + num_spilled;
+}
+
+int ActionQueue::spill(const evt_t &evt) {
+  // events are length-prefixed as their serialized form may contain newlines
+  std::string serialized = evt->serialize();
+  uint32_t len = serialized.size();
+  std::string record((const char*) &len, sizeof(len));
+  record += serialized;
+
+  std::unique_lock<std::mutex> lock(spill_mtx);
+  if (spill_fd < 0) {
+    spill_fd = open(spill_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (spill_fd < 0) {
+      LOGGER_LOG_ERROR("Couldn't open spill file " << spill_path << ": " << strerror(errno));
+      return ERROR_NO_RETRY;
+    }
+    spill_read_offset = 0;
+    spill_write_offset = 0;
+  }
+
+  // a record is written with a single call, a partial record is cut off again
+  ssize_t rc = pwrite(spill_fd, record.data(), record.size(), spill_write_offset);
+  if (rc != (ssize_t) record.size()) {
+    LOGGER_LOG_ERROR("Couldn't write to spill file " << spill_path << ": "
+        << (rc < 0 ? strerror(errno) : "short write"));
+    if (rc > 0 && ftruncate(spill_fd, spill_write_offset) != 0) {
+      LOGGER_LOG_ERROR("Couldn't truncate spill file " << spill_path << ": " << strerror(errno));
+    }
+    return ERROR_NO_RETRY;
+  }
+  spill_write_offset += record.size();
+  return NO_ERROR;
+}
+
+evt_t ActionQueue::read_spilled() {
+  std::string serialized;
+  bool ok = false;
+  {
+    std::unique_lock<std::mutex> lock(spill_mtx);
+    uint32_t len = 0;
+    uint64_t available = spill_write_offset - spill_read_offset;
+    if (spill_fd >= 0 && available >= sizeof(len)
+        && pread(spill_fd, &len, sizeof(len), spill_read_offset) == sizeof(len)
+        && len <= available - sizeof(len)) {
+      serialized.resize(len);
+      ok = pread(spill_fd, &serialized[0], len, spill_read_offset + sizeof(len))
+          == (ssize_t) len;
+      spill_read_offset += sizeof(len) + len;
+    } else {
+      // we can't find the next record, skip whatever is left
+      spill_read_offset = spill_write_offset;
+    }
+    if (spill_fd >= 0 && spill_read_offset == spill_write_offset) {
+      // everything has been read back, start over with an empty file
+      reset_spill_file();
+    }
+  }
+
+  if (!ok) {
+    LOGGER_LOG_ERROR("Couldn't read back spilled event from " << spill_path);
+    return nullptr;
+  }
+  return Event::deserialize_event(serialized);
+}
+
+void ActionQueue::reset_spill_file() {
+  if (spill_fd >= 0) {
+    close(spill_fd);
+    spill_fd = -1;
+    remove(spill_path.c_str());
+  }
+  spill_read_offset = 0;
+  spill_write_offset = 0;
+}
+
+int ActionQueue::parse_policy(const std::string &str, overflow_policy_t *policy) {
+  if (str == "block") {
+    *policy = overflow_block;
+  } else if (str == "drop") {
+    *policy = overflow_drop;
+  } else if (str == "coalesce") {
+    *policy = overflow_coalesce;
+  } else if (str == "spill") {
+    *policy = overflow_spill;
+  } else {
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+std::string ActionQueue::policy_str(overflow_policy_t policy) {
+  switch (policy) {
+  case overflow_drop:
+    return "drop";
+  case overflow_coalesce:
+    return "coalesce";
+  case overflow_spill:
+    return "spill";
+  default:
+    return "block";
+  }
+}
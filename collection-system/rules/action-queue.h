@@ -0,0 +1,190 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef RULES_ACTION_QUEUE_H_
+#define RULES_ACTION_QUEUE_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "event.h"
+#include "metrics.h"
+
+typedef enum overflow_policy {
+  /* Block the producer (the consumer's main loop) until there's room. */
+  overflow_block,
+  /* Drop the new event. */
+  overflow_drop,
+  /*
+   * Drop the new event if an equivalent event (same coalesce key) is already
+   * queued, otherwise block.
+   */
+  overflow_coalesce,
+  /* Write the new event to a spill file and read it back once there's room. */
+  overflow_spill
+} overflow_policy_t;
+
+/**
+ * The queue between the consumer and an action's consumer threads. By
+ * default, the queue is unbounded. If it has a capacity, the overflow policy
+ * defines what happens to events that are pushed while the queue is full.
+ *
+ * Once an event has been spilled, all further events are spilled as well
+ * until the spill file has been read back completely, so events are always
+ * popped in the order in which they were pushed.
+ *
+ * Independent of the capacity, a queue can coalesce all events with the same
+ * coalesce key (see set_coalescing). This is meant for actions that catch up
+ * from their last state, for which a single pending execution per target
+ * covers any number of triggers. An optional debounce window holds back new
+ * events for a while so that a burst of triggers results in one execution.
+ *
+ * Actions that run on the shared executor take events with try_pop(). Events
+ * can have an affinity key, and try_pop() skips events whose affinity key is
+ * still being processed (until release() is called for that key), so events
+ * with the same key are never processed concurrently and stay in order.
+ */
+class ActionQueue {
+public:
+  /* Returns the coalesce key of an event, an empty key means the event can't be coalesced. */
+  typedef std::function<std::string(const Event &evt)> key_fn_t;
+  typedef std::chrono::steady_clock clock_t;
+
+private:
+  struct Entry {
+    evt_t evt;
+    /* Only set if the queue coalesces events. */
+    std::string key;
+    /* Only set if the queue has an affinity key function. */
+    std::string affinity;
+    /* The entry isn't popped before this time (debounce window). */
+    clock_t::time_point ready;
+  };
+
+  std::mutex mtx;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+  std::deque<Entry> queue;
+  /* Number of queued entries per coalesce key. */
+  std::unordered_map<std::string, size_t> queued_keys;
+  bool coalesce_all;
+  std::chrono::milliseconds debounce;
+  /* Number of wake-ups (see push_wakeup) that haven't been popped yet. */
+  size_t num_wakeups;
+  size_t capacity;
+  overflow_policy_t policy;
+  key_fn_t coalesce_key;
+  key_fn_t affinity_key;
+  /* Affinity keys of events that have been taken with try_pop() but not released yet. */
+  std::unordered_map<std::string, size_t> in_flight;
+  /* Called whenever an event has been queued. */
+  std::function<void()> listener;
+
+  std::string spill_path;
+  /* Events in the spill file that haven't been claimed by a consumer yet. */
+  size_t num_spilled;
+  /* Pushes that are writing to the spill file, later pushes have to be spilled as well. */
+  size_t num_spilling;
+  /*
+   * Protects the spill file, which is read and written without holding mtx.
+   * Lock order is mtx before spill_mtx.
+   */
+  std::mutex spill_mtx;
+  int spill_fd;
+  uint64_t spill_read_offset;
+  uint64_t spill_write_offset;
+
+  Counter *dropped;
+  Counter *coalesced;
+  Counter *spilled;
+  Counter *blocked_us;
+
+  bool is_full() const { return capacity && queue.size() >= capacity; }
+  /* Appends the event to the spill file. Must be called without holding mtx. */
+  int spill(const evt_t &evt);
+  /*
+   * Reads back the next spilled event. The caller has to claim it first by
+   * decrementing num_spilled. Must be called without holding mtx.
+   */
+  evt_t read_spilled();
+  /*
+   * Removes the first entry that is ready, returns false if there is none. If
+   * affinity is set, entries whose affinity key is in flight are skipped.
+   */
+  bool take_ready(clock_t::time_point now, bool affinity, Entry *entry,
+      clock_t::time_point *next_ready);
+  void enqueue(const evt_t &evt, const std::string &key);
+  /* Closes and removes the spill file. Requires spill_mtx. */
+  void reset_spill_file();
+
+public:
+  ActionQueue(size_t capacity = 0, overflow_policy_t policy = overflow_block);
+  ~ActionQueue();
+  ActionQueue(const ActionQueue&) = delete;
+  ActionQueue& operator=(const ActionQueue&) = delete;
+
+  /* A capacity of 0 makes the queue unbounded. */
+  void configure(size_t capacity, overflow_policy_t policy);
+  void set_coalesce_key(key_fn_t fn) { coalesce_key = fn; }
+  /* Sets the affinity key of events taken with try_pop(), see the class comment. */
+  void set_affinity_key(key_fn_t fn) { affinity_key = fn; }
+  /* The listener is called (without holding the queue's lock) after an event has been queued. */
+  void set_listener(std::function<void()> fn) { listener = fn; }
+  /*
+   * If enabled, an event is dropped (and counted as coalesced) whenever an
+   * event with the same coalesce key is still queued. New events are held
+   * back for the debounce window before they can be popped.
+   */
+  void set_coalescing(bool enabled, long debounce_ms = 0);
+  void set_spill_file(const std::string &path) { spill_path = path; }
+  /* Sets the counters for events that couldn't be queued normally, any of them may be null. */
+  void set_counters(Counter *dropped, Counter *coalesced, Counter *spilled, Counter *blocked_us);
+
+  /* Returns false if the event has been dropped or coalesced. */
+  bool push(evt_t evt);
+  /* Makes a consumer waiting in pop() return nullptr, regardless of the capacity. */
+  void push_wakeup();
+  evt_t pop();
+  /*
+   * Returns the next event that is ready to be processed without blocking or
+   * nullptr if there is none. In the latter case, next_ready is set to the
+   * time at which a debounced event becomes ready (or time_point::max()).
+   * The affinity key of a returned event must be passed to release() once
+   * the event has been processed.
+   */
+  evt_t try_pop(std::string *affinity, clock_t::time_point *next_ready);
+  void release(const std::string &affinity);
+  /* Returns true if try_pop() would return an event. */
+  bool has_ready();
+  /* Number of queued events, including spilled events. */
+  size_t size();
+
+  size_t get_capacity() const { return capacity; }
+  bool is_coalescing() const { return coalesce_all; }
+  overflow_policy_t get_policy() const { return policy; }
+
+  /* Parses block, drop, coalesce, or spill. */
+  static int parse_policy(const std::string &str, overflow_policy_t *policy);
+  static std::string policy_str(overflow_policy_t policy);
+};
+
+#endif /* RULES_ACTION_QUEUE_H_ */
@@ -15,9 +15,26 @@
  */
 
 #include "action-state.h"
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "config.h"
 #include "error.h"
 #include "logger.h"
 
+const long StateCheckpointer::DEFAULT_INTERVAL_MS;
+const size_t StateCheckpointer::DEFAULT_MAX_DIRTY;
+
+/* Size of the state buffers the actions pass to lookup_state. */
+static const size_t STATE_BUFFER_SIZE = 1024;
+
 /*------------------------------
  * FileStateBackend
  *------------------------------*/
@@ -113,3 +130,395 @@ int DBStateBackend::lookup_state(char *state_buffer, std::string rule_id, std::s
   else
     return ERROR_NO_RETRY;
 }
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+static int write_fully(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t rc = write(fd, data.data() + written, data.size() - written);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return ERROR_NO_RETRY;
+    }
+    written += rc;
+  }
+  return NO_ERROR;
+}
+
+/**
+ * Write-ahead file entries are '<rule len> <target len> <state len> <rule><target><state>\n'
+ * so that targets (e.g. paths) can contain any character.
+ */
+static std::string wal_entry(const std::string &rule_id, const std::string &target,
+    const std::string &state) {
+  return std::to_string(rule_id.size()) + " " + std::to_string(target.size()) + " "
+      + std::to_string(state.size()) + " " + rule_id + target + state + "\n";
+}
+
+/**
+ * Parses the entry at pos and advances pos. Returns false at the end of the file
+ * or if the entry is incomplete, e.g. because we crashed while appending it.
+ */
+static bool parse_wal_entry(const std::string &data, size_t *pos, std::string *rule_id,
+    std::string *target, std::string *state) {
+  size_t rule_len, target_len, state_len;
+  int header_len;
+  if (sscanf(data.c_str() + *pos, "%zu %zu %zu %n", &rule_len, &target_len, &state_len,
+      &header_len) != 3) {
+    return false;
+  }
+  size_t start = *pos + header_len;
+  size_t end = start + rule_len + target_len + state_len;
+  if (end >= data.size() || data[end] != '\n') {
+    return false;
+  }
+  *rule_id = data.substr(start, rule_len);
+  *target = data.substr(start + rule_len, target_len);
+  *state = data.substr(start + rule_len + target_len, state_len);
+  *pos = end + 1;
+  return true;
+}
+
+/*------------------------------
+ * StateCheckpointer
+ *------------------------------*/
+
+StateCheckpointer::StateCheckpointer(const std::string &wal_path, long interval_ms,
+    size_t max_dirty) :
+    wal_path { wal_path },
+    wal_fd { -1 },
+    interval_ms { interval_ms > 0 ? interval_ms : DEFAULT_INTERVAL_MS },
+    max_dirty { max_dirty > 0 ? max_dirty : 1 },
+    running { false } {}
+
+StateCheckpointer::~StateCheckpointer() {
+  stop();
+  if (wal_fd >= 0) {
+    close(wal_fd);
+  }
+}
+
+int StateCheckpointer::start() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (running) {
+    return NO_ERROR;
+  }
+  if (recover() != NO_ERROR || compact_wal() != NO_ERROR) {
+    return ERROR_NO_RETRY;
+  }
+  running = true;
+  flusher = std::thread(&StateCheckpointer::run_flusher, this);
+  return NO_ERROR;
+}
+
+void StateCheckpointer::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!running) {
+      return;
+    }
+    running = false;
+  }
+  dirty_cv.notify_all();
+  flusher.join();
+  flush();
+}
+
+int StateCheckpointer::recover() {
+  std::ifstream in(wal_path, std::ios::binary);
+  if (!in) {
+    // nothing to recover
+    return NO_ERROR;
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string data = ss.str();
+
+  size_t pos = 0;
+  std::string rule_id, target, state;
+  while (parse_wal_entry(data, &pos, &rule_id, &target, &state)) {
+    recovered[std::make_pair(rule_id, target)] = state;
+  }
+  if (pos < data.size()) {
+    LOGGER_LOG_WARN("Ignoring " << data.size() - pos << " incomplete bytes at the end of "
+        << wal_path);
+  }
+  if (!recovered.empty()) {
+    LOGGER_LOG_INFO("Recovered " << recovered.size() << " action states from " << wal_path);
+  }
+  return NO_ERROR;
+}
+
+int StateCheckpointer::append_to_wal(const std::string &rule_id, const std::string &target,
+    const std::string &state) {
+  if (wal_fd < 0 || write_fully(wal_fd, wal_entry(rule_id, target, state)) != NO_ERROR
+      || fdatasync(wal_fd) != 0) {
+    LOGGER_LOG_ERROR("Can't append to " << wal_path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+int StateCheckpointer::compact_wal() {
+  std::string data;
+  for (const auto &entry : recovered) {
+    data += wal_entry(entry.first.first, entry.first.second, entry.second);
+  }
+  for (const auto &entry : dirty) {
+    data += wal_entry(std::get<1>(entry.first), std::get<2>(entry.first), entry.second);
+  }
+
+  // replace the file atomically so that we always have either the old or the new entries
+  std::string tmp_path = wal_path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0 || write_fully(fd, data) != NO_ERROR || fsync(fd) != 0) {
+    LOGGER_LOG_ERROR("Can't write " << tmp_path << ": " << strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return ERROR_NO_RETRY;
+  }
+  close(fd);
+  if (rename(tmp_path.c_str(), wal_path.c_str()) != 0) {
+    LOGGER_LOG_ERROR("Can't replace " << wal_path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  std::vector<char> dir_path(wal_path.begin(), wal_path.end());
+  dir_path.push_back('\0');
+  int dir_fd = open(dirname(dir_path.data()), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd >= 0) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+
+  if (wal_fd >= 0) {
+    close(wal_fd);
+  }
+  wal_fd = open(wal_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (wal_fd < 0) {
+    LOGGER_LOG_ERROR("Can't open " << wal_path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+int StateCheckpointer::update(CheckpointedStateBackend *backend, const std::string &rule_id,
+    const std::string &target, const std::string &state) {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (append_to_wal(rule_id, target, state) != NO_ERROR) {
+    return ERROR_NO_RETRY;
+  }
+  dirty[std::make_tuple(backend, rule_id, target)] = state;
+  recovered.erase(std::make_pair(rule_id, target));
+  if (dirty.size() >= max_dirty) {
+    dirty_cv.notify_one();
+  }
+  return NO_ERROR;
+}
+
+bool StateCheckpointer::lookup(CheckpointedStateBackend *backend, const std::string &rule_id,
+    const std::string &target, std::string *state) {
+  std::unique_lock<std::mutex> lock(mtx);
+  dirty_key_t key = std::make_tuple(backend, rule_id, target);
+  auto entry = dirty.find(key);
+  if (entry != dirty.end()) {
+    *state = entry->second;
+    return true;
+  }
+  // the backend may not have the state of the current checkpoint yet
+  entry = in_flight.find(key);
+  if (entry != in_flight.end()) {
+    *state = entry->second;
+    return true;
+  }
+  auto recovered_entry = recovered.find(std::make_pair(rule_id, target));
+  if (recovered_entry != recovered.end()) {
+    // the backend may have older state, write the recovered state with the next checkpoint
+    *state = recovered_entry->second;
+    dirty[std::make_tuple(backend, rule_id, target)] = *state;
+    recovered.erase(recovered_entry);
+    return true;
+  }
+  return false;
+}
+
+int StateCheckpointer::write_checkpoint(CheckpointedStateBackend *backend) {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!backend) {
+      in_flight.swap(dirty);
+    } else {
+      for (auto entry = dirty.begin(); entry != dirty.end();) {
+        if (std::get<0>(entry->first) == backend) {
+          in_flight.insert(*entry);
+          entry = dirty.erase(entry);
+        } else {
+          entry++;
+        }
+      }
+    }
+    if (in_flight.empty()) {
+      return NO_ERROR;
+    }
+  }
+
+  // only the latest state of each entry is written. in_flight is only changed
+  // here (under flush_mtx), so it can be read without mtx while lookups read it.
+  int rc = NO_ERROR;
+  std::map<dirty_key_t, std::string> failed;
+  for (const auto &entry : in_flight) {
+    if (std::get<0>(entry.first)->write_state(std::get<1>(entry.first), entry.second,
+        std::get<2>(entry.first)) != NO_ERROR) {
+      failed.insert(entry);
+      rc = ERROR_NO_RETRY;
+    }
+  }
+  LOGGER_LOG_DEBUG("Wrote checkpoint of " << in_flight.size() - failed.size()
+      << " action states, " << failed.size() << " failed");
+
+  std::unique_lock<std::mutex> lock(mtx);
+  in_flight.clear();
+  // retry failed entries with the next checkpoint unless they've been updated in the meantime
+  dirty.insert(failed.begin(), failed.end());
+  compact_wal();
+  return rc;
+}
+
+int StateCheckpointer::flush() {
+  std::unique_lock<std::mutex> lock(flush_mtx);
+  return write_checkpoint();
+}
+
+void StateCheckpointer::remove(CheckpointedStateBackend *backend) {
+  std::unique_lock<std::mutex> flush_lock(flush_mtx);
+  if (write_checkpoint(backend) != NO_ERROR) {
+    LOGGER_LOG_WARN("Couldn't write all state before the action was removed, keeping it in "
+        << wal_path << " until the next start.");
+  }
+
+  // keep entries that couldn't be written in the write-ahead file
+  std::unique_lock<std::mutex> lock(mtx);
+  for (auto entry = dirty.begin(); entry != dirty.end();) {
+    if (std::get<0>(entry->first) == backend) {
+      recovered[std::make_pair(std::get<1>(entry->first), std::get<2>(entry->first))] =
+          entry->second;
+      entry = dirty.erase(entry);
+    } else {
+      entry++;
+    }
+  }
+}
+
+size_t StateCheckpointer::get_num_dirty() {
+  std::unique_lock<std::mutex> lock(mtx);
+  return dirty.size();
+}
+
+void StateCheckpointer::run_flusher() {
+  std::unique_lock<std::mutex> lock(mtx);
+  while (running) {
+    dirty_cv.wait_for(lock, std::chrono::milliseconds(interval_ms),
+        [this] { return !running || dirty.size() >= max_dirty; });
+    if (!running) {
+      return;
+    }
+    lock.unlock();
+    int rc = flush();
+    lock.lock();
+    if (rc != NO_ERROR) {
+      // don't retry right away if the backend is down
+      dirty_cv.wait_for(lock, std::chrono::milliseconds(interval_ms),
+          [this] { return !running; });
+    }
+  }
+}
+
+/*------------------------------
+ * CheckpointedStateBackend
+ *------------------------------*/
+
+CheckpointedStateBackend::CheckpointedStateBackend(std::unique_ptr<ActionStateBackend> backend,
+    StateCheckpointer &checkpointer) :
+    backend { std::move(backend) },
+    checkpointer (checkpointer) {}
+
+int CheckpointedStateBackend::connect() {
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->connect();
+}
+
+int CheckpointedStateBackend::disconnect() {
+  checkpointer.remove(this);
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->disconnect();
+}
+
+int CheckpointedStateBackend::insert_state(std::string rule_id, std::string state,
+    std::string target) {
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->insert_state(rule_id, state, target);
+}
+
+int CheckpointedStateBackend::update_state(std::string rule_id, std::string state,
+    std::string target) {
+  if (checkpointer.update(this, rule_id, target, state) == NO_ERROR) {
+    return NO_ERROR;
+  }
+  LOGGER_LOG_WARN("Can't checkpoint state of rule " << rule_id << ", writing it directly.");
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->update_state(rule_id, state, target);
+}
+
+int CheckpointedStateBackend::lookup_state(char *state_buffer, std::string rule_id,
+    std::string target) {
+  std::string state;
+  if (checkpointer.lookup(this, rule_id, target, &state)) {
+    size_t len = state.copy(state_buffer, STATE_BUFFER_SIZE - 1);
+    state_buffer[len] = '\0';
+    return NO_ERROR;
+  }
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->lookup_state(state_buffer, rule_id, target);
+}
+
+int CheckpointedStateBackend::write_state(const std::string &rule_id, const std::string &state,
+    const std::string &target) {
+  std::unique_lock<std::mutex> lock(backend_mtx);
+  return backend->update_state(rule_id, state, target);
+}
+
+/*------------------------------
+ * Shared checkpointer
+ *------------------------------*/
+
+static std::unique_ptr<StateCheckpointer> create_state_checkpointer() {
+  if (!Config::has_conf_key(Config::CKEY_STATE_CHECKPOINT_FILE)) {
+    return nullptr;
+  }
+  std::string path = Config::config[Config::CKEY_STATE_CHECKPOINT_FILE];
+  long interval_ms = Config::has_conf_key(Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS) ?
+      Config::get_long(Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS) :
+      StateCheckpointer::DEFAULT_INTERVAL_MS;
+  long max_dirty = Config::has_conf_key(Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY) ?
+      Config::get_long(Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY) :
+      StateCheckpointer::DEFAULT_MAX_DIRTY;
+
+  std::unique_ptr<StateCheckpointer> checkpointer =
+      std::make_unique<StateCheckpointer>(path, interval_ms, max_dirty);
+  if (checkpointer->start() != NO_ERROR) {
+    LOGGER_LOG_ERROR("Can't use " << path << " for state checkpoints, action state is "
+        << "written to the backends directly.");
+    return nullptr;
+  }
+  return checkpointer;
+}
+
+StateCheckpointer* state_checkpointer() {
+  static std::unique_ptr<StateCheckpointer> checkpointer = create_state_checkpointer();
+  return checkpointer.get();
+}
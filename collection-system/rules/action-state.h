@@ -17,8 +17,13 @@
 #ifndef RULES_ACTION_STATE_H_
 #define RULES_ACTION_STATE_H_
 
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <fstream>
 
 #include "db-connector.h"
@@ -105,4 +110,121 @@ public:
       std::string target = "") override;
 };
 
+class CheckpointedStateBackend;
+
+/**
+ * Checkpoints the state of actions asynchronously. Instead of writing every
+ * state update to the backend right away (which, with a DBStateBackend, is a
+ * round-trip to the database for every execution), updates are appended to a
+ * local write-ahead file, which is synced before the update returns, and only
+ * the latest state per rule and target is written to the backends. This
+ * happens on a background thread after the checkpoint interval or once the
+ * number of dirty entries reaches a threshold, whichever comes first.
+ *
+ * On start, the write-ahead file is replayed and the recovered state is
+ * returned by lookups (and written to the backends) before the state stored
+ * in the backends, so no update is lost if the consumer crashes between two
+ * checkpoints. Once all dirty entries have been written, the write-ahead file
+ * is compacted to the entries that are still pending.
+ */
+class StateCheckpointer {
+public:
+  static const long DEFAULT_INTERVAL_MS = 1000;
+  static const size_t DEFAULT_MAX_DIRTY = 128;
+
+private:
+  /* Dirty state per backend, rule, and target. */
+  typedef std::tuple<CheckpointedStateBackend*, std::string, std::string> dirty_key_t;
+  /* Recovered state per rule and target. */
+  typedef std::pair<std::string, std::string> recovered_key_t;
+
+  std::string wal_path;
+  int wal_fd;
+  long interval_ms;
+  size_t max_dirty;
+
+  /* Protects the fields below and the write-ahead file. */
+  std::mutex mtx;
+  std::condition_variable dirty_cv;
+  std::map<dirty_key_t, std::string> dirty;
+  /* Entries taken from dirty that are being written to the backends. */
+  std::map<dirty_key_t, std::string> in_flight;
+  /* State from the write-ahead file that hasn't been looked up by an action yet. */
+  std::map<recovered_key_t, std::string> recovered;
+  bool running;
+  std::thread flusher;
+  /* Serializes writing checkpoints and removing backends. */
+  std::mutex flush_mtx;
+
+  int recover();
+  int append_to_wal(const std::string &rule_id, const std::string &target,
+      const std::string &state);
+  /* Rewrites the write-ahead file with the pending entries. Requires mtx. */
+  int compact_wal();
+  /* Writes the dirty entries (of a single backend if specified). Requires flush_mtx. */
+  int write_checkpoint(CheckpointedStateBackend *backend = nullptr);
+  void run_flusher();
+
+public:
+  StateCheckpointer(const std::string &wal_path, long interval_ms = DEFAULT_INTERVAL_MS,
+      size_t max_dirty = DEFAULT_MAX_DIRTY);
+  ~StateCheckpointer();
+  StateCheckpointer(const StateCheckpointer&) = delete;
+  StateCheckpointer& operator=(const StateCheckpointer&) = delete;
+
+  /* Replays the write-ahead file and starts the background thread. */
+  int start();
+  /* Writes all dirty entries to the backends and stops the background thread. */
+  void stop();
+  /* Makes the update durable in the write-ahead file and marks it dirty. */
+  int update(CheckpointedStateBackend *backend, const std::string &rule_id,
+      const std::string &target, const std::string &state);
+  /* Looks up state that hasn't been written to the backend yet. */
+  bool lookup(CheckpointedStateBackend *backend, const std::string &rule_id,
+      const std::string &target, std::string *state);
+  /* Writes all dirty entries to the backends. */
+  int flush();
+  /* Writes the dirty entries of the backend, which isn't used afterwards. */
+  void remove(CheckpointedStateBackend *backend);
+  size_t get_num_dirty();
+};
+
+/**
+ * Wraps the state backend of an action so that state updates go through the
+ * StateCheckpointer. Inserts and lookups of state that has already been
+ * checkpointed are passed through to the wrapped backend.
+ */
+class CheckpointedStateBackend: public ActionStateBackend {
+private:
+  std::unique_ptr<ActionStateBackend> backend;
+  StateCheckpointer &checkpointer;
+  /* The wrapped backend is used by the action and the checkpointer. */
+  std::mutex backend_mtx;
+
+public:
+  CheckpointedStateBackend(std::unique_ptr<ActionStateBackend> backend,
+      StateCheckpointer &checkpointer);
+  virtual ~CheckpointedStateBackend() {}
+
+  virtual int connect() override;
+  /* Writes the pending state before disconnecting. */
+  virtual int disconnect() override;
+  virtual int insert_state(std::string rule_id, std::string state,
+      std::string target = "") override;
+  virtual int update_state(std::string rule_id, std::string state,
+      std::string target = "") override;
+  virtual int lookup_state(char *state_buffer, std::string rule_id,
+      std::string target = "") override;
+  /* Writes a checkpoint to the wrapped backend, called by the checkpointer. */
+  int write_state(const std::string &rule_id, const std::string &state,
+      const std::string &target);
+};
+
+/*
+ * Returns the checkpointer shared by all actions, or nullptr if state is
+ * written to the backends synchronously (state-checkpoint-file is not set or
+ * the write-ahead file can't be opened). It is created on first use.
+ */
+StateCheckpointer* state_checkpointer();
+
 #endif /* RULES_ACTION_STATE_H_ */
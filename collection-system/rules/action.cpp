@@ -14,119 +14,76 @@
  * limitations under the License.
  */
 
-#include <ctime>
 #include <chrono>
+#include <sstream>
 
 #include "action.h"
+#include "config.h"
 #include "db-output-stream.h"
+#include "executor.h"
+#include "timestamp.h"
 
 /*------------------------------
- * Helper functions
+ * Action
  *------------------------------*/
 
-/**
- * Convert a date field by adding the specified time offset.
- *
- * TODO make data format configurable
- * At the moment we're assuming a fixed date format
- * of 'YYYY-mm-dd HH:MM:SS'.
- */
-std::string convert_date_field(std::string date, LogLoadField *field) {
-  // convert string to struct tm
-  struct tm tm;
-  strptime(date.c_str(), DATE_FORMAT.c_str(), &tm);
-  // check if we moved to a new day
-  if (tm.tm_hour + field->get_timeoffset() >= 24) {
-    // TODO Make conversion more robust (using, e.g., external library or <ctime> tools)
-    // Currently, this doesn't work for many corner cases, e.g. months breaks, leap years, etc.
-    tm.tm_mday = tm.tm_mday + 1;
-  }
-  tm.tm_hour = (tm.tm_hour + field->get_timeoffset()) % 24;
-  // convert new date back to string
-  char new_date[32];
-  strftime(new_date, sizeof(new_date), "%Y-%m-%d %H:%M:%S", &tm);
-  return std::string(new_date);
-}
+const int Action::DRAIN_BATCH_SIZE;
 
-/**
- * Helper function to extract a record from a line based on a specified
- * delimiter and a set of LogLoadFields.
- */
-std::string extract_record_from_line(std::string line, std::string delimiter,
-    std::vector<LogLoadField*> fields, evt_t msg) {
-  size_t pos = 0;
-  std::stringstream record;
-  std::string token;
-  std::vector<std::string> tokens;
-
-  while ((pos = line.find(delimiter)) != std::string::npos) {
-    token = line.substr(0, pos);
-    tokens.push_back(token);
-    line.erase(0, pos + delimiter.length());
+std::unique_ptr<Action> Action::parse_action(std::string action) {
+  // the queue settings from the config apply unless the action has a QUEUE clause
+  size_t capacity = 0;
+  overflow_policy_t policy = overflow_block;
+  if (Config::has_conf_key(Config::CKEY_ACTION_QUEUE_CAPACITY)) {
+    capacity = Config::get_long(Config::CKEY_ACTION_QUEUE_CAPACITY);
   }
-  tokens.push_back(line);
-
-  // TODO add range check on fieldIDs and tokens
-  for (unsigned int k = 0; k < fields.size(); k++) {
-    LogLoadField *field = fields.at(k);
-    if (field->is_range_field()) {
-      std::string field_value;
-      int parse_until = field->get_until_field_id() == -1 ?
-              tokens.size() - 1 : field->get_until_field_id();
-
-      for (int j = field->get_field_id(); j <= parse_until; j++) {
-        field_value += tokens.at(j) + ((j == parse_until) ? "" : " ");
-      }
-
-      if (field->is_timestamp_field()) {
-        record << convert_date_field(field_value, field);
-      } else {
-        record << field_value;
-      }
-      record << ((k == fields.size() - 1) ? "" : ",");
-    } else if (field->is_event_field()) {
-      std::string event_field_val = msg->get_value(field->get_field_name());
-      record << event_field_val << ((k == fields.size() - 1) ? "" : ",");
-    } else if (field->is_composite_field()) {
-      std::vector<int> ids = field->get_field_ids();
-      for (unsigned int j = 0; j < ids.size(); j++) {
-        record << tokens.at(ids.at(j));
-      }
-      record << ",";
-    } else {
-      if (field->is_timestamp_field()) {
-        record << convert_date_field(tokens.at(field->get_field_id()), field)
-            << ((k == fields.size() - 1) ? "" : ",");
-      } else {
-        record << tokens.at(field->get_field_id())
-            << ((k == fields.size() - 1) ? "" : ",");
+  if (Config::has_conf_key(Config::CKEY_ACTION_QUEUE_POLICY) && ActionQueue::parse_policy(
+      Config::config[Config::CKEY_ACTION_QUEUE_POLICY], &policy) != NO_ERROR) {
+    LOGGER_LOG_WARN("Unknown " << Config::CKEY_ACTION_QUEUE_POLICY << " "
+        << Config::config[Config::CKEY_ACTION_QUEUE_POLICY] << ", blocking on full queues.");
+  }
+  // the clause has to end the action, " QUEUE " elsewhere (e.g. in a regex or path) is
+  // part of the action
+  size_t queue_pos = action.rfind(QUEUE_CLAUSE);
+  if (queue_pos != std::string::npos) {
+    std::istringstream clause(action.substr(queue_pos + QUEUE_CLAUSE.size()));
+    std::string capacity_str, policy_str, rest;
+    if ((clause >> capacity_str >> policy_str) && !(clause >> rest) && !capacity_str.empty()
+        && capacity_str.size() <= 18
+        && capacity_str.find_first_not_of("0123456789") == std::string::npos) {
+      if (ActionQueue::parse_policy(policy_str, &policy) != NO_ERROR) {
+        LOGGER_LOG_ERROR("Invalid QUEUE clause in action " << action);
+        throw std::invalid_argument(action + " has an invalid QUEUE clause.");
       }
+      capacity = std::stol(capacity_str);
+      action = action.substr(0, queue_pos);
     }
   }
 
-  return record.str();
-}
-
-/*------------------------------
- * Action
- *------------------------------*/
-
-std::unique_ptr<Action> Action::parse_action(std::string action) {
   try {
+    std::unique_ptr<Action> a;
     if (action.substr(0, 6) == DB_LOAD_RULE) {
-      return std::make_unique<DBLoadAction>(action);
+      a = std::make_unique<DBLoadAction>(action);
     } else if (action.substr(0, 10) == DB_TRANSFER_RULE) {
-      return std::make_unique<DBTransferAction>(action);
+      a = std::make_unique<DBTransferAction>(action);
     } else if (action.substr(0, 7) == LOG_LOAD_RULE) {
-      return std::make_unique<LogLoadAction>(action);
+      a = std::make_unique<LogLoadAction>(action);
     } else if (action.substr(0, 5) == TRACK_RULE) {
-      return std::make_unique<TrackAction>(action);
+      a = std::make_unique<TrackAction>(action);
     } else if (action.substr(0, 11) == CAPTURESOUT_RULE) {
-      return std::make_unique<StdoutCaptureAction>(action);
+      a = std::make_unique<StdoutCaptureAction>(action);
     } else {
       LOGGER_LOG_WARN("No action matched for provided action " << action);
       return nullptr;
     }
+    a->action_queue->configure(capacity, policy);
+    if (a->is_idempotent()) {
+      bool coalesce = !Config::has_conf_key(Config::CKEY_ACTION_COALESCE)
+          || Config::get_bool(Config::config[Config::CKEY_ACTION_COALESCE]);
+      long debounce_ms = Config::has_conf_key(Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS) ?
+          Config::get_long(Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS) : 0;
+      a->action_queue->set_coalescing(coalesce, debounce_ms);
+    }
+    return a;
   } catch (const std::invalid_argument &e) {
     throw;
   } catch (const DBConnectionException &e) {
@@ -139,37 +96,103 @@ void Action::run_consumer() {
     LOGGER_LOG_DEBUG(rule_id << " - waiting for action to consume");
     evt_t msg = action_queue->pop();
     if (msg) {
-      LOGGER_LOG_DEBUG(rule_id << " - Received new message, executing action");
+      run_event(msg);
+    }
+  }
+
+  LOGGER_LOG_INFO(rule_id << " - finished");
+}
+
+void Action::run_event(evt_t msg) {
+  LOGGER_LOG_DEBUG(rule_id << " - Received new message, executing action");
 #ifdef PERF
-      std::string val = msg->get_value("eventTime");
-      LOGGER_LOG_DEBUG("Got event time " << val);
-
-      // extract milliseconds from time
-      size_t dot_pos = val.find(".", 0);
-      std::string time_no_millis = val.substr(0, dot_pos);
-      int millis = std::stoi(val.substr(dot_pos + 1, 3));
-
-      // convert to timestamp
-      std::tm t = { 0 };
-      std::istringstream ss(time_no_millis);
-      ss >> std::get_time(&t, "%Y-%m-%d %H:%M:%S");
-      time_t timestamp = std::mktime(&t);
-      long timestamp_millis = timestamp * 1000 + millis;
-
-      // get current timestamp
-      long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-          std::chrono::system_clock::now().time_since_epoch()).count();
-      LOGGER_LOG_DEBUG("Got current time " << ms);
-
-      // compute difference and log it
-      long lat = ms - timestamp_millis;
-      LOGGER_LOG_PERF("Rulelatency: " << lat);
+  std::string val = msg->get_value("eventTime");
+  LOGGER_LOG_DEBUG("Got event time " << val);
+
+  // convert to timestamp, event times are in UTC
+  int64_t timestamp_millis = 0;
+  Timestamp::parse_utc(val.data(), val.size(), &timestamp_millis);
+
+  // get current timestamp
+  long ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  LOGGER_LOG_DEBUG("Got current time " << ms);
+
+  // compute difference and log it
+  long lat = ms - timestamp_millis;
+  LOGGER_LOG_PERF("Rulelatency: " << lat);
 #endif
-      execute(msg);
+  queue_depth->set(action_queue->size());
+  auto start = std::chrono::steady_clock::now();
+  if (execute(msg) != NO_ERROR) {
+    failures->inc();
+  }
+  uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  execution_latency->record(elapsed_us);
+  execution_us.fetch_add(elapsed_us, std::memory_order_relaxed);
+  executions->inc();
+}
+
+void Action::schedule_drain() {
+  {
+    std::unique_lock<std::mutex> lock(drain_mtx);
+    if (!running || active_drains >= max_concurrency) {
+      // the active drain tasks pick up the event
+      return;
     }
+    active_drains++;
   }
+  action_executor().submit([this]() { drain(); });
+}
 
-  LOGGER_LOG_INFO(rule_id << " - finished");
+void Action::drain() {
+  ActionQueue::clock_t::time_point next_ready = ActionQueue::clock_t::time_point::max();
+  for (int i = 0; i < DRAIN_BATCH_SIZE && running; i++) {
+    std::string affinity;
+    evt_t msg = action_queue->try_pop(&affinity, &next_ready);
+    if (!msg) {
+      break;
+    }
+    run_event(msg);
+    action_queue->release(affinity);
+  }
+
+  std::unique_lock<std::mutex> lock(drain_mtx);
+  if (finish_drain(next_ready)) {
+    lock.unlock();
+    // yield the worker to other actions and continue later
+    action_executor().submit([this]() { drain(); });
+  }
+}
+
+bool Action::finish_drain(const ActionQueue::clock_t::time_point &next_ready) {
+  // check for new events under the lock, schedule_drain() might have seen
+  // this task as active after we last looked at the queue
+  if (running && action_queue->has_ready()) {
+    return true;
+  }
+  active_drains--;
+  if (running && next_ready != ActionQueue::clock_t::time_point::max() && !drain_timer_pending) {
+    // come back once the first debounced event is ready
+    drain_timer_pending = true;
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+        next_ready - ActionQueue::clock_t::now()) + std::chrono::milliseconds(1);
+    action_executor().submit_after([this]() {
+      {
+        std::unique_lock<std::mutex> lock(drain_mtx);
+        drain_timer_pending = false;
+        if (!running || active_drains >= max_concurrency) {
+          drained.notify_all();
+          return;
+        }
+        active_drains++;
+      }
+      drain();
+    }, delay);
+  }
+  drained.notify_all();
+  return false;
 }
 
 int Action::init_output_stream(std::string dst, size_t from) {
@@ -230,31 +253,92 @@ int Action::init_state(std::string dst, size_t from) {
     return ERROR_NO_RETRY;
   }
 
+  // batch state updates across actions if checkpointing is configured
+  if (StateCheckpointer *checkpointer = state_checkpointer()) {
+    state_backend = std::make_unique<CheckpointedStateBackend>(std::move(state_backend),
+        *checkpointer);
+  }
+
   return NO_ERROR;
 }
 
 void Action::start_action_consumers(int num_threads) {
   LOGGER_LOG_INFO(rule_id << " - starting action consumer");
-  for (int i = 0; i < num_threads; i++) {
-    consumer_threads.push_back(std::thread(&Action::run_consumer, this));
+  metric_labels_t labels = { { "rule", rule_id }, { "action", get_type() } };
+  executions = &metrics().counter("action_executions_total", "Executions of an action.", labels);
+  failures = &metrics().counter("action_failures_total", "Executions of an action that failed.",
+      labels);
+  execution_latency = &metrics().histogram("action_execution_latency_us",
+      "Time to execute an action.", labels);
+  queue_depth = &metrics().gauge("action_queue_depth",
+      "Events waiting in the queue of an action.", labels);
+  action_queue->set_counters(
+      &metrics().counter("action_events_dropped_total",
+          "Events dropped because the queue of an action was full.", labels),
+      &metrics().counter("action_events_coalesced_total",
+          "Events coalesced with a queued event for the same target.",
+          labels),
+      &metrics().counter("action_events_spilled_total",
+          "Events spilled to disk because the queue of an action was full.", labels),
+      &metrics().counter("action_queue_blocked_us_total",
+          "Time the consumer was blocked on the full queue of an action.", labels));
+
+  // the spill file has to be unique across all actions
+  static std::atomic<int> num_queues { 0 };
+  std::string spill_dir = Config::has_conf_key(Config::CKEY_ACTION_QUEUE_SPILL_DIR) ?
+      Config::config[Config::CKEY_ACTION_QUEUE_SPILL_DIR] : "/tmp";
+  action_queue->set_spill_file(spill_dir + "/ursprung-" + rule_id + "-" + get_type() + "-"
+      + std::to_string(num_queues++) + ".spill");
+  if (is_blocking()) {
+    for (int i = 0; i < num_threads; i++) {
+      consumer_threads.push_back(std::thread(&Action::run_consumer, this));
+    }
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(drain_mtx);
+    max_concurrency = num_threads > 0 ? num_threads : 1;
   }
+  action_queue->set_affinity_key([this](const Event &evt) { return get_affinity_key(evt); });
+  action_queue->set_listener([this]() { schedule_drain(); });
+  // events might have been queued before the consumers were started
+  schedule_drain();
 }
 
 void Action::stop_action_consumers() {
-  running = false;
-  // push a nullptr for each active thread to unblock pop()
+  {
+    std::unique_lock<std::mutex> lock(drain_mtx);
+    running = false;
+  }
+  // wake up each active thread to unblock pop()
   for (unsigned int i = 0; i < consumer_threads.size(); i++) {
-    action_queue->push(std::unique_ptr<Event>(nullptr));
+    action_queue->push_wakeup();
   }
   for (std::thread &t : consumer_threads) {
     t.join();
   }
+  consumer_threads.clear();
+
+  // wait for the drain tasks on the shared executor
+  std::unique_lock<std::mutex> lock(drain_mtx);
+  drained.wait(lock, [this]() { return active_drains == 0 && !drain_timer_pending; });
 }
 
 Action::Action() :
-    action_queue(new SynchronizedQueue<evt_t>()),
+    action_queue(new ActionQueue()),
     running(true),
-    out() {}
+    out(),
+    executions(),
+    failures(),
+    execution_latency(),
+    queue_depth(),
+    execution_us { 0 },
+    max_concurrency { 1 },
+    active_drains { 0 },
+    drain_timer_pending { false } {
+  action_queue->set_coalesce_key([this](const Event &evt) { return get_coalesce_key(evt); });
+}
 
 Action::~Action() {
   if (action_queue)
@@ -21,7 +21,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <atomic>
+#include <condition_variable>
 #include <exception>
+#include <mutex>
 #include <thread>
 #include <regex>
 
@@ -30,8 +34,13 @@
 #include "db-connector.h"
 #include "error.h"
 #include "logger.h"
-#include "sync-queue.h"
+#include "metrics.h"
+#include "action-queue.h"
 #include "action-state.h"
+#include "capture-loop.h"
+#include "tail-reader.h"
+#include "chunked-parser.h"
+#include "record-extractor.h"
 
 // libhg
 extern "C" {
@@ -40,7 +49,6 @@ extern "C" {
 }
 
 // string constants
-const std::string DATE_FORMAT = "%Y-%m-%d %H:%M:%S";
 const std::string DB_LOAD_RULE = "DBLOAD";
 const std::string DB_TRANSFER_RULE = "DBTRANSFER";
 const std::string LOG_LOAD_RULE = "LOGLOAD";
@@ -49,15 +57,10 @@ const std::string CAPTURESOUT_RULE = "CAPTURESOUT";
 // possible destinations for provenance collected by actions
 const std::string DB_DST = "DB";
 const std::string FILE_DST = "FILE";
+// optional clause at the end of an action to bound its queue, e.g. "QUEUE 1000 drop"
+const std::string QUEUE_CLAUSE = " QUEUE ";
 
-class LogLoadField;
-
-// helper functions
-std::string convert_date_field(std::string date, LogLoadField *field);
-std::string extract_record_from_line(std::string line, std::string delimiter,
-    std::vector<LogLoadField*> fields, evt_t msg);
-
-typedef SynchronizedQueue<evt_t> a_queue_t;
+typedef ActionQueue a_queue_t;
 typedef std::map<std::string, std::pair<long long int, unsigned long long>> parse_state_t;
 
 /**
@@ -66,19 +69,61 @@ typedef std::map<std::string, std::pair<long long int, unsigned long long>> pars
  * method which takes a string and returns the correct action object. When
  * implementing new actions, parseAction() needs to be updated.
  *
+ * Every action definition can end with a QUEUE clause that bounds the
+ * action's queue and defines what happens if it overflows:
+ *
+ * ... QUEUE capacity block|drop|coalesce|spill
+ *
+ * Without the clause, the action-queue-capacity and action-queue-policy
+ * config options apply (unbounded by default).
+ *
+ * Idempotent actions (see is_idempotent) additionally coalesce all pending
+ * events with the same coalesce key into a single execution, optionally
+ * after a debounce window (action-coalesce and action-coalesce-debounce-ms).
+ *
+ * Actions are executed on a shared work-stealing executor (see
+ * action_executor()). Each action processes at most get_num_consumer_threads()
+ * events concurrently and events with the same affinity key (see
+ * get_affinity_key) are processed one after the other, in order. Only
+ * blocking actions (see is_blocking) get dedicated consumer threads.
+ *
  * NB: Action's can't be copy constructed or assigned.
  */
 class Action {
 protected:
-  bool running;
+  /* Maximum number of events a drain task processes before yielding its worker. */
+  static const int DRAIN_BATCH_SIZE = 64;
+
+  std::atomic<bool> running;
   std::string rule_id;
   std::vector<std::thread> consumer_threads;
   a_queue_t *action_queue;
   MsgOutputStream *out;
   std::string out_dest;
   std::unique_ptr<ActionStateBackend> state_backend;
+  /* Action metrics, registered once the consumers are started and the rule ID is known. */
+  Counter *executions;
+  Counter *failures;
+  Histogram *execution_latency;
+  Gauge *queue_depth;
+  /* Total time spent in execute(), for the RuleEngine's cost accounting. */
+  std::atomic<uint64_t> execution_us;
+  /* State of the drain tasks on the shared executor. */
+  std::mutex drain_mtx;
+  std::condition_variable drained;
+  int max_concurrency;
+  int active_drains;
+  bool drain_timer_pending;
 
   void run_consumer();
+  /* Executes the action for an event and updates the action metrics. */
+  void run_event(evt_t msg);
+  /* Submits a drain task to the executor unless the concurrency limit has been reached. */
+  void schedule_drain();
+  /* Processes queued events on an executor worker. */
+  void drain();
+  /* Requires drain_mtx. Ends a drain task or keeps it going if there's more work. */
+  bool finish_drain(const ActionQueue::clock_t::time_point &next_ready);
   /*
    * Takes the 'INTO' part of an action definition and parses it
    * to create the correct output stream. The 'from' parameter
@@ -94,6 +139,30 @@ protected:
    */
   int init_state(std::string dst, size_t from);
   virtual int execute(evt_t msg) = 0;
+  /*
+   * Returns the key under which events for this action can be coalesced
+   * (see ActionQueue). Events with the same key trigger the same work, e.g.
+   * loading the new part of the same file. By default, events can't be
+   * coalesced.
+   */
+  virtual std::string get_coalesce_key(const Event &evt) const { return ""; }
+  /*
+   * Returns true if a single execution for a coalesce key covers all events
+   * with that key that arrived before it, i.e. the action catches up from
+   * its state instead of processing the event itself.
+   */
+  virtual bool is_idempotent() const { return false; }
+  /*
+   * Returns the key of the state an event updates. Events with the same key
+   * are never processed concurrently. By default, events are independent.
+   */
+  virtual std::string get_affinity_key(const Event &evt) const { return ""; }
+  /*
+   * Returns true if executions can block for a long time (e.g. until a traced
+   * process exits). Such actions get dedicated threads instead of occupying
+   * the workers of the shared executor.
+   */
+  virtual bool is_blocking() const { return false; }
 
 public:
   Action();
@@ -106,8 +175,9 @@ public:
   void stop_action_consumers();
   void set_rule_id(std::string rid) { rule_id = rid; }
   a_queue_t* get_action_queue() { return action_queue; }
+  uint64_t get_execution_us() const { return execution_us; }
 
-  // TODO make this configurable
+  /* Maximum number of events that are processed concurrently. */
   virtual int get_num_consumer_threads() const = 0;
   virtual std::string get_type() const = 0;
   virtual std::string str() const = 0;
@@ -123,11 +193,13 @@ public:
  * the .csv file that should be loaded. The database connection string contains
  * all necessary information to connect to the target database and also defines
  * the target table. The schema should be a comma-separated string of the columns
- * in the target table into which the .csv file should be inserted.
+ * in the target table into which the .csv file should be inserted. Large
+ * files are parsed in parallel chunks and loaded in batches.
  */
 class DBLoadAction: public Action {
 private:
   std::string event_field;
+  ChunkedParser parser;
 
 public:
   DBLoadAction(std::string action);
@@ -136,6 +208,14 @@ public:
   std::string get_event_field() const { return event_field; }
 
   virtual int execute(evt_t msg) override;
+  /*
+   * Every execution loads the whole file but annotates the records with the
+   * time of its own event, so the action isn't idempotent and the key only
+   * applies to the coalesce overflow policy.
+   */
+  virtual std::string get_coalesce_key(const Event &evt) const override {
+    return evt.get_value(event_field);
+  }
   virtual int get_num_consumer_threads() const override { return 10; }
   virtual std::string get_type() const override;
   virtual std::string str() const override;
@@ -180,6 +260,10 @@ public:
   std::string get_connection_string() const { return connection_string; }
 
   virtual int execute(evt_t msg) override;
+  /* Every execution runs the same query from the last state on. */
+  virtual std::string get_coalesce_key(const Event &evt) const override { return query; }
+  virtual std::string get_affinity_key(const Event &evt) const override { return query; }
+  virtual bool is_idempotent() const override { return true; }
   virtual int get_num_consumer_threads() const override { return 1; }
   virtual std::string get_type() const override;
   virtual std::string str() const override;
@@ -212,14 +296,32 @@ private:
    * keep the state for each individual file that is watched by this action in this parsing state.
    */
   parse_state_t parsing_state;
+  /* Protects the parsing state, the state backend, and the output stream. */
+  std::mutex state_mtx;
   std::string event_field;
   std::string matching_string_str;
-  std::regex matching_string;
+  /*
+   * Lines are searched for the phrase rather than matched against matching_string,
+   * which is equivalent but doesn't recurse once per character of the (.*) groups
+   * and hence works for arbitrarily long lines.
+   */
+  std::regex matching_phrase;
   std::string delimiter;
   std::vector<LogLoadField*> fields;
-  /* Fields to store internal state to correctly parse broken lines. */
-  std::vector<char> line_fragment;
-  int line_overflow = 0;
+  /* Compiled from the fields and the delimiter. */
+  RecordExtractor extractor;
+  /* Partial last lines per file, to correctly parse broken lines. */
+  std::map<std::string, std::string> line_fragments;
+  TailReader reader;
+  /* Parses large backlogs in parallel. */
+  ChunkedParser parser;
+
+  /*
+   * Loads the records and then saves the parsing state of the file. Returns the
+   * result of loading the records, failing to save the state is only logged.
+   */
+  int store_records(const std::string &path, std::vector<std::string> &records,
+      const std::pair<long long int, unsigned long long> &state);
 
 public:
   LogLoadAction(std::string action);
@@ -231,7 +333,16 @@ public:
   std::vector<LogLoadField*> get_fields() const { return fields; }
 
   virtual int execute(evt_t msg) override;
-  virtual int get_num_consumer_threads() const override { return 1; }
+  /* Every execution loads the file from the last parsed offset on. */
+  virtual std::string get_coalesce_key(const Event &evt) const override {
+    return evt.get_value(event_field);
+  }
+  /* The parsing state is kept per file. */
+  virtual std::string get_affinity_key(const Event &evt) const override {
+    return evt.get_value(event_field);
+  }
+  virtual bool is_idempotent() const override { return true; }
+  virtual int get_num_consumer_threads() const override { return 4; }
   virtual std::string get_type() const override;
   virtual std::string str() const override;
 };
@@ -293,17 +404,38 @@ public:
  * Note that this rule is stateless, i.e. if the consumer crashes or is killed,
  * it will not attempt to attach to any previously tracked process again as that
  * process might have changed in the meantime.
+ *
+ * An execution only submits the request to provd and hands the connection
+ * over to one of the action's capture loops (see CaptureLoop), which receive
+ * the matching lines of all traced processes and load the extracted records
+ * in batches.
  */
 class StdoutCaptureAction: public Action {
 private:
+  static const int DEFAULT_NUM_CAPTURE_LOOPS = 2;
+
   std::string matching_string;
   std::regex matching_regex;
   std::string delimiter;
   std::vector<LogLoadField*> fields;
+  /* Compiled from the fields and the delimiter. */
+  RecordExtractor extractor;
+  /* Started on the first execution. */
+  std::once_flag loops_started;
+  std::vector<std::unique_ptr<CaptureLoop>> loops;
+  /* Protocol flags requested from provd (see ProvdFrame). */
+  int32_t protocol_flags = 0;
+  /* Nodes whose provd doesn't support batching, they only get plain requests. */
+  std::set<std::string> unbatched_nodes;
+  std::mutex nodes_mtx;
+  /* Serializes batches from different capture loops. */
+  std::mutex out_mtx;
+
+  void start_capture_loops();
 
 public:
   StdoutCaptureAction(std::string action);
-  virtual ~StdoutCaptureAction() {};
+  virtual ~StdoutCaptureAction();
 
   std::string get_matching_string() const { return matching_string; }
   std::regex get_matching_regex() const { return matching_regex; }
@@ -311,7 +443,9 @@ public:
   std::vector<LogLoadField*> get_fields() const { return fields; }
 
   virtual int execute(evt_t msg) override;
-  virtual int get_num_consumer_threads() const override { return 1000; }
+  /* Executions only connect to provd, this bounds the number of concurrent connection attempts. */
+  virtual int get_num_consumer_threads() const override { return 10; }
+  size_t get_num_captures() const;
   virtual std::string get_type() const override;
   virtual std::string str() const override;
 };
@@ -341,15 +475,15 @@ private:
 public:
   LogLoadField(std::string field);
 
-  bool is_range_field() { return is_range; }
-  bool is_event_field() { return is_event_field_name; }
-  bool is_timestamp_field() { return is_timestamp; }
-  bool is_composite_field() { return is_composite; }
-  int get_field_id() { return field_id; }
-  int get_until_field_id() { return until_field_id; }
-  int get_timeoffset() { return timeoffset; }
-  std::string get_field_name() { return field_name; }
-  std::vector<int> get_field_ids() { return field_ids; }
+  bool is_range_field() const { return is_range; }
+  bool is_event_field() const { return is_event_field_name; }
+  bool is_timestamp_field() const { return is_timestamp; }
+  bool is_composite_field() const { return is_composite; }
+  int get_field_id() const { return field_id; }
+  int get_until_field_id() const { return until_field_id; }
+  int get_timeoffset() const { return timeoffset; }
+  const std::string& get_field_name() const { return field_name; }
+  const std::vector<int>& get_field_ids() const { return field_ids; }
   std::string str();
 };
 
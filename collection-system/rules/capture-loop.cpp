@@ -0,0 +1,273 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "capture-loop.h"
+
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "error.h"
+#include "logger.h"
+
+const size_t CaptureLoop::DEFAULT_BATCH_SIZE;
+const long CaptureLoop::DEFAULT_FLUSH_INTERVAL_MS;
+
+static int set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    LOGGER_LOG_ERROR("Couldn't make " << fd << " non-blocking: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  return NO_ERROR;
+}
+
+CaptureLoop::CaptureLoop(extract_fn_t extract, flush_fn_t flush, size_t batch_size,
+    long flush_interval_ms) :
+    extract { extract },
+    flush { flush },
+    batch_size { batch_size > 0 ? batch_size : 1 },
+    flush_interval { flush_interval_ms },
+    running { false },
+    wakeup_fds { -1, -1 },
+#ifdef __linux__
+    epoll_fd { -1 },
+#endif
+    num_connections { 0 } {}
+
+CaptureLoop::~CaptureLoop() {
+  stop();
+}
+
+int CaptureLoop::start() {
+  if (pipe(wakeup_fds) < 0) {
+    LOGGER_LOG_ERROR("Couldn't create wake-up pipe: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  set_nonblocking(wakeup_fds[0]);
+#ifdef __linux__
+  if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    LOGGER_LOG_ERROR("Couldn't create epoll instance: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  epoll_event ev = { };
+  ev.events = EPOLLIN;
+  ev.data.fd = wakeup_fds[0];
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fds[0], &ev);
+#endif
+  last_flush = clock_t::now();
+  running = true;
+  thr = std::thread(&CaptureLoop::run, this);
+  return NO_ERROR;
+}
+
+void CaptureLoop::stop() {
+  if (!running) {
+    return;
+  }
+  running = false;
+  char c = 0;
+  if (write(wakeup_fds[1], &c, 1) < 0) {
+    LOGGER_LOG_WARN("Couldn't wake up capture loop: " << strerror(errno));
+  }
+  thr.join();
+
+  // the loop thread is gone, clean up whatever is left
+  take_added();
+  for (auto &conn : connections) {
+    close(conn.first);
+  }
+  connections.clear();
+  num_connections = 0;
+  flush_batch();
+#ifdef __linux__
+  close(epoll_fd);
+#endif
+  close(wakeup_fds[0]);
+  close(wakeup_fds[1]);
+}
+
+int CaptureLoop::add(int fd, evt_t msg, bool framed) {
+  if (set_nonblocking(fd) != NO_ERROR) {
+    return ERROR_NO_RETRY;
+  }
+  std::unique_ptr<Connection> conn = std::make_unique<Connection>();
+  conn->fd = fd;
+  conn->msg = msg;
+  conn->decoder = ProvdLineDecoder(framed);
+  conn->num_lines = 0;
+  {
+    std::unique_lock<std::mutex> lock(added_mtx);
+    added.push_back(std::move(conn));
+  }
+  num_connections++;
+  char c = 0;
+  if (write(wakeup_fds[1], &c, 1) < 0) {
+    LOGGER_LOG_WARN("Couldn't wake up capture loop: " << strerror(errno));
+  }
+  return NO_ERROR;
+}
+
+void CaptureLoop::take_added() {
+  std::vector<std::unique_ptr<Connection>> new_conns;
+  {
+    std::unique_lock<std::mutex> lock(added_mtx);
+    new_conns.swap(added);
+  }
+  for (std::unique_ptr<Connection> &conn : new_conns) {
+#ifdef __linux__
+    epoll_event ev = { };
+    ev.events = EPOLLIN;
+    ev.data.fd = conn->fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0) {
+      LOGGER_LOG_ERROR("Couldn't watch capture connection: " << strerror(errno));
+      close(conn->fd);
+      num_connections--;
+      continue;
+    }
+#endif
+    connections[conn->fd] = std::move(conn);
+  }
+}
+
+int CaptureLoop::wait(int timeout_ms, std::vector<int> *ready) {
+  ready->clear();
+#ifdef __linux__
+  epoll_event events[64];
+  int n = epoll_wait(epoll_fd, events, 64, timeout_ms);
+  for (int i = 0; i < n; i++) {
+    ready->push_back(events[i].data.fd);
+  }
+#else
+  std::vector<pollfd> fds;
+  fds.push_back(pollfd { wakeup_fds[0], POLLIN, 0 });
+  for (auto &conn : connections) {
+    fds.push_back(pollfd { conn.first, POLLIN, 0 });
+  }
+  int n = poll(fds.data(), fds.size(), timeout_ms);
+  for (size_t i = 0; n > 0 && i < fds.size(); i++) {
+    if (fds[i].revents) {
+      ready->push_back(fds[i].fd);
+    }
+  }
+#endif
+  if (n < 0 && errno != EINTR) {
+    LOGGER_LOG_ERROR("Problems while waiting for capture connections: " << strerror(errno));
+  }
+  return n;
+}
+
+void CaptureLoop::run() {
+  std::vector<int> ready;
+  while (running) {
+    // wake up in time to flush a partial batch
+    int timeout_ms = -1;
+    if (!batch.empty()) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          last_flush + flush_interval - clock_t::now()).count();
+      timeout_ms = remaining > 0 ? remaining : 0;
+    }
+    wait(timeout_ms, &ready);
+
+    for (int fd : ready) {
+      if (fd == wakeup_fds[0]) {
+        char buf[64];
+        while (read(fd, buf, sizeof(buf)) > 0) {}
+        take_added();
+        continue;
+      }
+      auto conn = connections.find(fd);
+      if (conn != connections.end() && !read_connection(*conn->second)) {
+        close_connection(fd);
+        // make the records of a finished process visible right away
+        flush_batch();
+      }
+    }
+    if (!batch.empty() && clock_t::now() - last_flush >= flush_interval) {
+      flush_batch();
+    }
+  }
+}
+
+bool CaptureLoop::read_connection(Connection &conn) {
+  char buf[64 * 1024];
+  while (true) {
+    ssize_t n = read(conn.fd, buf, sizeof(buf));
+    if (n == 0) {
+      return false;
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      LOGGER_LOG_ERROR("Problems while reading captured lines: " << strerror(errno));
+      return false;
+    }
+
+    conn.decoder.feed(buf, n);
+    std::string line;
+    while (conn.decoder.next(&line)) {
+      LOGGER_LOG_DEBUG("Received matching line " << line);
+      conn.num_lines++;
+      std::string record;
+      if (extract(line, conn.msg, &record) && !record.empty()) {
+        batch.push_back(std::move(record));
+        if (batch.size() >= batch_size) {
+          flush_batch();
+        }
+      }
+    }
+    if (conn.decoder.is_corrupt()) {
+      LOGGER_LOG_ERROR("Received malformed data from provd, closing capture connection.");
+      return false;
+    }
+  }
+}
+
+void CaptureLoop::close_connection(int fd) {
+  auto conn = connections.find(fd);
+  LOGGER_LOG_DEBUG("Capture connection closed, received " << conn->second->num_lines
+      << " lines.");
+  if (conn->second->decoder.pending()) {
+    LOGGER_LOG_WARN("Capture connection closed in the middle of a line, dropping "
+        << conn->second->decoder.pending() << " bytes.");
+  }
+#ifdef __linux__
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+  close(fd);
+  connections.erase(conn);
+  num_connections--;
+}
+
+void CaptureLoop::flush_batch() {
+  last_flush = clock_t::now();
+  if (batch.empty()) {
+    return;
+  }
+  flush(batch);
+  batch.clear();
+}
@@ -0,0 +1,116 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef RULES_CAPTURE_LOOP_H_
+#define RULES_CAPTURE_LOOP_H_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+#include "event.h"
+#include "provd-client.h"
+
+/**
+ * Multiplexes the provd connections of stdout capture requests (see
+ * StdoutCaptureAction) on a single thread. The loop waits for data on all
+ * of its connections (with epoll on Linux and poll elsewhere), assembles the
+ * lines sent by provd incrementally, and extracts records from them. Records
+ * from all connections are collected in one batch, which is flushed once it
+ * is full, when a connection has been closed (the traced process finished),
+ * or after the flush interval.
+ */
+class CaptureLoop {
+public:
+  /*
+   * Appends the record extracted from a line to record. Returns false if the
+   * line is skipped, empty records are skipped as well.
+   */
+  typedef std::function<bool(boost::string_view line, const evt_t &msg,
+      std::string *record)> extract_fn_t;
+  typedef std::function<void(const std::vector<std::string> &records)> flush_fn_t;
+
+  static const size_t DEFAULT_BATCH_SIZE = 1000;
+  static const long DEFAULT_FLUSH_INTERVAL_MS = 1000;
+
+private:
+  typedef std::chrono::steady_clock clock_t;
+
+  struct Connection {
+    int fd;
+    /* The event that triggered the capture request. */
+    evt_t msg;
+    ProvdLineDecoder decoder;
+    uint64_t num_lines;
+  };
+
+  extract_fn_t extract;
+  flush_fn_t flush;
+  size_t batch_size;
+  std::chrono::milliseconds flush_interval;
+
+  std::thread thr;
+  std::atomic<bool> running;
+  /* Used to wake up the loop thread when connections are added or the loop is stopped. */
+  int wakeup_fds[2];
+#ifdef __linux__
+  int epoll_fd;
+#endif
+  std::mutex added_mtx;
+  std::vector<std::unique_ptr<Connection>> added;
+  /* Only accessed by the loop thread. */
+  std::unordered_map<int, std::unique_ptr<Connection>> connections;
+  std::atomic<size_t> num_connections;
+  std::vector<std::string> batch;
+  clock_t::time_point last_flush;
+
+  void run();
+  /* Waits for readable connections and returns their file descriptors. */
+  int wait(int timeout_ms, std::vector<int> *ready);
+  void take_added();
+  /* Reads everything that is available, returns false once the connection is closed. */
+  bool read_connection(Connection &conn);
+  void close_connection(int fd);
+  void flush_batch();
+
+public:
+  CaptureLoop(extract_fn_t extract, flush_fn_t flush, size_t batch_size = DEFAULT_BATCH_SIZE,
+      long flush_interval_ms = DEFAULT_FLUSH_INTERVAL_MS);
+  ~CaptureLoop();
+  CaptureLoop(const CaptureLoop&) = delete;
+  CaptureLoop& operator=(const CaptureLoop&) = delete;
+
+  int start();
+  /* Closes all connections and flushes the pending records. */
+  void stop();
+  /*
+   * Hands a connected socket over to the loop, which reads the lines sent by
+   * provd until the server closes the connection and then closes the socket.
+   * If framed is set, provd sends the lines in frames (see ProvdFrame).
+   */
+  int add(int fd, evt_t msg, bool framed = false);
+  size_t get_num_connections() const { return num_connections; }
+};
+
+#endif /* RULES_CAPTURE_LOOP_H_ */
@@ -15,6 +15,9 @@
  */
 
 #include <regex>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
 
 #include "action.h"
 #include "db-output-stream.h"
@@ -51,20 +54,27 @@ int DBLoadAction::execute(evt_t msg) {
   // get augmentation string to annotate loaded records with time and path
   std::string augment_str = "'" + msg->get_value("path") + "','" + msg->get_value("event_time") + "',";
 
-  std::vector<std::string> records;
-  std::ifstream in_file(path);
-  std::string line;
+  struct stat sb;
+  if (stat(path.c_str(), &sb) < 0) {
+    LOGGER_LOG_ERROR("stat() failed with " << strerror(errno) << " for " << path
+        << ". Not executing action " << this->str());
+    return ERROR_NO_RETRY;
+  }
 
+  // large files are parsed in parallel chunks and loaded in batches
   // TODO make 'skip first line' configurable
-  bool first_line = true;
-  while (std::getline(in_file, line)) {
-    if (first_line) {
-      first_line = false;
-      continue;
-    }
-    records.push_back(augment_str + line);
-  }
-  int rc = out->send_batch(records);
+  long long offset = 0;
+  int rc = parser.parse(path, &offset, sb.st_size,
+      ChunkedParser::SKIP_FIRST_LINE | ChunkedParser::INCLUDE_LAST_LINE,
+      [&augment_str](boost::string_view line, std::vector<std::string> *records) {
+        std::string record;
+        record.reserve(augment_str.size() + line.size());
+        record.append(augment_str).append(line.data(), line.size());
+        records->push_back(std::move(record));
+      },
+      [this](std::vector<std::string> &records, long long) {
+        return records.empty() ? NO_ERROR : out->send_batch(records);
+      });
   if (rc != NO_ERROR) {
     LOGGER_LOG_ERROR("Problems while bulk loading data from " << path << " into DB."
         << " Provenance may be incomplete. Action: " << this->str());
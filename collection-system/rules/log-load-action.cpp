@@ -22,10 +22,6 @@
 #include "action.h"
 #include "db-output-stream.h"
 
-// 4KB buffer size to store log file lines (we assume that 4K
-// is enough to hold the longest line in any log file.
-#define MAX_LINE_LENGTH 4096
-
 const std::regex LOG_LOAD_SYNTAX = std::regex("LOGLOAD [a-zA-Z0-9]* MATCH (.)* FIELDS "
     "(.)* DELIM (.*) INTO (FILE (.*)|DB (.*):(.*)@(.*) USING (.*)/(.*))");
 
@@ -42,9 +38,9 @@ LogLoadAction::LogLoadAction(std::string action) {
       match_pos - (LOG_LOAD_RULE.length() + 2));
 
   size_t fields_pos = action.find("FIELDS", match_pos);
-  matching_string_str = "(.*)" + action.substr(
-      match_pos + 6, fields_pos - (match_pos + 5 + 2)) + "(.*)";
-  matching_string = std::regex(matching_string_str);
+  std::string phrase = action.substr(match_pos + 6, fields_pos - (match_pos + 5 + 2));
+  matching_string_str = "(.*)" + phrase + "(.*)";
+  matching_phrase = std::regex(phrase);
 
   size_t delim_pos = action.find("DELIM", fields_pos);
   std::string fields_string = action.substr(fields_pos + 7, delim_pos - (fields_pos + 6 + 2));
@@ -62,6 +58,7 @@ LogLoadAction::LogLoadAction(std::string action) {
 
   size_t into_pos = action.find("INTO", delim_pos);
   delimiter = action.substr(delim_pos + 6, into_pos - (delim_pos + 5 + 2));
+  extractor = RecordExtractor(delimiter, fields);
 
   // parse output destination and set up stream
   if (init_output_stream(action, into_pos) != NO_ERROR) {
@@ -96,7 +93,9 @@ int LogLoadAction::execute(evt_t msg) {
   }
   unsigned long long inode = sb.st_ino;
 
-  // retrieve existing state
+  // retrieve existing state, events for the same path are never processed
+  // concurrently (see get_affinity_key) but other paths may be
+  std::unique_lock<std::mutex> lock(state_mtx);
   std::pair<long long int, unsigned long long> state;
   if (parsing_state.find(path) == parsing_state.end()) {
     // check if we have state stored in the database
@@ -142,119 +141,96 @@ int LogLoadAction::execute(evt_t msg) {
     }
   }
 
+  // map entries stay valid while other paths are added
+  std::pair<long long int, unsigned long long> &file_state = parsing_state[path];
+  std::string &line_fragment = line_fragments[path];
+  lock.unlock();
+
   // check if inode has changed
-  if (parsing_state[path].second != inode) {
+  if (file_state.second != inode) {
     // if inode has changed due to log rollover (i.e. same path but different inode)
     // reset the parsing state to store the new inode and start parsing from 0 again
-    parsing_state[path].first = 0;
-    parsing_state[path].second = inode;
+    file_state.first = 0;
+    file_state.second = inode;
+    line_fragment.clear();
     // TODO could there still be unread data in the old file?
     LOGGER_LOG_INFO("It seems like log file " << path << " has been rotated. Extracting from new file.");
   }
 
-  // open log file and seek to last parsed position
-  std::ifstream infile(path);
-  infile.seekg(parsing_state[path].first);
-
-  // We are reading the file in batches of 4KB and extracting data line by
-  // line. If we're at the end of the file and we have not ended the current
-  // line, we store the partial line in lineFragment. On the next action trigger,
-  // we read until the end of the previously stored partial line and combine it
-  // with the lineFragment to restore the full line.
-  //
-  // NB: This code is not yet able to combine lines *across* read calls and hence,
-  // we assume that no line exceeds 4KB, i.e. we can always read at least one line break
-  // per read call.
-  char buffer[MAX_LINE_LENGTH];
-  std::vector<std::string> records;
-  std::string line;
-  bool found_entries = false;
-  bool read = true;
-
-  while (read) {
-    infile.read(buffer, MAX_LINE_LENGTH);
-    size_t bytes_read = infile.gcount();
-
-    // error handling
-    if (infile.eof()) {
-      read = false;
-    }
-    if (infile.bad()) {
-      LOGGER_LOG_ERROR("Error while reading, bad stream. LogLoad not reading from " << path);
-      read = false;
-    }
-
-    int lineoffset = 0;
-    for (uint i = 0; i < bytes_read; i++) {
-      if (buffer[i] == '\n') {
-        // read one line
-        int line_length = i - lineoffset;
-        if (line_overflow > 0) {
-          line_length += line_overflow;
-        }
-
-        std::vector<char> line(line_length);
-        if (line_overflow > 0) {
-          LOGGER_LOG_DEBUG("Appending previous line fragment to currently read line.");
-          for (unsigned j = 0; j < line_fragment.size(); j++) {
-            line[j] = line_fragment[j];
-          }
-          for (unsigned j = lineoffset; j < i; j++) {
-            line[j - lineoffset + line_overflow] = buffer[j];
-          }
-          line_overflow = 0;
-        } else {
-          // insert inserts from [lineoffset, i), i.e. buffer[i] is *excluded*
-          for (unsigned j = lineoffset; j < i; j++) {
-            line[j - lineoffset] = buffer[j];
-          }
-        }
-
-        lineoffset = i + 1;
-        std::string line_str(line.begin(), line.end());
-        LOGGER_LOG_DEBUG("Read line '" << line_str << "'");
-
-        // match the line to find possible records to extract
-        if (std::regex_match(line_str, matching_string)) {
-          std::string record = extract_record_from_line(line_str, delimiter, fields, msg);
-          records.push_back(record);
-          found_entries = true;
-        }
-      }
-      if (i == bytes_read - 1 && buffer[i] != '\n') {
-        // we're not ending with a new line
-        // store everything from the last line break in a buffer
-        line_fragment.resize(bytes_read - lineoffset);
-        for (unsigned j = lineoffset; j < bytes_read; j++) {
-          line_fragment[j - lineoffset] = buffer[j];
-        }
-        line_overflow = bytes_read - lineoffset;
-        std::string line_fragment_str(line_fragment.begin(), line_fragment.end());
-        LOGGER_LOG_DEBUG("Read data doesn't end with new line, storing broken line '"
-            << line_fragment_str << "' with line overflow " << line_overflow);
+  // match the lines to find possible records to extract, only matching lines are copied
+  auto parse_line = [this, &msg](boost::string_view line, std::vector<std::string> *records) {
+    if (std::regex_search(line.begin(), line.end(), matching_phrase)) {
+      std::string record;
+      if (extractor.extract(line, *msg, &record)) {
+        records->push_back(std::move(record));
+      } else {
+        LOGGER_LOG_DEBUG("Skipping line '" << line << "' as it doesn't have all fields.");
       }
     }
-
-    parsing_state[path].first = parsing_state[path].first + bytes_read;
+  };
+
+  if (sb.st_size - file_state.first > (long long) parser.get_chunk_size()) {
+    // a large backlog (e.g. the rule has been added for an existing log) is parsed
+    // in parallel chunks and loaded in batches, the state is updated after each batch.
+    // The chunks start at a line, so a partial line is parsed again from its start.
+    LOGGER_LOG_INFO("LogLoadAction " << this->str() << ": loading "
+        << sb.st_size - file_state.first << " bytes from " << path << " in parallel");
+    file_state.first -= line_fragment.size();
+    line_fragment.clear();
+    rc = parser.parse(path, &file_state.first, sb.st_size, 0, parse_line,
+        [this, &path, &file_state](std::vector<std::string> &records, long long offset) {
+          return store_records(path, records, std::make_pair(offset, file_state.second));
+        });
+    if (rc != NO_ERROR) {
+      LOGGER_LOG_ERROR("Problems while loading " << path << ". LogLoad continues from offset "
+          << file_state.first << " on the next execution.");
+    }
+    return rc;
   }
-  // TODO this needs to be synchronized if we make action handling multi-threaded
-  rc = state_backend->update_state(rule_id, std::to_string(parsing_state[path].first) + ","
-      + std::to_string(parsing_state[path].second), path);
+
+  // read everything that has been appended since the last execution, a partial
+  // last line is kept in the line fragment and completed on the next execution.
+  // The offset and the fragment are only committed once the records have been
+  // loaded, so a failed batch is read again.
+  std::vector<std::string> records;
+  long long offset = file_state.first;
+  std::string fragment = line_fragment;
+  rc = reader.read(path, &offset, &fragment, [&](boost::string_view line) {
+    parse_line(line, &records);
+  });
   if (rc != NO_ERROR) {
-    LOGGER_LOG_ERROR("Problems while updating state for rule " << this->str()
-        << ". State can't be backed up at the moment.");
+    LOGGER_LOG_ERROR("Problems while reading " << path << ". LogLoad continues from offset "
+        << offset << " on the next execution.");
+  }
+
+  if ((rc = store_records(path, records, std::make_pair(offset, file_state.second)))
+      != NO_ERROR) {
+    return rc;
   }
-  infile.close();
+  file_state.first = offset;
+  line_fragment = std::move(fragment);
+  return NO_ERROR;
+}
 
-  if (found_entries) {
-    rc = out->send_batch(records);
+int LogLoadAction::store_records(const std::string &path, std::vector<std::string> &records,
+    const std::pair<long long int, unsigned long long> &state) {
+  std::unique_lock<std::mutex> lock(state_mtx);
+  if (!records.empty()) {
+    int rc = out->send_batch(records);
     if (rc != NO_ERROR) {
       LOGGER_LOG_ERROR("Problems while bulk loading data into DB."
           << " Provenance may be incomplete. Action: " << this->str());
+      return rc;
     }
   }
 
-  return rc;
+  // the state is only updated once the records have been loaded
+  if (state_backend->update_state(rule_id, std::to_string(state.first) + ","
+      + std::to_string(state.second), path) != NO_ERROR) {
+    LOGGER_LOG_ERROR("Problems while updating state for rule " << this->str()
+        << ". State can't be backed up at the moment.");
+  }
+  return NO_ERROR;
 }
 
 std::string LogLoadAction::str() const {
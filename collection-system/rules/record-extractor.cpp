@@ -0,0 +1,155 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "record-extractor.h"
+
+#include <algorithm>
+
+#include "action.h"
+#include "timestamp.h"
+
+RecordExtractor::RecordExtractor() :
+    last_field_id { -1 } {}
+
+RecordExtractor::RecordExtractor(const std::string &delimiter,
+    const std::vector<LogLoadField*> &fields) :
+    delimiter { delimiter },
+    last_field_id { 0 } {
+  for (size_t i = 0; i < fields.size(); i++) {
+    const LogLoadField *field = fields[i];
+    Step step;
+    step.field_id = field->get_field_id();
+    step.until_field_id = field->get_until_field_id();
+    step.is_timestamp = field->is_timestamp_field();
+    step.timeoffset = field->get_timeoffset();
+    step.separator = i < fields.size() - 1;
+    if (field->is_range_field()) {
+      step.type = step_range;
+      if (step.until_field_id == -1) {
+        last_field_id = -1;
+      } else if (last_field_id != -1) {
+        last_field_id = std::max(last_field_id, step.until_field_id);
+      }
+    } else if (field->is_event_field()) {
+      step.type = step_event_field;
+      step.field_name = field->get_field_name();
+    } else if (field->is_composite_field()) {
+      step.type = step_composite;
+      step.field_ids = field->get_field_ids();
+      step.separator = true;
+      if (last_field_id != -1 && !step.field_ids.empty()) {
+        last_field_id = std::max(last_field_id,
+            *std::max_element(step.field_ids.begin(), step.field_ids.end()));
+      }
+    } else {
+      step.type = step_field;
+      if (last_field_id != -1) {
+        last_field_id = std::max(last_field_id, step.field_id);
+      }
+    }
+    plan.push_back(step);
+  }
+}
+
+void RecordExtractor::tokenize(boost::string_view line,
+    std::vector<boost::string_view> *tokens) const {
+  tokens->clear();
+  if (delimiter.empty()) {
+    tokens->push_back(line);
+    return;
+  }
+  size_t pos = 0;
+  while (last_field_id == -1 || (int) tokens->size() <= last_field_id) {
+    size_t next = line.find(delimiter, pos);
+    if (next == boost::string_view::npos) {
+      tokens->push_back(line.substr(pos));
+      return;
+    }
+    tokens->push_back(line.substr(pos, next - pos));
+    pos = next + delimiter.size();
+  }
+}
+
+bool RecordExtractor::extract(boost::string_view line, const Event &msg,
+    std::string *record) const {
+  // reused across lines, extract may be called concurrently for different lines
+  static thread_local std::vector<boost::string_view> tokens;
+  static thread_local std::string range;
+  tokenize(line, &tokens);
+  int num_tokens = tokens.size();
+
+  for (const Step &step : plan) {
+    switch (step.type) {
+    case step_field:
+      if (step.field_id < 0 || step.field_id >= num_tokens) {
+        return false;
+      }
+      if (step.is_timestamp) {
+        append_date(tokens[step.field_id], step.timeoffset, record);
+      } else {
+        record->append(tokens[step.field_id].data(), tokens[step.field_id].size());
+      }
+      break;
+    case step_range: {
+      int until = step.until_field_id == -1 ? num_tokens - 1 : step.until_field_id;
+      if (step.field_id < 0 || (step.field_id <= until && until >= num_tokens)) {
+        return false;
+      }
+      std::string *out = record;
+      if (step.is_timestamp) {
+        range.clear();
+        out = &range;
+      }
+      for (int j = step.field_id; j <= until; j++) {
+        out->append(tokens[j].data(), tokens[j].size());
+        if (j != until) {
+          out->push_back(' ');
+        }
+      }
+      if (step.is_timestamp) {
+        append_date(range, step.timeoffset, record);
+      }
+      break;
+    }
+    case step_event_field:
+      record->append(msg.get_value(step.field_name));
+      break;
+    case step_composite:
+      for (int id : step.field_ids) {
+        if (id < 0 || id >= num_tokens) {
+          return false;
+        }
+        record->append(tokens[id].data(), tokens[id].size());
+      }
+      break;
+    }
+    if (step.separator) {
+      record->push_back(',');
+    }
+  }
+  return true;
+}
+
+void RecordExtractor::append_date(boost::string_view date, int timeoffset, std::string *out) {
+  int64_t secs;
+  if (!Timestamp::parse_datetime(date.data(), date.size(), &secs)) {
+    out->append(date.data(), date.size());
+    return;
+  }
+  char buf[Timestamp::DATETIME_LENGTH];
+  out->append(buf, Timestamp::format_datetime(secs + timeoffset * 3600, buf));
+}
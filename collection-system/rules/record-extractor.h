@@ -0,0 +1,84 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef RULES_RECORD_EXTRACTOR_H_
+#define RULES_RECORD_EXTRACTOR_H_
+
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+#include "event.h"
+
+class LogLoadField;
+
+/**
+ * Extracts records from log lines according to the FIELDS and DELIM clauses
+ * of LOGLOAD and CAPTURESOUT actions (see LogLoadField).
+ *
+ * The fields are compiled into a plan once per action. A line is split into
+ * views in a single pass, which stops after the last field the plan needs,
+ * and the record is appended to an output buffer without building
+ * intermediate strings. The fields of a record are separated by ',', ranges
+ * of fields are joined by ' ', and the parts of a composite field are
+ * concatenated (followed by a ',' even if it is the last field).
+ */
+class RecordExtractor {
+private:
+  typedef enum step_type {
+    step_field,
+    step_range,
+    step_event_field,
+    step_composite
+  } step_type_t;
+
+  struct Step {
+    step_type_t type;
+    int field_id;
+    /* Last field of a range, -1 for the end of the line. */
+    int until_field_id;
+    bool is_timestamp;
+    int timeoffset;
+    std::string field_name;
+    std::vector<int> field_ids;
+    bool separator;
+  };
+
+  std::string delimiter;
+  std::vector<Step> plan;
+  /* Highest field the plan needs, or -1 if it needs all fields. */
+  int last_field_id;
+
+  void tokenize(boost::string_view line, std::vector<boost::string_view> *tokens) const;
+
+public:
+  RecordExtractor();
+  RecordExtractor(const std::string &delimiter, const std::vector<LogLoadField*> &fields);
+
+  /*
+   * Appends the record extracted from line to record. Returns false if the
+   * line doesn't have all the fields of the plan, record is undefined then.
+   */
+  bool extract(boost::string_view line, const Event &msg, std::string *record) const;
+  /*
+   * Appends the date 'YYYY-mm-dd HH:MM:SS' shifted by timeoffset hours. Dates
+   * in other formats are appended unchanged.
+   */
+  static void append_date(boost::string_view date, int timeoffset, std::string *out);
+};
+
+#endif /* RULES_RECORD_EXTRACTOR_H_ */
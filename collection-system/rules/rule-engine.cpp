@@ -16,6 +16,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 #include <openssl/md5.h>
 
 #include "rule-engine.h"
@@ -24,11 +25,36 @@
 const std::string RULE_DELIM = "->";
 const char DELIM = ';';
 
+const long RuleEngine::DEFAULT_COST_REPORT_INTERVAL_S;
+const uint32_t RuleEngine::DEFAULT_SAMPLE_RATE;
+const size_t RuleEngine::NUM_REPORTED_RULES;
+const uint64_t RuleEngine::MIN_EVALS_FOR_BUDGET;
+
+static const char* mode_str(rule_mode_t mode) {
+  switch (mode) {
+  case rule_sampled:
+    return "sampled";
+  case rule_disabled:
+    return "disabled";
+  default:
+    return "active";
+  }
+}
+
 /*------------------------------
  * RuleEngine
  *------------------------------*/
 
-RuleEngine::RuleEngine(std::string rules_file) {
+RuleEngine::RuleEngine(std::string rules_file) :
+    events_evaluated(metrics().counter("rules_events_evaluated_total",
+        "Events evaluated against the rules.")),
+    evaluation_latency(metrics().histogram("rules_evaluation_latency_us",
+        "Time to evaluate the conditions of all rules for an event.")),
+    cost_report_interval { DEFAULT_COST_REPORT_INTERVAL_S },
+    last_cost_report { clock_t::now() },
+    cost_budget_ns { 0 },
+    over_budget_mode { rule_sampled },
+    sample_rate { DEFAULT_SAMPLE_RATE } {
   std::ifstream in_file(rules_file);
   std::string line;
 
@@ -58,6 +84,7 @@ int RuleEngine::add_rule(std::string rule) {
     md5_ss << std::setw(2) << (long long) c;
   }
   r->set_rule_id(md5_ss.str());
+  r->register_metrics();
 
   // add conditions
   size_t pos = rule.find(RULE_DELIM);
@@ -81,15 +108,44 @@ int RuleEngine::add_rule(std::string rule) {
 }
 
 std::vector<uint32_t> RuleEngine::evaluate_conditions(evt_t msg) {
-  std::string value;
   std::vector<uint32_t> idx;
+  clock_t::time_point start = clock_t::now();
+  clock_t::time_point rule_start = start;
 
   for (uint32_t i = 0; i < rules.size(); i++) {
-    if (rules[i]->eval_condition_expr(msg)) {
+    Rule *r = rules[i].get();
+    if (r->mode == rule_disabled) {
+      continue;
+    }
+    if (r->mode == rule_sampled && ++r->num_skipped < sample_rate) {
+      continue;
+    }
+    r->num_skipped = 0;
+
+    bool matched = r->eval_condition_expr(msg);
+    clock_t::time_point rule_end = clock_t::now();
+    uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        rule_end - rule_start).count();
+    rule_start = rule_end;
+
+    r->eval_ns += elapsed;
+    r->num_evals++;
+    // a single condition usually takes less than a microsecond
+    r->eval_latency->record(elapsed);
+    if (matched) {
       idx.push_back(i);
+      r->num_matches++;
+      r->matches->inc();
     }
   }
 
+  events_evaluated.inc();
+  evaluation_latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+      rule_start - start).count());
+
+  if (cost_report_interval.count() > 0 && rule_start - last_cost_report >= cost_report_interval) {
+    report_rule_costs();
+  }
   return idx;
 }
 
@@ -101,6 +157,58 @@ int RuleEngine::run_actions(std::vector<uint32_t> rule_ids, evt_t msg) {
   return NO_ERROR;
 }
 
+void RuleEngine::set_cost_report_interval(long seconds) {
+  cost_report_interval = std::chrono::seconds(seconds);
+}
+
+void RuleEngine::set_cost_budget(uint64_t budget_ns, rule_mode_t mode, uint32_t sample_rate) {
+  cost_budget_ns = budget_ns;
+  over_budget_mode = mode;
+  this->sample_rate = sample_rate > 0 ? sample_rate : 1;
+}
+
+void RuleEngine::report_rule_costs() {
+  last_cost_report = clock_t::now();
+
+  // rank rules by the time spent evaluating them since the last report
+  std::vector<Rule*> ranked;
+  for (std::unique_ptr<Rule> &r : rules) {
+    ranked.push_back(r.get());
+  }
+  std::sort(ranked.begin(), ranked.end(), [](const Rule *a, const Rule *b) {
+    return a->eval_ns - a->reported_eval_ns > b->eval_ns - b->reported_eval_ns;
+  });
+
+  for (size_t i = 0; i < ranked.size(); i++) {
+    Rule *r = ranked[i];
+    uint64_t evals = r->num_evals - r->reported_evals;
+    uint64_t eval_ns = r->eval_ns - r->reported_eval_ns;
+    uint64_t avg_ns = evals ? eval_ns / evals : 0;
+    uint64_t execution_us = r->get_action_execution_us();
+
+    if (i < NUM_REPORTED_RULES && evals) {
+      LOGGER_LOG_INFO("Rule " << r->rule_id << " (" << mode_str(r->mode) << "): " << evals
+          << " evaluations, " << r->num_matches - r->reported_matches << " matches, "
+          << avg_ns << " ns per evaluation, " << eval_ns / 1000 << " us evaluating, "
+          << execution_us - r->reported_execution_us << " us executing actions, "
+          << r->get_action_queue_depth() << " queued events");
+    }
+
+    if (cost_budget_ns && r->mode == rule_active && evals >= MIN_EVALS_FOR_BUDGET
+        && avg_ns > cost_budget_ns) {
+      LOGGER_LOG_WARN("Rule " << r->rule_id << " takes " << avg_ns << " ns per evaluation, "
+          << "which exceeds the budget of " << cost_budget_ns << " ns. The rule is "
+          << mode_str(over_budget_mode) << " from now on.");
+      r->set_mode(over_budget_mode);
+    }
+
+    r->reported_evals = r->num_evals;
+    r->reported_eval_ns = r->eval_ns;
+    r->reported_matches = r->num_matches;
+    r->reported_execution_us = execution_us;
+  }
+}
+
 int RuleEngine::shutdown() {
   for (size_t i = 0; i < rules.size(); i++) {
     rules[i]->remove_actions();
@@ -132,6 +240,40 @@ int Rule::add_action(std::string action) {
   }
 }
 
+void Rule::register_metrics() {
+  metric_labels_t labels = { { "rule", rule_id } };
+  matches = &metrics().counter("rules_matches_total", "Events that matched a rule.", labels);
+  eval_latency = &metrics().histogram("rules_condition_latency_ns",
+      "Time to evaluate the conditions of a rule for an event.", labels);
+  mode_gauge = &metrics().gauge("rules_mode",
+      "Whether a rule is active (0), sampled (1), or disabled (2).", labels);
+  mode_gauge->set(mode);
+}
+
+void Rule::set_mode(rule_mode_t m) {
+  mode = m;
+  num_skipped = 0;
+  if (mode_gauge) {
+    mode_gauge->set(mode);
+  }
+}
+
+uint64_t Rule::get_action_execution_us() const {
+  uint64_t total = 0;
+  for (const std::unique_ptr<Action> &a : actions) {
+    total += a->get_execution_us();
+  }
+  return total;
+}
+
+size_t Rule::get_action_queue_depth() const {
+  size_t total = 0;
+  for (const std::unique_ptr<Action> &a : actions) {
+    total += a->get_action_queue()->size();
+  }
+  return total;
+}
+
 bool Rule::eval_condition_expr(evt_t msg) const {
   return condition_expr->eval(*msg);
 }
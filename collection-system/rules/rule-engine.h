@@ -17,6 +17,7 @@
 #ifndef RULE_ENGINE_H
 #define RULE_ENGINE_H
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -24,11 +25,21 @@
 #include "action.h"
 #include "condition.h"
 #include "event.h"
+#include "metrics.h"
 
 class Rule;
 typedef std::vector<std::unique_ptr<Rule>> Rules;
 typedef std::vector<std::unique_ptr<Action>> Actions;
 
+typedef enum rule_mode {
+  /* The rule is evaluated for every event. */
+  rule_active,
+  /* The rule is only evaluated for every n-th event (see RuleEngine::set_cost_budget). */
+  rule_sampled,
+  /* The rule is not evaluated anymore. */
+  rule_disabled
+} rule_mode_t;
+
 /**
  * Rules consist of a set of conditions and actions. Conditions
  * and actions are independent, i.e. if a rule has been determined
@@ -39,6 +50,27 @@ private:
   Actions actions;
   std::string rule_id;
   std::unique_ptr<ConditionExpr> condition_expr;
+  rule_mode_t mode = rule_active;
+  /* Events seen since the last evaluation of a sampled rule. */
+  uint32_t num_skipped = 0;
+
+  /*
+   * Cost accounting. Rules are only evaluated on the consumer thread so the
+   * totals don't need to be atomic, the reported_* values are the totals at
+   * the time of the last cost report.
+   */
+  uint64_t eval_ns = 0;
+  uint64_t num_evals = 0;
+  uint64_t num_matches = 0;
+  uint64_t reported_eval_ns = 0;
+  uint64_t reported_evals = 0;
+  uint64_t reported_matches = 0;
+  uint64_t reported_execution_us = 0;
+  Counter *matches = nullptr;
+  Histogram *eval_latency = nullptr;
+  Gauge *mode_gauge = nullptr;
+
+  friend class RuleEngine;
 
 public:
   /*
@@ -61,7 +93,18 @@ public:
   void run_actions(evt_t msg) const;
 
   void set_rule_id(std::string rid) { rule_id = rid; }
+  /* Registers the rule's metrics, requires the rule ID to be set. */
+  void register_metrics();
+  void set_mode(rule_mode_t m);
+
   std::string get_rule_id() { return rule_id; }
+  rule_mode_t get_mode() const { return mode; }
+  uint64_t get_eval_ns() const { return eval_ns; }
+  uint64_t get_num_evals() const { return num_evals; }
+  uint64_t get_num_matches() const { return num_matches; }
+  /* Total execution time and queue depth of all actions of this rule. */
+  uint64_t get_action_execution_us() const;
+  size_t get_action_queue_depth() const;
   std::vector<std::string> get_action_types();
 };
 
@@ -71,8 +114,27 @@ public:
  * of that rule are executed.
  */
 class RuleEngine {
+public:
+  static const long DEFAULT_COST_REPORT_INTERVAL_S = 60;
+  static const uint32_t DEFAULT_SAMPLE_RATE = 10;
+  /* Number of rules in the periodic cost report. */
+  static const size_t NUM_REPORTED_RULES = 5;
+  /* Rules are only checked against the budget once they have been evaluated this often. */
+  static const uint64_t MIN_EVALS_FOR_BUDGET = 100;
+
 private:
+  typedef std::chrono::steady_clock clock_t;
+
   Rules rules;
+  Counter &events_evaluated;
+  Histogram &evaluation_latency;
+
+  /* Cost accounting, see report_rule_costs. */
+  std::chrono::seconds cost_report_interval;
+  clock_t::time_point last_cost_report;
+  uint64_t cost_budget_ns;
+  rule_mode_t over_budget_mode;
+  uint32_t sample_rate;
 
 public:
   /*
@@ -93,12 +155,30 @@ public:
   int run_actions(std::vector<uint32_t> rule_ids, evt_t msg);
   int shutdown();
 
+  /* Sets how often the most expensive rules are reported (0 disables the report). */
+  void set_cost_report_interval(long seconds);
+  /*
+   * Sets the budget for the average time it takes to evaluate the conditions
+   * of a single rule for an event (0 disables the budget). Rules that exceed
+   * it during a report interval are put into the given mode: either they are
+   * only evaluated for every sample_rate-th event or not at all. Rules stay in
+   * that mode until the consumer is restarted.
+   */
+  void set_cost_budget(uint64_t budget_ns, rule_mode_t mode,
+      uint32_t sample_rate = DEFAULT_SAMPLE_RATE);
+  /*
+   * Logs the rules that were most expensive since the last report and
+   * enforces the cost budget. Called periodically by evaluate_conditions.
+   */
+  void report_rule_costs();
+
   int add_rule(std::string rule);
   bool has_rules() const { return (rules.size() > 0) ? true : false; }
   /* Return a list of action types for each action associated with the specified rule. */
   std::vector<std::string> get_action_types(int rule_idx) {
     return rules[rule_idx]->get_action_types();
   }
+  Rule* get_rule(int rule_idx) { return rules[rule_idx].get(); }
 };
 
 #endif
@@ -14,12 +14,16 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <regex>
 
 #include "action.h"
+#include "config.h"
 #include "db-output-stream.h"
 #include "provd-client.h"
 
+const int StdoutCaptureAction::DEFAULT_NUM_CAPTURE_LOOPS;
+
 const std::regex CAPTURESOUT_SYNTAX = std::regex("CAPTURESOUT MATCH (.)* FIELDS "
     "(.)* DELIM (.*) INTO (FILE (.*)|DB (.*):(.*)@(.*) USING (.*)/(.*))");
 
@@ -52,6 +56,7 @@ StdoutCaptureAction::StdoutCaptureAction(std::string action) {
 
   size_t into_pos = action.find("INTO", delim_pos);
   delimiter = action.substr(delim_pos + 6, into_pos - (delim_pos + 5 + 2));
+  extractor = RecordExtractor(delimiter, fields);
 
   // parse output destination and set up stream
    if (init_output_stream(action, into_pos) != NO_ERROR) {
@@ -59,7 +64,54 @@ StdoutCaptureAction::StdoutCaptureAction(std::string action) {
    }
 }
 
+StdoutCaptureAction::~StdoutCaptureAction() {
+  // stop the loops while the output stream is still there for the last batches
+  for (std::unique_ptr<CaptureLoop> &loop : loops) {
+    loop->stop();
+  }
+  for (unsigned int i = 0; i < fields.size(); i++) {
+    delete fields.at(i);
+  }
+}
+
+void StdoutCaptureAction::start_capture_loops() {
+  long num_loops = Config::has_conf_key(Config::CKEY_STDOUT_CAPTURE_THREADS) ?
+      Config::get_long(Config::CKEY_STDOUT_CAPTURE_THREADS) : DEFAULT_NUM_CAPTURE_LOOPS;
+  long batch_size = Config::has_conf_key(Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE) ?
+      Config::get_long(Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE) : CaptureLoop::DEFAULT_BATCH_SIZE;
+  long flush_ms = Config::has_conf_key(Config::CKEY_STDOUT_CAPTURE_FLUSH_MS) ?
+      Config::get_long(Config::CKEY_STDOUT_CAPTURE_FLUSH_MS) :
+      CaptureLoop::DEFAULT_FLUSH_INTERVAL_MS;
+  if (Config::has_conf_key(Config::CKEY_STDOUT_CAPTURE_COMPRESS)
+      && Config::get_bool(Config::config[Config::CKEY_STDOUT_CAPTURE_COMPRESS])) {
+    protocol_flags |= ProvdFrame::FLAG_LZ4;
+  }
+
+  for (long i = 0; i < std::max(num_loops, 1L); i++) {
+    std::unique_ptr<CaptureLoop> loop = std::make_unique<CaptureLoop>(
+        [this](boost::string_view line, const evt_t &msg, std::string *record) {
+          return extractor.extract(line, *msg, record);
+        },
+        [this](const std::vector<std::string> &records) {
+          std::unique_lock<std::mutex> lock(out_mtx);
+          if (out->send_batch(records) != NO_ERROR) {
+            LOGGER_LOG_ERROR("Problems while bulk loading data from  into DB."
+                << " Provenance may be incomplete. Action: " << this->str());
+          }
+        }, batch_size, flush_ms);
+    if (loop->start() == NO_ERROR) {
+      loops.push_back(std::move(loop));
+    }
+  }
+}
+
 int StdoutCaptureAction::execute(evt_t msg) {
+  std::call_once(loops_started, &StdoutCaptureAction::start_capture_loops, this);
+  if (loops.empty()) {
+    LOGGER_LOG_ERROR("No capture loop running, can't execute " << this->str());
+    return ERROR_NO_RETRY;
+  }
+
   // retrieve name and pid of node and process to trace
   std::string node_name = msg->get_node_name();
   std::string pid_str = msg->get_value("pid");
@@ -73,43 +125,46 @@ int StdoutCaptureAction::execute(evt_t msg) {
     LOGGER_LOG_ERROR("Couldn't connect to provd server on " << node_name);
     return ERROR_NO_RETRY;
   }
-  if ((rc = client.submit_trace_proc_request(pid, matching_string)) < 0) {
+  // don't wait for the batching negotiation to time out again on older servers
+  bool batching;
+  {
+    std::unique_lock<std::mutex> lock(nodes_mtx);
+    batching = unbatched_nodes.find(node_name) == unbatched_nodes.end();
+  }
+  rc = batching ? client.submit_batched_trace_proc_request(pid, matching_string, protocol_flags)
+      : client.submit_trace_proc_request(pid, matching_string);
+  if (rc < 0) {
     LOGGER_LOG_ERROR("Couldn't submit trace proc request.");
+    client.disconnect_from_server();
     return ERROR_NO_RETRY;
   }
+  if (batching && !client.is_batched()) {
+    std::unique_lock<std::mutex> lock(nodes_mtx);
+    unbatched_nodes.insert(node_name);
+  }
 
-  // receive matching lines from target node until process finishes
-  std::vector<std::string> records;
-  bool found_entries = false;
-  std::string line;
-  uint32_t line_counter = 0;
-  while (client.receive_line(&line) > 0) {
-    LOGGER_LOG_DEBUG("Received matching line " << line);
-    found_entries = true;
-    // we found a matching line, extract the information
-    std::string record = extract_record_from_line(line, delimiter, fields, msg);
-    if (record.size() > 0) {
-      records.push_back(record);
-      line_counter++;
+  // the least busy loop receives the matching lines until the process finishes
+  CaptureLoop *loop = loops[0].get();
+  for (std::unique_ptr<CaptureLoop> &l : loops) {
+    if (l->get_num_connections() < loop->get_num_connections()) {
+      loop = l.get();
     }
   }
-  LOGGER_LOG_DEBUG("StdoutCapture Action done, received " << line_counter << " lines.");
-
-  // finish up
-  if ((rc = client.disconnect_from_server()) < 0) {
-    LOGGER_LOG_ERROR("Problems while disconnecting from provd server " << rc);
+  if (loop->add(client.get_socket(), msg, client.is_batched()) != NO_ERROR) {
+    client.disconnect_from_server();
     return ERROR_NO_RETRY;
   }
-  if (found_entries) {
-    if (out->send_batch(records) != NO_ERROR) {
-      LOGGER_LOG_ERROR("Problems while bulk loading data from  into DB."
-          << " Provenance may be incomplete. Action: " << this->str());
-    }
-  }
-
   return NO_ERROR;
 }
 
+size_t StdoutCaptureAction::get_num_captures() const {
+  size_t num_captures = 0;
+  for (const std::unique_ptr<CaptureLoop> &loop : loops) {
+    num_captures += loop->get_num_connections();
+  }
+  return num_captures;
+}
+
 std::string StdoutCaptureAction::str() const {
   // convert the fields vector to a string
   std::stringstream ss;
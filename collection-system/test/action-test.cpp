@@ -14,13 +14,18 @@
  * limitations under the License.
  */
 
+#include <condition_variable>
 #include <cstdio>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 #include "gmock/gmock.h"
 #include "action.h"
 #include "error.h"
 #include "db-connector.h"
+#include "provd-client.h"
 
 /*------------------------------
  * DBLoadAction
@@ -179,6 +184,64 @@ TEST(log_load_action_test, test_execute) {
   EXPECT_EQ("second line,some-entry,3 4 5", lines[2]);
 }
 
+TEST(log_load_action_test, test_execute_long_lines) {
+  LogLoadAction a("LOGLOAD f1 MATCH some-entry FIELDS 0,2 DELIM , INTO "
+      "FILE logload-long-out");
+  std::ofstream out_file("test-log-load-long");
+  std::shared_ptr<Event> msg =
+      std::make_shared<TestEvent>("test-log-load-long","f2","f3");
+
+  // lines are no longer limited to 4KB
+  std::string long_field(100000, 'x');
+  out_file << "short,some-entry," << long_field << std::endl;
+  out_file << long_field << ",no match" << std::endl;
+  a.execute(msg);
+  std::vector<std::string> lines = read_file("logload-long-out");
+  ASSERT_EQ(1, lines.size());
+  EXPECT_EQ("short," + long_field, lines[0]);
+
+  // a long line that is split across several executions
+  out_file << "split," << long_field;
+  out_file.flush();
+  a.execute(msg);
+  out_file << long_field;
+  out_file.flush();
+  a.execute(msg);
+  out_file << ",some-entry" << std::endl;
+  a.execute(msg);
+  lines = read_file("logload-long-out");
+  ASSERT_EQ(2, lines.size());
+  EXPECT_EQ("split,some-entry", lines[1]);
+}
+
+TEST(log_load_action_test, test_execute_large_backlog) {
+  // the backlog is larger than a chunk and hence parsed in parallel
+  std::ofstream out_file("test-log-load-backlog");
+  std::string padding(100, 'p');
+  int num_lines = 2 * ChunkedParser::DEFAULT_CHUNK_SIZE / padding.size();
+  for (int i = 0; i < num_lines; i++) {
+    out_file << i << (i % 3 == 0 ? ",some-entry," : ",other,") << padding << "\n";
+  }
+  out_file << "partial,some-entry" << std::flush;
+
+  LogLoadAction a("LOGLOAD f1 MATCH some-entry FIELDS 0 DELIM , INTO "
+      "FILE logload-backlog-out");
+  std::shared_ptr<Event> msg =
+      std::make_shared<TestEvent>("test-log-load-backlog","f2","f3");
+  a.execute(msg);
+  std::vector<std::string> lines = read_file("logload-backlog-out");
+  ASSERT_EQ((num_lines + 2) / 3, lines.size());
+  for (size_t i = 0; i < lines.size(); i++) {
+    ASSERT_EQ(std::to_string(3 * i), lines[i]);
+  }
+
+  // the partial last line is completed by the next execution
+  out_file << ",last" << std::endl;
+  a.execute(msg);
+  lines = read_file("logload-backlog-out");
+  EXPECT_EQ("partial", lines.back());
+}
+
 TEST(log_load_action_test, test_str) {
   LogLoadAction a("LOGLOAD path MATCH some-entry FIELDS 0,1,3-5 DELIM , INTO "
       "DB MOCK user1:password2@dsn3 USING table4/schema5");
@@ -186,6 +249,157 @@ TEST(log_load_action_test, test_str) {
       "user1:password2@dsn3 USING table4/schema5", a.str());
 }
 
+TEST(log_load_action_test, test_shared_executor) {
+  std::unique_ptr<Action> a = Action::parse_action("LOGLOAD f1 MATCH some-entry FIELDS 0,1 "
+      "DELIM , INTO FILE logload-executor-out");
+  a->set_rule_id("test-shared-executor");
+  a->start_action_consumers(a->get_num_consumer_threads());
+  std::ofstream out_file("test-log-load-executor");
+  out_file << "first line,some-entry" << std::endl;
+  a->get_action_queue()->push(std::make_shared<TestEvent>("test-log-load-executor", "f2", "f3"));
+
+  // the event is processed on the shared executor
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (read_file("logload-executor-out").empty() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  a->stop_action_consumers();
+  std::vector<std::string> lines = read_file("logload-executor-out");
+  ASSERT_EQ(1, lines.size());
+  EXPECT_EQ("first line,some-entry", lines[0]);
+}
+
+/*------------------------------
+ * StdoutCaptureAction
+ *------------------------------*/
+
+static std::string provd_frame(const std::string &line) {
+  int32_t len = htonl(line.size());
+  return std::string((char*) &len, sizeof(len)) + line;
+}
+
+TEST(stdout_capture_action_test, test_line_decoder) {
+  ProvdLineDecoder decoder;
+  std::string data = provd_frame("first line") + provd_frame("") + provd_frame("third");
+  std::string line;
+  // feed the frames in small, unaligned chunks
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < data.size(); i += 3) {
+    decoder.feed(data.data() + i, std::min<size_t>(3, data.size() - i));
+    while (decoder.next(&line)) {
+      lines.push_back(line);
+    }
+  }
+  EXPECT_EQ(std::vector<std::string>({ "first line", "", "third" }), lines);
+  EXPECT_EQ(0, decoder.pending());
+  EXPECT_FALSE(decoder.is_corrupt());
+
+  // negative or garbage lengths are rejected instead of waiting for the line
+  ProvdLineDecoder corrupt;
+  int32_t len = htonl(-1);
+  corrupt.feed((char*) &len, sizeof(len));
+  EXPECT_FALSE(corrupt.next(&line));
+  EXPECT_TRUE(corrupt.is_corrupt());
+}
+
+TEST(stdout_capture_action_test, test_framed_line_decoder) {
+  std::string payload;
+  std::string data;
+  std::string frame;
+  ProvdFrame::append_line("first line", &payload);
+  ProvdFrame::append_line("", &payload);
+  ProvdFrame::encode(payload, 2, 0, &frame);
+  data += frame;
+  payload.clear();
+  ProvdFrame::append_line("third", &payload);
+  ProvdFrame::encode(payload, 1, ProvdFrame::supported_flags(), &frame);
+  data += frame;
+
+  ProvdLineDecoder decoder(true);
+  std::string line;
+  std::vector<std::string> lines;
+  for (size_t i = 0; i < data.size(); i += 5) {
+    decoder.feed(data.data() + i, std::min<size_t>(5, data.size() - i));
+    while (decoder.next(&line)) {
+      lines.push_back(line);
+    }
+  }
+  EXPECT_EQ(std::vector<std::string>({ "first line", "", "third" }), lines);
+  EXPECT_EQ(0, decoder.pending());
+  EXPECT_FALSE(decoder.is_corrupt());
+
+  // a frame whose lines exceed its payload is rejected
+  ProvdLineDecoder corrupt(true);
+  ProvdFrame::encode(provd_frame("line"), 2, 0, &frame);
+  corrupt.feed(frame.data(), frame.size());
+  EXPECT_FALSE(corrupt.next(&line));
+  EXPECT_TRUE(corrupt.is_corrupt());
+}
+
+TEST(stdout_capture_action_test, test_capture_loop) {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::vector<std::string> extracted;
+  std::vector<std::vector<std::string>> batches;
+  CaptureLoop loop([&](boost::string_view line, const evt_t &msg, std::string *record) {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      extracted.push_back(line.to_string());
+    }
+    cv.notify_all();
+    if (line == "skip") {
+      return false;
+    }
+    record->append(msg->get_value("f1") + ":").append(line.data(), line.size());
+    return true;
+  }, [&](const std::vector<std::string> &records) {
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      batches.push_back(records);
+    }
+    cv.notify_all();
+  }, 2, 60 * 1000);
+  ASSERT_EQ(NO_ERROR, loop.start());
+
+  int fds1[2], fds2[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds1));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds2));
+  EXPECT_EQ(NO_ERROR, loop.add(fds1[0], std::make_shared<TestEvent>("p1", "a", "b")));
+  EXPECT_EQ(NO_ERROR, loop.add(fds2[0], std::make_shared<TestEvent>("p2", "a", "b")));
+  EXPECT_EQ(2, loop.get_num_connections());
+
+  auto wait_for = [&](const auto &v, size_t n) {
+    std::unique_lock<std::mutex> lock(mtx);
+    return cv.wait_for(lock, std::chrono::seconds(5), [&]() { return v.size() >= n; });
+  };
+
+  // a full batch is flushed right away
+  std::string data = provd_frame("l1") + provd_frame("skip") + provd_frame("l2");
+  ASSERT_EQ(data.size(), write(fds1[1], data.data(), data.size()));
+  ASSERT_TRUE(wait_for(batches, 1));
+  // a closed connection flushes the partial batch
+  data = provd_frame("l3");
+  ASSERT_EQ(data.size(), write(fds2[1], data.data(), data.size()));
+  close(fds2[1]);
+  ASSERT_TRUE(wait_for(batches, 2));
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    ASSERT_EQ(2, batches.size());
+    EXPECT_EQ(std::vector<std::string>({ "p1:l1", "p1:l2" }), batches[0]);
+    EXPECT_EQ(std::vector<std::string>({ "p2:l3" }), batches[1]);
+  }
+  EXPECT_EQ(1, loop.get_num_connections());
+
+  // stopping flushes whatever is left once the line has been read
+  data = provd_frame("l4");
+  ASSERT_EQ(data.size(), write(fds1[1], data.data(), data.size()));
+  ASSERT_TRUE(wait_for(extracted, 5));
+  loop.stop();
+  close(fds1[1]);
+  ASSERT_EQ(3, batches.size());
+  EXPECT_EQ(std::vector<std::string>({ "p1:l4" }), batches[2]);
+}
+
 /*------------------------------
  * TrackAction
  *------------------------------*/
@@ -275,3 +489,479 @@ TEST(logloadfield_test, test_composite_field) {
   EXPECT_EQ(3, ids[1]);
   EXPECT_EQ(5, ids[2]);
 }
+
+/*------------------------------
+ * RecordExtractor
+ *------------------------------*/
+
+static std::vector<LogLoadField*> parse_fields(const std::vector<std::string> &specs) {
+  std::vector<LogLoadField*> fields;
+  for (const std::string &spec : specs) {
+    fields.push_back(new LogLoadField(spec));
+  }
+  return fields;
+}
+
+static void delete_fields(std::vector<LogLoadField*> &fields) {
+  for (LogLoadField *f : fields) {
+    delete f;
+  }
+}
+
+TEST(record_extractor_test, test_extract) {
+  std::vector<LogLoadField*> fields = parse_fields({ "0", "f1", "2-4", "1+3", "5/2", "6-e" });
+  RecordExtractor extractor(" | ", fields);
+  TestEvent msg("v1", "v2", "v3");
+
+  std::string record;
+  ASSERT_TRUE(extractor.extract("a | b | c | d | e | 2020-12-31 23:00:00 | f | g", msg,
+      &record));
+  EXPECT_EQ("a,v1,c d e,bd,2021-01-01 01:00:00,f g", record);
+
+  // the record is appended to the buffer
+  ASSERT_TRUE(extractor.extract("0 | 1 | 2 | 3 | 4 | 5 | 6", msg, &record));
+  EXPECT_EQ("a,v1,c d e,bd,2021-01-01 01:00:00,f g0,v1,2 3 4,13,5,6", record);
+
+  // lines without all fields are skipped
+  record.clear();
+  EXPECT_FALSE(extractor.extract("a | b | c", msg, &record));
+  delete_fields(fields);
+}
+
+TEST(record_extractor_test, test_extract_prefix) {
+  // only the fields up to the last one in the plan are split
+  std::vector<LogLoadField*> fields = parse_fields({ "1", "0" });
+  RecordExtractor extractor(",", fields);
+  TestEvent msg("v1", "v2", "v3");
+  std::string record;
+  ASSERT_TRUE(extractor.extract("a,b,c,d", msg, &record));
+  EXPECT_EQ("b,a", record);
+  record.clear();
+  ASSERT_TRUE(extractor.extract("a,b", msg, &record));
+  EXPECT_EQ("b,a", record);
+  EXPECT_FALSE(extractor.extract("a", msg, &record));
+
+  // a composite field is always followed by a separator
+  std::vector<LogLoadField*> composite = parse_fields({ "0+2" });
+  RecordExtractor composite_extractor(",", composite);
+  record.clear();
+  ASSERT_TRUE(composite_extractor.extract("a,b,c", msg, &record));
+  EXPECT_EQ("ac,", record);
+  delete_fields(fields);
+  delete_fields(composite);
+}
+
+TEST(record_extractor_test, test_append_date) {
+  std::string out;
+  RecordExtractor::append_date("2020-08-03 12:06:36", 8, &out);
+  EXPECT_EQ("2020-08-03 20:06:36", out);
+  // the offset carries over into the next month and year
+  out.clear();
+  RecordExtractor::append_date("2020-02-29 18:00:00", 8, &out);
+  EXPECT_EQ("2020-03-01 02:00:00", out);
+  out.clear();
+  RecordExtractor::append_date("2020-12-31 23:59:59", 8, &out);
+  EXPECT_EQ("2021-01-01 07:59:59", out);
+  out.clear();
+  RecordExtractor::append_date("2020-08-01 01:00:00", -3, &out);
+  EXPECT_EQ("2020-07-31 22:00:00", out);
+  // dates that can't be parsed are kept
+  out.clear();
+  RecordExtractor::append_date("yesterday", 8, &out);
+  EXPECT_EQ("yesterday", out);
+}
+
+/*------------------------------
+ * StateCheckpointer
+ *------------------------------*/
+
+class CountingStateBackend: public ActionStateBackend {
+public:
+  std::map<std::string, std::string> &states;
+  int &num_updates;
+
+  CountingStateBackend(std::map<std::string, std::string> &states, int &num_updates) :
+      states(states), num_updates(num_updates) {}
+  int connect() override { return NO_ERROR; }
+  int disconnect() override { return NO_ERROR; }
+  int insert_state(std::string rule_id, std::string state, std::string target) override {
+    states[rule_id + target] = state;
+    return NO_ERROR;
+  }
+  int update_state(std::string rule_id, std::string state, std::string target) override {
+    num_updates++;
+    states[rule_id + target] = state;
+    return NO_ERROR;
+  }
+  int lookup_state(char *state_buffer, std::string rule_id, std::string target) override {
+    strcpy(state_buffer, states[rule_id + target].c_str());
+    return NO_ERROR;
+  }
+};
+
+TEST(state_checkpointer_test, test_batch_updates) {
+  std::string wal = "state-checkpoint-test.wal";
+  std::remove(wal.c_str());
+  std::map<std::string, std::string> states;
+  int num_updates = 0;
+  StateCheckpointer checkpointer(wal, 60000, 100);
+  ASSERT_EQ(NO_ERROR, checkpointer.start());
+  CheckpointedStateBackend backend(
+      std::make_unique<CountingStateBackend>(states, num_updates), checkpointer);
+
+  // updates of the same target are coalesced and visible before the checkpoint
+  char buffer[1024];
+  for (int i = 1; i <= 10; i++) {
+    EXPECT_EQ(NO_ERROR, backend.update_state("rule", std::to_string(i), "file1"));
+  }
+  EXPECT_EQ(NO_ERROR, backend.update_state("rule", "5", "file2"));
+  EXPECT_EQ(2u, checkpointer.get_num_dirty());
+  EXPECT_EQ(0, num_updates);
+  EXPECT_EQ(NO_ERROR, backend.lookup_state(buffer, "rule", "file1"));
+  EXPECT_STREQ("10", buffer);
+
+  EXPECT_EQ(NO_ERROR, checkpointer.flush());
+  EXPECT_EQ(2, num_updates);
+  EXPECT_EQ("10", states["rulefile1"]);
+  EXPECT_EQ("5", states["rulefile2"]);
+  EXPECT_EQ(0u, checkpointer.get_num_dirty());
+
+  // pending state is written when the backend is disconnected
+  EXPECT_EQ(NO_ERROR, backend.update_state("rule", "11", "file1"));
+  backend.disconnect();
+  EXPECT_EQ(3, num_updates);
+  EXPECT_EQ("11", states["rulefile1"]);
+  checkpointer.stop();
+  std::remove(wal.c_str());
+}
+
+/* Blocks writing state until it's released (or a timeout passes). */
+class BlockingStateBackend: public CountingStateBackend {
+public:
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool writing = false;
+  bool released = false;
+
+  using CountingStateBackend::CountingStateBackend;
+  int update_state(std::string rule_id, std::string state, std::string target) override {
+    std::unique_lock<std::mutex> lock(mtx);
+    writing = true;
+    cv.notify_all();
+    cv.wait_for(lock, std::chrono::seconds(2), [this] { return released; });
+    return CountingStateBackend::update_state(rule_id, state, target);
+  }
+};
+
+TEST(state_checkpointer_test, test_lookup_during_checkpoint) {
+  std::string wal = "state-checkpoint-test.wal";
+  std::remove(wal.c_str());
+  std::map<std::string, std::string> states;
+  int num_updates = 0;
+  StateCheckpointer checkpointer(wal, 60000, 100);
+  ASSERT_EQ(NO_ERROR, checkpointer.start());
+  BlockingStateBackend *blocking = new BlockingStateBackend(states, num_updates);
+  CheckpointedStateBackend backend(std::unique_ptr<ActionStateBackend>(blocking), checkpointer);
+  EXPECT_EQ(NO_ERROR, backend.update_state("rule", "1", "file1"));
+  EXPECT_EQ(NO_ERROR, backend.update_state("rule", "2", "file2"));
+
+  std::thread flusher([&checkpointer]() { checkpointer.flush(); });
+  {
+    std::unique_lock<std::mutex> lock(blocking->mtx);
+    blocking->cv.wait(lock, [blocking] { return blocking->writing; });
+  }
+  // the entries being written are still returned instead of the backend's older state
+  char buffer[1024];
+  EXPECT_EQ(NO_ERROR, backend.lookup_state(buffer, "rule", "file1"));
+  EXPECT_STREQ("1", buffer);
+  EXPECT_EQ(NO_ERROR, backend.lookup_state(buffer, "rule", "file2"));
+  EXPECT_STREQ("2", buffer);
+  {
+    std::unique_lock<std::mutex> lock(blocking->mtx);
+    blocking->released = true;
+  }
+  blocking->cv.notify_all();
+  flusher.join();
+  EXPECT_EQ(2, num_updates);
+  backend.disconnect();
+  checkpointer.stop();
+  std::remove(wal.c_str());
+}
+
+TEST(state_checkpointer_test, test_dirty_threshold) {
+  std::string wal = "state-checkpoint-test.wal";
+  std::remove(wal.c_str());
+  std::map<std::string, std::string> states;
+  int num_updates = 0;
+  StateCheckpointer checkpointer(wal, 60000, 3);
+  ASSERT_EQ(NO_ERROR, checkpointer.start());
+  CheckpointedStateBackend backend(
+      std::make_unique<CountingStateBackend>(states, num_updates), checkpointer);
+
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(NO_ERROR, backend.update_state("rule", "1", "file" + std::to_string(i)));
+  }
+  // the flusher writes the checkpoint without waiting for the interval
+  for (int i = 0; i < 100 && checkpointer.get_num_dirty() > 0; i++) {
+    usleep(10000);
+  }
+  EXPECT_EQ(0u, checkpointer.get_num_dirty());
+  backend.disconnect();
+  checkpointer.stop();
+  EXPECT_EQ(3, num_updates);
+  std::remove(wal.c_str());
+}
+
+TEST(state_checkpointer_test, test_recovery) {
+  std::string wal = "state-checkpoint-test.wal";
+  std::remove(wal.c_str());
+  std::map<std::string, std::string> states;
+  int num_updates = 0;
+  {
+    StateCheckpointer checkpointer(wal, 60000, 100);
+    ASSERT_EQ(NO_ERROR, checkpointer.start());
+    CheckpointedStateBackend backend(
+        std::make_unique<CountingStateBackend>(states, num_updates), checkpointer);
+    EXPECT_EQ(NO_ERROR, backend.update_state("rule", "1", "file1"));
+    EXPECT_EQ(NO_ERROR, backend.update_state("rule", "42", "file with spaces\n"));
+    // simulate a crash before the checkpoint by keeping a copy of the write-ahead file
+    std::ifstream in(wal, std::ios::binary);
+    std::ofstream out(wal + ".crash", std::ios::binary);
+    out << in.rdbuf() << "3 5 2 rul";
+    backend.disconnect();
+  }
+  ASSERT_EQ(0, rename((wal + ".crash").c_str(), wal.c_str()));
+
+  std::map<std::string, std::string> recovered_states;
+  int recovered_updates = 0;
+  StateCheckpointer checkpointer(wal, 60000, 100);
+  ASSERT_EQ(NO_ERROR, checkpointer.start());
+  CheckpointedStateBackend backend(
+      std::make_unique<CountingStateBackend>(recovered_states, recovered_updates),
+      checkpointer);
+  char buffer[1024];
+  EXPECT_EQ(NO_ERROR, backend.lookup_state(buffer, "rule", "file with spaces\n"));
+  EXPECT_STREQ("42", buffer);
+  EXPECT_EQ(NO_ERROR, backend.lookup_state(buffer, "rule", "file1"));
+  EXPECT_STREQ("1", buffer);
+  // recovered state is written to the backend that looked it up
+  EXPECT_EQ(NO_ERROR, checkpointer.flush());
+  EXPECT_EQ(2, recovered_updates);
+  EXPECT_EQ("42", recovered_states["rulefile with spaces\n"]);
+  backend.disconnect();
+  checkpointer.stop();
+  std::remove(wal.c_str());
+}
+
+/*------------------------------
+ * ActionQueue
+ *------------------------------*/
+
+TEST(action_queue_test, test_drop) {
+  MetricsRegistry registry;
+  Counter &dropped = registry.counter("dropped", "");
+  ActionQueue q(2, overflow_drop);
+  q.set_counters(&dropped, nullptr, nullptr, nullptr);
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("1", "a", "b")));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("2", "a", "b")));
+  EXPECT_FALSE(q.push(std::make_shared<TestEvent>("3", "a", "b")));
+  EXPECT_EQ(2, q.size());
+  EXPECT_EQ(1, dropped.get());
+  EXPECT_EQ("1", q.pop()->get_value("f1"));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("4", "a", "b")));
+  EXPECT_EQ("2", q.pop()->get_value("f1"));
+  EXPECT_EQ("4", q.pop()->get_value("f1"));
+}
+
+TEST(action_queue_test, test_coalesce) {
+  MetricsRegistry registry;
+  Counter &coalesced = registry.counter("coalesced", "");
+  ActionQueue q(2, overflow_coalesce);
+  q.set_counters(nullptr, &coalesced, nullptr, nullptr);
+  q.set_coalesce_key([](const Event &evt) { return evt.get_value("f2"); });
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("1", "file1", "b")));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("2", "file2", "b")));
+  // an event for file1 is already queued
+  EXPECT_FALSE(q.push(std::make_shared<TestEvent>("3", "file1", "b")));
+  EXPECT_EQ(1, coalesced.get());
+
+  // events that can't be coalesced block until there's room
+  std::thread producer([&q]() {
+    q.push(std::make_shared<TestEvent>("4", "file3", "b"));
+  });
+  EXPECT_EQ("1", q.pop()->get_value("f1"));
+  producer.join();
+  EXPECT_EQ("2", q.pop()->get_value("f1"));
+  EXPECT_EQ("4", q.pop()->get_value("f1"));
+  EXPECT_EQ(0, q.size());
+}
+
+TEST(action_queue_test, test_spill) {
+  MetricsRegistry registry;
+  Counter &spilled = registry.counter("spilled", "");
+  std::string spill_file = "action-queue-test.spill";
+  ActionQueue q(2, overflow_spill);
+  q.set_counters(nullptr, nullptr, &spilled, nullptr);
+  q.set_spill_file(spill_file);
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(q.push(std::make_shared<TestEvent>(std::to_string(i), "a\nb", "c")));
+  }
+  EXPECT_EQ(5, q.size());
+  EXPECT_EQ(3, spilled.get());
+
+  // events are popped in order, new events are spilled until the spill file is drained
+  EXPECT_EQ("0", q.pop()->get_value("f1"));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("5", "a", "c")));
+  EXPECT_EQ(4, spilled.get());
+  for (int i = 1; i <= 5; i++) {
+    EXPECT_EQ(std::to_string(i), q.pop()->get_value("f1"));
+  }
+  EXPECT_EQ(0, q.size());
+  EXPECT_FALSE(std::ifstream(spill_file).good());
+
+  // a full queue spills again once the file has been drained
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("6", "a", "c")));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("7", "a", "c")));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("8", "a", "c")));
+  EXPECT_EQ(5, spilled.get());
+  for (int i = 6; i <= 8; i++) {
+    EXPECT_EQ(std::to_string(i), q.pop()->get_value("f1"));
+  }
+  EXPECT_FALSE(std::ifstream(spill_file).good());
+}
+
+TEST(action_queue_test, test_spill_concurrent) {
+  // consumers read spilled events while the producer keeps spilling
+  std::string spill_file = "action-queue-test-concurrent.spill";
+  ActionQueue q(4, overflow_spill);
+  q.set_spill_file(spill_file);
+  const int num_events = 2000;
+  std::thread producer([&q]() {
+    for (int i = 0; i < num_events; i++) {
+      q.push(std::make_shared<TestEvent>(std::to_string(i), "a", "c"));
+    }
+  });
+  for (int i = 0; i < num_events; i++) {
+    evt_t evt = q.pop();
+    ASSERT_NE(nullptr, evt);
+    EXPECT_EQ(std::to_string(i), evt->get_value("f1"));
+  }
+  producer.join();
+  EXPECT_EQ(0, q.size());
+  std::remove(spill_file.c_str());
+}
+
+TEST(action_queue_test, test_wakeup) {
+  ActionQueue q(1, overflow_block);
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("1", "a", "b")));
+  // wake-ups don't count against the capacity
+  q.push_wakeup();
+  EXPECT_NE(nullptr, q.pop());
+  EXPECT_EQ(nullptr, q.pop());
+}
+
+TEST(action_queue_test, test_queue_clause) {
+  std::unique_ptr<Action> a = Action::parse_action(
+      "LOGLOAD path MATCH .* FIELDS 0 DELIM , INTO FILE logload-out QUEUE 100 coalesce");
+  EXPECT_EQ(100, a->get_action_queue()->get_capacity());
+  EXPECT_EQ(overflow_coalesce, a->get_action_queue()->get_policy());
+
+  // without a clause, queues are unbounded
+  a = Action::parse_action("DBLOAD f1 INTO FILE dbload-out");
+  EXPECT_EQ(0, a->get_action_queue()->get_capacity());
+
+  EXPECT_THROW(Action::parse_action("DBLOAD f1 INTO FILE dbload-out QUEUE 10 sometimes"),
+      std::invalid_argument);
+
+  // QUEUE in other parts of the action isn't a clause
+  a = Action::parse_action(
+      "LOGLOAD path MATCH job QUEUE full FIELDS 0 DELIM , INTO FILE logload-out");
+  ASSERT_NE(nullptr, a);
+  EXPECT_EQ(0, a->get_action_queue()->get_capacity());
+  a = Action::parse_action(
+      "LOGLOAD path MATCH QUEUE 10 drop FIELDS 0 DELIM , INTO FILE logload-out QUEUE 5 drop");
+  ASSERT_NE(nullptr, a);
+  EXPECT_EQ(5, a->get_action_queue()->get_capacity());
+  EXPECT_EQ(overflow_drop, a->get_action_queue()->get_policy());
+}
+
+TEST(action_queue_test, test_coalesce_pending) {
+  MetricsRegistry registry;
+  Counter &coalesced = registry.counter("coalesced", "");
+  ActionQueue q;
+  q.set_counters(nullptr, &coalesced, nullptr, nullptr);
+  q.set_coalesce_key([](const Event &evt) { return evt.get_value("f2"); });
+  q.set_coalescing(true);
+  // the queue isn't full but pending events for the same target are still coalesced
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("1", "file1", "b")));
+  EXPECT_FALSE(q.push(std::make_shared<TestEvent>("2", "file1", "b")));
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("3", "file2", "b")));
+  EXPECT_FALSE(q.push(std::make_shared<TestEvent>("4", "file1", "b")));
+  EXPECT_EQ(2, q.size());
+  EXPECT_EQ(2, coalesced.get());
+  EXPECT_EQ("1", q.pop()->get_value("f1"));
+  // once the event has been popped, the next trigger is queued again
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("5", "file1", "b")));
+  EXPECT_EQ("3", q.pop()->get_value("f1"));
+  EXPECT_EQ("5", q.pop()->get_value("f1"));
+}
+
+TEST(action_queue_test, test_coalesce_debounce) {
+  ActionQueue q;
+  q.set_coalesce_key([](const Event &evt) { return evt.get_value("f2"); });
+  q.set_coalescing(true, 100);
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("1", "file1", "b")));
+  EXPECT_FALSE(q.push(std::make_shared<TestEvent>("2", "file1", "b")));
+  EXPECT_EQ("1", q.pop()->get_value("f1"));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+  // pending events are flushed without waiting when the queue is stopped
+  EXPECT_TRUE(q.push(std::make_shared<TestEvent>("3", "file1", "b")));
+  q.push_wakeup();
+  start = std::chrono::steady_clock::now();
+  EXPECT_EQ("3", q.pop()->get_value("f1"));
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+  EXPECT_EQ(nullptr, q.pop());
+}
+
+TEST(action_queue_test, test_affinity) {
+  ActionQueue q;
+  q.set_affinity_key([](const Event &evt) { return evt.get_value("f2"); });
+  q.push(std::make_shared<TestEvent>("1", "file1", "b"));
+  q.push(std::make_shared<TestEvent>("2", "file1", "b"));
+  q.push(std::make_shared<TestEvent>("3", "file2", "b"));
+
+  std::string key1, key2;
+  ActionQueue::clock_t::time_point next_ready;
+  EXPECT_EQ("1", q.try_pop(&key1, &next_ready)->get_value("f1"));
+  EXPECT_EQ("file1", key1);
+  // event 2 has to wait until event 1 has been processed
+  EXPECT_EQ("3", q.try_pop(&key2, &next_ready)->get_value("f1"));
+  EXPECT_EQ(nullptr, q.try_pop(&key2, &next_ready));
+  EXPECT_FALSE(q.has_ready());
+  q.release(key1);
+  EXPECT_TRUE(q.has_ready());
+  EXPECT_EQ("2", q.try_pop(&key1, &next_ready)->get_value("f1"));
+}
+
+TEST(action_queue_test, test_coalesce_idempotent_actions) {
+  std::unique_ptr<Action> a = Action::parse_action(
+      "LOGLOAD path MATCH .* FIELDS 0 DELIM , INTO FILE logload-out");
+  EXPECT_TRUE(a->get_action_queue()->is_coalescing());
+  // DBLOAD annotates the loaded records with the time of each event, so
+  // pending events for the same file aren't coalesced
+  a = Action::parse_action("DBLOAD f1 INTO FILE dbload-out");
+  EXPECT_FALSE(a->get_action_queue()->is_coalescing());
+  EXPECT_TRUE(a->get_action_queue()->push(std::make_shared<TestEvent>("file1", "a", "b")));
+  EXPECT_TRUE(a->get_action_queue()->push(std::make_shared<TestEvent>("file1", "a", "b")));
+  EXPECT_EQ(2, a->get_action_queue()->size());
+
+  // but a full queue with the coalesce policy drops events for a file that's
+  // already queued
+  a = Action::parse_action("DBLOAD f1 INTO FILE dbload-out QUEUE 1 coalesce");
+  EXPECT_FALSE(a->get_action_queue()->is_coalescing());
+  EXPECT_TRUE(a->get_action_queue()->push(std::make_shared<TestEvent>("file1", "a", "b")));
+  EXPECT_FALSE(a->get_action_queue()->push(std::make_shared<TestEvent>("file1", "a", "b")));
+  EXPECT_EQ(1, a->get_action_queue()->size());
+}
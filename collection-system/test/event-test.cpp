@@ -15,11 +15,16 @@
  */
 
 #include <memory>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
 
 #include "gtest/gtest.h"
 #include "event.h"
 #include "scale-event.h"
 #include "auditd-event.h"
+#include "event-pool.h"
+#include "trace.h"
 
 TEST(event_test, test_event_test1) {
   TestEvent e("1","abc","hello world");
@@ -363,3 +368,152 @@ TEST(event_test, fs_event_json_test4) {
   EXPECT_EQ("_NULL_",  e_deserialized->get_value("dst_path"));
   EXPECT_EQ("",  e_deserialized->get_value("version_hash"));
 }
+
+TEST(event_test, syscall_event_pool_test1) {
+  std::string evt = "4,node1,time1,12345,1,2,3,4,5,6,clone,"
+      "0,a0,a1,a2,a3,a4,time2,data0,data1";
+  SyscallEventPool pool(2);
+  EXPECT_EQ(0, pool.get_num_free());
+
+  // syscall events are kept for reuse up to the pool's limit
+  pool.release(new SyscallEvent(evt));
+  pool.release(new SyscallEvent(evt));
+  EXPECT_EQ(2, pool.get_num_free());
+  pool.release(new SyscallEvent(evt));
+  EXPECT_EQ(2, pool.get_num_free());
+
+  // other events are deleted
+  pool.release(new ProcessEvent(1, 2, 3, "/", { "ls" }, "time1", "time2"));
+  pool.release(nullptr);
+  EXPECT_EQ(2, pool.get_num_free());
+  EXPECT_EQ(0, pool.get_num_allocated());
+  EXPECT_EQ(0, pool.get_num_reused());
+}
+
+#ifdef __linux__
+TEST(event_test, syscall_event_pool_test2) {
+  // an execve with arguments and a working directory followed by a plain close
+  const char *records =
+      "type=SYSCALL msg=audit(1600000000.123:100): arch=c000003e syscall=59 success=yes exit=0 "
+      "a0=1 a1=2 a2=3 a3=4 items=2 ppid=1 pid=100 auid=0 uid=10 gid=11 euid=12 suid=0 fsuid=0 "
+      "egid=13 sgid=0 fsgid=0\n"
+      "type=EXECVE msg=audit(1600000000.123:100): argc=2 a0=\"ls\" a1=\"-l\"\n"
+      "type=CWD msg=audit(1600000000.123:100): cwd=\"/tmp\"\n"
+      "type=SYSCALL msg=audit(1600000001.456:101): arch=c000003e syscall=3 success=yes exit=0 "
+      "a0=5 items=0 ppid=2 pid=200 auid=0 uid=20 gid=21 euid=22 suid=0 fsuid=0 egid=23 sgid=0 "
+      "fsgid=0\n";
+  auparse_state_t *au = auparse_init(AUSOURCE_BUFFER, records);
+  ASSERT_NE(nullptr, au);
+  SyscallEventPool pool(1);
+
+  ASSERT_EQ(1, auparse_next_event(au));
+  SyscallEvent *first = pool.acquire(au);
+  EXPECT_EQ("execve", first->get_value("syscall_name"));
+  EXPECT_EQ("100", first->get_value("pid"));
+  EXPECT_NE("", first->get_value("data"));
+  first->set_node_name("node1");
+  EXPECT_EQ(1, pool.get_num_allocated());
+  pool.release(first);
+
+  // the released event is handed out again and nothing from the execve is left over
+  ASSERT_EQ(1, auparse_next_event(au));
+  SyscallEvent *second = pool.acquire(au);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1, pool.get_num_allocated());
+  EXPECT_EQ(1, pool.get_num_reused());
+  EXPECT_EQ(0, pool.get_num_free());
+  EXPECT_EQ("close", second->get_value("syscall_name"));
+  EXPECT_EQ("101", second->get_value("auditd_event_id"));
+  EXPECT_EQ("200", second->get_value("pid"));
+  EXPECT_EQ("2", second->get_value("ppid"));
+  EXPECT_EQ("20", second->get_value("uid"));
+  EXPECT_EQ("21", second->get_value("gid"));
+  EXPECT_EQ("22", second->get_value("euid"));
+  EXPECT_EQ("23", second->get_value("egid"));
+  EXPECT_EQ("0", second->get_value("rc"));
+  EXPECT_EQ("", second->get_value("arg1"));
+  EXPECT_EQ("", second->get_value("arg2"));
+  EXPECT_EQ("", second->get_value("arg3"));
+  EXPECT_EQ("", second->get_value("data"));
+  EXPECT_EQ("", second->get_node_name());
+  EXPECT_EQ(1600000001456u, second->get_audit_time_ms());
+  EXPECT_EQ("2020-09-13 12:26:41.456", second->get_value("event_time"));
+
+  pool.release(second);
+  auparse_destroy(au);
+}
+#endif
+
+TEST(event_test, event_trace_test1) {
+  std::string evt = "4,node1,,12345,1,2,3,4,5,6,clone,"
+      "0,a0,a1,a2,a3,a4,time2,data0,data1";
+  std::shared_ptr<Event> e = Event::deserialize_event(evt);
+
+  // untraced events are left alone
+  EXPECT_FALSE(EventTrace::is_traced(e.get()));
+  EventTrace::stamp(e.get(), trace_loader);
+  EXPECT_EQ("", e->get_send_time());
+
+  EventTrace::start(e.get(), trace_extractor, 1000);
+  EXPECT_TRUE(EventTrace::is_traced(e.get()));
+  EventTrace::stamp(e.get(), trace_loader);
+
+  // the trace survives serialization
+  std::shared_ptr<Event> e_deserialized = Event::deserialize_event(e->serialize());
+  EventTrace trace;
+  EXPECT_TRUE(trace.parse(e_deserialized->get_send_time()));
+  EXPECT_EQ(1000, trace.get_stamp(trace_audit));
+  EXPECT_LT(0, trace.get_stamp(trace_extractor));
+  EXPECT_EQ(0, trace.get_stamp(trace_transformer));
+  EXPECT_LE(trace.get_stamp(trace_extractor), trace.get_stamp(trace_loader));
+  EXPECT_EQ("1", e_deserialized->get_value("pid"));
+
+  EXPECT_FALSE(trace.parse("time1"));
+}
+
+TEST(event_test, trace_sampler_test1) {
+  TraceSampler disabled;
+  TraceSampler sampler(4);
+  int num_sampled = 0;
+  for (int i = 0; i < 100; i++) {
+    EXPECT_FALSE(disabled.sample());
+    if (sampler.sample()) {
+      num_sampled++;
+    }
+  }
+  EXPECT_EQ(25, num_sampled);
+}
+
+TEST(event_test, trace_collector_test1) {
+  std::string trace_file = "trace-collector-test.csv";
+  remove(trace_file.c_str());
+  {
+    TraceCollector collector(trace_file);
+    std::shared_ptr<Event> e = Event::deserialize_event("4,node1,"
+        "trace:1000:2000:0:5000:9000:9500:10000,12345,1,2,3,4,5,6,clone,"
+        "0,a0,a1,a2,a3,a4,time2,data0,data1");
+    std::shared_ptr<Event> untraced = Event::deserialize_event("4,node1,,12345,1,2,3,4,5,6,clone,"
+        "0,a0,a1,a2,a3,a4,time2,data0,data1");
+    collector.collect(e.get());
+    collector.collect(untraced.get());
+    collector.report();
+  }
+
+  std::ifstream traces(trace_file);
+  std::string line;
+  int num_lines = 0;
+  while (std::getline(traces, line)) {
+    EXPECT_EQ("4,node1,1000,2000,0,5000,9000,9500,10000", line);
+    num_lines++;
+  }
+  EXPECT_EQ(1, num_lines);
+
+  std::ifstream summary(trace_file + ".summary");
+  std::stringstream summary_ss;
+  summary_ss << summary.rdbuf();
+  EXPECT_NE(std::string::npos, summary_ss.str().find("traces 1\n"));
+  EXPECT_NE(std::string::npos, summary_ss.str().find("loader_us count 1 p50 3000"));
+  EXPECT_NE(std::string::npos, summary_ss.str().find("end_to_end_us count 1"));
+  remove(trace_file.c_str());
+  remove((trace_file + ".summary").c_str());
+}
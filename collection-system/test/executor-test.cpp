@@ -0,0 +1,111 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "executor.h"
+
+TEST(executor_test, test_run_all_tasks) {
+  std::atomic<int> num_runs { 0 };
+  {
+    WorkStealingExecutor executor(4);
+    for (int i = 0; i < 1000; i++) {
+      executor.submit([&num_runs]() { num_runs++; });
+    }
+    // stop() runs the remaining tasks
+    executor.stop();
+  }
+  EXPECT_EQ(1000, num_runs);
+}
+
+TEST(executor_test, test_steal) {
+  WorkStealingExecutor executor(2);
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool release = false;
+  std::atomic<int> num_runs { 0 };
+
+  // block one worker and queue follow-up tasks on its deque, which can only
+  // run if the other worker steals them
+  executor.submit([&]() {
+    for (int i = 0; i < 10; i++) {
+      executor.submit([&num_runs]() { num_runs++; });
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&release]() { return release; });
+  });
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (num_runs < 10 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(10, num_runs);
+  EXPECT_LE(10, executor.get_num_steals());
+
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    release = true;
+  }
+  cv.notify_all();
+  executor.stop();
+}
+
+TEST(executor_test, test_submit_after) {
+  WorkStealingExecutor executor(1);
+  std::atomic<bool> done { false };
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::steady_clock::time_point ran;
+  executor.submit_after([&]() {
+    ran = std::chrono::steady_clock::now();
+    done = true;
+  }, std::chrono::milliseconds(50));
+  while (!done) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_GE(ran - start, std::chrono::milliseconds(50));
+  executor.stop();
+}
+
+TEST(executor_test, test_concurrent_submit) {
+  std::atomic<int> num_runs { 0 };
+  {
+    WorkStealingExecutor executor(4);
+    // tasks that are taken right after being queued mustn't throw off the
+    // queued task count, otherwise the workers never go idle and stop() hangs
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < 4; t++) {
+      submitters.emplace_back([&executor, &num_runs]() {
+        for (int i = 0; i < 1000; i++) {
+          executor.submit([&executor, &num_runs]() {
+            num_runs++;
+            executor.submit([&num_runs]() { num_runs++; });
+          });
+        }
+      });
+    }
+    for (std::thread &t : submitters) {
+      t.join();
+    }
+    executor.stop();
+  }
+  EXPECT_EQ(8000, num_runs);
+}
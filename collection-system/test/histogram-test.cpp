@@ -0,0 +1,88 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "histogram.h"
+
+TEST(histogram_test, test_bucket_index) {
+  // small values have their own bucket
+  for (uint64_t v = 0; v < Histogram::SUB_BUCKETS; v++) {
+    EXPECT_EQ(v, Histogram::bucket_index(v));
+    EXPECT_EQ(v, Histogram::bucket_upper_bound(v));
+  }
+  // buckets are contiguous and every value falls within its bucket
+  uint64_t values[] = { 16, 17, 31, 32, 33, 63, 64, 1000, 123456789, UINT64_MAX };
+  for (uint64_t v : values) {
+    size_t i = Histogram::bucket_index(v);
+    EXPECT_LT(i, Histogram::NUM_BUCKETS);
+    EXPECT_LE(v, Histogram::bucket_upper_bound(i));
+    EXPECT_GT(v, Histogram::bucket_upper_bound(i - 1));
+  }
+  EXPECT_EQ(Histogram::NUM_BUCKETS - 1, Histogram::bucket_index(UINT64_MAX));
+  EXPECT_EQ(UINT64_MAX, Histogram::bucket_upper_bound(Histogram::NUM_BUCKETS - 1));
+}
+
+TEST(histogram_test, test_percentiles) {
+  Histogram h;
+  for (uint64_t v = 1; v <= 1000; v++) {
+    h.record(v);
+  }
+  HistogramSnapshot s = h.snapshot();
+  EXPECT_EQ(1000, s.get_count());
+  EXPECT_EQ(1000, s.get_max());
+  EXPECT_DOUBLE_EQ(500.5, s.get_mean());
+  // percentiles are accurate to within the sub-bucket precision
+  EXPECT_NEAR(500, s.get_percentile(50), 500 / Histogram::SUB_BUCKETS);
+  EXPECT_NEAR(990, s.get_percentile(99), 990 / Histogram::SUB_BUCKETS);
+  EXPECT_EQ(1000, s.get_percentile(100));
+  EXPECT_EQ(1, h.snapshot().get_percentile(0));
+}
+
+TEST(histogram_test, test_snapshot_reset) {
+  Histogram h;
+  h.record(5);
+  h.record(7);
+  HistogramSnapshot s = h.snapshot(true);
+  EXPECT_EQ(2, s.get_count());
+  EXPECT_EQ(7, s.get_max());
+  EXPECT_EQ(7, s.get_percentile(99));
+
+  s = h.snapshot();
+  EXPECT_EQ(0, s.get_count());
+  EXPECT_EQ(0, s.get_max());
+  EXPECT_EQ(0, s.get_percentile(50));
+}
+
+TEST(histogram_test, test_concurrent_record) {
+  Histogram h;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.push_back(std::thread([&h]() {
+      for (uint64_t v = 0; v < 10000; v++) {
+        h.record(v);
+      }
+    }));
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  HistogramSnapshot s = h.snapshot();
+  EXPECT_EQ(40000, s.get_count());
+  EXPECT_EQ(9999, s.get_max());
+}
@@ -0,0 +1,174 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "logger.h"
+
+static std::vector<std::string> read_lines(const std::string &file_name) {
+  std::ifstream in(file_name);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line)) {
+    lines.push_back(line);
+  }
+  return lines;
+}
+
+TEST(logger_test, test_rate_limiter) {
+  LogRateLimiter limiter;
+  uint32_t suppressed = 0;
+
+  // unlimited by default
+  for (int i = 0; i < 100; i++) {
+    EXPECT_TRUE(limiter.allow(&suppressed));
+  }
+
+  Logger::set_rate_limit(10);
+  int num_allowed = 0;
+  for (int i = 0; i < 100; i++) {
+    if (limiter.allow(&suppressed)) {
+      num_allowed++;
+    }
+  }
+  // we might have crossed into the next second
+  EXPECT_LE(10, num_allowed);
+  EXPECT_GE(20, num_allowed);
+
+  // the next message that passes reports the suppressed ones
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  EXPECT_TRUE(limiter.allow(&suppressed));
+  EXPECT_EQ(100 - num_allowed, suppressed);
+  Logger::set_rate_limit(0);
+}
+
+TEST(logger_test, test_async_writer) {
+  std::string log_file = "async-writer-test.log";
+  remove(log_file.c_str());
+  {
+    AsyncLogWriter writer(std::make_unique<FileBackend>(log_file), 1024, 32);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.push_back(std::thread([&writer, t]() {
+        for (int i = 0; i < 100; i++) {
+          writer.submit("thread " + std::to_string(t) + " record " + std::to_string(i));
+        }
+      }));
+    }
+    for (std::thread &t : threads) {
+      t.join();
+    }
+    writer.submit(std::string(100, 'x'));
+    writer.stop();
+    EXPECT_FALSE(writer.submit("after stop"));
+  }
+
+  std::vector<std::string> lines = read_lines(log_file);
+  ASSERT_EQ(401, lines.size());
+  // records of a single thread stay in order
+  int next_record = 0;
+  for (const std::string &line : lines) {
+    if (line.find("thread 2 ") == 0) {
+      EXPECT_EQ("thread 2 record " + std::to_string(next_record++), line);
+    }
+  }
+  EXPECT_EQ(100, next_record);
+  EXPECT_EQ(std::string(32, 'x') + "... [truncated 68 bytes]", lines.back());
+  remove(log_file.c_str());
+}
+
+TEST(logger_test, test_async_writer_full) {
+  std::string log_file = "async-writer-full-test.log";
+  remove(log_file.c_str());
+  int num_submitted = 0;
+  {
+    AsyncLogWriter writer(std::make_unique<FileBackend>(log_file), 4);
+    // submitting never blocks, records that don't fit are dropped
+    for (int i = 0; i < 10000; i++) {
+      if (writer.submit("record " + std::to_string(i))) {
+        num_submitted++;
+      }
+    }
+    writer.stop();
+    EXPECT_LT(0, num_submitted);
+    EXPECT_GT(10000, num_submitted);
+  }
+
+  // everything that was accepted has been written and the drops are reported
+  int num_records = 0;
+  bool drops_reported = false;
+  for (const std::string &line : read_lines(log_file)) {
+    if (line.find("record ") == 0) {
+      num_records++;
+    } else if (line.find("dropped") != std::string::npos) {
+      drops_reported = true;
+    }
+  }
+  EXPECT_EQ(num_submitted, num_records);
+  EXPECT_TRUE(drops_reported);
+  remove(log_file.c_str());
+}
+
+TEST(logger_test, test_log_format_text) {
+  LogFormat format((uint8_t) Level::Error, "event {} failed with {} after {}s", "f", 1);
+  EXPECT_EQ("event abc failed with -3 after 1.5s",
+      format.format_text(std::string("abc"), -3, 1.5));
+  // missing arguments leave the placeholders, extra arguments are appended
+  EXPECT_EQ("event x failed with {} after {}s", format.format_text("x"));
+  LogFormat no_args((uint8_t) Level::Error, "no placeholders", "f", 2);
+  EXPECT_EQ("no placeholders 42", no_args.format_text(42u));
+}
+
+TEST(logger_test, test_binary_log) {
+  std::string log_file = "binary-log-test.binlog";
+  LogFormat first((uint8_t) Level::Error, "Problems while receiving event {} Skipping event.",
+      "run", 42);
+  LogFormat second((uint8_t) Level::Warning, "{} of {} records ({}%)", "report", 7);
+  {
+    AsyncLogWriter writer(std::make_unique<BinaryFileBackend>(log_file), 1024, SIZE_MAX);
+    // events may be written before their format definition
+    writer.submit(first.encode_event(0, std::string("bad,event")));
+    writer.submit(first.encode_definition());
+    writer.submit(second.encode_definition());
+    writer.submit(second.encode_event(0, 3ul, -10, 2.5));
+    writer.submit(first.encode_event(0, std::string(binlog::MAX_STRING_ARG + 10, 'x')));
+    writer.stop();
+  }
+
+  std::ifstream in(log_file, std::ifstream::binary);
+  std::ostringstream out;
+  EXPECT_EQ(3, binlog::decode(in, out));
+  std::istringstream rendered(out.str());
+  std::string line;
+  std::getline(rendered, line);
+  EXPECT_NE(std::string::npos,
+      line.find(" [run:42] [ERROR] - Problems while receiving event bad,event Skipping event."));
+  std::getline(rendered, line);
+  EXPECT_NE(std::string::npos, line.find(" [report:7] [WARN] - 3 of -10 records (2.5%)"));
+  // long strings are truncated
+  std::getline(rendered, line);
+  EXPECT_NE(std::string::npos, line.find(std::string(binlog::MAX_STRING_ARG, 'x') + " Skipping"));
+  remove(log_file.c_str());
+
+  std::istringstream not_binary("some text log");
+  EXPECT_EQ(-1, binlog::decode(not_binary, out));
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "gtest/gtest.h"
+#include "error.h"
+#include "metrics.h"
+
+TEST(metrics_test, test_render) {
+  MetricsRegistry registry;
+  registry.counter("events_total", "Events.", { { "source", "a" } }).inc(3);
+  registry.counter("events_total", "Events.", { { "source", "b\"c" } }).inc();
+  // the same name and labels return the same metric
+  registry.counter("events_total", "Events.", { { "source", "a" } }).inc();
+  registry.gauge("queue_depth", "Queue depth.").set(-2);
+  Histogram &h = registry.histogram("latency_us", "Latency.", { { "rule", "r1" } });
+  for (int i = 1; i <= 100; i++) {
+    h.record(i);
+  }
+
+  std::string rendered = registry.render();
+  EXPECT_NE(std::string::npos, rendered.find("# TYPE events_total counter\n"));
+  EXPECT_NE(std::string::npos, rendered.find("events_total{source=\"a\"} 4\n"));
+  EXPECT_NE(std::string::npos, rendered.find("events_total{source=\"b\\\"c\"} 1\n"));
+  EXPECT_NE(std::string::npos, rendered.find("# TYPE queue_depth gauge\nqueue_depth -2\n"));
+  EXPECT_NE(std::string::npos, rendered.find("# TYPE latency_us summary\n"));
+  EXPECT_NE(std::string::npos, rendered.find("latency_us{rule=\"r1\",quantile=\"0.5\"} 5"));
+  EXPECT_NE(std::string::npos, rendered.find("latency_us_sum{rule=\"r1\"} 5050\n"));
+  EXPECT_NE(std::string::npos, rendered.find("latency_us_count{rule=\"r1\"} 100\n"));
+}
+
+TEST(metrics_test, test_type_conflict) {
+  MetricsRegistry registry;
+  registry.counter("metric", "A counter.");
+  EXPECT_THROW(registry.gauge("metric", "A gauge."), std::invalid_argument);
+}
+
+TEST(metrics_test, test_server) {
+  MetricsRegistry registry;
+  registry.counter("requests_total", "Requests.").inc(7);
+  MetricsServer server(registry, 0);
+  ASSERT_EQ(NO_ERROR, server.start());
+  ASSERT_LT(0, server.get_port());
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(server.get_port());
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  ASSERT_EQ(0, connect(fd, (sockaddr*) &addr, sizeof(addr)));
+  std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  ASSERT_EQ((ssize_t) request.size(), write(fd, request.data(), request.size()));
+
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    response.append(buf, n);
+  }
+  close(fd);
+  server.stop();
+
+  EXPECT_EQ(0, response.find("HTTP/1.0 200 OK\r\n"));
+  EXPECT_NE(std::string::npos, response.find("\r\n\r\n# HELP requests_total Requests.\n"));
+  EXPECT_NE(std::string::npos, response.find("requests_total 7\n"));
+}
@@ -14,8 +14,56 @@
  * limitations under the License.
  */
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "gtest/gtest.h"
 #include "os-model.h"
+#include "proc-scanner.h"
+#include "dns-cache.h"
+
+/*
+ * The fake procfs in the test resources only contains regular files as
+ * dangling symlinks can't be reliably checked in and copied. This creates
+ * the cwd and fd links that the ProcScanner reads through readlink.
+ */
+static void create_procfs_links() {
+  mkdir("procfs/100/fd", 0755);
+  mkdir("procfs/101/fd", 0755);
+  symlink("/home/user", "procfs/100/cwd");
+  symlink("pipe:[5000]", "procfs/100/fd/1");
+  symlink("/dev/pts/0", "procfs/100/fd/2");
+  symlink("/tmp", "procfs/101/cwd");
+  symlink("pipe:[5000]", "procfs/101/fd/0");
+  symlink("socket:[6000]", "procfs/101/fd/3");
+}
+
+/*
+ * Looks up the address until it's no longer pending (or we give up)
+ * as the cache resolves addresses in the background.
+ */
+static dns_lookup_rc_t wait_for_lookup(ReverseDnsCache &cache, const std::string &addr,
+    std::string *hostname) {
+  dns_lookup_rc_t rc = cache.lookup(addr, hostname);
+  for (int i = 0; i < 500 && rc == dns_pending; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    rc = cache.lookup(addr, hostname);
+  }
+  return rc;
+}
+
+static std::vector<std::string> get_socket_connect_events(const std::vector<Event*> &events) {
+  std::vector<std::string> connects;
+  for (Event *e : events) {
+    if (e->get_type() == EventType::SOCKET_CONNECT_EVENT) {
+      connects.push_back(e->serialize());
+    }
+  }
+  return connects;
+}
 
 TEST(os_model_test, test_fork_exec_exit) {
   OSModel os;
@@ -153,7 +201,7 @@ TEST(os_model_test, test_pipe_ipc) {
 TEST(os_model_test, test_socket_ipc) {
   OSModel os;
 
-  Socket::reverse_dns_cache["192.168.0.1"] = "some-host";
+  Socket::reverse_dns_cache.put("192.168.0.1", "some-host");
 
   std::string clone_event1_str = "4,node1,2020/04/26-14:24:01.100,1,121,120,1010,2,1010,2,"
       "clone,122,,,,,,2020/04/26-14:24:01.100,";
@@ -205,3 +253,248 @@ TEST(os_model_test, test_socket_ipc) {
   EXPECT_EQ("6,,,122,2020/04/26-14:24:02.000,2020/04/26-14:24:06.100,12345,", events[12]->serialize());
   EXPECT_EQ("7,,,123,2020/04/26-14:24:04.000,some-host,12345,", events[13]->serialize());
 }
+
+TEST(os_model_test, test_proc_scanner) {
+  create_procfs_links();
+  ProcScanner scanner("procfs", 2);
+  std::vector<ProcSnapshot> snapshots = scanner.scan();
+
+  EXPECT_FALSE(scanner.was_truncated());
+  ASSERT_EQ(2, snapshots.size());
+
+  EXPECT_EQ(100, snapshots[0].pid);
+  EXPECT_EQ(1, snapshots[0].ppid);
+  EXPECT_EQ(100, snapshots[0].pgid);
+  EXPECT_EQ("/home/user", snapshots[0].cwd);
+  EXPECT_EQ(std::vector<std::string>({ "bash", "-c", "cat file | grep foo" }),
+      snapshots[0].cmd_line);
+  EXPECT_EQ("2020-09-13 12:26:50.500", snapshots[0].start_time_utc);
+  // the tty fd is neither a pipe nor a socket and hence skipped
+  ASSERT_EQ(1, snapshots[0].fds.size());
+  EXPECT_EQ(1, snapshots[0].fds[0].fd);
+  EXPECT_EQ(osm_fd_pipe_write, snapshots[0].fds[0].type);
+  EXPECT_EQ(5000, snapshots[0].fds[0].inode);
+
+  // the command name of this process contains parentheses
+  EXPECT_EQ(101, snapshots[1].pid);
+  EXPECT_EQ(100, snapshots[1].ppid);
+  EXPECT_EQ(100, snapshots[1].pgid);
+  EXPECT_EQ("/tmp", snapshots[1].cwd);
+  EXPECT_EQ(std::vector<std::string>({ "grep", "foo" }), snapshots[1].cmd_line);
+  EXPECT_EQ("2020-09-13 12:26:52.600", snapshots[1].start_time_utc);
+  ASSERT_EQ(2, snapshots[1].fds.size());
+  EXPECT_EQ(osm_fd_pipe_read, snapshots[1].fds[0].type);
+  EXPECT_EQ(5000, snapshots[1].fds[0].inode);
+  EXPECT_EQ(3, snapshots[1].fds[1].fd);
+  EXPECT_EQ(osm_fd_socket, snapshots[1].fds[1].type);
+  EXPECT_EQ(6000, snapshots[1].fds[1].inode);
+
+  // make sure the process limit is respected
+  ProcScanner limited_scanner("procfs", 1, ProcScanner::DEFAULT_TIMEOUT_MS, 1);
+  EXPECT_EQ(1, limited_scanner.scan().size());
+  EXPECT_TRUE(limited_scanner.was_truncated());
+}
+
+TEST(os_model_test, test_proc_bootstrap) {
+  OSModel os;
+
+  create_procfs_links();
+  ProcScanner scanner("procfs");
+  os.bootstrap(scanner.scan());
+
+  // the bootstrapped processes share a pipe, which is finished once both ends are closed
+  std::string close_event1_str = "4,node1,2020/04/26-14:24:01.000,1,100,1,1010,2,1010,2,"
+      "close,0,1,,,,,2020/04/26-14:24:01.000,";
+  std::string exit_group_event1_str = "4,node1,2020/04/26-14:24:02.000,2,100,1,1010,2,1010,2,"
+      "exit_group,0,,,,,,2020/04/26-14:24:02.000,";
+  std::string close_event2_str = "4,node1,2020/04/26-14:24:03.000,3,101,100,1010,2,1010,2,"
+      "close,0,0,,,,,2020/04/26-14:24:03.000,";
+  std::string exit_group_event2_str = "4,node1,2020/04/26-14:24:04.000,4,101,100,1010,2,1010,2,"
+      "exit_group,0,,,,,,2020/04/26-14:24:04.000,";
+
+  std::shared_ptr<Event> close_event1 = Event::deserialize_event(close_event1_str);
+  std::shared_ptr<Event> exit_group_event1 = Event::deserialize_event(exit_group_event1_str);
+  std::shared_ptr<Event> close_event2 = Event::deserialize_event(close_event2_str);
+  std::shared_ptr<Event> exit_group_event2 = Event::deserialize_event(exit_group_event2_str);
+
+  os.apply_syscall((SyscallEvent*) close_event1.get());
+  os.apply_syscall((SyscallEvent*) exit_group_event1.get());
+  os.apply_syscall((SyscallEvent*) close_event2.get());
+  os.apply_syscall((SyscallEvent*) exit_group_event2.get());
+
+  std::vector<Event*> events = os.reap_os_events();
+  EXPECT_EQ(7, events.size());
+  EXPECT_EQ("2,,,100,1,100,2020-09-13 12:26:50.500,2020/04/26-14:24:02.000,/home/user,bash,-c,"
+      "cat file | grep foo,", events[4]->serialize());
+  EXPECT_EQ("2,,,101,100,100,2020-09-13 12:26:52.600,2020/04/26-14:24:04.000,/tmp,grep,foo,",
+      events[5]->serialize());
+  EXPECT_EQ("5,,,100,101,2020-09-13 12:26:50.500,2020-09-13 12:26:52.600,",
+      events[6]->serialize());
+}
+
+TEST(os_model_test, test_reverse_dns_cache) {
+  std::atomic<int> num_resolutions(0);
+  ReverseDnsCache cache(2, 60000, 50, 1);
+  cache.set_resolver([&num_resolutions](const std::string &addr, std::string *hostname) {
+    num_resolutions++;
+    if (addr == "10.0.0.9") {
+      return false;
+    }
+    *hostname = "host-" + addr.substr(addr.rfind('.') + 1);
+    return true;
+  });
+
+  // addresses are resolved in the background and cached afterwards
+  std::string hostname;
+  EXPECT_EQ(dns_pending, cache.lookup("10.0.0.1", &hostname));
+  EXPECT_EQ(dns_resolved, wait_for_lookup(cache, "10.0.0.1", &hostname));
+  EXPECT_EQ("host-1", hostname);
+  EXPECT_EQ(dns_resolved, cache.lookup("10.0.0.1", &hostname));
+  EXPECT_EQ(1, num_resolutions);
+
+  // failed resolutions are cached until their (shorter) TTL expires
+  EXPECT_EQ(dns_unresolvable, wait_for_lookup(cache, "10.0.0.9", &hostname));
+  EXPECT_EQ(dns_unresolvable, cache.lookup("10.0.0.9", &hostname));
+  EXPECT_EQ(2, num_resolutions);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_EQ(dns_unresolvable, wait_for_lookup(cache, "10.0.0.9", &hostname));
+  EXPECT_EQ(3, num_resolutions);
+
+  // the least recently used address is evicted once the cache is full
+  cache.clear();
+  cache.put("10.0.0.1", "host-1");
+  cache.put("10.0.0.2", "host-2");
+  EXPECT_EQ(dns_resolved, cache.lookup("10.0.0.1", &hostname));
+  cache.put("10.0.0.3", "host-3");
+  EXPECT_EQ(2, cache.size());
+  EXPECT_EQ(dns_resolved, cache.lookup("10.0.0.3", &hostname));
+  EXPECT_EQ(dns_resolved, cache.lookup("10.0.0.1", &hostname));
+  EXPECT_EQ("host-1", hostname);
+  EXPECT_EQ(dns_pending, cache.lookup("10.0.0.2", &hostname));
+}
+
+TEST(os_model_test, test_reverse_dns_cache_stuck_resolver) {
+  // the resolver hangs until we release it, e.g. like getnameinfo on a dead DNS server
+  std::shared_ptr<std::atomic<bool>> release = std::make_shared<std::atomic<bool>>(false);
+  std::shared_ptr<std::atomic<bool>> resolving = std::make_shared<std::atomic<bool>>(false);
+  std::unique_ptr<ReverseDnsCache> cache = std::make_unique<ReverseDnsCache>(2, 60000, 50, 1);
+  cache->set_resolver([release, resolving](const std::string &addr, std::string *hostname) {
+    *resolving = true;
+    while (!*release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    *hostname = "stale-host";
+    return true;
+  });
+  std::string hostname;
+  EXPECT_EQ(dns_pending, cache->lookup("10.0.0.1", &hostname));
+  while (!*resolving) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // clearing the cache doesn't wait for the stuck resolver forever
+  auto start = std::chrono::steady_clock::now();
+  cache->clear();
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::milliseconds(2 * ReverseDnsCache::STOP_TIMEOUT_MS));
+
+  // the abandoned resolution doesn't end up in the cache
+  cache->set_resolver([](const std::string &addr, std::string *hostname) {
+    *hostname = "new-host";
+    return true;
+  });
+  EXPECT_EQ(dns_resolved, wait_for_lookup(*cache, "10.0.0.2", &hostname));
+  *release = true;
+  EXPECT_EQ(dns_resolved, wait_for_lookup(*cache, "10.0.0.1", &hostname));
+  EXPECT_EQ("new-host", hostname);
+
+  // neither does destroying the cache
+  *release = false;
+  *resolving = false;
+  cache->set_resolver([release, resolving](const std::string &addr, std::string *hostname) {
+    *resolving = true;
+    while (!*release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+  });
+  EXPECT_EQ(dns_pending, cache->lookup("10.0.0.3", &hostname));
+  while (!*resolving) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  start = std::chrono::steady_clock::now();
+  cache.reset();
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+      std::chrono::milliseconds(2 * ReverseDnsCache::STOP_TIMEOUT_MS));
+  *release = true;
+}
+
+TEST(os_model_test, test_socket_connect_dns_enrichment) {
+  OSModel os;
+
+  // the resolver blocks until we release it to simulate a slow DNS server
+  std::atomic<bool> release(false);
+  Socket::reverse_dns_cache.clear();
+  Socket::reverse_dns_cache.set_resolver([&release](const std::string &addr,
+      std::string *hostname) {
+    while (!release) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (addr == "10.0.0.1") {
+      *hostname = "late-host";
+      return true;
+    }
+    return false;
+  });
+
+  std::string socket_event1_str = "4,node1,2020/04/26-14:24:01.000,1,122,121,1010,2,1010,2,"
+      "socket,3,,,,,,2020/04/26-14:24:01.000,";
+  std::string connect_event1_str = "4,node1,2020/04/26-14:24:02.000,2,122,121,1010,2,1010,2,"
+      "connect,0,3,,,,,2020/04/26-14:24:02.000,10.0.0.1,80,";
+  std::string socket_event2_str = "4,node1,2020/04/26-14:24:03.000,3,123,121,1010,2,1010,2,"
+      "socket,3,,,,,,2020/04/26-14:24:03.000,";
+  std::string connect_event2_str = "4,node1,2020/04/26-14:24:04.000,4,123,121,1010,2,1010,2,"
+      "connect,0,3,,,,,2020/04/26-14:24:04.000,10.0.0.2,443,";
+
+  std::shared_ptr<Event> socket_event1 = Event::deserialize_event(socket_event1_str);
+  std::shared_ptr<Event> connect_event1 = Event::deserialize_event(connect_event1_str);
+  std::shared_ptr<Event> socket_event2 = Event::deserialize_event(socket_event2_str);
+  std::shared_ptr<Event> connect_event2 = Event::deserialize_event(connect_event2_str);
+
+  // the connects are held back while their addresses are being resolved
+  os.set_dns_resolve_wait(60000);
+  os.apply_syscall((SyscallEvent*) socket_event1.get());
+  os.apply_syscall((SyscallEvent*) connect_event1.get());
+  os.apply_syscall((SyscallEvent*) socket_event2.get());
+  os.apply_syscall((SyscallEvent*) connect_event2.get());
+  std::vector<Event*> events = os.reap_os_events();
+  EXPECT_EQ(4, events.size());
+  EXPECT_TRUE(get_socket_connect_events(events).empty());
+
+  // once resolved, they are enriched with the hostname or passed on with the IP
+  release = true;
+  std::string hostname;
+  wait_for_lookup(Socket::reverse_dns_cache, "10.0.0.1", &hostname);
+  wait_for_lookup(Socket::reverse_dns_cache, "10.0.0.2", &hostname);
+  std::vector<std::string> connects = get_socket_connect_events(os.reap_os_events());
+  ASSERT_EQ(2, connects.size());
+  EXPECT_EQ("7,,,122,2020/04/26-14:24:02.000,late-host,80,", connects[0]);
+  EXPECT_EQ("7,,,123,2020/04/26-14:24:04.000,10.0.0.2,443,", connects[1]);
+
+  // draining releases connects that are still waiting for the resolver
+  release = false;
+  std::string connect_event3_str = "4,node1,2020/04/26-14:24:05.000,5,123,121,1010,2,1010,2,"
+      "connect,0,3,,,,,2020/04/26-14:24:05.000,10.0.0.3,8080,";
+  std::shared_ptr<Event> connect_event3 = Event::deserialize_event(connect_event3_str);
+  os.apply_syscall((SyscallEvent*) connect_event3.get());
+  EXPECT_TRUE(get_socket_connect_events(os.reap_os_events()).empty());
+  connects = get_socket_connect_events(os.reap_os_events(true));
+  ASSERT_EQ(1, connects.size());
+  EXPECT_EQ("7,,,123,2020/04/26-14:24:05.000,10.0.0.3,8080,", connects[0]);
+
+  release = true;
+  Socket::reverse_dns_cache.set_resolver([](const std::string&, std::string*) {
+    return false;
+  });
+  Socket::reverse_dns_cache.clear();
+}
@@ -0,0 +1,221 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <libaudit.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gtest/gtest.h"
+#include "audit-input.h"
+#include "plugin-util.h"
+#include "config.h"
+#include "error.h"
+
+/*------------------------------
+ * SyscallFilter
+ *------------------------------*/
+
+TEST(syscall_filter_test, test_empty_filter) {
+  // without an allow list, every syscall passes
+  SyscallFilter filter;
+  unsigned int arch = audit_machine_to_elf(audit_detect_machine());
+  int connect = audit_name_to_syscall("connect", audit_detect_machine());
+  ASSERT_GE(connect, 0);
+  EXPECT_TRUE(filter.is_allowed(connect, arch));
+  EXPECT_TRUE(filter.is_allowed(100000, arch));
+  EXPECT_TRUE(filter.is_allowed(-1, arch));
+}
+
+TEST(syscall_filter_test, test_allowed_syscalls) {
+  SyscallFilter filter;
+  int machine = audit_detect_machine();
+  unsigned int arch = audit_machine_to_elf(machine);
+  int connect = audit_name_to_syscall("connect", machine);
+  int execve = audit_name_to_syscall("execve", machine);
+  int read = audit_name_to_syscall("read", machine);
+  ASSERT_GE(connect, 0);
+  ASSERT_GE(execve, 0);
+  ASSERT_GE(read, 0);
+
+  // only the listed syscalls pass, everything else is denied
+  filter.set_allowed_syscalls({ "connect", "execve" });
+  EXPECT_TRUE(filter.is_allowed(connect, arch));
+  EXPECT_TRUE(filter.is_allowed(execve, arch));
+  EXPECT_FALSE(filter.is_allowed(read, arch));
+  EXPECT_FALSE(filter.is_allowed(100000, arch));
+  EXPECT_FALSE(filter.is_allowed(-1, arch));
+
+  // syscall numbers of other architectures can't be checked, so they pass
+  EXPECT_TRUE(filter.is_allowed(read, arch ^ __AUDIT_ARCH_64BIT));
+
+  // a new list replaces the previous one
+  filter.set_allowed_syscalls({ "read" });
+  EXPECT_TRUE(filter.is_allowed(read, arch));
+  EXPECT_FALSE(filter.is_allowed(connect, arch));
+
+  filter.allow_all_syscalls();
+  EXPECT_TRUE(filter.is_allowed(read, arch));
+  EXPECT_TRUE(filter.is_allowed(connect, arch));
+}
+
+TEST(syscall_filter_test, test_unknown_syscalls) {
+  SyscallFilter filter;
+  int machine = audit_detect_machine();
+  unsigned int arch = audit_machine_to_elf(machine);
+  int connect = audit_name_to_syscall("connect", machine);
+  int read = audit_name_to_syscall("read", machine);
+
+  // unknown names are ignored
+  filter.set_allowed_syscalls({ "no_such_syscall", "connect" });
+  EXPECT_TRUE(filter.is_allowed(connect, arch));
+  EXPECT_FALSE(filter.is_allowed(read, arch));
+
+  // a list with only unknown names still denies everything else
+  filter.set_allowed_syscalls({ "no_such_syscall" });
+  EXPECT_FALSE(filter.is_allowed(connect, arch));
+  EXPECT_FALSE(filter.is_allowed(read, arch));
+}
+
+TEST(syscall_filter_test, test_load_config) {
+  SyscallFilter filter;
+  int machine = audit_detect_machine();
+  unsigned int arch = audit_machine_to_elf(machine);
+  int connect = audit_name_to_syscall("connect", machine);
+  int execve = audit_name_to_syscall("execve", machine);
+  int read = audit_name_to_syscall("read", machine);
+
+  Config::config[Config::CKEY_SYSCALL_FILTER] = " connect,execve ,";
+  filter.load_config();
+  EXPECT_TRUE(filter.is_allowed(connect, arch));
+  EXPECT_TRUE(filter.is_allowed(execve, arch));
+  EXPECT_FALSE(filter.is_allowed(read, arch));
+
+  Config::config[Config::CKEY_SYSCALL_FILTER] = "all";
+  filter.load_config();
+  EXPECT_TRUE(filter.is_allowed(read, arch));
+  Config::config.erase(Config::CKEY_SYSCALL_FILTER);
+}
+
+/*------------------------------
+ * AuditInput
+ *------------------------------*/
+
+static std::string read_all(AuditInput &input) {
+  std::string out;
+  const char *chunk;
+  ssize_t len;
+  while ((len = input.read_chunk(&chunk)) > 0) {
+    out.append(chunk, len);
+  }
+  EXPECT_EQ(0, len);
+  return out;
+}
+
+TEST(audit_input_test, test_split_at_nul) {
+  std::vector<std::string> parts;
+  auto feed = [&parts](const char *data, size_t len) { parts.emplace_back(data, len); };
+  const char chunk[] = "type=A\n\0\0type=B\ntype=C\0";
+  AuditInput::split_at_nul(chunk, sizeof(chunk) - 1, feed);
+  ASSERT_EQ(2, parts.size());
+  EXPECT_EQ("type=A\n", parts[0]);
+  EXPECT_EQ("type=B\ntype=C", parts[1]);
+
+  parts.clear();
+  AuditInput::split_at_nul("type=D\n", 7, feed);
+  ASSERT_EQ(1, parts.size());
+  EXPECT_EQ("type=D\n", parts[0]);
+  parts.clear();
+  AuditInput::split_at_nul("\0", 1, feed);
+  EXPECT_TRUE(parts.empty());
+}
+
+TEST(audit_input_test, test_file_input) {
+  std::string records = "type=SYSCALL msg=audit(1600000000.123:100): syscall=59\n"
+      "type=CWD msg=audit(1600000000.123:100): cwd=\"/tmp\"\n";
+  {
+    std::ofstream out("audit-input-test.log");
+    out << records;
+  }
+
+  // the file is handed out in chunks until the end is reached
+  FileAuditInput input("audit-input-test.log", 16);
+  ASSERT_EQ(NO_ERROR, input.open());
+  EXPECT_EQ(-1, input.get_fd());
+  const char *chunk;
+  EXPECT_EQ(16, input.read_chunk(&chunk));
+  EXPECT_EQ(records.substr(0, 16), std::string(chunk, 16));
+  EXPECT_EQ(records.substr(16), read_all(input));
+  input.close();
+
+  // the input can be read again after reopening it
+  ASSERT_EQ(NO_ERROR, input.open());
+  EXPECT_EQ(records, read_all(input));
+  input.close();
+
+  std::ofstream("audit-input-test.log", std::ios::trunc).close();
+  FileAuditInput empty("audit-input-test.log");
+  ASSERT_EQ(NO_ERROR, empty.open());
+  EXPECT_EQ("", read_all(empty));
+  std::remove("audit-input-test.log");
+
+  FileAuditInput missing("audit-input-test.log");
+  EXPECT_EQ(ERROR_NO_RETRY, missing.open());
+}
+
+TEST(audit_input_test, test_unix_socket_input) {
+  std::string path = "audit-input-test.sock";
+  unlink(path.c_str());
+
+  // the socket isn't up yet, which the extractor retries
+  UnixSocketAuditInput input(path, 16);
+  EXPECT_EQ(ERROR_RETRY, input.open());
+  EXPECT_EQ(-1, input.get_fd());
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(server, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  ASSERT_EQ(0, bind(server, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, listen(server, 1));
+
+  ASSERT_EQ(NO_ERROR, input.open());
+  EXPECT_GE(input.get_fd(), 0);
+  int conn = accept(server, nullptr, nullptr);
+  ASSERT_GE(conn, 0);
+
+  // records are read as they arrive, in chunks of at most the chunk size
+  std::string records = "type=SYSCALL msg=audit(1600000000.123:100): syscall=59\n";
+  ASSERT_EQ((ssize_t) records.size(), write(conn, records.data(), records.size()));
+  close(conn);
+  const char *chunk;
+  EXPECT_EQ(16, input.read_chunk(&chunk));
+  EXPECT_EQ(records.substr(0, 16), std::string(chunk, 16));
+  EXPECT_EQ(records.substr(16), read_all(input));
+
+  input.close();
+  EXPECT_EQ(-1, input.get_fd());
+  close(server);
+  unlink(path.c_str());
+
+  UnixSocketAuditInput too_long(std::string(200, 'a'));
+  EXPECT_EQ(ERROR_NO_RETRY, too_long.open());
+}
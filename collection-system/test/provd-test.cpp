@@ -0,0 +1,581 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "gtest/gtest.h"
+#include "error.h"
+#include "event-loop.h"
+#include "line-matcher.h"
+#include "output-scanner.h"
+#include "provd.h"
+#include "provd-client.h"
+
+static bool wait_until(std::function<bool()> condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+TEST(event_loop_test, test_fd_callback) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  std::atomic<int> num_bytes { 0 };
+  EXPECT_EQ(NO_ERROR, loop.add_fd(fds[0], [&]() {
+    char buf[16];
+    num_bytes += read(fds[0], buf, sizeof(buf));
+  }));
+
+  ASSERT_EQ(3, write(fds[1], "abc", 3));
+  EXPECT_TRUE(wait_until([&]() { return num_bytes == 3; }));
+  // no more callbacks once the fd has been removed
+  loop.remove_fd(fds[0]);
+  ASSERT_EQ(2, write(fds[1], "de", 2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(3, num_bytes);
+
+  loop.stop();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(event_loop_test, test_write_callback) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  // fill the socket so that it isn't writable anymore
+  char buf[4096] = { };
+  size_t num_written = 0;
+  ssize_t len;
+  while ((len = send(fds[0], buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    num_written += len;
+  }
+  std::atomic<int> num_readable { 0 };
+  std::atomic<int> num_writable { 0 };
+  EXPECT_EQ(NO_ERROR, loop.add_fd(fds[0], [&]() { num_readable++; }));
+  EXPECT_EQ(NO_ERROR, loop.add_write_fd(fds[0], [&]() {
+    num_writable++;
+    loop.remove_write_fd(fds[0]);
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(0, num_writable);
+
+  // the callback runs once the peer has read the data, the read callback is kept
+  while (num_written > 0 && (len = read(fds[1], buf, sizeof(buf))) > 0) {
+    num_written -= len;
+  }
+  EXPECT_TRUE(wait_until([&]() { return num_writable == 1; }));
+  ASSERT_EQ(1, write(fds[1], "a", 1));
+  EXPECT_TRUE(wait_until([&]() { return num_readable > 0; }));
+  EXPECT_EQ(1, num_writable);
+
+  loop.stop();
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST(event_loop_test, test_post) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  std::atomic<bool> on_other_thread { false };
+  std::atomic<int> num_runs { 0 };
+  std::thread::id caller = std::this_thread::get_id();
+  loop.post([&]() {
+    on_other_thread = std::this_thread::get_id() != caller;
+    num_runs++;
+  });
+  EXPECT_TRUE(wait_until([&]() { return num_runs == 1; }));
+  EXPECT_TRUE(on_other_thread);
+
+  // callbacks posted after the loop has been stopped are discarded
+  loop.stop();
+  loop.post([&]() { num_runs++; });
+  EXPECT_EQ(1, num_runs);
+}
+
+#ifdef __linux__
+TEST(event_loop_test, test_file_watch) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  std::string path = "event-loop-test-watch";
+  std::ofstream out(path);
+  std::atomic<int> num_callbacks { 0 };
+  int wd = loop.add_file_watch(path, [&]() { num_callbacks++; });
+  ASSERT_LE(0, wd);
+
+  out << "some output" << std::endl;
+  EXPECT_TRUE(wait_until([&]() { return num_callbacks > 0; }));
+  loop.remove_file_watch(wd);
+  int seen = num_callbacks;
+  out << "more output" << std::endl;
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(seen, num_callbacks);
+
+  loop.stop();
+  out.close();
+  remove(path.c_str());
+}
+#endif
+
+/* Builds a request the same way ProvdClient sends it. */
+static std::string make_request(int16_t opcode, int32_t pid, const std::string &regex) {
+  std::string req;
+  int16_t op = htons(opcode);
+  int32_t p = htonl(pid);
+  req.append((char*) &op, sizeof(op));
+  req.append((char*) &p, sizeof(p));
+  if (opcode == REQ_TRACE_PROCESS) {
+    int32_t len = htonl(regex.size() + 1);
+    req.append((char*) &len, sizeof(len));
+    req.append(regex.c_str(), regex.size() + 1);
+  }
+  return req;
+}
+
+TEST(provd_request_parser_test, test_trace_request) {
+  std::string req = make_request(REQ_TRACE_PROCESS, 4711, "prov: (.*)");
+  ProvdRequestParser parser;
+  // deliver the request byte by byte
+  for (size_t i = 0; i < req.size() - 1; i++) {
+    EXPECT_EQ(parse_incomplete, parser.feed(&req[i], 1));
+  }
+  EXPECT_EQ(parse_complete, parser.feed(&req[req.size() - 1], 1));
+  EXPECT_EQ(REQ_TRACE_PROCESS, parser.opcode);
+  EXPECT_EQ(4711, parser.pid);
+  EXPECT_EQ("prov: (.*)", parser.regex);
+}
+
+TEST(provd_request_parser_test, test_stop_request) {
+  std::string req = make_request(REQ_TRACE_PROCESS_STOP, 42, "");
+  ProvdRequestParser parser;
+  EXPECT_EQ(parse_incomplete, parser.feed(req.data(), 3));
+  EXPECT_EQ(parse_complete, parser.feed(req.data() + 3, req.size() - 3));
+  EXPECT_EQ(REQ_TRACE_PROCESS_STOP, parser.opcode);
+  EXPECT_EQ(42, parser.pid);
+}
+
+TEST(provd_request_parser_test, test_batched_request) {
+  std::string regex = "prov: (.*)";
+  std::string req;
+  int16_t op = htons(REQ_TRACE_PROCESS_BATCHED);
+  int32_t pid = htonl(7);
+  int32_t flags = htonl(ProvdFrame::FLAG_LZ4);
+  int32_t len = htonl(regex.size() + 1);
+  req.append((char*) &op, sizeof(op));
+  req.append((char*) &pid, sizeof(pid));
+  req.append((char*) &flags, sizeof(flags));
+  req.append((char*) &len, sizeof(len));
+  req.append(regex.c_str(), regex.size() + 1);
+
+  ProvdRequestParser parser;
+  EXPECT_EQ(parse_incomplete, parser.feed(req.data(), 12));
+  EXPECT_EQ(parse_complete, parser.feed(req.data() + 12, req.size() - 12));
+  EXPECT_EQ(REQ_TRACE_PROCESS_BATCHED, parser.opcode);
+  EXPECT_EQ(7, parser.pid);
+  EXPECT_EQ(ProvdFrame::FLAG_LZ4, parser.flags);
+  EXPECT_EQ(regex, parser.regex);
+}
+
+/* Reads a complete request from an accepted connection. */
+static parse_rc_t read_request(int fd, ProvdRequestParser *parser) {
+  char buf[256];
+  ssize_t len;
+  parse_rc_t rc = parse_incomplete;
+  while (rc == parse_incomplete && (len = read(fd, buf, sizeof(buf))) > 0) {
+    rc = parser->feed(buf, len);
+  }
+  return rc;
+}
+
+TEST(provd_client_test, test_batching_fallback) {
+  // a server that accepts requests but never replies to a batched one
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listen_fd, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addr_len = sizeof(addr);
+  ASSERT_EQ(0, bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, listen(listen_fd, 2));
+  ASSERT_EQ(0, getsockname(listen_fd, (struct sockaddr*) &addr, &addr_len));
+
+  ProvdRequestParser batched, plain;
+  std::thread server([&]() {
+    int first = accept(listen_fd, nullptr, nullptr);
+    read_request(first, &batched);
+    int second = accept(listen_fd, nullptr, nullptr);
+    read_request(second, &plain);
+    close(second);
+    close(first);
+  });
+
+  ProvdClient client;
+  client.set_negotiation_timeout(100);
+  ASSERT_EQ(0, client.connect_to_server("127.0.0.1", ntohs(addr.sin_port)));
+  auto start = std::chrono::steady_clock::now();
+  EXPECT_GE(client.submit_batched_trace_proc_request(42, "prov: (.*)", ProvdFrame::FLAG_LZ4), 0);
+  EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+  EXPECT_FALSE(client.is_batched());
+  server.join();
+  client.disconnect_from_server();
+  close(listen_fd);
+
+  EXPECT_EQ(REQ_TRACE_PROCESS_BATCHED, batched.opcode);
+  EXPECT_EQ(REQ_TRACE_PROCESS, plain.opcode);
+  EXPECT_EQ(42, plain.pid);
+  EXPECT_EQ("prov: (.*)", plain.regex);
+}
+
+TEST(provd_frame_test, test_encode_decode) {
+  std::string payload;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 1000; i++) {
+    expected.push_back("prov: record " + std::to_string(i % 10));
+    ProvdFrame::append_line(expected.back(), &payload);
+  }
+  for (int32_t flags : { 0, ProvdFrame::supported_flags() }) {
+    std::string frame;
+    ProvdFrame::encode(payload, expected.size(), flags, &frame);
+    if (flags & ProvdFrame::FLAG_LZ4) {
+      // the lines are repetitive and compress well
+      EXPECT_LT(frame.size(), payload.size());
+    }
+    std::vector<std::string> lines;
+    ASSERT_TRUE(ProvdFrame::decode(frame.data() + sizeof(int32_t),
+        frame.size() - sizeof(int32_t), &lines));
+    EXPECT_EQ(expected, lines);
+  }
+}
+
+TEST(provd_request_parser_test, test_invalid_request) {
+  ProvdRequestParser unknown;
+  std::string req = make_request(0x7f, 1, "");
+  EXPECT_EQ(parse_error, unknown.feed(req.data(), req.size()));
+
+  // a regex length beyond the limit is rejected before the regex arrives
+  ProvdRequestParser too_long;
+  req = make_request(REQ_TRACE_PROCESS, 1, "");
+  int32_t len = htonl(ProvdRequestParser::MAX_REGEX_LENGTH + 1);
+  memcpy(&req[6], &len, sizeof(len));
+  EXPECT_EQ(parse_error, too_long.feed(req.data(), 10));
+}
+
+TEST(output_scanner_test, test_matching_lines) {
+  std::vector<std::string> matches;
+  OutputScanner scanner(LineMatcher::create("prov: (.*)"), [&](const std::string &line) {
+    matches.push_back(line);
+  });
+  // lines can be split across chunks, control sequences and characters are removed
+  std::string out = "hello\nprov: \x1b[31ma\x1b[0";
+  scanner.feed(out.data(), out.size());
+  EXPECT_TRUE(matches.empty());
+  out = "mb\r\nno prov\nprov: c\n";
+  scanner.feed(out.data(), out.size());
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ("prov: ab", matches[0]);
+  EXPECT_EQ("prov: c", matches[1]);
+}
+
+#ifdef __linux__
+/* Reads the output the process has already written to a file instead of redirecting it. */
+class FileCaptureHandler: public TraceProcessReqHandler {
+private:
+  std::string path;
+
+protected:
+  virtual int redirect_output() override { return open_output_file(path); }
+
+public:
+  FileCaptureHandler(const std::string &path, int sock, EventLoop *loop,
+      WorkStealingExecutor *pool, bool batched) :
+      TraceProcessReqHandler(sock, getpid(), "prov: (.*)", loop, pool, capture_file, batched),
+      path { path } {}
+};
+
+/* Reads the output from a pipe instead of redirecting the process' output. */
+class PipeCaptureHandler: public TraceProcessReqHandler {
+private:
+  int fd;
+  int tee_fd;
+
+protected:
+  virtual int redirect_output() override {
+    add_pipe_stream(STDOUT_FILENO, fd, tee_fd);
+    return NO_ERROR;
+  }
+
+public:
+  PipeCaptureHandler(int fd, int tee_fd, int sock, EventLoop *loop, WorkStealingExecutor *pool) :
+      TraceProcessReqHandler(sock, getpid(), "prov: (.*)", loop, pool, capture_pipe),
+      fd { fd }, tee_fd { tee_fd } {}
+};
+
+/* Reads from fd until the decoder has returned n lines or nothing arrives anymore. */
+static std::vector<std::string> read_lines(int fd, ProvdLineDecoder *decoder, size_t n) {
+  std::vector<std::string> lines;
+  std::string line;
+  char buf[4096];
+  while (lines.size() < n) {
+    pollfd pfd = { fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 5000) <= 0) {
+      break;
+    }
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len <= 0) {
+      break;
+    }
+    decoder->feed(buf, len);
+    while (decoder->next(&line)) {
+      lines.push_back(line);
+    }
+  }
+  return lines;
+}
+
+TEST(trace_process_handler_test, test_file_capture) {
+  for (bool batched : { false, true }) {
+    EventLoop loop;
+    ASSERT_EQ(NO_ERROR, loop.start());
+    WorkStealingExecutor pool(1);
+    int fds[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    std::string path = "trace-handler-test-out";
+    std::ofstream out(path);
+    out << "prov: before" << std::endl;
+
+    std::atomic<bool> finished { false };
+    auto handler = std::make_shared<FileCaptureHandler>(path, fds[0], &loop, &pool, batched);
+    handler->set_on_finished([&finished]() { finished = true; });
+    handler->handle();
+
+    // lines written before and after the watch has been added are delivered,
+    // lines split across writes are assembled first
+    out << "noise\nprov: a" << std::flush;
+    out << "b\nprov: c" << std::endl;
+    ProvdLineDecoder decoder(batched);
+    EXPECT_EQ(std::vector<std::string>({ "prov: before", "prov: ab", "prov: c" }),
+        read_lines(fds[1], &decoder, 3)) << "batched " << batched;
+
+    // the handler stops once the client disconnects and removes the file
+    close(fds[1]);
+    EXPECT_TRUE(wait_until([&]() { return finished.load(); }));
+    EXPECT_NE(0, access(path.c_str(), F_OK));
+    loop.stop();
+    pool.stop();
+  }
+}
+
+TEST(trace_process_handler_test, test_slow_client) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  WorkStealingExecutor pool(1);
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  std::string path = "trace-handler-test-out";
+  std::ofstream out(path);
+  std::atomic<bool> finished { false };
+  auto handler = std::make_shared<FileCaptureHandler>(path, fds[0], &loop, &pool, false);
+  handler->set_on_finished([&finished]() { finished = true; });
+  handler->handle();
+
+  // the client doesn't read while the process writes more than can be queued
+  const int num_lines = 60000;
+  std::string padding(100, 'x');
+  for (int i = 0; i < num_lines; i++) {
+    out << "prov: " << i << padding << "\n";
+  }
+  out.flush();
+
+  // the loop keeps serving other fds in the meantime
+  int other[2];
+  ASSERT_EQ(0, pipe(other));
+  std::atomic<int> num_callbacks { 0 };
+  EXPECT_EQ(NO_ERROR, loop.add_fd(other[0], [&]() {
+    char c;
+    num_callbacks += read(other[0], &c, 1);
+  }));
+  ASSERT_EQ(1, write(other[1], "a", 1));
+  EXPECT_TRUE(wait_until([&]() { return num_callbacks == 1; }));
+  loop.remove_fd(other[0]);
+
+  // reading resumes once the client has caught up, no line is lost
+  ProvdLineDecoder decoder;
+  std::vector<std::string> lines = read_lines(fds[1], &decoder, num_lines);
+  ASSERT_EQ(num_lines, lines.size());
+  EXPECT_EQ("prov: 0" + padding, lines.front());
+  EXPECT_EQ("prov: " + std::to_string(num_lines - 1) + padding, lines.back());
+
+  handler->stop();
+  EXPECT_TRUE(wait_until([&]() { return finished.load(); }));
+  loop.stop();
+  pool.stop();
+  close(fds[1]);
+  close(other[0]);
+  close(other[1]);
+}
+
+TEST(trace_process_handler_test, test_slow_destination) {
+  EventLoop loop;
+  ASSERT_EQ(NO_ERROR, loop.start());
+  WorkStealingExecutor pool(1);
+  int fds[2], out[2], dest[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  ASSERT_EQ(0, pipe(out));
+  ASSERT_EQ(0, pipe(dest));
+  fcntl(out[0], F_SETFL, fcntl(out[0], F_GETFL, 0) | O_NONBLOCK);
+  std::atomic<bool> finished { false };
+  // the handler owns our end of the output pipe and the destination
+  auto handler = std::make_shared<PipeCaptureHandler>(out[0], dest[1], fds[0], &loop, &pool);
+  handler->set_on_finished([&finished]() { finished = true; });
+  handler->handle();
+
+  // the process writes more than the destination and the handler take while
+  // nobody reads the destination
+  std::string output;
+  std::vector<std::string> matches;
+  for (int i = 0; i < 20000; i++) {
+    if (i % 1000 == 0) {
+      matches.push_back("prov: " + std::to_string(i));
+      output += matches.back() + "\n";
+    } else {
+      output += "output " + std::to_string(i) + std::string(100, 'x') + "\n";
+    }
+  }
+  std::thread tracee([&]() {
+    for (size_t written = 0; written < output.size();) {
+      ssize_t len = write(out[1], output.data() + written,
+          std::min<size_t>(4096, output.size() - written));
+      if (len <= 0) {
+        break;
+      }
+      written += len;
+    }
+    close(out[1]);
+  });
+  EXPECT_TRUE(wait_until([&]() {
+    int available = 0;
+    return ioctl(dest[0], FIONREAD, &available) == 0 && available >= 60 * 1024;
+  }));
+
+  // the loop keeps serving other fds in the meantime
+  int other[2];
+  ASSERT_EQ(0, pipe(other));
+  std::atomic<int> num_callbacks { 0 };
+  EXPECT_EQ(NO_ERROR, loop.add_fd(other[0], [&]() {
+    char c;
+    num_callbacks += read(other[0], &c, 1);
+  }));
+  ASSERT_EQ(1, write(other[1], "a", 1));
+  EXPECT_TRUE(wait_until([&]() { return num_callbacks == 1; }));
+  loop.remove_fd(other[0]);
+
+  // everything is forwarded in order once the destination is read, the
+  // handler finishes after the process has closed its output
+  std::string forwarded;
+  char buf[4096];
+  ssize_t len;
+  while ((len = read(dest[0], buf, sizeof(buf))) > 0) {
+    forwarded.append(buf, len);
+  }
+  tracee.join();
+  EXPECT_EQ(output.size(), forwarded.size());
+  EXPECT_TRUE(output == forwarded);
+  ProvdLineDecoder decoder;
+  EXPECT_EQ(matches, read_lines(fds[1], &decoder, matches.size()));
+  EXPECT_TRUE(wait_until([&]() { return finished.load(); }));
+
+  loop.stop();
+  pool.stop();
+  close(fds[1]);
+  close(dest[0]);
+  close(other[0]);
+  close(other[1]);
+}
+#endif
+
+TEST(line_matcher_test, test_required_literal) {
+  bool prefix;
+  EXPECT_EQ("prov: ", LineMatcher::required_literal("prov: (.*)", &prefix));
+  EXPECT_TRUE(prefix);
+  EXPECT_EQ("prov: ", LineMatcher::required_literal("^prov: .*", &prefix));
+  EXPECT_TRUE(prefix);
+  // optional characters end the literal, repeated ones are still required once
+  EXPECT_EQ("d: recor", LineMatcher::required_literal("[0-9]+ recor?d: recor+d", &prefix));
+  EXPECT_FALSE(prefix);
+  EXPECT_EQ("a.b", LineMatcher::required_literal("x*a\\.b\\d", &prefix));
+  EXPECT_FALSE(prefix);
+  // nothing is required with top-level alternatives, groups are skipped
+  EXPECT_EQ("", LineMatcher::required_literal("prov|other", &prefix));
+  EXPECT_EQ("end", LineMatcher::required_literal("(a|[)(])end", &prefix));
+  EXPECT_EQ("", LineMatcher::required_literal("\\w+", &prefix));
+  // escapes with arguments are a single atom, unknown ones aren't guessed
+  EXPECT_EQ("BC", LineMatcher::required_literal("\\x41BC", &prefix));
+  EXPECT_EQ("BC", LineMatcher::required_literal("\\u0041BC", &prefix));
+  EXPECT_EQ("ab", LineMatcher::required_literal("\\x{41}ab", &prefix));
+  EXPECT_EQ("BC", LineMatcher::required_literal("\\cJBC", &prefix));
+  EXPECT_EQ("BC", LineMatcher::required_literal("\\pLBC", &prefix));
+  EXPECT_EQ("BC", LineMatcher::required_literal("\\p{Greek}BC", &prefix));
+  EXPECT_EQ("ab", LineMatcher::required_literal("(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)\\10ab", &prefix));
+  EXPECT_EQ("", LineMatcher::required_literal("\\QBC", &prefix));
+  EXPECT_EQ("", LineMatcher::required_literal("\\x4", &prefix));
+  EXPECT_EQ("", LineMatcher::required_literal("(?i)prov: (.*)", &prefix));
+  EXPECT_EQ("prov: ", LineMatcher::required_literal("(?:a|b)prov: ", &prefix));
+}
+
+TEST(line_matcher_test, test_engines) {
+  std::vector<std::string> regexes = { "prov: (.*)", "[0-9]+ recor?d: .*", "(a|b)+c",
+      ".*(x|yz)$", "(\\w+)=\\1", "\\x41BC", "\\u0041BC", "\\cJBC" };
+  std::vector<std::string> lines = { "prov: a", "prov:", "12 recod: x", "1 record: ",
+      "abac", "abc ", "--yz", "ab=ab", "ab=ba", "", "ABC", "41BC", "0041BC", "\nBC",
+      "prov: a\xff\xfe b" };
+  for (matcher_engine_t engine : { matcher_std, matcher_re2 }) {
+    for (const std::string &regex : regexes) {
+      std::unique_ptr<LineMatcher> matcher = LineMatcher::create(regex, engine);
+      std::regex re(regex);
+      for (const std::string &line : lines) {
+        EXPECT_EQ(std::regex_match(line, re), matcher->matches(line))
+            << regex << " on " << line << " with engine " << engine;
+      }
+    }
+  }
+#ifdef WITH_RE2
+  // std::regex doesn't support flag groups, the literal must not make RE2 case-sensitive
+  EXPECT_TRUE(LineMatcher::create("(?i)prov: (.*)", matcher_re2)->matches("PROV: x"));
+#endif
+  // RE2 doesn't support backreferences
+  EXPECT_EQ(matcher_std, LineMatcher::create("(\\w+)=\\1", matcher_re2)->get_engine());
+  EXPECT_THROW(LineMatcher::create("prov: (", matcher_std), std::regex_error);
+}
@@ -0,0 +1,161 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "chunked-parser.h"
+#include "error.h"
+#include "executor.h"
+#include "tail-reader.h"
+
+static std::vector<std::string> numbered_lines(int num_lines) {
+  std::vector<std::string> lines;
+  for (int i = 0; i < num_lines; i++) {
+    // vary the line length so that chunks end at different positions in a line
+    lines.push_back("line " + std::to_string(i) + std::string(i % 37, 'x'));
+  }
+  return lines;
+}
+
+static void write_lines(const std::string &path, const std::vector<std::string> &lines) {
+  std::ofstream out(path);
+  for (const std::string &line : lines) {
+    out << line << "\n";
+  }
+}
+
+/*------------------------------
+ * TailReader
+ *------------------------------*/
+
+TEST(tail_reader_test, test_read_appended_lines) {
+  TailReader reader(16);
+  std::ofstream out("test-tail-reader");
+  long long offset = 0;
+  std::string fragment;
+  std::vector<std::string> lines;
+  auto collect = [&lines](boost::string_view line) { lines.push_back(line.to_string()); };
+
+  out << "first line\nsecond" << std::flush;
+  EXPECT_EQ(NO_ERROR, reader.read("test-tail-reader", &offset, &fragment, collect));
+  EXPECT_EQ(std::vector<std::string>({ "first line" }), lines);
+  EXPECT_EQ("second", fragment);
+  EXPECT_EQ(17, offset);
+
+  // lines longer than the read window are reassembled from the fragment
+  std::string long_line(100, 'y');
+  out << " line\n" << long_line << "\n" << std::flush;
+  EXPECT_EQ(NO_ERROR, reader.read("test-tail-reader", &offset, &fragment, collect));
+  EXPECT_EQ(std::vector<std::string>({ "first line", "second line", long_line }), lines);
+  EXPECT_TRUE(fragment.empty());
+
+  // a truncated file is read from the start
+  out.close();
+  std::ofstream("test-tail-reader") << "new\n";
+  EXPECT_EQ(NO_ERROR, reader.read("test-tail-reader", &offset, &fragment, collect));
+  EXPECT_EQ("new", lines.back());
+  EXPECT_EQ(4, offset);
+}
+
+/*------------------------------
+ * ChunkedParser
+ *------------------------------*/
+
+TEST(chunked_parser_test, test_ordered_batches) {
+  std::vector<std::string> expected = numbered_lines(5000);
+  write_lines("test-chunked-parser", expected);
+  long long size = std::ifstream("test-chunked-parser", std::ios::ate).tellg();
+
+  WorkStealingExecutor executor(4);
+  ChunkedParser parser(256, 3, &executor);
+  std::vector<std::string> lines;
+  long long last_offset = 0;
+  size_t max_batch = 0;
+  long long offset = 0;
+  int rc = parser.parse("test-chunked-parser", &offset, size, 0,
+      [](boost::string_view line, std::vector<std::string> *records) {
+        records->push_back(line.to_string());
+      },
+      [&](std::vector<std::string> &records, long long batch_offset) {
+        // batches arrive in file order and end at a line
+        EXPECT_GT(batch_offset, last_offset);
+        last_offset = batch_offset;
+        max_batch = std::max(max_batch, records.size());
+        lines.insert(lines.end(), records.begin(), records.end());
+        return NO_ERROR;
+      });
+  EXPECT_EQ(NO_ERROR, rc);
+  EXPECT_EQ(size, offset);
+  EXPECT_EQ(expected, lines);
+  EXPECT_LT(max_batch, 100);
+}
+
+TEST(chunked_parser_test, test_first_and_last_line) {
+  std::ofstream("test-chunked-parser-csv") << "header\na\nb\nc";
+  ChunkedParser parser;
+  std::vector<std::string> lines;
+  auto parse_fn = [](boost::string_view line, std::vector<std::string> *records) {
+    records->push_back(line.to_string());
+  };
+  auto sink_fn = [&lines](std::vector<std::string> &records, long long) {
+    lines.insert(lines.end(), records.begin(), records.end());
+    return NO_ERROR;
+  };
+
+  // the unterminated last line is left for the next call by default
+  long long offset = 0;
+  EXPECT_EQ(NO_ERROR, parser.parse("test-chunked-parser-csv", &offset, 12,
+      ChunkedParser::SKIP_FIRST_LINE, parse_fn, sink_fn));
+  EXPECT_EQ(std::vector<std::string>({ "a", "b" }), lines);
+  EXPECT_EQ(11, offset);
+
+  lines.clear();
+  offset = 0;
+  EXPECT_EQ(NO_ERROR, parser.parse("test-chunked-parser-csv", &offset, 12,
+      ChunkedParser::SKIP_FIRST_LINE | ChunkedParser::INCLUDE_LAST_LINE, parse_fn, sink_fn));
+  EXPECT_EQ(std::vector<std::string>({ "a", "b", "c" }), lines);
+  EXPECT_EQ(12, offset);
+}
+
+TEST(chunked_parser_test, test_sink_error) {
+  write_lines("test-chunked-parser-error", numbered_lines(1000));
+  long long size = std::ifstream("test-chunked-parser-error", std::ios::ate).tellg();
+
+  WorkStealingExecutor executor(4);
+  ChunkedParser parser(128, 4, &executor);
+  int num_batches = 0;
+  long long stored_offset = 0;
+  long long offset = 0;
+  int rc = parser.parse("test-chunked-parser-error", &offset, size, 0,
+      [](boost::string_view line, std::vector<std::string> *records) {
+        records->push_back(line.to_string());
+      },
+      [&](std::vector<std::string> &records, long long batch_offset) {
+        if (++num_batches == 5) {
+          return ERROR_NO_RETRY;
+        }
+        stored_offset = batch_offset;
+        return NO_ERROR;
+      });
+  // parsing stops at the failed batch, which is parsed again on the next call
+  EXPECT_EQ(ERROR_NO_RETRY, rc);
+  EXPECT_EQ(5, num_batches);
+  EXPECT_EQ(stored_offset, offset);
+}
@@ -0,0 +1,102 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "error.h"
+#include "rule-engine.h"
+
+static std::unique_ptr<RuleEngine> create_engine() {
+  std::unique_ptr<RuleEngine> engine = std::make_unique<RuleEngine>("no-rules-file");
+  engine->set_cost_report_interval(0);
+  EXPECT_EQ(NO_ERROR, engine->add_rule("f1=1->DBLOAD f1 INTO FILE rule-engine-out"));
+  EXPECT_EQ(NO_ERROR, engine->add_rule("f2@s[.*]->DBLOAD f1 INTO FILE rule-engine-out"));
+  return engine;
+}
+
+static void destroy_engine(std::unique_ptr<RuleEngine> &engine) {
+  engine->shutdown();
+  engine.reset();
+  std::remove("rule-engine-out");
+}
+
+TEST(rule_engine_test, test_cost_accounting) {
+  std::unique_ptr<RuleEngine> engine = create_engine();
+  evt_t match = std::make_shared<TestEvent>("1", "x", "3");
+  evt_t no_match = std::make_shared<TestEvent>("2", "x", "3");
+
+  EXPECT_EQ(std::vector<uint32_t>({ 0 }), engine->evaluate_conditions(match));
+  EXPECT_EQ(std::vector<uint32_t>(), engine->evaluate_conditions(no_match));
+  for (int i = 0; i < 2; i++) {
+    Rule *r = engine->get_rule(i);
+    EXPECT_EQ(2, r->get_num_evals());
+    EXPECT_EQ(i == 0 ? 1 : 0, r->get_num_matches());
+    EXPECT_LT(0, r->get_eval_ns());
+  }
+
+  // without a budget, rules stay active
+  engine->report_rule_costs();
+  EXPECT_EQ(rule_active, engine->get_rule(0)->get_mode());
+  destroy_engine(engine);
+}
+
+TEST(rule_engine_test, test_cost_budget_disable) {
+  std::unique_ptr<RuleEngine> engine = create_engine();
+  engine->set_cost_budget(1, rule_disabled);
+  evt_t match = std::make_shared<TestEvent>("1", "s", "3");
+
+  // rules are only checked once they've been evaluated often enough
+  for (uint64_t i = 0; i < RuleEngine::MIN_EVALS_FOR_BUDGET - 1; i++) {
+    engine->evaluate_conditions(match);
+  }
+  engine->report_rule_costs();
+  EXPECT_EQ(rule_active, engine->get_rule(0)->get_mode());
+
+  for (uint64_t i = 0; i < RuleEngine::MIN_EVALS_FOR_BUDGET; i++) {
+    engine->evaluate_conditions(match);
+  }
+  engine->report_rule_costs();
+  EXPECT_EQ(rule_disabled, engine->get_rule(0)->get_mode());
+  EXPECT_EQ(rule_disabled, engine->get_rule(1)->get_mode());
+  EXPECT_EQ(std::vector<uint32_t>(), engine->evaluate_conditions(match));
+  destroy_engine(engine);
+}
+
+TEST(rule_engine_test, test_cost_budget_sample) {
+  std::unique_ptr<RuleEngine> engine = create_engine();
+  engine->set_cost_budget(1, rule_sampled, 10);
+  evt_t match = std::make_shared<TestEvent>("1", "s", "3");
+
+  for (uint64_t i = 0; i < RuleEngine::MIN_EVALS_FOR_BUDGET; i++) {
+    engine->evaluate_conditions(match);
+  }
+  engine->report_rule_costs();
+  ASSERT_EQ(rule_sampled, engine->get_rule(0)->get_mode());
+
+  // sampled rules are only evaluated for every 10th event
+  uint64_t num_evals = engine->get_rule(0)->get_num_evals();
+  int num_matched = 0;
+  for (int i = 0; i < 100; i++) {
+    if (!engine->evaluate_conditions(match).empty()) {
+      num_matched++;
+    }
+  }
+  EXPECT_EQ(num_evals + 10, engine->get_rule(0)->get_num_evals());
+  EXPECT_EQ(10, num_matched);
+  destroy_engine(engine);
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <ctime>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "timestamp.h"
+
+static std::string format_datetime(int64_t secs) {
+  char buf[Timestamp::DATETIME_LENGTH];
+  return std::string(buf, Timestamp::format_datetime(secs, buf));
+}
+
+TEST(timestamp_test, test_parse_datetime) {
+  int64_t secs;
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-08-03 16:06:36", 19, &secs));
+  EXPECT_EQ(1596470796, secs);
+  // trailing characters are ignored and fields don't need to be padded
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-8-3 16:6:36.123 INFO", 25, &secs));
+  EXPECT_EQ(1596470796, secs);
+  ASSERT_TRUE(Timestamp::parse_datetime("1970-01-01 00:00:00", 19, &secs));
+  EXPECT_EQ(0, secs);
+  ASSERT_TRUE(Timestamp::parse_datetime("1969-12-31 23:59:59", 19, &secs));
+  EXPECT_EQ(-1, secs);
+
+  EXPECT_FALSE(Timestamp::parse_datetime("2020-13-03 16:06:36", 19, &secs));
+  EXPECT_FALSE(Timestamp::parse_datetime("2020-08-03 24:06:36", 19, &secs));
+  EXPECT_FALSE(Timestamp::parse_datetime("2020-08-03 16:06", 16, &secs));
+  EXPECT_FALSE(Timestamp::parse_datetime("2020-08-03", 10, &secs));
+  EXPECT_FALSE(Timestamp::parse_datetime("not a date", 10, &secs));
+  // the length is respected
+  EXPECT_FALSE(Timestamp::parse_datetime("2020-08-03 16:06:36", 17, &secs));
+}
+
+TEST(timestamp_test, test_parse_datetime_cache) {
+  // the same date with different times and other dates in between
+  int64_t secs;
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-02-28 10:00:00", 19, &secs));
+  EXPECT_EQ("2020-02-28 10:00:00", format_datetime(secs));
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-02-28 11:30:00", 19, &secs));
+  EXPECT_EQ("2020-02-28 11:30:00", format_datetime(secs));
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-02-29 00:00:01", 19, &secs));
+  EXPECT_EQ("2020-02-29 00:00:01", format_datetime(secs));
+  ASSERT_TRUE(Timestamp::parse_datetime("2020-02-28 23:59:59", 19, &secs));
+  EXPECT_EQ("2020-02-28 23:59:59", format_datetime(secs));
+}
+
+TEST(timestamp_test, test_parse_utc) {
+  int64_t millis;
+  ASSERT_TRUE(Timestamp::parse_utc("2020-08-03 16:06:36.042", 23, &millis));
+  EXPECT_EQ(1596470796042, millis);
+  ASSERT_TRUE(Timestamp::parse_utc("2020-08-03 16:06:36", 19, &millis));
+  EXPECT_EQ(1596470796000, millis);
+  EXPECT_FALSE(Timestamp::parse_utc("2020-08-03 16:06:36.", 20, &millis));
+}
+
+TEST(timestamp_test, test_parse_scale_time) {
+  int64_t secs;
+  ASSERT_TRUE(Timestamp::parse_scale_time("2020-08-03_09:06:36-0700", 24, &secs));
+  EXPECT_EQ("2020-08-03 16:06:36.000", Timestamp::to_utc(secs, 0));
+  ASSERT_TRUE(Timestamp::parse_scale_time("2020-08-03_01:06:36+0230", 24, &secs));
+  EXPECT_EQ("2020-08-02 22:36:36.000", Timestamp::to_utc(secs, 0));
+  ASSERT_TRUE(Timestamp::parse_scale_time("2020-08-03_09:06:36", 19, &secs));
+  EXPECT_EQ("2020-08-03 09:06:36.000", Timestamp::to_utc(secs, 0));
+  EXPECT_FALSE(Timestamp::parse_scale_time("2020-08-03 09:06:36-0700", 24, &secs));
+  EXPECT_FALSE(Timestamp::parse_scale_time("2020-08-03_09:06:36-07", 22, &secs));
+}
+
+TEST(timestamp_test, test_format_matches_strftime) {
+  // every 7919 seconds over a few years, including leap years and negative times
+  char expected[32];
+  for (int64_t secs = -100000000; secs < 1700000000; secs += 7919 * 997) {
+    time_t t = secs;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm);
+    ASSERT_EQ(std::string(expected) + ".007", Timestamp::to_utc(secs, 7));
+
+    int64_t parsed;
+    ASSERT_TRUE(Timestamp::parse_datetime(expected, strlen(expected), &parsed));
+    ASSERT_EQ(secs, parsed);
+  }
+}
+
+TEST(timestamp_test, test_now_utc) {
+  std::string now = Timestamp::now_utc();
+  ASSERT_EQ(Timestamp::UTC_LENGTH, now.size());
+  int64_t millis;
+  EXPECT_TRUE(Timestamp::parse_utc(now.data(), now.size(), &millis));
+}
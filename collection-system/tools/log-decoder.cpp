@@ -0,0 +1,49 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fstream>
+#include <iostream>
+
+#include "binary-log.h"
+
+/**
+ * Renders a binary log written by Logger::enable_binary as text, in the
+ * same format as the regular log. Reads from stdin if no file is given.
+ */
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    std::cerr << "Usage: " << argv[0] << " [binary-log-file]" << std::endl;
+    return 1;
+  }
+
+  long num_events;
+  if (argc == 2) {
+    std::ifstream in(argv[1], std::ifstream::binary);
+    if (!in.is_open()) {
+      std::cerr << "Couldn't open " << argv[1] << std::endl;
+      return 1;
+    }
+    num_events = binlog::decode(in, std::cout);
+  } else {
+    num_events = binlog::decode(std::cin, std::cout);
+  }
+
+  if (num_events < 0) {
+    std::cerr << "Input is not a binary log" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,281 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "binary-log.h"
+
+#include <atomic>
+#include <ctime>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+/*------------------------------
+ * LogFormat
+ *------------------------------*/
+
+static std::atomic<uint32_t> next_format_id { 1 };
+static std::atomic<LogFormat::register_hook_t> register_hook { nullptr };
+
+static std::mutex& registry_mtx() {
+  static std::mutex mtx;
+  return mtx;
+}
+
+static std::vector<const LogFormat*>& registry() {
+  static std::vector<const LogFormat*> formats;
+  return formats;
+}
+
+LogFormat::LogFormat(uint8_t level, const char *fmt, const char *function, int line) :
+    id { next_format_id++ },
+    level { level },
+    fmt { fmt },
+    function { function },
+    line { line } {
+  {
+    std::unique_lock<std::mutex> lock(registry_mtx());
+    registry().push_back(this);
+  }
+  register_hook_t hook = register_hook.load();
+  if (hook) {
+    hook(*this);
+  }
+}
+
+void LogFormat::set_register_hook(register_hook_t hook) {
+  register_hook = hook;
+}
+
+std::vector<const LogFormat*> LogFormat::get_registered() {
+  std::unique_lock<std::mutex> lock(registry_mtx());
+  return registry();
+}
+
+std::string LogFormat::encode_definition() const {
+  std::string record;
+  binlog::put<uint32_t>(record, 0);
+  binlog::put<uint8_t>(record, binlog::kind_format);
+  binlog::put<uint32_t>(record, id);
+  binlog::put<uint8_t>(record, level);
+  binlog::put<int32_t>(record, line);
+  binlog::put_string(record, function, strlen(function));
+  binlog::put_string(record, fmt, strlen(fmt));
+  finish_record(record);
+  return record;
+}
+
+void LogFormat::finish_record(std::string &record) {
+  uint32_t len = record.size() - sizeof(uint32_t);
+  memcpy(&record[0], &len, sizeof(len));
+}
+
+/*------------------------------
+ * Decoding
+ *------------------------------*/
+
+namespace {
+
+struct FormatDefinition {
+  uint8_t level;
+  int32_t line;
+  std::string function;
+  std::string fmt;
+};
+
+/* Reads from a single record, all reads fail once the end has been reached. */
+class RecordReader {
+private:
+  const char *pos;
+  const char *end;
+
+public:
+  RecordReader(const char *start, size_t len) : pos { start }, end { start + len } {}
+
+  template<typename T>
+  bool get(T *value) {
+    if ((size_t) (end - pos) < sizeof(T)) {
+      return false;
+    }
+    memcpy(value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+
+  bool get_string(std::string *value) {
+    uint32_t len;
+    if (!get(&len) || (size_t) (end - pos) < len) {
+      return false;
+    }
+    value->assign(pos, len);
+    pos += len;
+    return true;
+  }
+};
+
+const char *LEVEL_NAMES[] = { "FATAL", "ERROR", "WARN", "INFO", "DEBUG", "PERF" };
+
+std::string format_time(uint64_t time_us) {
+  time_t seconds = time_us / 1000000;
+  char buf[64];
+  ctime_r(&seconds, buf);
+  buf[strlen(buf) - 1] = '\0'; // wipe newline
+  return buf;
+}
+
+bool decode_arg(RecordReader &reader, std::string *arg) {
+  uint8_t type;
+  if (!reader.get(&type)) {
+    return false;
+  }
+  switch (type) {
+  case binlog::arg_int: {
+    int64_t value;
+    if (!reader.get(&value)) return false;
+    *arg = std::to_string(value);
+    return true;
+  }
+  case binlog::arg_uint: {
+    uint64_t value;
+    if (!reader.get(&value)) return false;
+    *arg = std::to_string(value);
+    return true;
+  }
+  case binlog::arg_double: {
+    double value;
+    if (!reader.get(&value)) return false;
+    std::ostringstream ss;
+    ss << value;
+    *arg = ss.str();
+    return true;
+  }
+  case binlog::arg_string:
+    return reader.get_string(arg);
+  default:
+    return false;
+  }
+}
+
+void render(std::ostream &out, const FormatDefinition *def, uint32_t id, uint64_t time_us,
+    const std::vector<std::string> &args) {
+  out << format_time(time_us);
+  if (!def) {
+    // definition got lost (e.g. dropped), still show the arguments
+    out << " [unknown format " << id << "] -";
+    for (const std::string &arg : args) {
+      out << " " << arg;
+    }
+    out << "\n";
+    return;
+  }
+
+  out << " [" << def->function << ":" << def->line << "] ["
+      << (def->level < 6 ? LEVEL_NAMES[def->level] : "NONE") << "] - ";
+  const char *fmt = def->fmt.c_str();
+  size_t next_arg = 0;
+  const char *placeholder;
+  while ((placeholder = strstr(fmt, "{}")) && next_arg < args.size()) {
+    out.write(fmt, placeholder - fmt);
+    out << args[next_arg++];
+    fmt = placeholder + 2;
+  }
+  out << fmt;
+  for (; next_arg < args.size(); next_arg++) {
+    out << " " << args[next_arg];
+  }
+  out << "\n";
+}
+
+}
+
+long binlog::decode(std::istream &in, std::ostream &out) {
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  size_t header_len = sizeof(MAGIC) + sizeof(uint32_t);
+  if (data.size() < header_len || memcmp(data.data(), MAGIC, sizeof(MAGIC))) {
+    return -1;
+  }
+  uint32_t version;
+  memcpy(&version, data.data() + sizeof(MAGIC), sizeof(version));
+  if (version != VERSION) {
+    return -1;
+  }
+
+  // Records are written by several threads and a format definition may end
+  // up after the first event that uses it, so collect all definitions first.
+  std::vector<std::pair<const char*, uint32_t>> records;
+  std::map<uint32_t, FormatDefinition> formats;
+  size_t pos = header_len;
+  while (pos + sizeof(uint32_t) <= data.size()) {
+    uint32_t len;
+    memcpy(&len, data.data() + pos, sizeof(len));
+    pos += sizeof(len);
+    if (len > data.size() - pos) {
+      // truncated record at the end of the log
+      break;
+    }
+    const char *record = data.data() + pos;
+    pos += len;
+
+    if (len && record[0] == kind_format) {
+      RecordReader reader(record + 1, len - 1);
+      uint32_t id;
+      FormatDefinition def;
+      if (reader.get(&id) && reader.get(&def.level) && reader.get(&def.line)
+          && reader.get_string(&def.function) && reader.get_string(&def.fmt)) {
+        formats[id] = std::move(def);
+      }
+    } else {
+      records.push_back(std::make_pair(record, len));
+    }
+  }
+
+  long num_events = 0;
+  for (auto &r : records) {
+    RecordReader reader(r.first + 1, r.second ? r.second - 1 : 0);
+    if (!r.second) {
+      continue;
+    }
+    if (r.first[0] == kind_dropped) {
+      uint64_t dropped;
+      if (reader.get(&dropped)) {
+        out << "[WARN] - Log buffer full, dropped " << dropped << " records\n";
+      }
+      continue;
+    }
+    if (r.first[0] != kind_event) {
+      // unknown record kinds are skipped
+      continue;
+    }
+
+    uint32_t id;
+    uint64_t time_us;
+    uint8_t num_args;
+    if (!reader.get(&id) || !reader.get(&time_us) || !reader.get(&num_args)) {
+      continue;
+    }
+    std::vector<std::string> args(num_args);
+    bool complete = true;
+    for (std::string &arg : args) {
+      complete = complete && decode_arg(reader, &arg);
+    }
+    if (!complete) {
+      continue;
+    }
+    auto def = formats.find(id);
+    render(out, def != formats.end() ? &def->second : nullptr, id, time_us, args);
+    num_events++;
+  }
+  return num_events;
+}
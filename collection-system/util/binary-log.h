@@ -0,0 +1,195 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTIL_BINARY_LOG_H_
+#define UTIL_BINARY_LOG_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/*
+ * Binary log format. A binary log starts with a header (MAGIC followed by
+ * the version as uint32) and is followed by length-prefixed records. Every
+ * record starts with its kind:
+ *
+ *  - format definition: id, level, line, function, and format string of a
+ *    log statement. Written once per statement.
+ *  - event: id of the format, time in us since the epoch, and the raw
+ *    arguments (each prefixed by its type).
+ *  - dropped: number of records that were dropped because the log buffer
+ *    was full.
+ *
+ * Integers are stored in host byte order, logs are decoded on the same
+ * architecture they were written on. Use log-decoder to render a binary log.
+ */
+namespace binlog {
+const char MAGIC[4] = { 'U', 'L', 'O', 'G' };
+const uint32_t VERSION = 1;
+/* String arguments are truncated to this size. */
+const size_t MAX_STRING_ARG = 16 * 1024;
+
+enum record_kind : uint8_t {
+  kind_format = 1,
+  kind_event = 2,
+  kind_dropped = 3
+};
+
+enum arg_type : uint8_t {
+  arg_int = 1,
+  arg_uint = 2,
+  arg_double = 3,
+  arg_string = 4
+};
+
+template<typename T>
+void put(std::string &buf, T value) {
+  buf.append((const char*) &value, sizeof(value));
+}
+
+inline void put_string(std::string &buf, const char *str, size_t len) {
+  put<uint32_t>(buf, len);
+  buf.append(str, len);
+}
+
+/* Encoding of a single argument, depending on its type. */
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+encode_arg(std::string &buf, const T &arg) {
+  put<uint8_t>(buf, arg_int);
+  put<int64_t>(buf, arg);
+}
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+encode_arg(std::string &buf, const T &arg) {
+  put<uint8_t>(buf, arg_uint);
+  put<uint64_t>(buf, arg);
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+encode_arg(std::string &buf, const T &arg) {
+  put<uint8_t>(buf, arg_double);
+  put<double>(buf, arg);
+}
+
+inline void encode_arg(std::string &buf, const std::string &arg) {
+  put<uint8_t>(buf, arg_string);
+  put_string(buf, arg.data(), std::min(arg.size(), MAX_STRING_ARG));
+}
+
+inline void encode_arg(std::string &buf, const char *arg) {
+  put<uint8_t>(buf, arg_string);
+  put_string(buf, arg, arg ? strnlen(arg, MAX_STRING_ARG) : 0);
+}
+
+/* Anything else is formatted as text. */
+template<typename T>
+typename std::enable_if<!std::is_arithmetic<T>::value>::type
+encode_arg(std::string &buf, const T &arg) {
+  std::ostringstream ss;
+  ss << arg;
+  encode_arg(buf, ss.str());
+}
+
+inline void encode_args(std::string &buf) {}
+
+template<typename T, typename... Args>
+void encode_args(std::string &buf, const T &arg, const Args&... args) {
+  encode_arg(buf, arg);
+  encode_args(buf, args...);
+}
+
+/* Replaces the {} placeholders in fmt with the arguments, in order. */
+inline void format_args(std::ostringstream &out, const char *fmt) {
+  out << fmt;
+}
+
+template<typename T, typename... Args>
+void format_args(std::ostringstream &out, const char *fmt, const T &arg, const Args&... args) {
+  const char *placeholder = strstr(fmt, "{}");
+  if (!placeholder) {
+    // more arguments than placeholders, append the rest
+    out << fmt << " " << arg;
+    format_args(out, "", args...);
+    return;
+  }
+  out.write(fmt, placeholder - fmt);
+  out << arg;
+  format_args(out, placeholder + 2, args...);
+}
+
+/*
+ * Renders a binary log as text. Returns the number of rendered events or
+ * -1 if the input isn't a binary log.
+ */
+long decode(std::istream &in, std::ostream &out);
+}
+
+/**
+ * The static description of a log statement that takes a format string
+ * (see LOGF in logger.h). Every statement registers its format once, which
+ * assigns the id that binary log records refer to.
+ */
+class LogFormat {
+public:
+  typedef void (*register_hook_t)(const LogFormat &format);
+
+  const uint32_t id;
+  const uint8_t level;
+  const char *fmt;
+  const char *function;
+  const int line;
+
+  LogFormat(uint8_t level, const char *fmt, const char *function, int line);
+
+  /* Called for every format that is registered after the hook has been set. */
+  static void set_register_hook(register_hook_t hook);
+  static std::vector<const LogFormat*> get_registered();
+
+  std::string encode_definition() const;
+
+  template<typename... Args>
+  std::string encode_event(uint64_t time_us, const Args&... args) const {
+    std::string record;
+    binlog::put<uint32_t>(record, 0);
+    binlog::put<uint8_t>(record, binlog::kind_event);
+    binlog::put<uint32_t>(record, id);
+    binlog::put<uint64_t>(record, time_us);
+    binlog::put<uint8_t>(record, sizeof...(args));
+    binlog::encode_args(record, args...);
+    finish_record(record);
+    return record;
+  }
+
+  template<typename... Args>
+  std::string format_text(const Args&... args) const {
+    std::ostringstream out;
+    binlog::format_args(out, fmt, args...);
+    return out.str();
+  }
+
+  /* Fills in the length prefix of a record. */
+  static void finish_record(std::string &record);
+};
+
+#endif /* UTIL_BINARY_LOG_H_ */
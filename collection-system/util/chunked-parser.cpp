@@ -0,0 +1,231 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "chunked-parser.h"
+
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "error.h"
+#include "executor.h"
+#include "logger.h"
+
+const int ChunkedParser::SKIP_FIRST_LINE;
+const int ChunkedParser::INCLUDE_LAST_LINE;
+const size_t ChunkedParser::DEFAULT_CHUNK_SIZE;
+const size_t ChunkedParser::DEFAULT_MAX_PENDING_CHUNKS;
+
+/* Size of the reads when looking for the end of a chunk. */
+static const size_t SCAN_BLOCK_SIZE = 4096;
+
+struct ChunkedParser::Chunk {
+  long long start;
+  long long end;
+  /* The end of the last line that has been parsed. */
+  long long parsed_end;
+  int rc;
+  std::vector<std::string> records;
+  std::promise<void> done;
+};
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/**
+ * Reads len bytes at offset. Returns the number of bytes read, which is only
+ * smaller than len if the file has been truncated, or -1 on error.
+ */
+static ssize_t pread_fully(int fd, char *buf, size_t len, long long offset) {
+  size_t total = 0;
+  while (total < len) {
+    ssize_t rc = pread(fd, buf + total, len - total, offset + total);
+    if (rc < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (rc == 0) {
+      break;
+    }
+    total += rc;
+  }
+  return total;
+}
+
+/**
+ * Returns the offset after the first line break at or after pos, or end if
+ * there is none. Returns -1 on error.
+ */
+static long long next_line(int fd, long long pos, long long end) {
+  char buf[SCAN_BLOCK_SIZE];
+  while (pos < end) {
+    ssize_t bytes_read = pread_fully(fd, buf, std::min<long long>(sizeof(buf), end - pos), pos);
+    if (bytes_read < 0) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      break;
+    }
+    const char *line_end = (const char*) memchr(buf, '\n', bytes_read);
+    if (line_end) {
+      return pos + (line_end - buf) + 1;
+    }
+    pos += bytes_read;
+  }
+  return end;
+}
+
+/*------------------------------
+ * ChunkedParser
+ *------------------------------*/
+
+ChunkedParser::ChunkedParser(size_t chunk_size, size_t max_pending_chunks,
+    WorkStealingExecutor *executor) :
+    chunk_size { chunk_size > 0 ? chunk_size : DEFAULT_CHUNK_SIZE },
+    max_pending_chunks { max_pending_chunks > 0 ? max_pending_chunks : 1 },
+    executor { executor } {}
+
+void ChunkedParser::parse_chunk(int fd, Chunk *chunk, bool include_last_line,
+    const parse_fn_t &parse_fn) const {
+  std::vector<char> buf(chunk->end - chunk->start);
+  ssize_t bytes_read = pread_fully(fd, buf.data(), buf.size(), chunk->start);
+  if (bytes_read < 0) {
+    LOGGER_LOG_ERROR("Error while reading chunk at " << chunk->start << ": " << strerror(errno));
+    chunk->rc = ERROR_NO_RETRY;
+    return;
+  }
+
+  // chunks end at a line break, so only the last chunk can end with a partial line
+  const char *data = buf.data();
+  const char *end = data + bytes_read;
+  const char *pos = data;
+  while (pos < end) {
+    const char *line_end = (const char*) memchr(pos, '\n', end - pos);
+    if (!line_end) {
+      break;
+    }
+    parse_fn(boost::string_view(pos, line_end - pos), &chunk->records);
+    pos = line_end + 1;
+  }
+  if (pos < end && include_last_line && bytes_read == (ssize_t) buf.size()) {
+    parse_fn(boost::string_view(pos, end - pos), &chunk->records);
+    pos = end;
+  }
+  chunk->parsed_end = chunk->start + (pos - data);
+}
+
+int ChunkedParser::parse(const std::string &path, long long *offset, long long end, int flags,
+    const parse_fn_t &parse_fn, const sink_fn_t &sink_fn) const {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOGGER_LOG_ERROR("Can't open " << path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+
+  long long pos = *offset;
+  if (flags & SKIP_FIRST_LINE) {
+    pos = next_line(fd, pos, end);
+    if (pos < 0) {
+      LOGGER_LOG_ERROR("Error while reading " << path << ": " << strerror(errno));
+      close(fd);
+      return ERROR_NO_RETRY;
+    }
+    *offset = pos;
+  }
+  bool include_last_line = flags & INCLUDE_LAST_LINE;
+
+  // small regions are parsed right away
+  if (end - pos <= (long long) chunk_size) {
+    Chunk chunk;
+    chunk.start = pos;
+    chunk.end = end;
+    chunk.parsed_end = pos;
+    chunk.rc = NO_ERROR;
+    parse_chunk(fd, &chunk, include_last_line, parse_fn);
+    close(fd);
+    if (chunk.rc != NO_ERROR) {
+      return chunk.rc;
+    }
+    int rc = sink_fn(chunk.records, chunk.parsed_end);
+    if (rc == NO_ERROR) {
+      *offset = chunk.parsed_end;
+    }
+    return rc;
+  }
+
+  WorkStealingExecutor &chunk_executor = executor ? *executor : parse_executor();
+  std::deque<std::pair<std::shared_ptr<Chunk>, std::future<void>>> pending;
+  int rc = NO_ERROR;
+  while (true) {
+    // keep up to max_pending_chunks chunks in flight
+    while (rc == NO_ERROR && pos < end && pending.size() < max_pending_chunks) {
+      long long chunk_end = end - pos <= (long long) chunk_size ?
+          end : next_line(fd, pos + chunk_size - 1, end);
+      if (chunk_end < 0) {
+        LOGGER_LOG_ERROR("Error while reading " << path << ": " << strerror(errno));
+        rc = ERROR_NO_RETRY;
+        break;
+      }
+      std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+      chunk->start = pos;
+      chunk->end = chunk_end;
+      chunk->parsed_end = pos;
+      chunk->rc = NO_ERROR;
+      pending.push_back(std::make_pair(chunk, chunk->done.get_future()));
+      chunk_executor.submit([this, fd, chunk, include_last_line, &parse_fn]() {
+        parse_chunk(fd, chunk.get(), include_last_line, parse_fn);
+        chunk->done.set_value();
+      });
+      pos = chunk_end;
+    }
+    if (pending.empty()) {
+      break;
+    }
+
+    // hand the records to the sink in file order, after an error we only
+    // wait for the chunks in flight as they use the file and the parse function
+    std::shared_ptr<Chunk> chunk = pending.front().first;
+    pending.front().second.wait();
+    pending.pop_front();
+    if (rc != NO_ERROR) {
+      continue;
+    }
+    if (chunk->rc != NO_ERROR) {
+      rc = chunk->rc;
+      continue;
+    }
+    rc = sink_fn(chunk->records, chunk->parsed_end);
+    if (rc == NO_ERROR) {
+      *offset = chunk->parsed_end;
+      // all but the last chunk end at a line break unless the file has been truncated
+      if (chunk->parsed_end < chunk->end && chunk->end < end) {
+        LOGGER_LOG_WARN(path << " has been truncated while parsing it.");
+        rc = ERROR_NO_RETRY;
+      }
+    }
+  }
+
+  close(fd);
+  return rc;
+}
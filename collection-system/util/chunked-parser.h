@@ -0,0 +1,91 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef UTIL_CHUNKED_PARSER_H_
+#define UTIL_CHUNKED_PARSER_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/utility/string_view.hpp>
+
+class WorkStealingExecutor;
+
+/**
+ * Parses large files in parallel while keeping the records in file order.
+ *
+ * The region to parse is split into chunks of roughly chunk_size bytes that
+ * end at a line break. The chunks are read and parsed into records on the
+ * parse executor, at most max_pending_chunks at a time, and the records of
+ * each chunk are handed to a sink on the calling thread in the order of the
+ * chunks. Hence, memory stays bounded independent of the size of the file
+ * and the sink can persist how far the file has been parsed after each batch.
+ * A region that fits into a single chunk is parsed on the calling thread.
+ */
+class ChunkedParser {
+public:
+  /*
+   * Parses a line (without the line break) and appends the resulting records,
+   * if any. Called concurrently for different chunks.
+   */
+  typedef std::function<void(boost::string_view line,
+      std::vector<std::string> *records)> parse_fn_t;
+  /*
+   * Receives the records of the next chunk together with the offset up to
+   * which the file has been parsed once they've been stored. If it returns an
+   * error, parsing stops before the chunk.
+   */
+  typedef std::function<int(std::vector<std::string> &records, long long offset)> sink_fn_t;
+
+  /* Skip the first line of the region, e.g. a CSV header. */
+  static const int SKIP_FIRST_LINE = 0x1;
+  /* Parse a last line that isn't terminated by a line break. */
+  static const int INCLUDE_LAST_LINE = 0x2;
+
+  static const size_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
+  static const size_t DEFAULT_MAX_PENDING_CHUNKS = 8;
+
+private:
+  struct Chunk;
+
+  size_t chunk_size;
+  size_t max_pending_chunks;
+  /* The parse executor is only created once a region doesn't fit into a chunk. */
+  WorkStealingExecutor *executor;
+
+  void parse_chunk(int fd, Chunk *chunk, bool include_last_line, const parse_fn_t &parse_fn) const;
+
+public:
+  ChunkedParser(size_t chunk_size = DEFAULT_CHUNK_SIZE,
+      size_t max_pending_chunks = DEFAULT_MAX_PENDING_CHUNKS,
+      WorkStealingExecutor *executor = nullptr);
+
+  /*
+   * Parses the lines of path between *offset and end. *offset is advanced
+   * after every batch that has been accepted by the sink and ends up after the
+   * last line that has been parsed. A trailing line without line break is left
+   * for the next call unless INCLUDE_LAST_LINE is set. Returns NO_ERROR,
+   * ERROR_NO_RETRY if the file can't be read, or the error of the sink.
+   */
+  int parse(const std::string &path, long long *offset, long long end, int flags,
+      const parse_fn_t &parse_fn, const sink_fn_t &sink_fn) const;
+
+  size_t get_chunk_size() const { return chunk_size; }
+};
+
+#endif /* UTIL_CHUNKED_PARSER_H_ */
@@ -45,6 +45,45 @@ const std::string Config::CKEY_OUT_FILE = "out-file";
 const std::string Config::CKEY_AUDITD_KEY = "auditd-key";
 const std::string Config::CKEY_EMIT_SYSCALL_EVENTS = "emit-syscall-events";
 const std::string Config::CKEY_HOSTNAME_SUFFIX = "hostname-suffix";
+const std::string Config::CKEY_PROC_BOOTSTRAP = "proc-bootstrap";
+const std::string Config::CKEY_PROC_BOOTSTRAP_TIMEOUT = "proc-bootstrap-timeout";
+const std::string Config::CKEY_DNS_CACHE_SIZE = "dns-cache-size";
+const std::string Config::CKEY_DNS_CACHE_TTL = "dns-cache-ttl";
+const std::string Config::CKEY_DNS_RESOLVE_WAIT = "dns-resolve-wait";
+const std::string Config::CKEY_SYSCALL_FILTER = "syscall-filter";
+const std::string Config::CKEY_EVENT_POOL_SIZE = "event-pool-size";
+const std::string Config::CKEY_AUDIT_INPUT = "audit-input";
+const std::string Config::CKEY_AUDIT_INPUT_PATH = "audit-input-path";
+const std::string Config::CKEY_STATS_INTERVAL = "stats-interval";
+const std::string Config::CKEY_STATS_FILE = "stats-file";
+const std::string Config::CKEY_TRACE_SAMPLE_RATE = "trace-sample-rate";
+const std::string Config::CKEY_TRACE_FILE = "trace-file";
+const std::string Config::CKEY_LOG_ASYNC = "log-async";
+const std::string Config::CKEY_LOG_RATE_LIMIT = "log-rate-limit";
+const std::string Config::CKEY_LOG_BINARY_FILE = "log-binary-file";
+const std::string Config::CKEY_METRICS_PORT = "metrics-port";
+const std::string Config::CKEY_METRICS_ADDRESS = "metrics-address";
+const std::string Config::CKEY_RULE_COST_REPORT_INTERVAL = "rule-cost-report-interval";
+const std::string Config::CKEY_RULE_COST_BUDGET = "rule-cost-budget-ns";
+const std::string Config::CKEY_RULE_COST_ACTION = "rule-cost-action";
+const std::string Config::CKEY_RULE_SAMPLE_RATE = "rule-sample-rate";
+const std::string Config::CKEY_ACTION_QUEUE_CAPACITY = "action-queue-capacity";
+const std::string Config::CKEY_ACTION_QUEUE_POLICY = "action-queue-policy";
+const std::string Config::CKEY_ACTION_QUEUE_SPILL_DIR = "action-queue-spill-dir";
+const std::string Config::CKEY_ACTION_COALESCE = "action-coalesce";
+const std::string Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS = "action-coalesce-debounce-ms";
+const std::string Config::CKEY_ACTION_EXECUTOR_THREADS = "action-executor-threads";
+const std::string Config::CKEY_STDOUT_CAPTURE_THREADS = "stdout-capture-threads";
+const std::string Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE = "stdout-capture-batch-size";
+const std::string Config::CKEY_STDOUT_CAPTURE_FLUSH_MS = "stdout-capture-flush-ms";
+const std::string Config::CKEY_PROVD_WORKERS = "provd-workers";
+const std::string Config::CKEY_PROVD_CAPTURE_MODE = "provd-capture-mode";
+const std::string Config::CKEY_STDOUT_CAPTURE_COMPRESS = "stdout-capture-compress";
+const std::string Config::CKEY_PROVD_MATCHER = "provd-matcher";
+const std::string Config::CKEY_PARSE_EXECUTOR_THREADS = "parse-executor-threads";
+const std::string Config::CKEY_STATE_CHECKPOINT_FILE = "state-checkpoint-file";
+const std::string Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS = "state-checkpoint-interval-ms";
+const std::string Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY = "state-checkpoint-max-dirty";
 
 config_opts_t Config::config;
 
@@ -123,6 +162,45 @@ void Config::print_config() {
       << Config::CKEY_AUDITD_KEY << " = "  << Config::config[Config::CKEY_AUDITD_KEY] << std::endl
       << Config::CKEY_EMIT_SYSCALL_EVENTS << " = "  << Config::config[Config::CKEY_EMIT_SYSCALL_EVENTS] << std::endl
       << Config::CKEY_HOSTNAME_SUFFIX << " = "  << Config::config[Config::CKEY_HOSTNAME_SUFFIX] << std::endl
+      << Config::CKEY_PROC_BOOTSTRAP << " = "  << Config::config[Config::CKEY_PROC_BOOTSTRAP] << std::endl
+      << Config::CKEY_PROC_BOOTSTRAP_TIMEOUT << " = "  << Config::config[Config::CKEY_PROC_BOOTSTRAP_TIMEOUT] << std::endl
+      << Config::CKEY_DNS_CACHE_SIZE << " = "  << Config::config[Config::CKEY_DNS_CACHE_SIZE] << std::endl
+      << Config::CKEY_DNS_CACHE_TTL << " = "  << Config::config[Config::CKEY_DNS_CACHE_TTL] << std::endl
+      << Config::CKEY_DNS_RESOLVE_WAIT << " = "  << Config::config[Config::CKEY_DNS_RESOLVE_WAIT] << std::endl
+      << Config::CKEY_SYSCALL_FILTER << " = "  << Config::config[Config::CKEY_SYSCALL_FILTER] << std::endl
+      << Config::CKEY_EVENT_POOL_SIZE << " = "  << Config::config[Config::CKEY_EVENT_POOL_SIZE] << std::endl
+      << Config::CKEY_AUDIT_INPUT << " = "  << Config::config[Config::CKEY_AUDIT_INPUT] << std::endl
+      << Config::CKEY_AUDIT_INPUT_PATH << " = "  << Config::config[Config::CKEY_AUDIT_INPUT_PATH] << std::endl
+      << Config::CKEY_STATS_INTERVAL << " = "  << Config::config[Config::CKEY_STATS_INTERVAL] << std::endl
+      << Config::CKEY_STATS_FILE << " = "  << Config::config[Config::CKEY_STATS_FILE] << std::endl
+      << Config::CKEY_TRACE_SAMPLE_RATE << " = "  << Config::config[Config::CKEY_TRACE_SAMPLE_RATE] << std::endl
+      << Config::CKEY_TRACE_FILE << " = "  << Config::config[Config::CKEY_TRACE_FILE] << std::endl
+      << Config::CKEY_LOG_ASYNC << " = "  << Config::config[Config::CKEY_LOG_ASYNC] << std::endl
+      << Config::CKEY_LOG_RATE_LIMIT << " = "  << Config::config[Config::CKEY_LOG_RATE_LIMIT] << std::endl
+      << Config::CKEY_LOG_BINARY_FILE << " = "  << Config::config[Config::CKEY_LOG_BINARY_FILE] << std::endl
+      << Config::CKEY_METRICS_PORT << " = "  << Config::config[Config::CKEY_METRICS_PORT] << std::endl
+      << Config::CKEY_METRICS_ADDRESS << " = "  << Config::config[Config::CKEY_METRICS_ADDRESS] << std::endl
+      << Config::CKEY_RULE_COST_REPORT_INTERVAL << " = "  << Config::config[Config::CKEY_RULE_COST_REPORT_INTERVAL] << std::endl
+      << Config::CKEY_RULE_COST_BUDGET << " = "  << Config::config[Config::CKEY_RULE_COST_BUDGET] << std::endl
+      << Config::CKEY_RULE_COST_ACTION << " = "  << Config::config[Config::CKEY_RULE_COST_ACTION] << std::endl
+      << Config::CKEY_RULE_SAMPLE_RATE << " = "  << Config::config[Config::CKEY_RULE_SAMPLE_RATE] << std::endl
+      << Config::CKEY_ACTION_QUEUE_CAPACITY << " = "  << Config::config[Config::CKEY_ACTION_QUEUE_CAPACITY] << std::endl
+      << Config::CKEY_ACTION_QUEUE_POLICY << " = "  << Config::config[Config::CKEY_ACTION_QUEUE_POLICY] << std::endl
+      << Config::CKEY_ACTION_QUEUE_SPILL_DIR << " = "  << Config::config[Config::CKEY_ACTION_QUEUE_SPILL_DIR] << std::endl
+      << Config::CKEY_ACTION_COALESCE << " = "  << Config::config[Config::CKEY_ACTION_COALESCE] << std::endl
+      << Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS << " = "  << Config::config[Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS] << std::endl
+      << Config::CKEY_ACTION_EXECUTOR_THREADS << " = "  << Config::config[Config::CKEY_ACTION_EXECUTOR_THREADS] << std::endl
+      << Config::CKEY_STDOUT_CAPTURE_THREADS << " = "  << Config::config[Config::CKEY_STDOUT_CAPTURE_THREADS] << std::endl
+      << Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE << " = "  << Config::config[Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE] << std::endl
+      << Config::CKEY_STDOUT_CAPTURE_FLUSH_MS << " = "  << Config::config[Config::CKEY_STDOUT_CAPTURE_FLUSH_MS] << std::endl
+      << Config::CKEY_PROVD_WORKERS << " = "  << Config::config[Config::CKEY_PROVD_WORKERS] << std::endl
+      << Config::CKEY_PROVD_CAPTURE_MODE << " = "  << Config::config[Config::CKEY_PROVD_CAPTURE_MODE] << std::endl
+      << Config::CKEY_STDOUT_CAPTURE_COMPRESS << " = "  << Config::config[Config::CKEY_STDOUT_CAPTURE_COMPRESS] << std::endl
+      << Config::CKEY_PROVD_MATCHER << " = "  << Config::config[Config::CKEY_PROVD_MATCHER] << std::endl
+      << Config::CKEY_PARSE_EXECUTOR_THREADS << " = "  << Config::config[Config::CKEY_PARSE_EXECUTOR_THREADS] << std::endl
+      << Config::CKEY_STATE_CHECKPOINT_FILE << " = "  << Config::config[Config::CKEY_STATE_CHECKPOINT_FILE] << std::endl
+      << Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS << " = "  << Config::config[Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS] << std::endl
+      << Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY << " = "  << Config::config[Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY] << std::endl
       << std::endl;
 }
 
@@ -182,6 +260,84 @@ bool Config::is_conf_key_valid(std::string key) {
     return true;
   if (key == Config::CKEY_HOSTNAME_SUFFIX)
     return true;
+  if (key == Config::CKEY_PROC_BOOTSTRAP)
+    return true;
+  if (key == Config::CKEY_PROC_BOOTSTRAP_TIMEOUT)
+    return true;
+  if (key == Config::CKEY_DNS_CACHE_SIZE)
+    return true;
+  if (key == Config::CKEY_DNS_CACHE_TTL)
+    return true;
+  if (key == Config::CKEY_DNS_RESOLVE_WAIT)
+    return true;
+  if (key == Config::CKEY_SYSCALL_FILTER)
+    return true;
+  if (key == Config::CKEY_EVENT_POOL_SIZE)
+    return true;
+  if (key == Config::CKEY_AUDIT_INPUT)
+    return true;
+  if (key == Config::CKEY_AUDIT_INPUT_PATH)
+    return true;
+  if (key == Config::CKEY_STATS_INTERVAL)
+    return true;
+  if (key == Config::CKEY_STATS_FILE)
+    return true;
+  if (key == Config::CKEY_TRACE_SAMPLE_RATE)
+    return true;
+  if (key == Config::CKEY_TRACE_FILE)
+    return true;
+  if (key == Config::CKEY_LOG_ASYNC)
+    return true;
+  if (key == Config::CKEY_LOG_RATE_LIMIT)
+    return true;
+  if (key == Config::CKEY_LOG_BINARY_FILE)
+    return true;
+  if (key == Config::CKEY_METRICS_PORT)
+    return true;
+  if (key == Config::CKEY_METRICS_ADDRESS)
+    return true;
+  if (key == Config::CKEY_RULE_COST_REPORT_INTERVAL)
+    return true;
+  if (key == Config::CKEY_RULE_COST_BUDGET)
+    return true;
+  if (key == Config::CKEY_RULE_COST_ACTION)
+    return true;
+  if (key == Config::CKEY_RULE_SAMPLE_RATE)
+    return true;
+  if (key == Config::CKEY_ACTION_QUEUE_CAPACITY)
+    return true;
+  if (key == Config::CKEY_ACTION_QUEUE_POLICY)
+    return true;
+  if (key == Config::CKEY_ACTION_QUEUE_SPILL_DIR)
+    return true;
+  if (key == Config::CKEY_ACTION_COALESCE)
+    return true;
+  if (key == Config::CKEY_ACTION_COALESCE_DEBOUNCE_MS)
+    return true;
+  if (key == Config::CKEY_ACTION_EXECUTOR_THREADS)
+    return true;
+  if (key == Config::CKEY_STDOUT_CAPTURE_THREADS)
+    return true;
+  if (key == Config::CKEY_STDOUT_CAPTURE_BATCH_SIZE)
+    return true;
+  if (key == Config::CKEY_STDOUT_CAPTURE_FLUSH_MS)
+    return true;
+  if (key == Config::CKEY_PROVD_WORKERS)
+    return true;
+  if (key == Config::CKEY_PROVD_CAPTURE_MODE)
+    return true;
+  if (key == Config::CKEY_STDOUT_CAPTURE_COMPRESS)
+    return true;
+  if (key == Config::CKEY_PROVD_MATCHER)
+    return true;
+  if (key == Config::CKEY_PARSE_EXECUTOR_THREADS)
+    return true;
+  if (key == Config::CKEY_STATE_CHECKPOINT_FILE)
+    return true;
+  if (key == Config::CKEY_STATE_CHECKPOINT_INTERVAL_MS)
+    return true;
+  if (key == Config::CKEY_STATE_CHECKPOINT_MAX_DIRTY)
+    return true;
 
   return false;
 }
@@ -56,6 +56,45 @@ public:
   static const std::string CKEY_AUDITD_KEY;
   static const std::string CKEY_EMIT_SYSCALL_EVENTS;
   static const std::string CKEY_HOSTNAME_SUFFIX;
+  static const std::string CKEY_PROC_BOOTSTRAP;
+  static const std::string CKEY_PROC_BOOTSTRAP_TIMEOUT;
+  static const std::string CKEY_DNS_CACHE_SIZE;
+  static const std::string CKEY_DNS_CACHE_TTL;
+  static const std::string CKEY_DNS_RESOLVE_WAIT;
+  static const std::string CKEY_SYSCALL_FILTER;
+  static const std::string CKEY_EVENT_POOL_SIZE;
+  static const std::string CKEY_AUDIT_INPUT;
+  static const std::string CKEY_AUDIT_INPUT_PATH;
+  static const std::string CKEY_STATS_INTERVAL;
+  static const std::string CKEY_STATS_FILE;
+  static const std::string CKEY_TRACE_SAMPLE_RATE;
+  static const std::string CKEY_TRACE_FILE;
+  static const std::string CKEY_LOG_ASYNC;
+  static const std::string CKEY_LOG_RATE_LIMIT;
+  static const std::string CKEY_LOG_BINARY_FILE;
+  static const std::string CKEY_METRICS_PORT;
+  static const std::string CKEY_METRICS_ADDRESS;
+  static const std::string CKEY_RULE_COST_REPORT_INTERVAL;
+  static const std::string CKEY_RULE_COST_BUDGET;
+  static const std::string CKEY_RULE_COST_ACTION;
+  static const std::string CKEY_RULE_SAMPLE_RATE;
+  static const std::string CKEY_ACTION_QUEUE_CAPACITY;
+  static const std::string CKEY_ACTION_QUEUE_POLICY;
+  static const std::string CKEY_ACTION_QUEUE_SPILL_DIR;
+  static const std::string CKEY_ACTION_COALESCE;
+  static const std::string CKEY_ACTION_COALESCE_DEBOUNCE_MS;
+  static const std::string CKEY_ACTION_EXECUTOR_THREADS;
+  static const std::string CKEY_STDOUT_CAPTURE_THREADS;
+  static const std::string CKEY_STDOUT_CAPTURE_BATCH_SIZE;
+  static const std::string CKEY_STDOUT_CAPTURE_FLUSH_MS;
+  static const std::string CKEY_PROVD_WORKERS;
+  static const std::string CKEY_PROVD_CAPTURE_MODE;
+  static const std::string CKEY_STDOUT_CAPTURE_COMPRESS;
+  static const std::string CKEY_PROVD_MATCHER;
+  static const std::string CKEY_PARSE_EXECUTOR_THREADS;
+  static const std::string CKEY_STATE_CHECKPOINT_FILE;
+  static const std::string CKEY_STATE_CHECKPOINT_INTERVAL_MS;
+  static const std::string CKEY_STATE_CHECKPOINT_MAX_DIRTY;
 
   static config_opts_t config;
   /*
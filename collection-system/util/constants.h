@@ -61,6 +61,15 @@ const std::string SCALE_SRC = "scale";
 const std::string ODBC_STREAM = "ODBC";
 const std::string KAFKA_STREAM = "Kafka";
 const std::string FILE_STREAM = "File";
+
+// define audit record sources for the auditd plugin
+const std::string AUDIT_INPUT_STDIN = "stdin";
+const std::string AUDIT_INPUT_FILE = "file";
+const std::string AUDIT_INPUT_UNIX = "unix";
+
+// define what happens to rules that exceed their cost budget
+const std::string RULE_COST_SAMPLE = "sample";
+const std::string RULE_COST_DISABLE = "disable";
 }
 
 #endif /* UTIL_CONSTANTS_H_ */
@@ -0,0 +1,178 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "executor.h"
+
+#include <algorithm>
+
+#include "config.h"
+#include "logger.h"
+
+const int WorkStealingExecutor::DEFAULT_NUM_WORKERS;
+
+/* The executor and worker the current thread belongs to, if any. */
+static thread_local WorkStealingExecutor *current_executor = nullptr;
+static thread_local size_t current_worker = 0;
+
+WorkStealingExecutor::WorkStealingExecutor(int num_workers) :
+    stopping { false },
+    num_queued { 0 },
+    next_worker { 0 },
+    num_steals { 0 } {
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+  for (int i = 0; i < num_workers; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < num_workers; i++) {
+    threads.push_back(std::thread(&WorkStealingExecutor::run_worker, this, i));
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+  stop();
+}
+
+void WorkStealingExecutor::submit(task_t task) {
+  if (current_executor == this) {
+    enqueue(current_worker, task, true);
+  } else {
+    enqueue(next_worker++ % workers.size(), task, false);
+  }
+}
+
+void WorkStealingExecutor::submit_after(task_t task, std::chrono::milliseconds delay) {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (stopping) {
+      return;
+    }
+    delayed.push(DelayedTask { clock_t::now() + delay, task });
+  }
+  // make sure a worker picks up the new deadline
+  work_available.notify_one();
+}
+
+void WorkStealingExecutor::enqueue(size_t idx, task_t task, bool front) {
+  {
+    // increment under the lock so that no worker misses the new task when going
+    // to sleep and before publishing the task so that taking it can't underflow
+    std::unique_lock<std::mutex> lock(mtx);
+    num_queued++;
+  }
+  {
+    std::unique_lock<std::mutex> lock(workers[idx]->mtx);
+    if (front) {
+      workers[idx]->tasks.push_front(task);
+    } else {
+      workers[idx]->tasks.push_back(task);
+    }
+  }
+  work_available.notify_one();
+}
+
+bool WorkStealingExecutor::take_task(size_t idx, task_t *task) {
+  {
+    std::unique_lock<std::mutex> lock(workers[idx]->mtx);
+    if (!workers[idx]->tasks.empty()) {
+      *task = std::move(workers[idx]->tasks.front());
+      workers[idx]->tasks.pop_front();
+      num_queued--;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < workers.size(); i++) {
+    Worker &victim = *workers[(idx + i) % workers.size()];
+    std::unique_lock<std::mutex> lock(victim.mtx);
+    if (!victim.tasks.empty()) {
+      *task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      num_queued--;
+      num_steals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingExecutor::run_worker(size_t idx) {
+  current_executor = this;
+  current_worker = idx;
+  while (true) {
+    task_t task;
+    if (take_task(idx, &task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!delayed.empty() && (delayed.top().due <= clock_t::now() || stopping)) {
+      if (stopping) {
+        // delayed tasks aren't run after the executor has been stopped
+        delayed = decltype(delayed)();
+        continue;
+      }
+      task = delayed.top().task;
+      delayed.pop();
+      lock.unlock();
+      task();
+      continue;
+    }
+    if (num_queued > 0) {
+      // a task has been queued (or another worker is about to take it)
+      continue;
+    }
+    if (stopping) {
+      return;
+    }
+    if (delayed.empty()) {
+      work_available.wait(lock);
+    } else {
+      work_available.wait_until(lock, delayed.top().due);
+    }
+  }
+}
+
+void WorkStealingExecutor::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (stopping) {
+      return;
+    }
+    stopping = true;
+  }
+  work_available.notify_all();
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  threads.clear();
+}
+
+WorkStealingExecutor& action_executor() {
+  static WorkStealingExecutor executor(Config::has_conf_key(Config::CKEY_ACTION_EXECUTOR_THREADS) ?
+      Config::get_long(Config::CKEY_ACTION_EXECUTOR_THREADS) :
+      WorkStealingExecutor::DEFAULT_NUM_WORKERS);
+  return executor;
+}
+
+WorkStealingExecutor& parse_executor() {
+  static WorkStealingExecutor executor(Config::has_conf_key(Config::CKEY_PARSE_EXECUTOR_THREADS) ?
+      Config::get_long(Config::CKEY_PARSE_EXECUTOR_THREADS) :
+      std::max(1u, std::thread::hardware_concurrency()));
+  return executor;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef UTIL_EXECUTOR_H_
+#define UTIL_EXECUTOR_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size thread pool in which each worker has its own task deque.
+ * Workers take tasks from the front of their own deque and, once it is
+ * empty, steal tasks from the back of the other workers' deques. Tasks
+ * submitted from a worker are put on that worker's deque (so follow-up work
+ * tends to stay on the same thread), other tasks are distributed round-robin.
+ *
+ * Tasks can also be submitted with a delay, e.g. to retry work that isn't
+ * ready yet. When the executor is stopped, all queued tasks are still run
+ * but delayed tasks that aren't due yet are discarded.
+ */
+class WorkStealingExecutor {
+public:
+  typedef std::function<void()> task_t;
+  typedef std::chrono::steady_clock clock_t;
+
+  static const int DEFAULT_NUM_WORKERS = 16;
+
+private:
+  struct Worker {
+    std::mutex mtx;
+    std::deque<task_t> tasks;
+  };
+
+  struct DelayedTask {
+    clock_t::time_point due;
+    task_t task;
+    bool operator>(const DelayedTask &other) const { return due > other.due; }
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  /* Protects the fields below and is used to put idle workers to sleep. */
+  std::mutex mtx;
+  std::condition_variable work_available;
+  std::priority_queue<DelayedTask, std::vector<DelayedTask>, std::greater<DelayedTask>> delayed;
+  bool stopping;
+  /* Number of tasks in (or about to be pushed to) the workers' deques. */
+  std::atomic<size_t> num_queued;
+  std::atomic<size_t> next_worker;
+  std::atomic<uint64_t> num_steals;
+
+  void run_worker(size_t idx);
+  /* Takes a task from the worker's own deque or steals one from another worker. */
+  bool take_task(size_t idx, task_t *task);
+  void enqueue(size_t idx, task_t task, bool front);
+
+public:
+  WorkStealingExecutor(int num_workers = DEFAULT_NUM_WORKERS);
+  ~WorkStealingExecutor();
+  WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+  WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+  void submit(task_t task);
+  void submit_after(task_t task, std::chrono::milliseconds delay);
+  /* Runs the remaining tasks and joins the workers. */
+  void stop();
+
+  size_t get_num_workers() const { return workers.size(); }
+  uint64_t get_num_steals() const { return num_steals; }
+};
+
+/*
+ * Returns the executor shared by all actions. It is created on first use with
+ * the number of workers from the action-executor-threads config option.
+ */
+WorkStealingExecutor& action_executor();
+
+/*
+ * Returns the executor on which large files are parsed in parallel (see
+ * ChunkedParser). It is separate from the action executor as actions wait
+ * for the parsed chunks. It is created on first use with the number of workers
+ * from the parse-executor-threads config option, or one worker per core.
+ */
+WorkStealingExecutor& parse_executor();
+
+#endif /* UTIL_EXECUTOR_H_ */
@@ -0,0 +1,117 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "histogram.h"
+
+#include <cmath>
+
+const int Histogram::SUB_BUCKET_BITS;
+const uint64_t Histogram::SUB_BUCKETS;
+const size_t Histogram::NUM_BUCKETS;
+
+/*------------------------------
+ * HistogramSnapshot
+ *------------------------------*/
+
+HistogramSnapshot::HistogramSnapshot() :
+    counts(Histogram::NUM_BUCKETS, 0),
+    count { 0 },
+    sum { 0 },
+    max { 0 } {}
+
+uint64_t HistogramSnapshot::get_percentile(double percentile) const {
+  if (count == 0) {
+    return 0;
+  }
+  if (percentile >= 100) {
+    return max;
+  }
+
+  // the rank of the value we're looking for, starting at 1
+  uint64_t rank = (uint64_t) std::ceil(percentile / 100 * count);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < counts.size(); i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      uint64_t upper = Histogram::bucket_upper_bound(i);
+      return upper < max ? upper : max;
+    }
+  }
+  return max;
+}
+
+/*------------------------------
+ * Histogram
+ *------------------------------*/
+
+Histogram::Histogram() :
+    sum { 0 },
+    max { 0 } {
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+size_t Histogram::bucket_index(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  // position of the highest set bit determines the power of two and the
+  // next SUB_BUCKET_BITS bits the linear bucket within it
+  int exponent = 63 - __builtin_clzll(value);
+  int shift = exponent - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t Histogram::bucket_upper_bound(size_t index) {
+  if (index < SUB_BUCKETS) {
+    return index;
+  }
+  int shift = index / SUB_BUCKETS - 1;
+  uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+  // computed as lower bound + width - 1 so that the last bucket doesn't overflow
+  return (sub_bucket << shift) + ((uint64_t) 1 << shift) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+  buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(value, std::memory_order_relaxed);
+  uint64_t current_max = max.load(std::memory_order_relaxed);
+  while (value > current_max
+      && !max.compare_exchange_weak(current_max, value, std::memory_order_relaxed)) {}
+}
+
+HistogramSnapshot Histogram::snapshot(bool reset) {
+  HistogramSnapshot s;
+  for (size_t i = 0; i < NUM_BUCKETS; i++) {
+    s.counts[i] = reset ? buckets[i].exchange(0, std::memory_order_relaxed)
+        : buckets[i].load(std::memory_order_relaxed);
+    s.count += s.counts[i];
+  }
+  // count is derived from the buckets so that percentiles are consistent
+  // even if values are being recorded while we copy
+  if (reset) {
+    s.sum = sum.exchange(0, std::memory_order_relaxed);
+    s.max = max.exchange(0, std::memory_order_relaxed);
+  } else {
+    s.sum = sum.load(std::memory_order_relaxed);
+    s.max = max.load(std::memory_order_relaxed);
+  }
+  return s;
+}
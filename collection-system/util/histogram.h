@@ -0,0 +1,91 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTIL_HISTOGRAM_H_
+#define UTIL_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Point-in-time copy of a Histogram that can be queried for percentiles.
+ */
+class HistogramSnapshot {
+friend class Histogram;
+
+private:
+  std::vector<uint64_t> counts;
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+
+public:
+  HistogramSnapshot();
+
+  uint64_t get_count() const { return count; }
+  uint64_t get_max() const { return max; }
+  uint64_t get_sum() const { return sum; }
+  double get_mean() const { return count ? (double) sum / count : 0; }
+  /*
+   * Returns the value at the given percentile (0-100). The result is the
+   * upper bound of the bucket the percentile falls into, so it is accurate
+   * to within the histogram's precision.
+   */
+  uint64_t get_percentile(double percentile) const;
+};
+
+/**
+ * A lock-free histogram with HDR-style log-linear buckets. Each power of two
+ * is split into SUB_BUCKETS linear buckets, which bounds the relative error
+ * of any recorded value to 1/SUB_BUCKETS (~6%) while covering the entire
+ * uint64_t range with less than a thousand buckets.
+ *
+ * Values can be recorded concurrently from any number of threads. Recording
+ * is a few relaxed atomic operations and never blocks.
+ */
+class Histogram {
+public:
+  static const int SUB_BUCKET_BITS = 4;
+  static const uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+  std::atomic<uint64_t> buckets[NUM_BUCKETS];
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+
+public:
+  Histogram();
+
+  Histogram(const Histogram&) = delete;
+  Histogram& operator=(const Histogram&) = delete;
+
+  void record(uint64_t value);
+  /*
+   * Copies the current state of the histogram. If reset is set, the recorded
+   * values are removed at the same time, which allows reporting per interval
+   * without losing values that are recorded concurrently.
+   */
+  HistogramSnapshot snapshot(bool reset = false);
+
+  static size_t bucket_index(uint64_t value);
+  /* Largest value that falls into the bucket with the given index. */
+  static uint64_t bucket_upper_bound(size_t index);
+};
+
+#endif /* UTIL_HISTOGRAM_H_ */
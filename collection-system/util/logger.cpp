@@ -17,10 +17,49 @@
 #include "logger.h"
 
 #include <iostream>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <string.h>
 #include <unistd.h>
 
 std::string Logger::log_file_name = "";
+std::atomic<AsyncLogWriter*> Logger::async_writer { nullptr };
+std::atomic<AsyncLogWriter*> Logger::binary_writer { nullptr };
+std::atomic<uint32_t> LogRateLimiter::max_per_second { 0 };
+const size_t AsyncLogWriter::DEFAULT_RING_SIZE;
+const size_t AsyncLogWriter::DEFAULT_MAX_RECORD_SIZE;
+
+/*------------------------------
+ * LogRateLimiter
+ *------------------------------*/
+
+bool LogRateLimiter::allow(uint32_t *suppressed) {
+  uint32_t max = max_per_second.load(std::memory_order_relaxed);
+  if (!max) {
+    return true;
+  }
+
+  int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  int64_t current = window.load(std::memory_order_relaxed);
+  if (now != current && window.compare_exchange_strong(current, now)) {
+    // first message in a new second, concurrent callers may still see
+    // the old count, which only makes the limit slightly less strict
+    num_logged.store(0, std::memory_order_relaxed);
+  }
+
+  if (num_logged.fetch_add(1, std::memory_order_relaxed) < max) {
+    *suppressed = num_suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+  num_suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+/*------------------------------
+ * Logger
+ *------------------------------*/
 
 Logger::Logger(Level l) :
     level { l }, lock { } {
@@ -44,7 +83,79 @@ void Logger::set_log_file_name(std::string filename) {
   log_file_name = filename;
 }
 
-void Logger::log(std::string msg, char const *function, int line) {
+void Logger::set_rate_limit(uint32_t max_per_second) {
+  LogRateLimiter::max_per_second = max_per_second;
+}
+
+void Logger::enable_async() {
+  if (async_writer.load()) {
+    return;
+  }
+  std::unique_ptr<LogBackend> sink;
+  if (!log_file_name.empty()) {
+    sink = std::make_unique<FileBackend>(log_file_name);
+  } else {
+    sink = std::make_unique<ConsoleBackend>();
+  }
+  // The writer is never deleted as other threads may still be logging while
+  // the program shuts down. Once stopped, records are written synchronously.
+  AsyncLogWriter *expected = nullptr;
+  AsyncLogWriter *writer = new AsyncLogWriter(std::move(sink));
+  if (!async_writer.compare_exchange_strong(expected, writer)) {
+    delete writer;
+    return;
+  }
+  std::atexit(Logger::disable_async);
+}
+
+void Logger::disable_async() {
+  AsyncLogWriter *writer = async_writer.load();
+  if (writer) {
+    writer->stop();
+  }
+}
+
+void Logger::enable_binary(const std::string &filename) {
+  if (binary_writer.load()) {
+    return;
+  }
+  // binary records must not be truncated
+  AsyncLogWriter *expected = nullptr;
+  AsyncLogWriter *writer = new AsyncLogWriter(std::make_unique<BinaryFileBackend>(filename),
+      AsyncLogWriter::DEFAULT_RING_SIZE, SIZE_MAX);
+  if (!binary_writer.compare_exchange_strong(expected, writer)) {
+    delete writer;
+    return;
+  }
+
+  // Every format has to be defined in the log before it can be decoded. Set
+  // the hook first so no format that's registered concurrently is missed,
+  // formats that are defined twice don't hurt.
+  LogFormat::set_register_hook([](const LogFormat &format) {
+    AsyncLogWriter *writer = binary_writer.load(std::memory_order_acquire);
+    if (writer) {
+      writer->submit(format.encode_definition());
+    }
+  });
+  for (const LogFormat *format : LogFormat::get_registered()) {
+    writer->submit(format->encode_definition());
+  }
+  std::atexit(Logger::disable_binary);
+}
+
+void Logger::disable_binary() {
+  AsyncLogWriter *writer = binary_writer.load();
+  if (writer) {
+    writer->stop();
+  }
+}
+
+uint64_t Logger::now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void Logger::log(std::string msg, char const *function, int line, uint32_t num_suppressed) {
   std::string log_msg = pretty_utc_time() + " [" + function + ":"
       + std::to_string(line) + "]";
 
@@ -71,6 +182,15 @@ void Logger::log(std::string msg, char const *function, int line) {
     log_msg += " [NONE] - " + msg;
     break;
   }
+  if (num_suppressed) {
+    log_msg += " [suppressed " + std::to_string(num_suppressed) + " messages]";
+  }
+
+  AsyncLogWriter *writer = async_writer.load(std::memory_order_acquire);
+  if (writer && writer->is_running()) {
+    writer->submit(std::move(log_msg));
+    return;
+  }
 
   std::unique_lock<std::mutex> uniqueLock(lock);
   backend->log_msg(log_msg);
@@ -114,6 +234,10 @@ Logger& performance_logger() {
   return logger;
 }
 
+void LogBackend::log_dropped(uint64_t num_dropped) {
+  log_msg("[WARN] - Log buffer full, dropped " + std::to_string(num_dropped) + " records");
+}
+
 void ConsoleBackend::log_msg(std::string msg) {
   std::cout << msg << std::endl;
 }
@@ -129,3 +253,155 @@ FileBackend::~FileBackend() {
 void FileBackend::log_msg(std::string msg) {
   out_file << msg << std::endl;
 }
+
+BinaryFileBackend::BinaryFileBackend(std::string filename) {
+  out_file.open(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+  out_file.write(binlog::MAGIC, sizeof(binlog::MAGIC));
+  out_file.write((const char*) &binlog::VERSION, sizeof(binlog::VERSION));
+}
+
+BinaryFileBackend::~BinaryFileBackend() {
+  out_file.close();
+}
+
+void BinaryFileBackend::log_msg(std::string msg) {
+  out_file.write(msg.data(), msg.size());
+}
+
+void BinaryFileBackend::log_dropped(uint64_t num_dropped) {
+  std::string record;
+  binlog::put<uint32_t>(record, 0);
+  binlog::put<uint8_t>(record, binlog::kind_dropped);
+  binlog::put<uint64_t>(record, num_dropped);
+  LogFormat::finish_record(record);
+  log_msg(record);
+}
+
+void BinaryFileBackend::flush() {
+  out_file.flush();
+}
+
+/*------------------------------
+ * AsyncLogWriter
+ *------------------------------*/
+
+AsyncLogWriter::AsyncLogWriter(std::unique_ptr<LogBackend> sink, size_t ring_size,
+    size_t max_record_size) :
+    sink { std::move(sink) },
+    running { true },
+    num_dropped { 0 },
+    ring_size { ring_size > 1 ? ring_size : 2 },
+    max_record_size { max_record_size } {
+  writer = std::thread(&AsyncLogWriter::run, this);
+}
+
+AsyncLogWriter::~AsyncLogWriter() {
+  stop();
+}
+
+AsyncLogWriter::Ring* AsyncLogWriter::get_thread_ring() {
+  // closes the ring when the thread exits so the writer can drop it
+  struct ThreadRing {
+    AsyncLogWriter *owner = nullptr;
+    std::shared_ptr<Ring> ring;
+    ~ThreadRing() {
+      if (ring) {
+        ring->closed = true;
+      }
+    }
+  };
+  static thread_local ThreadRing thread_ring;
+
+  if (thread_ring.owner != this || !thread_ring.ring) {
+    if (thread_ring.ring) {
+      thread_ring.ring->closed = true;
+    }
+    thread_ring.ring = std::make_shared<Ring>(ring_size);
+    thread_ring.owner = this;
+    std::unique_lock<std::mutex> lock(rings_mtx);
+    rings.push_back(thread_ring.ring);
+  }
+  return thread_ring.ring.get();
+}
+
+bool AsyncLogWriter::submit(std::string &&record) {
+  if (!running) {
+    return false;
+  }
+
+  Ring *ring = get_thread_ring();
+  size_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (tail - ring->head.load(std::memory_order_acquire) >= ring->slots.size()) {
+    num_dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  std::string &slot = ring->slots[tail % ring->slots.size()];
+  if (record.size() > max_record_size) {
+    size_t truncated = record.size() - max_record_size;
+    record.resize(max_record_size);
+    record += "... [truncated " + std::to_string(truncated) + " bytes]";
+  }
+  slot = std::move(record);
+  ring->tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+size_t AsyncLogWriter::drain() {
+  std::vector<std::shared_ptr<Ring>> current_rings;
+  {
+    std::unique_lock<std::mutex> lock(rings_mtx);
+    current_rings = rings;
+  }
+
+  size_t num_written = 0;
+  for (std::shared_ptr<Ring> &ring : current_rings) {
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t tail = ring->tail.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+      std::string &slot = ring->slots[head % ring->slots.size()];
+      sink->log_msg(slot);
+      // release the memory of large records
+      std::string().swap(slot);
+      num_written++;
+    }
+    ring->head.store(head, std::memory_order_release);
+  }
+
+  uint64_t dropped = num_dropped.exchange(0, std::memory_order_relaxed);
+  if (dropped) {
+    sink->log_dropped(dropped);
+  }
+  if (num_written || dropped) {
+    sink->flush();
+  }
+
+  // forget about rings whose threads have exited and that have been drained
+  std::unique_lock<std::mutex> lock(rings_mtx);
+  for (auto it = rings.begin(); it != rings.end();) {
+    if ((*it)->closed && (*it)->head.load() == (*it)->tail.load()) {
+      it = rings.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return num_written;
+}
+
+void AsyncLogWriter::run() {
+  while (running) {
+    if (!drain()) {
+      // nothing to do, producers never wake us up to keep logging cheap
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+}
+
+void AsyncLogWriter::stop() {
+  bool was_running = running.exchange(false);
+  if (was_running && writer.joinable()) {
+    writer.join();
+  }
+  // write whatever has been submitted until now
+  drain();
+}
@@ -23,37 +23,87 @@
 #include <cstdint>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
 
-#define LOG(logger, msg)                    \
-  logger.log(                               \
-    static_cast<std::ostringstream&>(       \
-      std::ostringstream().flush() << msg   \
-    ).str(),                                \
-    __FUNCTION__,                           \
-    __LINE__                                \
-  );
+#include "binary-log.h"
 
-// always log fatal, errors, and warnings
+/*
+ * Every call site has its own rate limiter, which is checked before the
+ * message is formatted so suppressed messages cost next to nothing.
+ */
+#define LOG(logger, msg)                      \
+  do {                                        \
+    static LogRateLimiter rate_limiter;       \
+    uint32_t num_suppressed = 0;              \
+    if (rate_limiter.allow(&num_suppressed)) {\
+      logger.log(                             \
+        static_cast<std::ostringstream&>(     \
+          std::ostringstream().flush() << msg \
+        ).str(),                              \
+        __FUNCTION__,                         \
+        __LINE__,                             \
+        num_suppressed                        \
+      );                                      \
+    }                                         \
+  } while (0)
+
+/*
+ * Like LOG but takes a format string with {} placeholders and the arguments
+ * separately. The arguments are only evaluated if the message passes the
+ * rate limiter and, if binary logging is enabled, they are written as raw
+ * values without being formatted at all (see Logger::enable_binary).
+ */
+#define LOGF(logger, level, fmt, ...)                                       \
+  do {                                                                      \
+    static LogRateLimiter rate_limiter;                                     \
+    static const LogFormat log_format((uint8_t) level, fmt, __FUNCTION__,   \
+        __LINE__);                                                          \
+    uint32_t num_suppressed = 0;                                            \
+    if (rate_limiter.allow(&num_suppressed)) {                              \
+      logger.logf(log_format, num_suppressed, ##__VA_ARGS__);               \
+    }                                                                       \
+  } while (0)
+
+// always log fatal and errors
 #define LOGGER_LOG_FATAL(msg) LOG(fatal_logger(), msg)
 #define LOGGER_LOG_ERROR(msg) LOG(error_logger(), msg)
+#define LOGGER_LOGF_FATAL(fmt, ...) LOGF(fatal_logger(), Level::Fatal, fmt, ##__VA_ARGS__)
+#define LOGGER_LOGF_ERROR(fmt, ...) LOGF(error_logger(), Level::Error, fmt, ##__VA_ARGS__)
+
+// warnings are logged unless the build only asks for errors
+#ifdef ERROR_ONLY
+#define LOGGER_LOG_WARN(msg) do {} while(0)
+#define LOGGER_LOGF_WARN(fmt, ...) do {} while(0)
+#else
 #define LOGGER_LOG_WARN(msg) LOG(warn_logger(), msg)
+#define LOGGER_LOGF_WARN(fmt, ...) LOGF(warn_logger(), Level::Warning, fmt, ##__VA_ARGS__)
+#endif
 
 #ifndef INFO
 #define LOGGER_LOG_INFO(msg) do {} while(0)
+#define LOGGER_LOGF_INFO(fmt, ...) do {} while(0)
 #else
 #define LOGGER_LOG_INFO(msg) LOG(info_logger(), msg)
+#define LOGGER_LOGF_INFO(fmt, ...) LOGF(info_logger(), Level::Info, fmt, ##__VA_ARGS__)
 #endif
 
 #ifndef DEBUG
 #define LOGGER_LOG_DEBUG(msg) do {} while(0)
+#define LOGGER_LOGF_DEBUG(fmt, ...) do {} while(0)
 #else
 #define LOGGER_LOG_DEBUG(msg) LOG(debug_logger(), msg)
+#define LOGGER_LOGF_DEBUG(fmt, ...) LOGF(debug_logger(), Level::Debug, fmt, ##__VA_ARGS__)
 #endif
 
 #ifndef PERF
 #define LOGGER_LOG_PERF(msg) do {} while(0)
+#define LOGGER_LOGF_PERF(fmt, ...) do {} while(0)
 #else
 #define LOGGER_LOG_PERF(msg) LOG(performance_logger(), msg)
+#define LOGGER_LOGF_PERF(fmt, ...) LOGF(performance_logger(), Level::Performance, fmt, ##__VA_ARGS__)
 #endif
 
 enum class Level : uint8_t {
@@ -61,10 +111,35 @@ enum class Level : uint8_t {
 };
 
 class LogBackend;
+class AsyncLogWriter;
+
+/**
+ * Limits how many messages a single call site can log per second. Once the
+ * limit is reached, messages are dropped until the next second starts and the
+ * number of dropped messages is reported with the next message that passes.
+ * The limit is shared by all call sites and disabled (0) by default.
+ */
+class LogRateLimiter {
+private:
+  std::atomic<int64_t> window;
+  std::atomic<uint32_t> num_logged;
+  std::atomic<uint32_t> num_suppressed;
+
+public:
+  static std::atomic<uint32_t> max_per_second;
+
+  LogRateLimiter() : window { 0 }, num_logged { 0 }, num_suppressed { 0 } {}
+  /* Returns false if the message should be dropped. */
+  bool allow(uint32_t *suppressed);
+};
 
 class Logger {
 private:
   static std::string log_file_name;
+  /* Set once async logging has been enabled, never deleted (see enable_async). */
+  static std::atomic<AsyncLogWriter*> async_writer;
+  /* Set once binary logging has been enabled, never deleted (see enable_binary). */
+  static std::atomic<AsyncLogWriter*> binary_writer;
   Level level;
   LogBackend *backend;
   std::mutex lock;
@@ -73,7 +148,28 @@ public:
   Logger(Level l);
   ~Logger();
   static void set_log_file_name(std::string filename);
-  void log(std::string const msg, char const *function, int line);
+  /* Limits the number of messages per second and call site (0 disables the limit). */
+  static void set_rate_limit(uint32_t max_per_second);
+  /*
+   * Hands log records to a background writer instead of writing them on the
+   * calling thread. Must be called after set_log_file_name. Records are
+   * flushed when the program exits or disable_async is called.
+   */
+  static void enable_async();
+  static void disable_async();
+  /*
+   * Writes the records of all LOGF statements to the given file in the
+   * binary log format (see binary-log.h) instead of formatting them. Use
+   * log-decoder to render the file. LOG statements are not affected.
+   */
+  static void enable_binary(const std::string &filename);
+  static void disable_binary();
+  static uint64_t now_us();
+  void log(std::string const msg, char const *function, int line, uint32_t num_suppressed = 0);
+
+  /* Defined below AsyncLogWriter, which has to be complete. */
+  template<typename... Args>
+  void logf(const LogFormat &format, uint32_t num_suppressed, const Args&... args);
   std::string pretty_utc_time();
 };
 
@@ -88,6 +184,9 @@ class LogBackend {
 public:
   virtual ~LogBackend() {}
   virtual void log_msg(std::string msg) = 0;
+  /* Reports records that were dropped by the AsyncLogWriter. */
+  virtual void log_dropped(uint64_t num_dropped);
+  virtual void flush() {}
 };
 
 class ConsoleBackend: public LogBackend {
@@ -106,4 +205,81 @@ public:
   void log_msg(std::string msg);
 };
 
+/**
+ * Writes binary log records (see binary-log.h) to a file as they are,
+ * starting with the file header.
+ */
+class BinaryFileBackend: public LogBackend {
+private:
+  std::ofstream out_file;
+
+public:
+  BinaryFileBackend(std::string filename);
+  ~BinaryFileBackend();
+  void log_msg(std::string msg) override;
+  void log_dropped(uint64_t num_dropped) override;
+  void flush() override;
+};
+
+/**
+ * Writes log records on a background thread. Every logging thread gets its
+ * own fixed-size ring buffer of formatted records, which only it writes to
+ * and only the writer thread reads from, so submitting a record never takes
+ * a lock or waits for I/O. If a ring is full, the record is dropped and
+ * counted instead of stalling the caller. Very large records are truncated.
+ */
+class AsyncLogWriter {
+public:
+  static const size_t DEFAULT_RING_SIZE = 4096;
+  static const size_t DEFAULT_MAX_RECORD_SIZE = 16 * 1024;
+
+private:
+  struct Ring {
+    std::vector<std::string> slots;
+    /* Next slot to read (writer) and to write (producer). */
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    /* Set when the producing thread exits. */
+    std::atomic<bool> closed;
+
+    Ring(size_t size) : slots(size), head { 0 }, tail { 0 }, closed { false } {}
+  };
+
+  std::unique_ptr<LogBackend> sink;
+  std::mutex rings_mtx;
+  std::vector<std::shared_ptr<Ring>> rings;
+  std::thread writer;
+  std::atomic<bool> running;
+  std::atomic<uint64_t> num_dropped;
+  size_t ring_size;
+  size_t max_record_size;
+
+  Ring* get_thread_ring();
+  void run();
+  /* Writes all pending records, returns the number of written records. */
+  size_t drain();
+
+public:
+  AsyncLogWriter(std::unique_ptr<LogBackend> sink, size_t ring_size = DEFAULT_RING_SIZE,
+      size_t max_record_size = DEFAULT_MAX_RECORD_SIZE);
+  ~AsyncLogWriter();
+
+  /* Returns false if the record couldn't be queued (full ring or stopped writer). */
+  bool submit(std::string &&record);
+  /* Writes all pending records and stops the writer thread. */
+  void stop();
+  bool is_running() const { return running; }
+  uint64_t get_num_dropped() const { return num_dropped; }
+};
+
+template<typename... Args>
+void Logger::logf(const LogFormat &format, uint32_t num_suppressed, const Args&... args) {
+  AsyncLogWriter *writer = binary_writer.load(std::memory_order_acquire);
+  if (writer && writer->is_running()) {
+    writer->submit(format.encode_event(now_us(), args...));
+    return;
+  }
+  log(format.format_text(args...), format.function, format.line, num_suppressed);
+}
+
 #endif /* UTIL_LOGGER_H_ */
@@ -0,0 +1,278 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "metrics.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "error.h"
+#include "logger.h"
+
+// not available on MacOS, where SIGPIPE is ignored through SO_NOSIGPIPE instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const double QUANTILES[] = { 0.5, 0.9, 0.99 };
+
+/*------------------------------
+ * MetricsRegistry
+ *------------------------------*/
+
+MetricsRegistry::Family& MetricsRegistry::get_family(const std::string &name,
+    const std::string &help, metric_type_t type) {
+  auto it = families.find(name);
+  if (it == families.end()) {
+    Family &f = families[name];
+    f.type = type;
+    f.help = help;
+    return f;
+  }
+  if (it->second.type != type) {
+    throw std::invalid_argument("Metric " + name + " is already registered with another type");
+  }
+  return it->second;
+}
+
+std::string MetricsRegistry::render_labels(const metric_labels_t &labels) {
+  if (labels.empty()) {
+    return "";
+  }
+  std::string rendered = "{";
+  for (auto it = labels.begin(); it != labels.end(); ++it) {
+    if (it != labels.begin()) {
+      rendered += ",";
+    }
+    rendered += it->first + "=\"";
+    for (char c : it->second) {
+      if (c == '\\' || c == '"') {
+        rendered += '\\';
+        rendered += c;
+      } else if (c == '\n') {
+        rendered += "\\n";
+      } else {
+        rendered += c;
+      }
+    }
+    rendered += "\"";
+  }
+  return rendered + "}";
+}
+
+Counter& MetricsRegistry::counter(const std::string &name, const std::string &help,
+    const metric_labels_t &labels) {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::unique_ptr<Counter> &c = get_family(name, help, metric_counter)
+      .counters[render_labels(labels)];
+  if (!c) {
+    c = std::make_unique<Counter>();
+  }
+  return *c;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string &name, const std::string &help,
+    const metric_labels_t &labels) {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::unique_ptr<Gauge> &g = get_family(name, help, metric_gauge)
+      .gauges[render_labels(labels)];
+  if (!g) {
+    g = std::make_unique<Gauge>();
+  }
+  return *g;
+}
+
+Histogram& MetricsRegistry::histogram(const std::string &name, const std::string &help,
+    const metric_labels_t &labels) {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::unique_ptr<Histogram> &h = get_family(name, help, metric_histogram)
+      .histograms[render_labels(labels)];
+  if (!h) {
+    h = std::make_unique<Histogram>();
+  }
+  return *h;
+}
+
+std::string MetricsRegistry::render() {
+  std::unique_lock<std::mutex> lock(mtx);
+  std::ostringstream out;
+  for (auto &entry : families) {
+    const std::string &name = entry.first;
+    Family &f = entry.second;
+    out << "# HELP " << name << " " << f.help << "\n";
+    switch (f.type) {
+    case metric_counter:
+      out << "# TYPE " << name << " counter\n";
+      for (auto &c : f.counters) {
+        out << name << c.first << " " << c.second->get() << "\n";
+      }
+      break;
+    case metric_gauge:
+      out << "# TYPE " << name << " gauge\n";
+      for (auto &g : f.gauges) {
+        out << name << g.first << " " << g.second->get() << "\n";
+      }
+      break;
+    case metric_histogram:
+      out << "# TYPE " << name << " summary\n";
+      for (auto &h : f.histograms) {
+        HistogramSnapshot s = h.second->snapshot();
+        // add the quantile to the existing labels
+        std::string labels = h.first.empty() ? "{" : h.first.substr(0, h.first.size() - 1) + ",";
+        for (double q : QUANTILES) {
+          out << name << labels << "quantile=\"" << q << "\"} " << s.get_percentile(q * 100)
+              << "\n";
+        }
+        out << name << "_sum" << h.first << " " << s.get_sum() << "\n";
+        out << name << "_count" << h.first << " " << s.get_count() << "\n";
+      }
+      break;
+    }
+  }
+  return out.str();
+}
+
+MetricsRegistry& metrics() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+/*------------------------------
+ * MetricsServer
+ *------------------------------*/
+
+MetricsServer::MetricsServer(MetricsRegistry &registry, int port, const std::string &address) :
+    registry(registry),
+    address { address },
+    port { port },
+    listen_fd { -1 },
+    running { false } {}
+
+MetricsServer::~MetricsServer() {
+  stop();
+}
+
+int MetricsServer::start() {
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    LOGGER_LOG_ERROR("Couldn't create metrics socket: " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+    LOGGER_LOG_ERROR("Invalid metrics address " << address);
+    ::close(listen_fd);
+    listen_fd = -1;
+    return ERROR_NO_RETRY;
+  }
+  if (bind(listen_fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+    LOGGER_LOG_ERROR("Couldn't listen on " << address << ":" << port << " for metrics: "
+        << strerror(errno));
+    ::close(listen_fd);
+    listen_fd = -1;
+    return ERROR_NO_RETRY;
+  }
+
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*) &addr, &len);
+  port = ntohs(addr.sin_port);
+  LOGGER_LOG_INFO("Serving metrics on " << address << ":" << port);
+
+  running = true;
+  server = std::thread(&MetricsServer::run, this);
+  return NO_ERROR;
+}
+
+void MetricsServer::stop() {
+  if (running.exchange(false) && server.joinable()) {
+    server.join();
+  }
+  if (listen_fd >= 0) {
+    ::close(listen_fd);
+    listen_fd = -1;
+  }
+}
+
+void MetricsServer::run() {
+  pollfd pfd = { listen_fd, POLLIN, 0 };
+  while (running) {
+    // wake up regularly to check whether we've been stopped
+    int rc = poll(&pfd, 1, 200);
+    if (rc <= 0) {
+      continue;
+    }
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    handle_connection(fd);
+    ::close(fd);
+  }
+}
+
+void MetricsServer::handle_connection(int fd) {
+  // don't let a client that never sends anything block the server
+  timeval timeout = { 1, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+  int no_sigpipe = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe, sizeof(no_sigpipe));
+#endif
+
+  // we only care about the request line
+  char buf[1024];
+  ssize_t n = recv(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) {
+    return;
+  }
+  buf[n] = '\0';
+
+  std::string body;
+  std::string status;
+  if (strncmp(buf, "GET ", 4) == 0) {
+    status = "200 OK";
+    body = registry.render();
+  } else {
+    status = "405 Method Not Allowed";
+  }
+  std::string response = "HTTP/1.0 " + status + "\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: " + std::to_string(body.size()) + "\r\n"
+      "Connection: close\r\n\r\n" + body;
+
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t rc = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (rc <= 0) {
+      return;
+    }
+    sent += rc;
+  }
+}
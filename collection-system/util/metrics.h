@@ -0,0 +1,141 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTIL_METRICS_H_
+#define UTIL_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "histogram.h"
+
+typedef std::map<std::string, std::string> metric_labels_t;
+
+typedef enum metric_type {
+  metric_counter,
+  metric_gauge,
+  metric_histogram
+} metric_type_t;
+
+/**
+ * A monotonically increasing count, e.g. of received events.
+ */
+class Counter {
+private:
+  std::atomic<uint64_t> value;
+
+public:
+  Counter() : value { 0 } {}
+
+  void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * A value that can go up and down, e.g. the depth of a queue.
+ */
+class Gauge {
+private:
+  std::atomic<int64_t> value;
+
+public:
+  Gauge() : value { 0 } {}
+
+  void set(int64_t v) { value.store(v, std::memory_order_relaxed); }
+  void add(int64_t n) { value.fetch_add(n, std::memory_order_relaxed); }
+  int64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * Process-wide registry of named metrics. A metric is identified by its
+ * name and labels and created on first use. Looking up a metric takes a
+ * lock, so callers on hot paths should look up their metrics once and keep
+ * the returned reference, which stays valid for the lifetime of the process.
+ * Updating a metric is lock-free.
+ *
+ * Histograms are exported as Prometheus summaries (quantiles, sum, count).
+ */
+class MetricsRegistry {
+private:
+  struct Family {
+    metric_type_t type;
+    std::string help;
+    /* Keyed by the rendered labels, e.g. {rule="abc"}. */
+    std::map<std::string, std::unique_ptr<Counter>> counters;
+    std::map<std::string, std::unique_ptr<Gauge>> gauges;
+    std::map<std::string, std::unique_ptr<Histogram>> histograms;
+  };
+
+  std::mutex mtx;
+  std::map<std::string, Family> families;
+
+  /* Throws std::invalid_argument if the name is registered with a different type. */
+  Family& get_family(const std::string &name, const std::string &help, metric_type_t type);
+  static std::string render_labels(const metric_labels_t &labels);
+
+public:
+  MetricsRegistry() {}
+  MetricsRegistry(const MetricsRegistry&) = delete;
+  MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+  Counter& counter(const std::string &name, const std::string &help,
+      const metric_labels_t &labels = metric_labels_t());
+  Gauge& gauge(const std::string &name, const std::string &help,
+      const metric_labels_t &labels = metric_labels_t());
+  /* Histograms of latencies should record microseconds and use a _us suffix. */
+  Histogram& histogram(const std::string &name, const std::string &help,
+      const metric_labels_t &labels = metric_labels_t());
+
+  /* Renders all metrics in the Prometheus text exposition format. */
+  std::string render();
+};
+
+MetricsRegistry& metrics();
+
+/**
+ * Minimal HTTP server that serves the metrics of a registry as text on
+ * any GET request (e.g. GET /metrics). Requests are handled one at a time
+ * on a single background thread, which is plenty for a scraper polling
+ * every few seconds. Binds to the loopback address by default.
+ */
+class MetricsServer {
+private:
+  MetricsRegistry &registry;
+  std::string address;
+  int port;
+  int listen_fd;
+  std::atomic<bool> running;
+  std::thread server;
+
+  void run();
+  void handle_connection(int fd);
+
+public:
+  MetricsServer(MetricsRegistry &registry, int port, const std::string &address = "127.0.0.1");
+  ~MetricsServer();
+
+  /* Starts listening, port 0 picks a free port (see get_port). */
+  int start();
+  void stop();
+  int get_port() const { return port; }
+};
+
+#endif /* UTIL_METRICS_H_ */
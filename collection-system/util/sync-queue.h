@@ -17,6 +17,7 @@
 #ifndef UTIL_SYNC_QUEUE_H_
 #define UTIL_SYNC_QUEUE_H_
 
+#include <chrono>
 #include <mutex>
 #include <queue>
 #include <condition_variable>
@@ -34,6 +35,9 @@ private:
 public:
   void push(T elem);
   T pop();
+  /* Waits at most timeout for an element, returns false if there is none. */
+  bool pop(T *elem, std::chrono::milliseconds timeout);
+  size_t size();
 };
 
 template<class T>
@@ -58,4 +62,23 @@ T SynchronizedQueue<T>::pop() {
   return elem;
 }
 
+template<class T>
+bool SynchronizedQueue<T>::pop(T *elem, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex);
+  if (!monitor.wait_for(lock, timeout, [=]() { return !queue.empty(); })) {
+    return false;
+  }
+
+  *elem = queue.front();
+  queue.pop();
+
+  return true;
+}
+
+template<class T>
+size_t SynchronizedQueue<T>::size() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return queue.size();
+}
+
 #endif /* UTIL_SYNC_QUEUE_H_ */
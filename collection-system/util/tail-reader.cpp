@@ -0,0 +1,108 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tail-reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "error.h"
+#include "logger.h"
+
+const size_t TailReader::DEFAULT_WINDOW_SIZE;
+
+TailReader::TailReader(size_t window_size) :
+    window_size { window_size > 0 ? window_size : DEFAULT_WINDOW_SIZE } {}
+
+int TailReader::read(const std::string &path, long long *offset, std::string *fragment,
+    const line_cb_t &cb) const {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOGGER_LOG_ERROR("Can't open " << path << ": " << strerror(errno));
+    return ERROR_NO_RETRY;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) < 0) {
+    LOGGER_LOG_ERROR("Can't stat " << path << ": " << strerror(errno));
+    close(fd);
+    return ERROR_NO_RETRY;
+  }
+
+  long long size = sb.st_size;
+  if (size < *offset) {
+    LOGGER_LOG_INFO(path << " has been truncated, reading from the start.");
+    *offset = 0;
+    fragment->clear();
+  }
+  if (size == *offset) {
+    close(fd);
+    return NO_ERROR;
+  }
+
+  // the file may still grow while we're reading, we only read up to the
+  // size we've seen and pick up the rest on the next read
+  std::vector<char> window(std::min<long long>(window_size, size - *offset));
+  int rc = NO_ERROR;
+  while (*offset < size) {
+    size_t len = std::min<long long>(window.size(), size - *offset);
+    ssize_t bytes_read = pread(fd, window.data(), len, *offset);
+    if (bytes_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOGGER_LOG_ERROR("Error while reading " << path << ": " << strerror(errno));
+      rc = ERROR_NO_RETRY;
+      break;
+    }
+    if (bytes_read == 0) {
+      // truncated while we were reading
+      break;
+    }
+    split_lines(window.data(), bytes_read, fragment, cb);
+    *offset += bytes_read;
+  }
+
+  close(fd);
+  return rc;
+}
+
+void TailReader::split_lines(const char *data, size_t len, std::string *fragment,
+    const line_cb_t &cb) const {
+  const char *end = data + len;
+  const char *pos = data;
+  while (pos < end) {
+    const char *line_end = (const char*) memchr(pos, '\n', end - pos);
+    if (!line_end) {
+      fragment->append(pos, end - pos);
+      return;
+    }
+    if (fragment->empty()) {
+      cb(boost::string_view(pos, line_end - pos));
+    } else {
+      // complete the line that started in a previous window
+      fragment->append(pos, line_end - pos);
+      cb(boost::string_view(*fragment));
+      fragment->clear();
+    }
+    pos = line_end + 1;
+  }
+}
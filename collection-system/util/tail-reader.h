@@ -0,0 +1,64 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef UTIL_TAIL_READER_H_
+#define UTIL_TAIL_READER_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <boost/utility/string_view.hpp>
+
+/**
+ * Reads the lines that have been appended to a file since the last read.
+ *
+ * Only the region between the saved offset and the current end of the file
+ * is read, in large pread() windows that are split into lines in place. A
+ * line is handed to the callback as a view into the window, so it is only
+ * copied if it crosses a window boundary or the end of the file. The partial
+ * line at the end of the file is kept by the caller and completed on the next
+ * read, which means that lines can be arbitrarily long.
+ */
+class TailReader {
+public:
+  /* The view is only valid for the duration of the callback. */
+  typedef std::function<void(boost::string_view line)> line_cb_t;
+
+  static const size_t DEFAULT_WINDOW_SIZE = 1024 * 1024;
+
+private:
+  size_t window_size;
+
+  void split_lines(const char *data, size_t len, std::string *fragment,
+      const line_cb_t &cb) const;
+
+public:
+  TailReader(size_t window_size = DEFAULT_WINDOW_SIZE);
+
+  /*
+   * Reads path from *offset to the current end of the file and calls cb for
+   * every complete line (without the line break). *offset is advanced by the
+   * number of bytes read, including the bytes of a trailing partial line,
+   * which is appended to fragment. If the file is shorter than *offset, it is
+   * assumed to have been truncated and is read from the start. Returns
+   * NO_ERROR or ERROR_NO_RETRY if the file can't be read.
+   */
+  int read(const std::string &path, long long *offset, std::string *fragment,
+      const line_cb_t &cb) const;
+};
+
+#endif /* UTIL_TAIL_READER_H_ */
@@ -0,0 +1,261 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "timestamp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+const size_t Timestamp::DATETIME_LENGTH;
+const size_t Timestamp::UTC_LENGTH;
+
+static const int64_t SECS_PER_DAY = 24 * 60 * 60;
+/* Longest date we accept, 'YYYY-mm-dd'. */
+static const size_t MAX_DATE_LENGTH = 10;
+
+/*------------------------------
+ * Helpers
+ *------------------------------*/
+
+/**
+ * Days since the epoch for a date in the proleptic Gregorian calendar (see
+ * http://howardhinnant.github.io/date_algorithms.html).
+ */
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned) (y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t) doe - 719468;
+}
+
+/**
+ * Inverse of days_from_civil.
+ */
+static void civil_from_days(int64_t z, int64_t *y, unsigned *m, unsigned *d) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = (unsigned) (z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  *d = doy - (153 * mp + 2) / 5 + 1;
+  *m = mp < 10 ? mp + 3 : mp - 9;
+  *y = (int64_t) yoe + era * 400 + (*m <= 2);
+}
+
+/**
+ * Reads a number with between 1 and max_digits digits and advances pos.
+ */
+static bool read_number(const char **pos, const char *end, int max_digits, int *value) {
+  const char *p = *pos;
+  int v = 0;
+  int digits = 0;
+  while (p < end && digits < max_digits && *p >= '0' && *p <= '9') {
+    v = v * 10 + (*p - '0');
+    p++;
+    digits++;
+  }
+  if (digits == 0) {
+    return false;
+  }
+  *pos = p;
+  *value = v;
+  return true;
+}
+
+static bool expect(const char **pos, const char *end, char c) {
+  if (*pos < end && **pos == c) {
+    (*pos)++;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Parses 'YYYY-mm-dd' followed by the separator and sets days to the days
+ * since the epoch. The last date is cached as log and event timestamps are
+ * mostly from the same day.
+ */
+static bool parse_date(const char **pos, const char *end, char separator, int64_t *days) {
+  static thread_local char cached_date[MAX_DATE_LENGTH];
+  static thread_local size_t cached_length = 0;
+  static thread_local int64_t cached_days;
+
+  const char *date_end = (const char*) memchr(*pos, separator,
+      std::min<size_t>(end - *pos, MAX_DATE_LENGTH + 1));
+  if (!date_end) {
+    return false;
+  }
+  size_t length = date_end - *pos;
+  if (length == cached_length && memcmp(*pos, cached_date, length) == 0) {
+    *days = cached_days;
+    *pos = date_end + 1;
+    return true;
+  }
+
+  const char *p = *pos;
+  int year, month, day;
+  if (!read_number(&p, date_end, 4, &year) || !expect(&p, date_end, '-')
+      || !read_number(&p, date_end, 2, &month) || !expect(&p, date_end, '-')
+      || !read_number(&p, date_end, 2, &day) || p != date_end) {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > 31) {
+    return false;
+  }
+
+  *days = days_from_civil(year, month, day);
+  memcpy(cached_date, *pos, length);
+  cached_length = length;
+  cached_days = *days;
+  *pos = date_end + 1;
+  return true;
+}
+
+/**
+ * Parses 'HH:MM:SS' and adds it to secs.
+ */
+static bool parse_time(const char **pos, const char *end, int64_t *secs) {
+  int hour, min, sec;
+  if (!read_number(pos, end, 2, &hour) || !expect(pos, end, ':')
+      || !read_number(pos, end, 2, &min) || !expect(pos, end, ':')
+      || !read_number(pos, end, 2, &sec)) {
+    return false;
+  }
+  // allow for leap seconds as strptime() does
+  if (hour > 23 || min > 59 || sec > 61) {
+    return false;
+  }
+  *secs += hour * 3600 + min * 60 + sec;
+  return true;
+}
+
+static inline void write_digits(char *buf, unsigned value, int num_digits) {
+  for (int i = num_digits - 1; i >= 0; i--) {
+    buf[i] = '0' + value % 10;
+    value /= 10;
+  }
+}
+
+/*------------------------------
+ * Timestamp
+ *------------------------------*/
+
+bool Timestamp::parse_datetime(const char *str, size_t len, int64_t *secs) {
+  const char *pos = str;
+  const char *end = str + len;
+  int64_t days;
+  if (!parse_date(&pos, end, ' ', &days)) {
+    return false;
+  }
+  *secs = days * SECS_PER_DAY;
+  return parse_time(&pos, end, secs);
+}
+
+bool Timestamp::parse_utc(const char *str, size_t len, int64_t *millis) {
+  const char *pos = str;
+  const char *end = str + len;
+  int64_t days;
+  if (!parse_date(&pos, end, ' ', &days)) {
+    return false;
+  }
+  int64_t secs = days * SECS_PER_DAY;
+  if (!parse_time(&pos, end, &secs)) {
+    return false;
+  }
+  int ms = 0;
+  if (expect(&pos, end, '.') && !read_number(&pos, end, 3, &ms)) {
+    return false;
+  }
+  *millis = secs * 1000 + ms;
+  return true;
+}
+
+bool Timestamp::parse_scale_time(const char *str, size_t len, int64_t *secs) {
+  const char *pos = str;
+  const char *end = str + len;
+  int64_t days;
+  if (!parse_date(&pos, end, '_', &days)) {
+    return false;
+  }
+  *secs = days * SECS_PER_DAY;
+  if (!parse_time(&pos, end, secs)) {
+    return false;
+  }
+
+  // the time is local time, convert it to UTC
+  if (pos < end && (*pos == '+' || *pos == '-')) {
+    int sign = *pos == '+' ? 1 : -1;
+    pos++;
+    int hours, mins;
+    if (end - pos < 4 || !read_number(&pos, pos + 2, 2, &hours)
+        || !read_number(&pos, pos + 2, 2, &mins)) {
+      return false;
+    }
+    *secs -= sign * (hours * 3600 + mins * 60);
+  }
+  return true;
+}
+
+size_t Timestamp::format_datetime(int64_t secs, char *buf) {
+  static thread_local int64_t cached_day = INT64_MIN;
+  static thread_local char cached_date[MAX_DATE_LENGTH];
+
+  int64_t day = secs >= 0 ? secs / SECS_PER_DAY : (secs - SECS_PER_DAY + 1) / SECS_PER_DAY;
+  if (day != cached_day) {
+    int64_t y;
+    unsigned m, d;
+    civil_from_days(day, &y, &m, &d);
+    write_digits(cached_date, (unsigned) y, 4);
+    cached_date[4] = '-';
+    write_digits(cached_date + 5, m, 2);
+    cached_date[7] = '-';
+    write_digits(cached_date + 8, d, 2);
+    cached_day = day;
+  }
+  memcpy(buf, cached_date, MAX_DATE_LENGTH);
+
+  unsigned secs_of_day = (unsigned) (secs - day * SECS_PER_DAY);
+  buf[10] = ' ';
+  write_digits(buf + 11, secs_of_day / 3600, 2);
+  buf[13] = ':';
+  write_digits(buf + 14, secs_of_day / 60 % 60, 2);
+  buf[16] = ':';
+  write_digits(buf + 17, secs_of_day % 60, 2);
+  return DATETIME_LENGTH;
+}
+
+size_t Timestamp::format_utc(int64_t secs, int millis, char *buf) {
+  format_datetime(secs, buf);
+  buf[DATETIME_LENGTH] = '.';
+  write_digits(buf + DATETIME_LENGTH + 1, millis, 3);
+  return UTC_LENGTH;
+}
+
+std::string Timestamp::to_utc(int64_t secs, int millis) {
+  char buf[UTC_LENGTH];
+  return std::string(buf, format_utc(secs, millis, buf));
+}
+
+std::string Timestamp::now_utc() {
+  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  return to_utc(now / 1000, now % 1000);
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright 2020 IBM
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef UTIL_TIMESTAMP_H_
+#define UTIL_TIMESTAMP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Parsing and formatting of the timestamps in events and logs.
+ *
+ * Timestamps are passed around as 'YYYY-mm-dd HH:MM:SS.mmm' strings in UTC.
+ * Instead of going through strptime()/strftime(), which interpret the format
+ * string on every call, and mktime(), which depends on the local time zone,
+ * the formats we receive are parsed by hand and formatting writes into a
+ * fixed buffer. Consecutive timestamps usually fall on the same day, so the
+ * conversion between the date and the days since the epoch is cached per
+ * thread.
+ */
+class Timestamp {
+public:
+  /* Length of 'YYYY-mm-dd HH:MM:SS'. */
+  static const size_t DATETIME_LENGTH = 19;
+  /* Length of 'YYYY-mm-dd HH:MM:SS.mmm'. */
+  static const size_t UTC_LENGTH = 23;
+
+  /*
+   * Parses 'YYYY-mm-dd HH:MM:SS' at the start of str as UTC and sets secs to
+   * the seconds since the epoch. As with strptime(), the fields don't need to
+   * be zero-padded and anything after the seconds is ignored. Returns false if
+   * str doesn't start with a timestamp in this format.
+   */
+  static bool parse_datetime(const char *str, size_t len, int64_t *secs);
+  /* Parses 'YYYY-mm-dd HH:MM:SS[.mmm]' and sets millis to the milliseconds since the epoch. */
+  static bool parse_utc(const char *str, size_t len, int64_t *millis);
+  /*
+   * Parses the 'YYYY-mm-dd_HH:MM:SS+zzzz' timestamps of Spectrum Scale watch
+   * folders and sets secs to the seconds since the epoch. Timestamps without
+   * a UTC offset are taken as UTC.
+   */
+  static bool parse_scale_time(const char *str, size_t len, int64_t *secs);
+
+  /* Writes 'YYYY-mm-dd HH:MM:SS' to buf, which needs DATETIME_LENGTH bytes. Returns the length. */
+  static size_t format_datetime(int64_t secs, char *buf);
+  /* Writes 'YYYY-mm-dd HH:MM:SS.mmm' to buf, which needs UTC_LENGTH bytes. Returns the length. */
+  static size_t format_utc(int64_t secs, int millis, char *buf);
+  static std::string to_utc(int64_t secs, int millis);
+  /* Returns the current time as 'YYYY-mm-dd HH:MM:SS.mmm'. */
+  static std::string now_utc();
+};
+
+#endif /* UTIL_TIMESTAMP_H_ */